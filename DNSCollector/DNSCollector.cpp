@@ -0,0 +1,265 @@
+// Fleet collector for DNSMonitor: monitors started with --report stream
+// their cache counts and probe results here, and this ranks hostnames by
+// how much they hurt across the whole fleet. Portable: builds with Visual
+// Studio (DNSCollector.vcxproj) or with g++ on Linux, see README.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdarg>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FleetCollector.h"
+#include "MetricsServer.h"
+#include "Platform.h"
+
+static const int DEFAULT_TOP = 20;
+static const int DEFAULT_INTERVAL_SECONDS = 10;
+static const uint16_t DEFAULT_HTTP_PORT = 9155;
+static const size_t MAX_RANKED_EXPORT = 1000;    // Hosts in /hosts and /metrics
+static const int EXIT_POLL_MS = 100;
+
+static std::atomic<bool> g_shouldExit{ false };
+static FleetCollector* g_collector = nullptr;
+
+// Only sets the flag; the main loop notices within EXIT_POLL_MS
+static void HandleSignal(int) {
+    g_shouldExit = true;
+}
+
+static void AppendFormat(std::string& out, const char* format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) {
+        out.append(buffer, (std::min)((size_t)length, sizeof(buffer) - 1));
+    }
+}
+
+static void AppendQuoted(std::string& out, const std::string& value) {
+    out += '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (c == '\n') {
+            out += "\\n";
+        }
+        else if ((unsigned char)c >= 0x20) {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+static void AppendMetricHeader(std::string& out, const char* name, const char* type, const char* help) {
+    AppendFormat(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// One JSON line per ranked host, highest impact first
+static std::string FormatHostLines() {
+    std::vector<FleetHostRank> ranked;
+    g_collector->Ranked(ranked, MAX_RANKED_EXPORT);
+    std::string out;
+    for (const auto& host : ranked) {
+        out += "{\"host\":";
+        AppendQuoted(out, host.host);
+        AppendFormat(out, ",\"impact\":%llu,\"monitors\":%u,\"failing\":%u,\"changed\":%u,\"stale\":%u,\"slow\":%u,"
+            "\"avgResponseMs\":%u,\"probes\":%llu,\"failures\":%llu}\n", (unsigned long long)host.impact, host.monitors,
+            host.failing, host.changed, host.stale, host.slow, host.avgResponseMs, (unsigned long long)host.probes,
+            (unsigned long long)host.failures);
+    }
+    return out;
+}
+
+static std::string FormatPrometheus() {
+    FleetCollectorStats stats = g_collector->Stats();
+    std::string out;
+    AppendMetricHeader(out, "dnscollector_monitors", "gauge", "Monitors connected and reporting.");
+    AppendFormat(out, "dnscollector_monitors %u\n", stats.monitors);
+    struct { const char* name; const char* help; uint64_t value; } counters[] = {
+        { "dnscollector_reports_total", "Reports received from monitors.", stats.reports },
+        { "dnscollector_received_bytes_total", "Bytes received from monitors.", stats.bytes },
+        { "dnscollector_host_updates_total", "Per-host results received from monitors.", stats.hostUpdates },
+        { "dnscollector_protocol_errors_total", "Monitor connections dropped for a malformed stream.", stats.protocolErrors },
+    };
+    for (const auto& counter : counters) {
+        AppendMetricHeader(out, counter.name, "counter", counter.help);
+        AppendFormat(out, "%s %llu\n", counter.name, (unsigned long long)counter.value);
+    }
+
+    std::vector<FleetHostRank> ranked;
+    g_collector->Ranked(ranked, MAX_RANKED_EXPORT);
+    struct { const char* name; const char* help; } hostGauges[] = {
+        { "dnscollector_host_impact", "Monitors failing the host times the failure cost, plus response time beyond the slow threshold, in ms." },
+        { "dnscollector_host_monitors", "Monitors with the host cached." },
+        { "dnscollector_host_failing_monitors", "Monitors whose last probe of the host failed." },
+        { "dnscollector_host_changed_monitors", "Monitors whose cached address for the host upstream no longer returns." },
+    };
+    for (size_t gauge = 0; gauge < sizeof(hostGauges) / sizeof(hostGauges[0]); gauge++) {
+        AppendMetricHeader(out, hostGauges[gauge].name, "gauge", hostGauges[gauge].help);
+        for (const auto& host : ranked) {
+            double values[] = { (double)host.impact, (double)host.monitors, (double)host.failing, (double)host.changed };
+            AppendFormat(out, "%s{host=", hostGauges[gauge].name);
+            AppendQuoted(out, host.host);
+            AppendFormat(out, "} %g\n", values[gauge]);
+        }
+    }
+    return out;
+}
+
+static bool ServePage(const std::string& path, std::string& contentType, std::string& body) {
+    if (path == "/metrics") {
+        contentType = "text/plain; version=0.0.4";
+        body = FormatPrometheus();
+        return true;
+    }
+    if (path == "/hosts") {
+        contentType = "application/x-ndjson";
+        body = FormatHostLines();
+        return true;
+    }
+    return false;
+}
+
+static void PrintRanking(int top, double seconds, const FleetCollectorStats& stats, const FleetCollectorStats& last) {
+    std::vector<FleetHostRank> ranked;
+    g_collector->Ranked(ranked, (size_t)top);
+
+    printf("\n%u monitors   %.0f reports/s   %.0f host updates/s   %.1f KB/s   %llu protocol errors\n", stats.monitors,
+        (stats.reports - last.reports) / seconds, (stats.hostUpdates - last.hostUpdates) / seconds,
+        (stats.bytes - last.bytes) / seconds / 1024.0, (unsigned long long)stats.protocolErrors);
+    printf("%-48s  %10s  %8s  %7s  %7s  %5s  %5s  %6s\n", "host", "impact", "monitors", "failing", "changed", "stale", "slow", "avg ms");
+    printf("----------------------------------------------------------------------------------------------------------\n");
+    for (const auto& host : ranked) {
+        printf("%-48.48s  %10llu  %8u  %7u  %7u  %5u  %5u  %6u\n", host.host.c_str(), (unsigned long long)host.impact,
+            host.monitors, host.failing, host.changed, host.stale, host.slow, host.avgResponseMs);
+    }
+    if (ranked.empty()) {
+        printf("(no host is failing or slow anywhere)\n");
+    }
+    fflush(stdout);
+}
+
+static void PrintUsage() {
+    printf("Usage: DNSCollector [--port <port>] [--listen <address>] [--threads <n>] [--max-monitors <n>]\n");
+    printf("                    [--http-port <port>] [--http-listen <address>] [--top <n>] [--interval <s>]\n");
+    printf("                    [--slow <ms>] [--failure-cost <ms>]\n");
+    printf("  --port         Port monitors report to (default %u); --listen sets the address (default %s)\n",
+        (unsigned)FleetCollectorConfig().port, FleetCollectorConfig().address.c_str());
+    printf("  --threads      Worker threads the monitor connections are spread over (default %d)\n", FleetCollectorConfig().threads);
+    printf("  --http-port    Serve /metrics (Prometheus) and /hosts (JSON lines) here (default %u; 0 disables);\n",
+        (unsigned)DEFAULT_HTTP_PORT);
+    printf("                 --http-listen sets the address (default 127.0.0.1)\n");
+    printf("  --top          Hosts printed every --interval seconds (defaults %d and %d)\n", DEFAULT_TOP, DEFAULT_INTERVAL_SECONDS);
+    printf("  --slow         Response time beyond which latency counts against a host (default %u ms)\n",
+        FleetCollectorConfig().slowMs);
+    printf("  --failure-cost What one monitor failing a host weighs, in ms of excess latency (default %u)\n",
+        FleetCollectorConfig().failureCostMs);
+}
+
+int main(int argc, char* argv[]) {
+    FleetCollectorConfig config;
+    MetricsServerConfig httpConfig;
+    httpConfig.port = DEFAULT_HTTP_PORT;
+    int top = DEFAULT_TOP;
+    int interval = DEFAULT_INTERVAL_SECONDS;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            config.port = (uint16_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            config.address = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            config.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-monitors") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            config.maxMonitors = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--http-port") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+            httpConfig.port = (uint16_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--http-listen") == 0 && i + 1 < argc) {
+            httpConfig.address = argv[++i];
+        }
+        else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            top = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            interval = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--slow") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            config.slowMs = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--failure-cost") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+            config.failureCostMs = (uint32_t)atoi(argv[++i]);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        printf("Cannot initialize Winsock\n");
+        return 1;
+    }
+#endif
+
+    FleetCollector collector(config);
+    if (!collector.Start()) {
+        printf("Cannot listen on %s:%u\n", config.address.c_str(), (unsigned)config.port);
+        return 1;
+    }
+    g_collector = &collector;
+
+    std::unique_ptr<MetricsServer> http;
+    if (httpConfig.port != 0) {
+        http.reset(new MetricsServer(httpConfig, ServePage));
+        if (!http->Start()) {
+            printf("Cannot serve HTTP on %s:%u; continuing without it\n", httpConfig.address.c_str(), (unsigned)httpConfig.port);
+            http.reset();
+        }
+    }
+    printf("Collecting on %s:%u with %d threads%s\n", config.address.c_str(), (unsigned)collector.Port(), config.threads,
+        http ? "; /metrics and /hosts over HTTP" : "");
+    fflush(stdout);
+
+    std::signal(SIGINT, HandleSignal);
+    std::signal(SIGTERM, HandleSignal);
+
+    FleetCollectorStats last = collector.Stats();
+    auto lastTime = std::chrono::steady_clock::now();
+    while (!g_shouldExit) {
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastTime < std::chrono::seconds(interval)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(EXIT_POLL_MS));
+            continue;
+        }
+
+        FleetCollectorStats stats = collector.Stats();
+        PrintRanking(top, std::chrono::duration<double>(now - lastTime).count(), stats, last);
+        last = stats;
+        lastTime = now;
+    }
+
+    http.reset();
+    collector.Stop();
+    g_collector = nullptr;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "AnomalyDetector.h"
+
+#include <algorithm>
+#include <cmath>
+
+float ShiftDetector::Deviation(const ShiftDetectorConfig& config) const {
+    return (std::max)(std::sqrt(variance), config.minDeviation);
+}
+
+ShiftEvent ShiftDetector::Add(float value, const ShiftDetectorConfig& config) {
+    float excess = (value - mean) / Deviation(config);
+
+    if (alarm) {
+        shift += config.decay * (excess - shift);
+        if (shift >= config.slack) return ShiftEvent::None;
+        alarm = false;
+        cusum = 0.0f;
+        shift = 0.0f;
+        return ShiftEvent::Cleared;
+    }
+
+    if (samples >= config.warmup) {
+        cusum = (std::max)(0.0f, cusum + excess - config.slack);
+        if (cusum > config.threshold) {
+            alarm = true;
+            shift = excess;
+            return ShiftEvent::Raised;
+        }
+    }
+
+    // Baseline. Early samples weigh 1/n, a plain running mean and variance,
+    // so a young baseline is not pinned to its first sample. A sum already
+    // halfway to the alarm holds it, so the shift it is building on does not
+    // leak into the baseline and hide itself.
+    if (cusum > config.threshold * 0.5f) return ShiftEvent::None;
+    float weight = (std::max)(config.alpha, 1.0f / (samples + 1));
+    float delta = value - mean;
+    mean += weight * delta;
+    variance = (1.0f - weight) * (variance + weight * delta * delta);
+    if (samples < UINT16_MAX) samples++;
+    return ShiftEvent::None;
+}
+
+const char* AlertKindName(AlertKind kind) {
+    return kind == AlertKind::Latency ? "latency" : "failures";
+}
+
+// Latency in log space; the baseline is shown back in ms
+static float LogLatency(uint32_t latencyMs) {
+    return std::log1p((float)latencyMs);
+}
+
+static float LatencyMs(float logLatency) {
+    return std::expm1(logLatency);
+}
+
+static std::string AlertKey(const std::string& host, AlertKind kind) {
+    return host + '/' + AlertKindName(kind);
+}
+
+AnomalyDetector::AnomalyDetector(const AnomalyConfig& config)
+    : m_config(config), m_active(0), m_intervalStart(0), m_intervalLogLatency(0.0),
+      m_intervalAnswered(0), m_intervalFailed(0) {
+}
+
+void AnomalyDetector::Observe(HostDetector& detector, const std::string& host, const ProbeObservation& observation,
+    time_t now) {
+    float failed = observation.failed ? 1.0f : 0.0f;
+    ShiftEvent event = detector.failures.Add(failed, m_config.failures);
+    Apply(event, detector.failures, host, AlertKind::Failures, detector.failures.mean, failed, now);
+
+    if (!observation.failed) {
+        float value = LogLatency(observation.latencyMs);
+        event = detector.latency.Add(value, m_config.latency);
+        Apply(event, detector.latency, host, AlertKind::Latency,
+            LatencyMs(detector.latency.mean), (float)observation.latencyMs, now);
+        m_intervalLogLatency += value;
+        m_intervalAnswered++;
+    }
+    else {
+        m_intervalFailed++;
+    }
+}
+
+void AnomalyDetector::Tick(time_t now) {
+    if (m_intervalStart == 0) {
+        m_intervalStart = now;
+        return;
+    }
+    if (now < m_intervalStart + (time_t)m_config.globalInterval) return;
+    m_intervalStart = now;
+
+    // An idle interval says nothing either way
+    uint32_t samples = m_intervalAnswered + m_intervalFailed;
+    if (samples > 0) {
+        float failureRate = (float)m_intervalFailed / samples;
+        ShiftEvent event = m_global.failures.Add(failureRate, m_config.globalFailures);
+        Apply(event, m_global.failures, GLOBAL_ALERT_HOST, AlertKind::Failures,
+            m_global.failures.mean, failureRate, now);
+    }
+    if (m_intervalAnswered > 0) {
+        float meanLog = (float)(m_intervalLogLatency / m_intervalAnswered);
+        ShiftEvent event = m_global.latency.Add(meanLog, m_config.globalLatency);
+        Apply(event, m_global.latency, GLOBAL_ALERT_HOST, AlertKind::Latency,
+            LatencyMs(m_global.latency.mean), LatencyMs(meanLog), now);
+    }
+    m_intervalLogLatency = 0.0;
+    m_intervalAnswered = 0;
+    m_intervalFailed = 0;
+}
+
+void AnomalyDetector::Apply(ShiftEvent event, const ShiftDetector& detector, const std::string& host, AlertKind kind,
+    float baseline, float current, time_t now) {
+    if (event == ShiftEvent::None && !detector.alarm) return;
+
+    std::string key = AlertKey(host, kind);
+    if (event == ShiftEvent::Raised) {
+        AnomalyAlert& alert = m_alerts[key];
+        if (alert.host.empty() || alert.cleared != 0) m_active++;
+        alert.host = host;
+        alert.kind = kind;
+        alert.baseline = baseline;
+        alert.raised = now;
+        alert.cleared = 0;
+    }
+
+    // Gone if it was trimmed while active
+    auto it = m_alerts.find(key);
+    if (it == m_alerts.end()) return;
+    AnomalyAlert& alert = it->second;
+    alert.score = detector.shift;
+    alert.current = current;
+    if (event == ShiftEvent::Cleared) {
+        alert.cleared = now;
+        if (m_active > 0) m_active--;
+    }
+    if (event != ShiftEvent::None) {
+        if (m_listener) m_listener(alert);
+        Trim();
+    }
+}
+
+void AnomalyDetector::Prune(const std::function<bool(const AnomalyAlert& alert)>& keep, time_t now) {
+    for (auto& entry : m_alerts) {
+        AnomalyAlert& alert = entry.second;
+        if (alert.cleared != 0 || alert.host == GLOBAL_ALERT_HOST || keep(alert)) continue;
+        alert.cleared = now;
+        if (m_active > 0) m_active--;
+        if (m_listener) m_listener(alert);
+    }
+}
+
+// Past maxAlerts, drop cleared alerts oldest first, then active ones lowest score first
+void AnomalyDetector::Trim() {
+    while (m_alerts.size() > m_config.maxAlerts) {
+        auto victim = m_alerts.begin();
+        for (auto it = m_alerts.begin(); it != m_alerts.end(); ++it) {
+            const AnomalyAlert& a = it->second;
+            const AnomalyAlert& v = victim->second;
+            bool aCleared = a.cleared != 0;
+            bool vCleared = v.cleared != 0;
+            if (aCleared != vCleared ? aCleared : aCleared ? a.cleared < v.cleared : a.score < v.score) {
+                victim = it;
+            }
+        }
+        if (victim->second.cleared == 0 && m_active > 0) m_active--;
+        m_alerts.erase(victim);
+    }
+}
+
+void AnomalyDetector::Ranked(std::vector<AnomalyAlert>& alerts, size_t max) const {
+    alerts.clear();
+    for (const auto& entry : m_alerts) {
+        alerts.push_back(entry.second);
+    }
+    auto order = [](const AnomalyAlert& a, const AnomalyAlert& b) {
+        if ((a.cleared == 0) != (b.cleared == 0)) return a.cleared == 0;
+        return a.cleared == 0 ? a.score > b.score : a.cleared > b.cleared;
+    };
+    if (alerts.size() > max) {
+        std::partial_sort(alerts.begin(), alerts.begin() + max, alerts.end(), order);
+        alerts.resize(max);
+    }
+    else {
+        std::sort(alerts.begin(), alerts.end(), order);
+    }
+}
+
+bool AnomalyDetector::GlobalAlert() const {
+    for (AlertKind kind : { AlertKind::Latency, AlertKind::Failures }) {
+        auto it = m_alerts.find(AlertKey(GLOBAL_ALERT_HOST, kind));
+        if (it != m_alerts.end() && it->second.cleared == 0) return true;
+    }
+    return false;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Tuning for one ShiftDetector
+struct ShiftDetectorConfig {
+    float alpha = 0.05f;        // EWMA weight of a new sample
+    float slack = 1.0f;         // CUSUM allowance k, in baseline deviations
+    float threshold = 8.0f;     // CUSUM alarm level h
+    float minDeviation = 0.3f;  // Floor on the baseline deviation, so a flat series is not infinitely sensitive
+    uint16_t warmup = 8;        // Samples that only train the baseline
+    float decay = 0.3f;         // EWMA weight of a new sample in the shift of an active alarm
+};
+
+// What one sample did to a detector's alarm
+enum class ShiftEvent : uint8_t {
+    None,
+    Raised,
+    Cleared
+};
+
+// Streaming detector for a sustained upward shift in one series. The
+// baseline is an EWMA of mean and variance; a one-sided CUSUM of the
+// standardized excess over it raises an alarm once the excess adds up to
+// the threshold. While the alarm is up the baseline is frozen, so a lasting
+// regression stays alerted instead of becoming the new normal, and an EWMA
+// of the excess (the shift) clears it once the series is back within the
+// slack. O(1) time and 20 bytes per series.
+struct ShiftDetector {
+    float mean = 0.0f;
+    float variance = 0.0f;
+    float cusum = 0.0f;
+    float shift = 0.0f;         // Excess over the baseline in deviations, while alarmed
+    uint16_t samples = 0;
+    bool alarm = false;
+
+    ShiftEvent Add(float value, const ShiftDetectorConfig& config);
+
+    float Deviation(const ShiftDetectorConfig& config) const;
+};
+
+enum class AlertKind : uint8_t {
+    Latency,    // Response times moved up
+    Failures    // Failure rate moved up
+};
+
+const char* AlertKindName(AlertKind kind);      // "latency", "failures"
+
+// Latency and failure detectors for one host. Latency is watched in log
+// space, so a doubling counts the same for a 2ms and a 200ms host.
+struct HostDetector {
+    ShiftDetector latency;
+    ShiftDetector failures;
+};
+
+// Fed once per probe result. Timeouts and errors are failures and carry no latency.
+struct ProbeObservation {
+    uint32_t latencyMs;
+    bool failed;
+};
+
+// A raised alert, kept while it is active and for a while after it clears
+struct AnomalyAlert {
+    std::string host;           // GLOBAL_ALERT_HOST for the whole cache
+    AlertKind kind;
+    float score;                // Current shift in baseline deviations; ranks alerts across hosts
+    float baseline;             // ms for latency, a fraction for failures
+    float current;              // Latest value while active
+    time_t raised;              // Unix time
+    time_t cleared;             // 0 while active
+};
+
+using AlertListener = std::function<void(const AnomalyAlert& alert)>;
+
+static const char* const GLOBAL_ALERT_HOST = "*";
+
+struct AnomalyConfig {
+    ShiftDetectorConfig latency;
+    ShiftDetectorConfig failures = { 0.05f, 0.25f, 5.0f, 0.3f, 8, 0.3f };
+    ShiftDetectorConfig globalLatency = { 0.1f, 0.5f, 5.0f, 0.1f, 10, 0.3f };
+    ShiftDetectorConfig globalFailures = { 0.1f, 0.5f, 5.0f, 0.05f, 10, 0.3f };
+    uint32_t globalInterval = 10;   // Seconds of probes pooled into one global sample
+    size_t maxAlerts = 256;         // Active plus recently cleared; the lowest scores go first
+};
+
+// Per-host and global anomaly detection with a ranked alert board. Hosts
+// own their HostDetector (callers keep it next to their other per-host
+// state); the board only holds hosts that have alerted, so the cost of a
+// normal probe is two detector updates and no lookups. The global series
+// pools every probe into one sample per interval.
+class AnomalyDetector {
+public:
+    explicit AnomalyDetector(const AnomalyConfig& config = AnomalyConfig());
+
+    // One probe result for host; now is Unix time
+    void Observe(HostDetector& detector, const std::string& host, const ProbeObservation& observation, time_t now);
+
+    // Close the global interval if it is over
+    void Tick(time_t now);
+
+    // Clear the active host alerts keep() rejects, e.g. hosts that left the
+    // cache or whose detector was reset. Global alerts are left alone.
+    void Prune(const std::function<bool(const AnomalyAlert& alert)>& keep, time_t now);
+
+    // Active alerts by score, then cleared ones newest first; at most max
+    void Ranked(std::vector<AnomalyAlert>& alerts, size_t max) const;
+
+    size_t ActiveAlerts() const { return m_active; }
+    bool GlobalAlert() const;
+
+    // Called for every raise and clear, e.g. to stream it
+    void SetListener(AlertListener listener) { m_listener = std::move(listener); }
+
+    const AnomalyConfig& Config() const { return m_config; }
+
+private:
+    void Apply(ShiftEvent event, const ShiftDetector& detector, const std::string& host, AlertKind kind,
+        float baseline, float current, time_t now);
+    void Trim();
+
+    AnomalyConfig m_config;
+    std::unordered_map<std::string, AnomalyAlert> m_alerts;    // Keyed by host + '/' + kind
+    size_t m_active;
+
+    HostDetector m_global;
+    time_t m_intervalStart;
+    double m_intervalLogLatency;
+    uint32_t m_intervalAnswered;
+    uint32_t m_intervalFailed;
+
+    AlertListener m_listener;
+};
@@ -0,0 +1,189 @@
+#include "CacheControl.h"
+#include "Platform.h"
+
+#include <chrono>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef BOOL (WINAPI* FlushEntryFn)(LPCSTR hostname);
+typedef BOOL (WINAPI* FlushCacheFn)();
+#endif
+
+SystemCacheControl::SystemCacheControl()
+    : m_flushEntry(nullptr), m_flushCache(nullptr) {
+#ifdef _WIN32
+    // Loaded once and never freed; the process needs it until exit
+    HMODULE dnsapi = LoadLibraryA("dnsapi.dll");
+    if (dnsapi) {
+        m_flushEntry = (void*)GetProcAddress(dnsapi, "DnsFlushResolverCacheEntry_A");
+        m_flushCache = (void*)GetProcAddress(dnsapi, "DnsFlushResolverCache");
+    }
+#endif
+}
+
+const char* SystemCacheControl::Name() const {
+    return "system";
+}
+
+bool SystemCacheControl::Evict(const std::string& hostname) {
+#ifdef _WIN32
+    if (m_flushEntry) {
+        return ((FlushEntryFn)m_flushEntry)(hostname.c_str()) != FALSE;
+    }
+#else
+    (void)hostname;
+#endif
+    return false;
+}
+
+bool SystemCacheControl::CanEvict() const {
+    return m_flushEntry != nullptr;
+}
+
+bool SystemCacheControl::FlushAll() {
+#ifdef _WIN32
+    if (m_flushCache) {
+        return ((FlushCacheFn)m_flushCache)() != FALSE;
+    }
+    return system("ipconfig /flushdns > NUL") == 0;
+#else
+    return false;
+#endif
+}
+
+bool SystemCacheControl::Warm(const std::string& hostname) {
+    return SystemResolve(hostname, ProbeFamily::Any);
+}
+
+MockCacheControl::MockCacheControl(bool canEvict)
+    : m_canEvict(canEvict) {
+}
+
+bool MockCacheControl::Evict(const std::string& hostname) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (!m_canEvict) return false;
+    m_evictions++;
+    return m_names.erase(hostname) > 0;
+}
+
+bool MockCacheControl::FlushAll() {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_flushes++;
+    m_names.clear();
+    return true;
+}
+
+bool MockCacheControl::Warm(const std::string& hostname) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_warms++;
+    if (m_failWarm.count(hostname)) return false;
+    m_names.insert(hostname);
+    return true;
+}
+
+void MockCacheControl::Add(const std::string& hostname) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_names.insert(hostname);
+}
+
+bool MockCacheControl::Contains(const std::string& hostname) const {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_names.count(hostname) > 0;
+}
+
+void MockCacheControl::FailWarm(const std::string& hostname) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_failWarm.insert(hostname);
+}
+
+size_t MockCacheControl::Size() const {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_names.size();
+}
+
+int MockCacheControl::Evictions() const {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_evictions;
+}
+
+int MockCacheControl::Flushes() const {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_flushes;
+}
+
+int MockCacheControl::Warms() const {
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_warms;
+}
+
+static uint32_t ElapsedMs(std::chrono::steady_clock::time_point since) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - since).count();
+}
+
+EvictionReport RunEviction(const std::shared_ptr<CacheControl>& control, const EvictionPlan& plan,
+    const EvictionConfig& config) {
+    EvictionReport report = {};
+    auto start = std::chrono::steady_clock::now();
+
+    const std::vector<std::string>* warm = &plan.warm;
+    report.kept = plan.kept;
+    if (control->CanEvict()) {
+        for (const auto& hostname : plan.evict) {
+            if (control->Evict(hostname)) {
+                report.evicted++;
+            }
+            else {
+                report.evictFailed++;
+            }
+        }
+    }
+    else if (!plan.evict.empty()) {
+        // Nothing finer is available; everything goes, so warm the busiest healthy names instead
+        report.flushedAll = control->FlushAll();
+        if (report.flushedAll) {
+            report.evicted = (int)plan.evict.size();
+            report.kept = 0;
+            warm = &plan.warmAfterFlush;
+        }
+        else {
+            report.evictFailed = (int)plan.evict.size();
+            warm = nullptr;
+        }
+    }
+    report.evictMs = ElapsedMs(start);
+
+    // Lookups run on a throwaway engine; an abandoned one keeps the backend alive
+    if (warm && !warm->empty()) {
+        auto warmStart = std::chrono::steady_clock::now();
+        ProbeEngineConfig engineConfig;
+        engineConfig.maxConcurrency = config.warmConcurrency;
+        engineConfig.deadlineMs = config.warmDeadlineMs;
+        std::shared_ptr<CacheControl> backend = control;
+        ProbeEngine engine(engineConfig, [backend](const std::string& hostname, ProbeFamily) {
+            return backend->Warm(hostname);
+        });
+
+        for (size_t i = 0; i < warm->size(); i++) {
+            engine.Submit(i, (*warm)[i]);
+        }
+        std::vector<ProbeResult> results;
+        while (results.size() < warm->size()) {
+            engine.Wait(results, config.warmDeadlineMs);
+        }
+        for (const auto& result : results) {
+            if (result.outcome == ProbeOutcome::Ok) {
+                report.warmed++;
+            }
+            else {
+                report.warmFailed++;
+            }
+        }
+        report.warmMs = ElapsedMs(warmStart);
+    }
+
+    report.savedLookups = report.kept + report.warmed;
+    return report;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "ProbeEngine.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Access to the operating system's resolver cache. Shared with warm-up
+// lookups that can outlive an eviction run, so implementations must be safe
+// to call from several threads.
+class CacheControl {
+public:
+    virtual ~CacheControl() {}
+
+    virtual const char* Name() const = 0;
+
+    // Remove one name, every record type; false if it could not be removed
+    // or the backend cannot remove single names
+    virtual bool Evict(const std::string& hostname) = 0;
+    virtual bool CanEvict() const = 0;
+
+    // Drop the whole cache
+    virtual bool FlushAll() = 0;
+
+    // Look a name up through the cache so the next application finds it there
+    virtual bool Warm(const std::string& hostname) = 0;
+};
+
+// The real cache. On Windows single names go through DnsFlushResolverCacheEntry_A
+// in dnsapi.dll, looked up at run time since it is undocumented; without it
+// only FlushAll works.
+class SystemCacheControl : public CacheControl {
+public:
+    SystemCacheControl();
+
+    const char* Name() const override;
+    bool Evict(const std::string& hostname) override;
+    bool CanEvict() const override;
+    bool FlushAll() override;
+    bool Warm(const std::string& hostname) override;
+
+private:
+    void* m_flushEntry;         // DnsFlushResolverCacheEntry_A, or null
+    void* m_flushCache;         // DnsFlushResolverCache, or null
+};
+
+// In-memory cache for tests and the benchmark: a set of names, with
+// counters for every call and optional failures
+class MockCacheControl : public CacheControl {
+public:
+    explicit MockCacheControl(bool canEvict = true);
+
+    const char* Name() const override { return "mock"; }
+    bool Evict(const std::string& hostname) override;
+    bool CanEvict() const override { return m_canEvict; }
+    bool FlushAll() override;
+    bool Warm(const std::string& hostname) override;
+
+    void Add(const std::string& hostname);
+    bool Contains(const std::string& hostname) const;
+    void FailWarm(const std::string& hostname);     // Warm(hostname) will fail
+
+    size_t Size() const;
+    int Evictions() const;
+    int Flushes() const;
+    int Warms() const;
+
+private:
+    mutable std::mutex m_lock;
+    bool m_canEvict;
+    std::unordered_set<std::string> m_names;
+    std::unordered_set<std::string> m_failWarm;
+    int m_evictions = 0;
+    int m_flushes = 0;
+    int m_warms = 0;
+};
+
+// What to evict and what to look up again afterwards
+struct EvictionPlan {
+    std::vector<std::string> evict;         // Stale, unreachable or changed names
+    std::vector<std::string> warm;          // Evicted names that still resolve, most used first
+    std::vector<std::string> warmAfterFlush;    // Healthy names, most used first, if everything goes
+    int kept;                               // Cached names left alone
+};
+
+struct EvictionConfig {
+    int warmConcurrency = 16;
+    uint32_t warmDeadlineMs = 3000;
+};
+
+struct EvictionReport {
+    int evicted;
+    int evictFailed;
+    bool flushedAll;            // The backend could not evict single names, so everything went
+    int kept;                   // Names still cached afterwards
+    int warmed;
+    int warmFailed;
+    uint32_t evictMs;
+    uint32_t warmMs;
+    int savedLookups;           // Cold lookups avoided next to a full flush: kept plus warmed
+};
+
+// Evict the plan's names, falling back to a full flush when the backend
+// cannot remove single names, then warm the matching list concurrently.
+EvictionReport RunEviction(const std::shared_ptr<CacheControl>& control, const EvictionPlan& plan,
+    const EvictionConfig& config = EvictionConfig());
@@ -0,0 +1,427 @@
+#include "CacheParser.h"
+
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+static const size_t READ_CHUNK_SIZE = 64 * 1024;
+
+static bool StartsWith(std::string_view text, std::string_view prefix) {
+    return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+}
+
+static std::string_view Trim(std::string_view text) {
+    size_t start = 0;
+    while (start < text.size() && (text[start] == ' ' || text[start] == '\t')) start++;
+    size_t end = text.size();
+    while (end > start && (text[end - 1] == ' ' || text[end - 1] == '\t' || text[end - 1] == '\r')) end--;
+    return text.substr(start, end - start);
+}
+
+static uint32_t ParseNumber(std::string_view text) {
+    uint32_t value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') break;
+        value = value * 10 + (uint32_t)(c - '0');
+    }
+    return value;
+}
+
+// ipconfig names the type in "No records of type AAAA"
+static uint16_t ParseTypeName(std::string_view text) {
+    static const struct {
+        const char* name;
+        uint16_t type;
+    } types[] = {
+        { "A", 1 }, { "NS", 2 }, { "CNAME", 5 }, { "SOA", 6 }, { "PTR", 12 },
+        { "MX", 15 }, { "TXT", 16 }, { "AAAA", 28 }, { "SRV", 33 }
+    };
+    for (const auto& entry : types) {
+        if (text == entry.name) return entry.type;
+    }
+    return (uint16_t)ParseNumber(text);
+}
+
+// Split the next whitespace-separated token off the front of text
+static std::string_view NextToken(std::string_view& text) {
+    size_t start = 0;
+    while (start < text.size() && (text[start] == ' ' || text[start] == '\t')) start++;
+    size_t end = start;
+    while (end < text.size() && text[end] != ' ' && text[end] != '\t') end++;
+    std::string_view token = text.substr(start, end - start);
+    text.remove_prefix(end);
+    return token;
+}
+
+// Fully qualified names end in a dot in unbound's output
+static std::string_view StripRootDot(std::string_view name) {
+    if (name.size() > 1 && name.back() == '.') name.remove_suffix(1);
+    return name;
+}
+
+// "dnsmasq[812]: " or "Oct 16 10:00:01 ns1 systemd-resolved[377]: " in
+// front of a line taken from syslog or the journal
+static std::string_view StripLogPrefix(std::string_view line) {
+    size_t close = line.find("]: ");
+    if (close == std::string_view::npos) return line;
+    size_t open = line.rfind('[', close);
+    if (open == std::string_view::npos || line.find_first_of(" \t", open) < close) return line;
+    return line.substr(close + 3);
+}
+
+// "name [ttl] IN type data", the way unbound and resolved print a record.
+// False for anything else, which covers their headings and markers.
+static bool ParseRecordLine(std::string_view line, std::string_view& name, uint32_t& ttl, uint16_t& type,
+    std::string_view& data) {
+    name = StripRootDot(NextToken(line));
+    std::string_view token = NextToken(line);
+    ttl = 0;
+    if (!token.empty() && token[0] >= '0' && token[0] <= '9') {
+        ttl = ParseNumber(token);
+        token = NextToken(line);
+    }
+    std::string_view typeName = NextToken(line);
+    if (name.empty() || token != "IN" || typeName.empty()) return false;
+    type = ParseTypeName(typeName);
+    data = Trim(line);
+    return true;
+}
+
+CacheDumpParser::CacheDumpParser(CacheRecordFn onRecord)
+    : m_onRecord(std::move(onRecord)) {
+}
+
+void CacheDumpParser::Feed(const char* data, size_t length) {
+    const char* position = data;
+    const char* end = data + length;
+    m_bytes += length;
+
+    // Complete the line that straddled the previous chunk
+    if (!m_carry.empty()) {
+        const char* newline = (const char*)memchr(position, '\n', end - position);
+        if (!newline) {
+            m_carry.append(position, end);
+            return;
+        }
+        m_carry.append(position, newline);
+        ParseLine(m_carry);
+        m_carry.clear();
+        position = newline + 1;
+    }
+
+    while (position < end) {
+        const char* newline = (const char*)memchr(position, '\n', end - position);
+        if (!newline) {
+            m_carry.assign(position, end);
+            break;
+        }
+        ParseLine(std::string_view(position, newline - position));
+        position = newline + 1;
+    }
+}
+
+void CacheDumpParser::Finish() {
+    if (!m_carry.empty()) {
+        ParseLine(m_carry);
+        m_carry.clear();
+    }
+    EndOfInput();
+}
+
+void CacheDumpParser::Emit(const CacheRecord& record) {
+    m_onRecord(record);
+    m_records++;
+}
+
+DisplayDnsParser::DisplayDnsParser(CacheRecordFn onRecord)
+    : CacheDumpParser(std::move(onRecord)) {
+}
+
+void DisplayDnsParser::EndOfInput() {
+    EmitRecord();
+}
+
+void DisplayDnsParser::EmitRecord() {
+    if (m_inRecord && !m_name.empty()) {
+        CacheRecord record;
+        record.name = m_name;
+        record.type = m_type;
+        record.ttl = m_ttl;
+        record.data = m_data;
+        record.status = CacheRecordStatus::Record;
+        Emit(record);
+    }
+    m_inRecord = false;
+}
+
+void DisplayDnsParser::EmitNegative(CacheRecordStatus status, uint16_t type) {
+    EmitRecord();
+    if (m_heading.empty()) return;
+
+    CacheRecord record;
+    record.name = m_heading;
+    record.type = type;
+    record.ttl = 0;
+    record.status = status;
+    Emit(record);
+}
+
+void DisplayDnsParser::ParseLine(std::string_view line) {
+    line = Trim(line);
+    if (line.empty()) return;
+
+    // A separator starts the next name group
+    if (line[0] == '-') {
+        EmitRecord();
+        return;
+    }
+
+    // Field lines are "Label . . . . : value"; anything else is a group
+    // heading or a negative-cache line for the current group
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        if (line == "Name does not exist.") {
+            EmitNegative(CacheRecordStatus::NameError, 0);
+        }
+        else if (StartsWith(line, "No records of type")) {
+            EmitNegative(CacheRecordStatus::NoRecords, ParseTypeName(Trim(line.substr(18))));
+        }
+        else {
+            m_heading.assign(line.data(), line.size());
+        }
+        return;
+    }
+
+    std::string_view label = line.substr(0, colon);
+    std::string_view value = Trim(line.substr(colon + 1));
+
+    if (StartsWith(label, "Record Name")) {
+        EmitRecord();
+        m_name.assign(value.data(), value.size());
+        m_data.clear();
+        m_type = 0;
+        m_ttl = 0;
+        m_inRecord = true;
+    }
+    else if (StartsWith(label, "Record Type")) {
+        m_type = (uint16_t)ParseNumber(value);
+    }
+    else if (StartsWith(label, "Time To Live")) {
+        m_ttl = ParseNumber(value);
+    }
+    else if (StartsWith(label, "Data Length") || StartsWith(label, "Section")) {
+        return;
+    }
+    else if (label.find("Record") != std::string_view::npos) {
+        // "A (Host) Record", "AAAA Record", "CNAME Record", ...
+        m_data.assign(value.data(), value.size());
+    }
+}
+
+UnboundDumpParser::UnboundDumpParser(CacheRecordFn onRecord)
+    : CacheDumpParser(std::move(onRecord)) {
+}
+
+void UnboundDumpParser::ParseLine(std::string_view line) {
+    line = Trim(line);
+    if (line.empty() || line[0] == ';') return;
+    if (line == "START_MSG_CACHE" || line == "END_MSG_CACHE") {
+        m_inMessages = line[0] == 'S';
+        return;
+    }
+
+    CacheRecord record;
+    std::string_view data;
+    if (!m_inMessages) {
+        if (!ParseRecordLine(line, record.name, record.ttl, record.type, data)) return;
+        record.data = record.type == 5 ? StripRootDot(data) : data;
+        record.status = CacheRecordStatus::Record;
+        Emit(record);
+        return;
+    }
+
+    // "msg name IN type flags qdcount ttl security an ns ar"; the lines after
+    // it name the RRsets of the answer, which the RRset section listed already
+    if (!StartsWith(line, "msg ") || !ParseRecordLine(line.substr(4), record.name, record.ttl, record.type, data)) return;
+    uint32_t rcode = ParseNumber(NextToken(data)) & 0xF;
+    NextToken(data);
+    record.ttl = ParseNumber(NextToken(data));
+    NextToken(data);
+    uint32_t answers = ParseNumber(NextToken(data));
+    if (rcode == 3) {
+        record.status = CacheRecordStatus::NameError;
+        record.type = 0;
+    }
+    else if (rcode == 0 && answers == 0) {
+        record.status = CacheRecordStatus::NoRecords;
+    }
+    else {
+        return;
+    }
+    Emit(record);
+}
+
+DnsmasqDumpParser::DnsmasqDumpParser(CacheRecordFn onRecord)
+    : CacheDumpParser(std::move(onRecord)), m_now((int64_t)time(nullptr)) {
+}
+
+// ctime() text such as "Thu Oct 16 10:00:00 2026", taken as local time.
+// mktime() is slow, so it runs once per hour that expiry times fall in.
+bool DnsmasqDumpParser::ParseExpiry(std::string_view text, int64_t& seconds) {
+    static const char* months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+    NextToken(text);
+    std::string_view month = NextToken(text);
+    std::string_view day = NextToken(text);
+    std::string_view clock = NextToken(text);
+    std::string_view year = NextToken(text);
+
+    struct tm when = {};
+    when.tm_mon = -1;
+    for (int i = 0; i < 12; i++) {
+        if (month == months[i]) when.tm_mon = i;
+    }
+    if (when.tm_mon < 0 || day.empty() || clock.size() != 8 || year.size() != 4) return false;
+    when.tm_mday = (int)ParseNumber(day);
+    when.tm_hour = (int)ParseNumber(clock.substr(0, 2));
+    when.tm_year = (int)ParseNumber(year) - 1900;
+    when.tm_isdst = -1;
+    if (when.tm_mday < 1 || when.tm_mday > 31 || when.tm_hour > 23) return false;
+
+    uint32_t hour = (((uint32_t)when.tm_year * 12 + when.tm_mon) * 32 + when.tm_mday) * 24 + when.tm_hour;
+    auto it = m_hours.find(hour);
+    if (it == m_hours.end()) {
+        time_t start = mktime(&when);
+        if (start == (time_t)-1) return false;
+        it = m_hours.emplace(hour, (int64_t)start).first;
+    }
+    seconds = it->second + ParseNumber(clock.substr(3, 2)) * 60 + ParseNumber(clock.substr(6, 2));
+    return true;
+}
+
+void DnsmasqDumpParser::ParseLine(std::string_view line) {
+    line = StripLogPrefix(Trim(line));
+    CacheRecord record;
+    record.name = NextToken(line);
+
+    // The address column is blank for negative entries; an address or
+    // CNAME target always has a dot or a colon, the flags never do
+    std::string_view rest = line;
+    std::string_view address = NextToken(rest);
+    if (address.find_first_of(".:") != std::string_view::npos) {
+        record.data = address;
+        line = rest;
+    }
+
+    // Flags: the record type first ('4', '6', 'C', ...), then one letter per
+    // property; then the expiry time unless the entry never expires
+    line = Trim(line);
+    size_t flagsEnd = 0;
+    while (flagsEnd < line.size() && ((line[flagsEnd] >= 'A' && line[flagsEnd] <= 'Z') ||
+        (line[flagsEnd] >= '0' && line[flagsEnd] <= '9') || line[flagsEnd] == ' ')) {
+        flagsEnd++;
+    }
+    // The weekday of the expiry time starts with a capital too
+    while (flagsEnd > 0 && flagsEnd < line.size() && line[flagsEnd - 1] != ' ') flagsEnd--;
+    std::string_view flags = line.substr(0, flagsEnd);
+    if (record.name.empty() || flags.empty()) return;
+
+    switch (flags[0]) {
+    case '4': record.type = 1; break;
+    case '6': record.type = 28; break;
+    case 'C': record.type = 5; break;
+    default: return;
+    }
+    // Reverse, DHCP, /etc/hosts and configured entries are not upstream answers
+    if (flags.find_first_of("RDHC", 1) != std::string_view::npos) return;
+
+    record.ttl = 0;
+    int64_t expires;
+    if (ParseExpiry(line.substr(flagsEnd), expires) && expires > m_now) {
+        record.ttl = (uint32_t)(expires - m_now);
+    }
+
+    if (flags.find('N', 1) == std::string_view::npos) {
+        record.status = CacheRecordStatus::Record;
+        if (record.data.empty()) return;
+    }
+    else if (flags.find('X', 1) != std::string_view::npos) {
+        record.status = CacheRecordStatus::NameError;
+        record.type = 0;
+        record.data = std::string_view();
+    }
+    else {
+        record.status = CacheRecordStatus::NoRecords;
+        record.data = std::string_view();
+    }
+    Emit(record);
+}
+
+ResolvedDumpParser::ResolvedDumpParser(CacheRecordFn onRecord)
+    : CacheDumpParser(std::move(onRecord)) {
+}
+
+void ResolvedDumpParser::ParseLine(std::string_view line) {
+    CacheRecord record;
+    std::string_view data;
+    if (!ParseRecordLine(StripLogPrefix(Trim(line)), record.name, record.ttl, record.type, data)) return;
+
+    if (data == "NXDOMAIN") {
+        record.status = CacheRecordStatus::NameError;
+        record.type = 0;
+    }
+    else if (data == "NODATA") {
+        record.status = CacheRecordStatus::NoRecords;
+    }
+    else {
+        record.status = CacheRecordStatus::Record;
+        record.data = record.type == 5 ? StripRootDot(data) : data;
+    }
+    Emit(record);
+}
+
+void ParseDumpStream(FILE* stream, CacheDumpParser& parser, const std::atomic<bool>* stop) {
+    std::vector<char> buffer(READ_CHUNK_SIZE);
+
+    size_t length;
+    while ((!stop || !*stop) && (length = fread(buffer.data(), 1, buffer.size(), stream)) > 0) {
+        parser.Feed(buffer.data(), length);
+    }
+    parser.Finish();
+}
+
+uint64_t ParseDisplayDnsStream(FILE* stream, const CacheRecordFn& onRecord) {
+    DisplayDnsParser parser(onRecord);
+    ParseDumpStream(stream, parser);
+    return parser.RecordsParsed();
+}
+
+bool ParseDisplayDnsFile(const char* path, const CacheRecordFn& onRecord) {
+    FILE* file = nullptr;
+#ifdef _WIN32
+    fopen_s(&file, path, "rb");
+#else
+    file = fopen(path, "rb");
+#endif
+    if (!file) return false;
+
+    ParseDisplayDnsStream(file, onRecord);
+    fclose(file);
+    return true;
+}
+
+bool ParseDisplayDnsCommand(const char* command, const CacheRecordFn& onRecord) {
+#ifdef _WIN32
+    FILE* pipe = _popen(command, "rb");
+#else
+    FILE* pipe = popen(command, "r");
+#endif
+    if (!pipe) return false;
+
+    ParseDisplayDnsStream(pipe, onRecord);
+#ifdef _WIN32
+    _pclose(pipe);
+#else
+    pclose(pipe);
+#endif
+    return true;
+}
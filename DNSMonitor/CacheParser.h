@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// What a CacheRecord describes
+enum class CacheRecordStatus : uint8_t {
+    Record,         // An answer record
+    NameError,      // "Name does not exist." cached for the group's name
+    NoRecords       // "No records of type X" cached for the group's name
+};
+
+// One record from a cache dump. The views point into the parser's own
+// buffers and are only valid for the duration of the callback. Negative
+// entries carry the name that does not resolve, no TTL and no data.
+struct CacheRecord {
+    std::string_view name;      // Record Name
+    uint16_t type;              // Record Type (numeric, 1 = A, 28 = AAAA, 5 = CNAME); for NoRecords the missing type
+    uint32_t ttl;               // Time To Live in seconds
+    std::string_view data;      // Value of the "<type> Record" line: address or target name
+    CacheRecordStatus status;
+};
+
+using CacheRecordFn = std::function<void(const CacheRecord& record)>;
+
+// Incremental parser for a line-oriented cache dump. Feed it chunks of any
+// size; complete lines are tokenized in place and records are emitted as
+// they are recognized. Only a partial trailing line is copied between
+// chunks, so steady-state parsing does not allocate.
+class CacheDumpParser {
+public:
+    explicit CacheDumpParser(CacheRecordFn onRecord);
+    virtual ~CacheDumpParser() {}
+
+    void Feed(const char* data, size_t length);
+
+    // Flush the last partial line and pending record
+    void Finish();
+
+    uint64_t BytesParsed() const { return m_bytes; }
+    uint64_t RecordsParsed() const { return m_records; }
+
+protected:
+    virtual void ParseLine(std::string_view line) = 0;
+    virtual void EndOfInput() {}
+    void Emit(const CacheRecord& record);
+
+private:
+    CacheRecordFn m_onRecord;
+    std::string m_carry;        // Partial line left over from the previous chunk
+    uint64_t m_bytes = 0;
+    uint64_t m_records = 0;
+};
+
+// ipconfig /displaydns text. A record is emitted once the next one starts,
+// since its fields arrive on separate lines.
+class DisplayDnsParser : public CacheDumpParser {
+public:
+    explicit DisplayDnsParser(CacheRecordFn onRecord);
+
+protected:
+    void ParseLine(std::string_view line) override;
+    void EndOfInput() override;
+
+private:
+    void EmitRecord();
+    void EmitNegative(CacheRecordStatus status, uint16_t type);
+
+    std::string m_heading;      // Name of the current group
+    std::string m_name;         // Fields of the record being assembled; capacity is reused
+    std::string m_data;
+    uint16_t m_type = 0;
+    uint32_t m_ttl = 0;
+    bool m_inRecord = false;
+};
+
+// "unbound-control dump_cache" output. Answers come from the RRset section
+// ("name ttl IN type data"); cached NXDOMAIN and NODATA answers only show
+// in the message section, as "msg" lines whose flags carry the rcode.
+class UnboundDumpParser : public CacheDumpParser {
+public:
+    explicit UnboundDumpParser(CacheRecordFn onRecord);
+
+protected:
+    void ParseLine(std::string_view line) override;
+
+private:
+    bool m_inMessages = false;
+};
+
+// dnsmasq's cache dump, written to syslog or the journal on SIGUSR1: one
+// "host address flags expires" line per entry, with or without the log
+// prefix. Entries from /etc/hosts, DHCP and reverse lookups are skipped.
+// dnsmasq cuts hostnames to the width of its Host column.
+class DnsmasqDumpParser : public CacheDumpParser {
+public:
+    explicit DnsmasqDumpParser(CacheRecordFn onRecord);
+
+protected:
+    void ParseLine(std::string_view line) override;
+
+private:
+    bool ParseExpiry(std::string_view text, int64_t& seconds);
+
+    int64_t m_now;              // Expiry times are absolute; TTLs are counted from here
+    std::unordered_map<uint32_t, int64_t> m_hours;  // mktime() of each local hour seen
+};
+
+// systemd-resolved's cache, from "resolvectl show-cache" or the journal
+// dump on SIGUSR1: "name IN type data" per record, "name IN type NXDOMAIN"
+// or "NODATA" for negative entries. No TTLs are shown.
+class ResolvedDumpParser : public CacheDumpParser {
+public:
+    explicit ResolvedDumpParser(CacheRecordFn onRecord);
+
+protected:
+    void ParseLine(std::string_view line) override;
+};
+
+// Feed everything readable from an open stream (file or pipe) to a parser
+// and finish it. Once *stop is set the rest of the stream is left unread.
+void ParseDumpStream(FILE* stream, CacheDumpParser& parser, const std::atomic<bool>* stop = nullptr);
+
+// Parse everything readable from an open stream (file or pipe)
+uint64_t ParseDisplayDnsStream(FILE* stream, const CacheRecordFn& onRecord);
+
+// Parse a captured dump file; false if it cannot be opened
+bool ParseDisplayDnsFile(const char* path, const CacheRecordFn& onRecord);
+
+// Run a command and parse its output straight from a pipe; false if it cannot be started
+bool ParseDisplayDnsCommand(const char* command, const CacheRecordFn& onRecord);
@@ -0,0 +1,131 @@
+#include "CacheSnoop.h"
+#include "DnsClient.h"
+#include "RateLimit.h"
+
+#include <algorithm>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint32_t DRIVER_MAX_WAIT_MS = 20;
+
+const char* SnoopStatusName(SnoopStatus status) {
+    switch (status) {
+    case SnoopStatus::Cached: return "cached";
+    case SnoopStatus::NotCached: return "not cached";
+    case SnoopStatus::Negative: return "nxdomain";
+    case SnoopStatus::Refused: return "refused";
+    case SnoopStatus::Timeout: return "timeout";
+    default: return "error";
+    }
+}
+
+// A record of the target's type anywhere in the answer means the resolver
+// had the whole chain; a CNAME alone means it only had the alias
+static void Classify(const SnoopTarget& target, const DnsQueryResult& answer, uint32_t slack,
+    SnoopResult& result, CacheSnoopReport& report) {
+    result.responseTime = answer.responseTime;
+    switch (answer.status) {
+    case DnsQueryStatus::Timeout:
+        result.status = SnoopStatus::Timeout;
+        report.timeouts++;
+        return;
+    case DnsQueryStatus::NameError:
+        result.status = SnoopStatus::Negative;
+        report.negative++;
+        return;
+    case DnsQueryStatus::NetworkError:
+        result.status = SnoopStatus::Error;
+        report.errors++;
+        return;
+    case DnsQueryStatus::ServerError:
+        if (answer.rcode == DNS_RCODE_REFUSED) {
+            result.status = SnoopStatus::Refused;
+            report.refused++;
+        }
+        else {
+            result.status = SnoopStatus::Error;
+            report.errors++;
+        }
+        return;
+    case DnsQueryStatus::Ok:
+        break;
+    }
+
+    bool found = false;
+    uint32_t ttl = UINT32_MAX;
+    for (const auto& record : answer.answers) {
+        if (record.type == target.type) found = true;
+        if (record.type == target.type || record.type == DNS_TYPE_CNAME) {
+            ttl = (std::min)(ttl, record.ttl);
+        }
+    }
+    if (!found) {
+        result.status = SnoopStatus::NotCached;
+        report.notCached++;
+        return;
+    }
+
+    result.status = SnoopStatus::Cached;
+    result.upstreamTtl = ttl;
+    result.ttlDelta = (int64_t)ttl - (int64_t)target.cachedTtl;
+    result.addressMatches = target.cachedAddress.empty() || DnsAnswerHasAddress(answer, target.cachedAddress);
+    report.cached++;
+    if (!result.addressMatches) report.addressMismatches++;
+    if (result.ttlDelta > (int64_t)slack) report.upstreamNewer++;
+    if (result.ttlDelta < -(int64_t)slack) report.localOutlives++;
+}
+
+CacheSnoopReport SnoopResolverCache(const std::vector<SnoopTarget>& targets, const CacheSnoopConfig& config,
+    SnoopProgressFn progress) {
+    CacheSnoopReport report = {};
+    report.server = config.server;
+    report.results.assign(targets.size(), SnoopResult{ SnoopStatus::Error, 0, 0, false, 0 });
+
+    int batchSize = (std::max)(config.batchSize, 1);
+    DnsClientConfig clientConfig;
+    clientConfig.server = config.server;
+    clientConfig.deadlineMs = config.deadlineMs;
+    clientConfig.maxInFlight = batchSize;
+    clientConfig.recursionDesired = false;
+    DnsClient client(clientConfig);
+    report.usable = client.Start();
+    if (!report.usable) return report;
+
+    // The whole batch may leave at once; after that the rate holds
+    TokenBucket bucket(config.queriesPerSecond, batchSize);
+    bool limited = config.queriesPerSecond > 0.0;
+    auto start = Clock::now();
+    size_t next = 0;
+    int inFlight = 0;
+    int done = 0;
+    int total = (int)targets.size();
+    std::vector<DnsQueryResult> answers;
+    while (done < total) {
+        auto now = Clock::now();
+        while (next < targets.size() && inFlight < batchSize && (!limited || bucket.TryTake(now))) {
+            client.Submit(next, targets[next].hostname, targets[next].type);
+            next++;
+            inFlight++;
+            report.queries++;
+        }
+
+        uint32_t waitMs = DRIVER_MAX_WAIT_MS;
+        if (limited && next < targets.size() && inFlight < batchSize) {
+            auto delay = std::chrono::ceil<std::chrono::milliseconds>(bucket.Delay(now)).count();
+            waitMs = (std::min)(waitMs, (uint32_t)(std::max)((long long)delay, 1LL));
+        }
+
+        answers.clear();
+        client.Wait(answers, waitMs);
+        for (const auto& answer : answers) {
+            Classify(targets[answer.id], answer, config.ttlSlack, report.results[answer.id], report);
+            inFlight--;
+            done++;
+            if (progress) progress(done, total);
+        }
+    }
+
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return report;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A cached record to look for upstream, and what the local cache holds for it
+struct SnoopTarget {
+    std::string hostname;
+    uint16_t type;                  // DNS_TYPE_A or DNS_TYPE_AAAA
+    std::string cachedAddress;
+    uint32_t cachedTtl;             // Seconds the local copy has left
+};
+
+// What a non-recursive query found
+enum class SnoopStatus : uint8_t {
+    Cached,         // Answered from the resolver's cache (or its own zones)
+    NotCached,      // Nothing without recursion: expired upstream or never fetched
+    Negative,       // The resolver holds NXDOMAIN for the name
+    Refused,        // The resolver does not answer non-recursive queries
+    Timeout,
+    Error           // SERVFAIL, other rcodes, network errors
+};
+
+const char* SnoopStatusName(SnoopStatus status);
+
+// Outcome for one target
+struct SnoopResult {
+    SnoopStatus status;
+    uint32_t upstreamTtl;           // Cached only: least TTL left along the answer
+    int64_t ttlDelta;               // Cached only: upstreamTtl - cachedTtl
+    bool addressMatches;            // Cached only: the answer holds the cached address
+    uint32_t responseTime;          // Milliseconds
+};
+
+struct CacheSnoopConfig {
+    std::string server;             // "ip", "ip:port" or "[ipv6]:port"
+    uint32_t deadlineMs = 2000;
+    int batchSize = 256;            // Queries on the wire at once
+    double queriesPerSecond = 2000.0;   // Ceiling; 0 for none
+    uint32_t ttlSlack = 2;          // Seconds either way still counted as the same copy
+};
+
+struct CacheSnoopReport {
+    std::string server;
+    bool usable;                    // False if the address could not be opened
+    int queries;
+    int cached;
+    int notCached;
+    int negative;
+    int refused;
+    int timeouts;
+    int errors;
+    int addressMismatches;          // Cached upstream, but without the local address
+    int upstreamNewer;              // Cached upstream with more TTL left: fetched again after the local copy
+    int localOutlives;              // The local copy outlives the resolver's
+    double seconds;
+    std::vector<SnoopResult> results;   // One per target, in target order
+};
+
+// Called after each completed query with the number done so far
+using SnoopProgressFn = std::function<void(int done, int total)>;
+
+// Ask one resolver with RD=0 queries, pipelined batchSize at a time,
+// whether it still caches each target, and compare what it holds with the
+// local copy. One packet per name and no upstream recursion, so the check
+// costs the resolver next to nothing. Names the resolver is authoritative
+// for always show as Cached.
+CacheSnoopReport SnoopResolverCache(const std::vector<SnoopTarget>& targets, const CacheSnoopConfig& config,
+    SnoopProgressFn progress = nullptr);
@@ -0,0 +1,125 @@
+#include "CacheSource.h"
+
+#include <chrono>
+
+static const struct {
+    CacheFormat format;
+    const char* name;
+    const char* command;
+} CACHE_FORMATS[] = {
+    { CacheFormat::DisplayDns, "displaydns", "ipconfig /displaydns" },
+    { CacheFormat::Unbound, "unbound", "unbound-control dump_cache" },
+    { CacheFormat::Dnsmasq, "dnsmasq", nullptr },
+    { CacheFormat::Resolved, "resolved", "resolvectl show-cache" },
+};
+
+const char* CacheFormatName(CacheFormat format) {
+    for (const auto& entry : CACHE_FORMATS) {
+        if (entry.format == format) return entry.name;
+    }
+    return "unknown";
+}
+
+bool ParseCacheFormat(std::string_view name, CacheFormat& format) {
+    for (const auto& entry : CACHE_FORMATS) {
+        if (name == entry.name) {
+            format = entry.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* DefaultCacheCommand(CacheFormat format) {
+    for (const auto& entry : CACHE_FORMATS) {
+        if (entry.format == format) return entry.command;
+    }
+    return nullptr;
+}
+
+std::unique_ptr<CacheDumpParser> MakeCacheDumpParser(CacheFormat format, CacheRecordFn onRecord) {
+    switch (format) {
+    case CacheFormat::Unbound: return std::unique_ptr<CacheDumpParser>(new UnboundDumpParser(std::move(onRecord)));
+    case CacheFormat::Dnsmasq: return std::unique_ptr<CacheDumpParser>(new DnsmasqDumpParser(std::move(onRecord)));
+    case CacheFormat::Resolved: return std::unique_ptr<CacheDumpParser>(new ResolvedDumpParser(std::move(onRecord)));
+    default: return std::unique_ptr<CacheDumpParser>(new DisplayDnsParser(std::move(onRecord)));
+    }
+}
+
+void CacheSource::ReadStream(FILE* stream, const CacheRecordFn& onRecord, const std::atomic<bool>* stop) {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<CacheDumpParser> parser = MakeCacheDumpParser(m_format, onRecord);
+    ParseDumpStream(stream, *parser, stop);
+
+    m_lastRead.bytes = parser->BytesParsed();
+    m_lastRead.records = parser->RecordsParsed();
+    m_lastRead.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+CommandCacheSource::CommandCacheSource(CacheFormat format, std::string command)
+    : CacheSource(format), m_command(std::move(command)) {
+}
+
+bool CommandCacheSource::Read(const CacheRecordFn& onRecord, const std::atomic<bool>* stop) {
+#ifdef _WIN32
+    FILE* pipe = _popen(m_command.c_str(), "rb");
+#else
+    FILE* pipe = popen(m_command.c_str(), "r");
+#endif
+    if (!pipe) return false;
+
+    ReadStream(pipe, onRecord, stop);
+#ifdef _WIN32
+    _pclose(pipe);
+#else
+    pclose(pipe);
+#endif
+    return true;
+}
+
+FileCacheSource::FileCacheSource(CacheFormat format, std::string path)
+    : CacheSource(format), m_path(std::move(path)) {
+}
+
+bool FileCacheSource::Read(const CacheRecordFn& onRecord, const std::atomic<bool>* stop) {
+    FILE* file = nullptr;
+#ifdef _WIN32
+    fopen_s(&file, m_path.c_str(), "rb");
+#else
+    file = fopen(m_path.c_str(), "rb");
+#endif
+    if (!file) return false;
+
+    ReadStream(file, onRecord, stop);
+    fclose(file);
+    return true;
+}
+
+void AddCacheRecord(EntryTable& entries, const CacheRecord& record) {
+    size_t row;
+    if (record.status == CacheRecordStatus::NameError) {
+        if (!entries.Find(record.name, RecordKind::NameError, row)) {
+            entries.Add(record.name, RecordKind::NameError, PackedAddress(), 0);
+        }
+        return;
+    }
+    if (record.status != CacheRecordStatus::Record || record.data.empty()) return;
+
+    RecordKind kind = RecordKindFromType(record.type);
+    if (kind == RecordKind::CNAME) {
+        if (!entries.Find(record.name, kind, row)) {
+            row = entries.Add(record.name, kind, PackedAddress(), record.ttl);
+            entries.SetTarget(row, record.data);
+        }
+        return;
+    }
+
+    PackedAddress address;
+    if ((kind != RecordKind::A && kind != RecordKind::AAAA) || !PackAddress(record.data, address)) return;
+    if (entries.Find(record.name, kind, row)) {
+        entries.AddAddress(row, address);
+    }
+    else {
+        entries.Add(record.name, kind, address, record.ttl);
+    }
+}
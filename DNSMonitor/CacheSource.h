@@ -0,0 +1,90 @@
+#pragma once
+
+#include "CacheParser.h"
+#include "EntryTable.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Dump formats a cache can be read in
+enum class CacheFormat : uint8_t {
+    DisplayDns,     // Windows: ipconfig /displaydns
+    Unbound,        // unbound-control dump_cache
+    Dnsmasq,        // dnsmasq's SIGUSR1 dump, as logged to syslog or the journal
+    Resolved        // systemd-resolved: resolvectl show-cache
+};
+
+const char* CacheFormatName(CacheFormat format);    // "displaydns", "unbound", "dnsmasq", "resolved"
+bool ParseCacheFormat(std::string_view name, CacheFormat& format);
+
+// The command that prints the format's dump on the resolver itself; null for
+// dnsmasq, which only logs its cache
+const char* DefaultCacheCommand(CacheFormat format);
+
+std::unique_ptr<CacheDumpParser> MakeCacheDumpParser(CacheFormat format, CacheRecordFn onRecord);
+
+// What the last Read() got through
+struct CacheReadStats {
+    uint64_t bytes;
+    uint64_t records;
+    double seconds;
+};
+
+// Where the monitor gets the cache from. Read() streams one dump through
+// the format's parser and calls onRecord as each record is recognized, so
+// the caller can act on the start of a large dump while the rest is still
+// arriving. Only the parser thread reads a source.
+class CacheSource {
+public:
+    virtual ~CacheSource() {}
+
+    virtual const char* Name() const = 0;
+    CacheFormat Format() const { return m_format; }
+
+    // Read one dump; false if it could not be opened or started. Once *stop
+    // is set the rest of the dump is left unread.
+    virtual bool Read(const CacheRecordFn& onRecord, const std::atomic<bool>* stop) = 0;
+
+    CacheReadStats LastRead() const { return m_lastRead; }
+
+protected:
+    explicit CacheSource(CacheFormat format) : m_format(format), m_lastRead() {}
+    void ReadStream(FILE* stream, const CacheRecordFn& onRecord, const std::atomic<bool>* stop);
+
+    CacheFormat m_format;
+    CacheReadStats m_lastRead;
+};
+
+// Runs a command for every read and parses its output straight from the
+// pipe: ipconfig on Windows, or e.g. "ssh ns1 unbound-control dump_cache"
+// for a resolver elsewhere
+class CommandCacheSource : public CacheSource {
+public:
+    CommandCacheSource(CacheFormat format, std::string command);
+
+    const char* Name() const override { return m_command.c_str(); }
+    bool Read(const CacheRecordFn& onRecord, const std::atomic<bool>* stop) override;
+
+private:
+    std::string m_command;
+};
+
+// Reads a dump file, re-read on every refresh so another job can keep it current
+class FileCacheSource : public CacheSource {
+public:
+    FileCacheSource(CacheFormat format, std::string path);
+
+    const char* Name() const override { return m_path.c_str(); }
+    bool Read(const CacheRecordFn& onRecord, const std::atomic<bool>* stop) override;
+
+private:
+    std::string m_path;
+};
+
+// Add a parsed record to a table being built: every A and AAAA address,
+// each CNAME and each cached NXDOMAIN. Other types have no probe, so they
+// are left out.
+void AddCacheRecord(EntryTable& entries, const CacheRecord& record);
@@ -0,0 +1,426 @@
+#include "ConnectProbe.h"
+#include "Platform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static const int IO_MAX_WAIT_MS = 250;          // Bounds shutdown latency
+#ifdef __linux__
+static const int EPOLL_BATCH = 256;             // Events taken per wait
+#endif
+
+// An attempt waiting for a slot, or connecting
+struct ConnectAttempt {
+    size_t id;
+    std::string hostname;
+    PackedAddress address;
+    uint16_t port;
+    SOCKET sock = INVALID_SOCKET;
+    uint64_t sequence = 0;          // Tells a reused socket number from the one a deadline was set for
+    Clock::time_point started;
+};
+
+struct ConnectDeadline {
+    Clock::time_point at;
+    SOCKET sock;
+    uint64_t sequence;
+};
+
+struct ConnectProbeState {
+    std::mutex lock;
+    std::condition_variable workReady;
+    std::condition_variable resultReady;
+
+    ConnectProbeConfig config;
+    bool stopping = false;
+    bool waiting = false;           // I/O thread is blocked on the sockets, not the condition variable
+
+    // Loopback UDP socket polled with the rest; a datagram sent to itself
+    // interrupts the wait so new attempts start without delay
+    SOCKET wake = INVALID_SOCKET;
+    struct sockaddr_storage wakeAddress;
+    socklen_t wakeLength = 0;
+#ifdef __linux__
+    int epoll = -1;
+#endif
+
+    std::deque<ConnectAttempt> backlog;
+    std::unordered_map<SOCKET, ConnectAttempt> inFlight;
+    std::deque<ConnectDeadline> deadlines;      // Every attempt gets the same timeout, so start order is deadline order
+    uint64_t nextSequence = 0;
+    std::vector<ConnectResult> results;
+
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t timedOut = 0;
+    ProbeSampleWindow samples;
+};
+
+const char* ConnectOutcomeName(ConnectOutcome outcome) {
+    switch (outcome) {
+    case ConnectOutcome::Connected: return "Connected";
+    case ConnectOutcome::Refused: return "Refused";
+    case ConnectOutcome::Unreachable: return "Unreachable";
+    default: return "Timeout";
+    }
+}
+
+static uint32_t ElapsedMs(Clock::time_point from, Clock::time_point to) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
+}
+
+static void ToSocketAddress(const PackedAddress& address, uint16_t port, struct sockaddr_storage& storage, socklen_t& length) {
+    storage = {};
+    if (address.IsV4()) {
+        struct sockaddr_in* v4 = (struct sockaddr_in*)&storage;
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        memcpy(&v4->sin_addr, address.bytes + 12, 4);
+        length = sizeof(struct sockaddr_in);
+    }
+    else {
+        struct sockaddr_in6* v6 = (struct sockaddr_in6*)&storage;
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        memcpy(&v6->sin6_addr, address.bytes, 16);
+        length = sizeof(struct sockaddr_in6);
+    }
+}
+
+static void ReportLocked(ConnectProbeState& state, const ConnectAttempt& attempt, ConnectOutcome outcome, Clock::time_point now) {
+    ConnectResult result;
+    result.id = attempt.id;
+    result.hostname = attempt.hostname;
+    result.address = attempt.address;
+    result.port = attempt.port;
+    result.outcome = outcome;
+    result.connectMs = PROBE_TIMEOUT;
+
+    uint32_t latency = (std::min)(ElapsedMs(attempt.started, now), state.config.deadlineMs);
+    if (outcome == ConnectOutcome::Connected || outcome == ConnectOutcome::Refused) {
+        result.connectMs = latency;
+        state.completed++;
+        if (outcome == ConnectOutcome::Refused) state.failed++;
+    }
+    else {
+        state.timedOut++;
+    }
+    state.samples.Record(now, latency);
+
+    state.results.push_back(std::move(result));
+    state.resultReady.notify_all();
+    if (state.config.onResult) state.config.onResult();
+}
+
+// Close a connecting socket and hand its outcome back to the owner
+static void FinishLocked(ConnectProbeState& state, SOCKET sock, ConnectOutcome outcome, Clock::time_point now) {
+    auto it = state.inFlight.find(sock);
+    if (it == state.inFlight.end()) return;
+
+    ReportLocked(state, it->second, outcome, now);
+    closesocket(sock);      // Also drops it from the epoll set
+    state.inFlight.erase(it);
+}
+
+// Open a socket and start the handshake. False, leaving the attempt
+// untouched, if no socket is free right now.
+static bool StartLocked(ConnectProbeState& state, ConnectAttempt& attempt, Clock::time_point now) {
+    struct sockaddr_storage address;
+    socklen_t length;
+    ToSocketAddress(attempt.address, attempt.port, address, length);
+    attempt.started = now;
+
+    SOCKET sock = socket(address.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET) {
+        // Out of descriptors: wait for a running attempt to free one
+        if (!state.inFlight.empty()) return false;
+        ReportLocked(state, attempt, ConnectOutcome::Unreachable, now);
+        return true;
+    }
+    if (!SetSocketNonBlocking(sock)) {
+        closesocket(sock);
+        ReportLocked(state, attempt, ConnectOutcome::Unreachable, now);
+        return true;
+    }
+
+    int status = connect(sock, (const struct sockaddr*)&address, length);
+    int error = status == 0 ? 0 : LastSocketError();
+    if (status != 0 && !SocketWouldBlock(error)) {
+        closesocket(sock);
+        ReportLocked(state, attempt, SocketRefused(error) ? ConnectOutcome::Refused : ConnectOutcome::Unreachable, now);
+        return true;
+    }
+    if (status == 0) {
+        closesocket(sock);
+        ReportLocked(state, attempt, ConnectOutcome::Connected, now);
+        return true;
+    }
+
+#ifdef __linux__
+    struct epoll_event event = {};
+    event.events = EPOLLOUT;
+    event.data.fd = sock;
+    if (epoll_ctl(state.epoll, EPOLL_CTL_ADD, sock, &event) != 0) {
+        closesocket(sock);
+        ReportLocked(state, attempt, ConnectOutcome::Unreachable, now);
+        return true;
+    }
+#endif
+
+    attempt.sock = sock;
+    attempt.sequence = ++state.nextSequence;
+    state.deadlines.push_back({ now + std::chrono::milliseconds(state.config.deadlineMs), sock, attempt.sequence });
+    state.inFlight.emplace(sock, std::move(attempt));
+    return true;
+}
+
+static void FillSlotsLocked(ConnectProbeState& state, Clock::time_point now) {
+    while (!state.backlog.empty() && (int)state.inFlight.size() < state.config.maxInFlight) {
+        if (!StartLocked(state, state.backlog.front(), now)) break;
+        state.backlog.pop_front();
+    }
+}
+
+static void ExpireLocked(ConnectProbeState& state, Clock::time_point now) {
+    while (!state.deadlines.empty() && state.deadlines.front().at <= now) {
+        ConnectDeadline deadline = state.deadlines.front();
+        state.deadlines.pop_front();
+
+        auto it = state.inFlight.find(deadline.sock);
+        if (it != state.inFlight.end() && it->second.sequence == deadline.sequence) {
+            FinishLocked(state, deadline.sock, ConnectOutcome::Timeout, now);
+        }
+    }
+}
+
+// The handshake settled one way or the other; SO_ERROR says which
+static void HandleReadyLocked(ConnectProbeState& state, SOCKET sock, Clock::time_point now) {
+    if (state.inFlight.find(sock) == state.inFlight.end()) return;
+
+    int error = 0;
+    socklen_t errorLength = sizeof(error);
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &errorLength) != 0) {
+        error = LastSocketError();
+    }
+    FinishLocked(state, sock, error == 0 ? ConnectOutcome::Connected :
+        SocketRefused(error) ? ConnectOutcome::Refused : ConnectOutcome::Unreachable, now);
+}
+
+static void DrainWake(ConnectProbeState& state) {
+    char buffer[64];
+    while (recv(state.wake, buffer, sizeof(buffer), 0) > 0) {
+    }
+}
+
+static void RunIoLoop(std::shared_ptr<ConnectProbeState> state) {
+    std::vector<SOCKET> ready;
+#ifdef __linux__
+    struct epoll_event events[EPOLL_BATCH];
+#else
+    std::vector<SocketPollFd> fds;
+#endif
+
+    std::unique_lock<std::mutex> guard(state->lock);
+    for (;;) {
+        state->workReady.wait(guard, [&] {
+            return state->stopping || !state->inFlight.empty() || !state->backlog.empty();
+        });
+        if (state->stopping) break;
+
+        auto now = Clock::now();
+        FillSlotsLocked(*state, now);
+        ExpireLocked(*state, now);
+        if (state->inFlight.empty()) continue;     // Everything settled straight away
+
+        auto wakeAt = now + std::chrono::milliseconds(IO_MAX_WAIT_MS);
+        if (!state->deadlines.empty()) {
+            wakeAt = (std::min)(wakeAt, state->deadlines.front().at);
+        }
+        int timeoutMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - now).count() + 1;
+
+        ready.clear();
+#ifdef __linux__
+        state->waiting = true;
+        guard.unlock();
+        int count = epoll_wait(state->epoll, events, EPOLL_BATCH, timeoutMs);
+        guard.lock();
+        state->waiting = false;
+        for (int i = 0; i < count; i++) {
+            ready.push_back((SOCKET)events[i].data.fd);
+        }
+#else
+        // Older WSAPoll versions never flag a refused connect; those end as timeouts
+        fds.clear();
+        SocketPollFd wakeFd = {};
+        wakeFd.fd = state->wake;
+        wakeFd.events = POLLIN;
+        fds.push_back(wakeFd);
+        for (const auto& item : state->inFlight) {
+            SocketPollFd fd = {};
+            fd.fd = item.first;
+            fd.events = POLLOUT;
+            fds.push_back(fd);
+        }
+
+        state->waiting = true;
+        guard.unlock();
+        int count = PollSockets(fds.data(), fds.size(), timeoutMs);
+        guard.lock();
+        state->waiting = false;
+        for (size_t i = 0; count > 0 && i < fds.size(); i++) {
+            if (fds[i].revents) ready.push_back(fds[i].fd);
+        }
+#endif
+
+        now = Clock::now();
+        for (SOCKET sock : ready) {
+            if (sock == state->wake) {
+                DrainWake(*state);
+            }
+            else {
+                HandleReadyLocked(*state, sock, now);
+            }
+        }
+    }
+
+    for (auto& item : state->inFlight) {
+        closesocket(item.first);
+    }
+    state->inFlight.clear();
+}
+
+ConnectProbe::ConnectProbe(const ConnectProbeConfig& config)
+    : m_config(config), m_state(std::make_shared<ConnectProbeState>()) {
+    if (m_config.maxInFlight < 1) m_config.maxInFlight = 1;
+    m_state->config = m_config;
+}
+
+ConnectProbe::~ConnectProbe() {
+    {
+        std::lock_guard<std::mutex> guard(m_state->lock);
+        m_state->stopping = true;
+        m_state->workReady.notify_all();
+        if (m_state->wake != INVALID_SOCKET) {
+            sendto(m_state->wake, "x", 1, 0, (const struct sockaddr*)&m_state->wakeAddress, m_state->wakeLength);
+        }
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_state->wake != INVALID_SOCKET) {
+        closesocket(m_state->wake);
+    }
+#ifdef __linux__
+    if (m_state->epoll >= 0) {
+        close(m_state->epoll);
+    }
+#endif
+}
+
+bool ConnectProbe::Start() {
+    SOCKET wake = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wake == INVALID_SOCKET) {
+        return false;
+    }
+
+    struct sockaddr_in loopback = {};
+    loopback.sin_family = AF_INET;
+    loopback.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    m_state->wakeLength = sizeof(m_state->wakeAddress);
+    if (!SetSocketNonBlocking(wake) || bind(wake, (const struct sockaddr*)&loopback, sizeof(loopback)) != 0 ||
+        getsockname(wake, (struct sockaddr*)&m_state->wakeAddress, &m_state->wakeLength) != 0) {
+        closesocket(wake);
+        return false;
+    }
+
+#ifdef __linux__
+    m_state->epoll = epoll_create1(0);
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wake;
+    if (m_state->epoll < 0 || epoll_ctl(m_state->epoll, EPOLL_CTL_ADD, wake, &event) != 0) {
+        closesocket(wake);
+        return false;
+    }
+#endif
+
+    m_state->wake = wake;
+    m_thread = std::thread(RunIoLoop, m_state);
+    return true;
+}
+
+void ConnectProbe::Submit(size_t id, const std::string& hostname, const PackedAddress& address, uint16_t port) {
+    ConnectAttempt attempt;
+    attempt.id = id;
+    attempt.hostname = hostname;
+    attempt.address = address;
+    attempt.port = port;
+
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    m_state->submitted++;
+    if (m_state->wake == INVALID_SOCKET || m_state->stopping || address.IsEmpty()) {
+        attempt.started = Clock::now();
+        ReportLocked(*m_state, attempt, ConnectOutcome::Unreachable, attempt.started);
+        return;
+    }
+
+    m_state->backlog.push_back(std::move(attempt));
+    m_state->workReady.notify_one();
+    if (m_state->waiting) {
+        sendto(m_state->wake, "x", 1, 0, (const struct sockaddr*)&m_state->wakeAddress, m_state->wakeLength);
+    }
+}
+
+size_t ConnectProbe::Poll(std::vector<ConnectResult>& results) {
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    size_t count = m_state->results.size();
+    for (auto& result : m_state->results) {
+        results.push_back(std::move(result));
+    }
+    m_state->results.clear();
+    return count;
+}
+
+size_t ConnectProbe::Wait(std::vector<ConnectResult>& results, uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> guard(m_state->lock);
+    m_state->resultReady.wait_for(guard, std::chrono::milliseconds(timeoutMs),
+        [&] { return !m_state->results.empty(); });
+
+    size_t count = m_state->results.size();
+    for (auto& result : m_state->results) {
+        results.push_back(std::move(result));
+    }
+    m_state->results.clear();
+    return count;
+}
+
+size_t ConnectProbe::Pending() const {
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    return m_state->backlog.size() + m_state->inFlight.size() + m_state->results.size();
+}
+
+ProbeEngineStats ConnectProbe::GetStats() const {
+    ProbeEngineStats stats = {};
+
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    stats.submitted = m_state->submitted;
+    stats.completed = m_state->completed;
+    stats.failed = m_state->failed;
+    stats.timedOut = m_state->timedOut;
+    stats.queued = (int)m_state->backlog.size();
+    stats.inFlight = (int)m_state->inFlight.size();
+    m_state->samples.Fill(stats, Clock::now());
+    return stats;
+}
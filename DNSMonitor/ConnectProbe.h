@@ -0,0 +1,73 @@
+#pragma once
+
+#include "EntryTable.h"
+#include "ProbeEngine.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How a connect attempt ended, best first
+enum class ConnectOutcome {
+    Connected,      // Handshake completed: something serves the port
+    Refused,        // Reset: the host is up but nothing listens
+    Unreachable,    // No route to the host, or no socket could be opened
+    Timeout         // Nothing came back before the deadline
+};
+
+const char* ConnectOutcomeName(ConnectOutcome outcome);
+
+struct ConnectResult {
+    size_t id;                      // Caller supplied id
+    std::string hostname;           // Caller supplied, echoed back
+    PackedAddress address;
+    uint16_t port;
+    ConnectOutcome outcome;
+    uint32_t connectMs;             // Milliseconds, PROBE_TIMEOUT unless Connected or Refused
+};
+
+struct ConnectProbeConfig {
+    uint32_t deadlineMs = 3000;     // Per attempt
+    int maxInFlight = 4096;         // Sockets open at once; the rest wait
+    std::function<void()> onResult; // As in ProbeEngineConfig; timeouts call it too
+};
+
+struct ConnectProbeState;
+
+// Checks that cached addresses still take connections: one non-blocking TCP
+// connect per address and port, closed as soon as the handshake settles.
+// Every attempt shares a private I/O thread that waits on epoll on Linux and
+// WSAPoll elsewhere, so thousands can be in flight; each has its own deadline.
+class ConnectProbe {
+public:
+    explicit ConnectProbe(const ConnectProbeConfig& config);
+    ~ConnectProbe();
+
+    ConnectProbe(const ConnectProbe&) = delete;
+    ConnectProbe& operator=(const ConnectProbe&) = delete;
+
+    // Set up the event loop and start the I/O thread; false if that fails
+    bool Start();
+
+    // Queue an attempt; never blocks
+    void Submit(size_t id, const std::string& hostname, const PackedAddress& address, uint16_t port);
+
+    // Append finished attempts to results without blocking
+    size_t Poll(std::vector<ConnectResult>& results);
+
+    // Like Poll, but waits up to timeoutMs for at least one result
+    size_t Wait(std::vector<ConnectResult>& results, uint32_t timeoutMs);
+
+    // Waiting, connecting, and finished but not yet collected
+    size_t Pending() const;
+
+    const ConnectProbeConfig& Config() const { return m_config; }
+    ProbeEngineStats GetStats() const;
+
+private:
+    ConnectProbeConfig m_config;
+    std::shared_ptr<ConnectProbeState> m_state;
+    std::thread m_thread;
+};
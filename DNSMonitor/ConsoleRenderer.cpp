@@ -0,0 +1,191 @@
+#include "ConsoleRenderer.h"
+
+#include <cstdarg>
+#include <cstring>
+#include <utility>
+
+// Unchanged cells between two runs that are cheaper to resend than to skip
+static const int RUN_MERGE_GAP = 4;
+
+FrameBuffer::FrameBuffer(int width, int height)
+    : m_width(width), m_height(height), m_cells((size_t)width * height, ConsoleCell{ ' ', 7 }) {
+}
+
+void FrameBuffer::Clear(uint8_t attr) {
+    for (auto& cell : m_cells) {
+        cell.ch = ' ';
+        cell.attr = attr;
+    }
+    m_row = 0;
+    m_col = 0;
+    m_attr = attr;
+}
+
+void FrameBuffer::MoveTo(int row, int col) {
+    m_row = row;
+    m_col = col;
+}
+
+void FrameBuffer::Print(const char* format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length > 0) {
+        Write(text, (size_t)length < sizeof(text) ? (size_t)length : sizeof(text) - 1);
+    }
+}
+
+void FrameBuffer::Write(const char* text, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '\n') {
+            m_row++;
+            m_col = 0;
+            continue;
+        }
+        if (m_row >= 0 && m_row < m_height && m_col >= 0 && m_col < m_width) {
+            ConsoleCell& cell = m_cells[(size_t)m_row * m_width + m_col];
+            cell.ch = text[i];
+            cell.attr = m_attr;
+        }
+        m_col++;
+    }
+}
+
+AnsiConsoleBackend::AnsiConsoleBackend(FILE* out)
+    : m_out(out) {
+}
+
+// Windows color bits are blue/green/red, ANSI's are red/green/blue
+static int AnsiColor(int windowsColor) {
+    return ((windowsColor & 4) ? 1 : 0) | (windowsColor & 2) | ((windowsColor & 1) ? 4 : 0);
+}
+
+size_t AnsiConsoleBackend::Write(const FrameBuffer& frame, const std::vector<CellRun>& runs) {
+    m_buffer.clear();
+    if (m_first) {
+        m_buffer += "\x1b[?25l\x1b[2J";     // Hide the cursor, clear once
+        m_first = false;
+    }
+
+    int attr = -1;
+    char sequence[32];
+    for (const auto& run : runs) {
+        snprintf(sequence, sizeof(sequence), "\x1b[%d;%dH", run.row + 1, run.col + 1);
+        m_buffer += sequence;
+
+        for (int col = run.col; col < run.col + run.length; col++) {
+            const ConsoleCell& cell = frame.At(run.row, col);
+            if (cell.attr != attr) {
+                attr = cell.attr;
+                int foreground = attr & 0x0F;
+                int background = (attr >> 4) & 0x0F;
+                snprintf(sequence, sizeof(sequence), "\x1b[%d;%dm",
+                    ((foreground & 8) ? 90 : 30) + AnsiColor(foreground),
+                    ((background & 8) ? 100 : 40) + AnsiColor(background));
+                m_buffer += sequence;
+            }
+            m_buffer += cell.ch;
+        }
+    }
+    if (attr != -1) {
+        m_buffer += "\x1b[0m";
+    }
+
+    if (!m_buffer.empty()) {
+        fwrite(m_buffer.data(), 1, m_buffer.size(), m_out);
+        fflush(m_out);
+    }
+    return m_buffer.size();
+}
+
+#ifdef _WIN32
+Win32ConsoleBackend::Win32ConsoleBackend(HANDLE console)
+    : m_console(console) {
+    CONSOLE_CURSOR_INFO cursor;
+    if (GetConsoleCursorInfo(m_console, &cursor)) {
+        cursor.bVisible = FALSE;
+        SetConsoleCursorInfo(m_console, &cursor);
+    }
+}
+
+size_t Win32ConsoleBackend::Write(const FrameBuffer& frame, const std::vector<CellRun>& runs) {
+    if (runs.empty()) return 0;
+
+    // Every run's cells side by side in one buffer row; each run is then
+    // written as its own rectangle from its slice, so unchanged cells
+    // between runs (rows apart, like the clock and the footer) stay untouched
+    size_t cells = 0;
+    for (const auto& run : runs) {
+        cells += (size_t)run.length;
+    }
+    m_buffer.resize(cells);
+
+    size_t offset = 0;
+    for (const auto& run : runs) {
+        for (int i = 0; i < run.length; i++) {
+            const ConsoleCell& cell = frame.At(run.row, run.col + i);
+            CHAR_INFO& info = m_buffer[offset + i];
+            info.Char.AsciiChar = cell.ch;
+            info.Attributes = cell.attr;
+        }
+        offset += (size_t)run.length;
+    }
+
+    COORD size = { (SHORT)cells, 1 };
+    offset = 0;
+    for (const auto& run : runs) {
+        COORD origin = { (SHORT)offset, 0 };
+        SMALL_RECT region = { (SHORT)run.col, (SHORT)run.row, (SHORT)(run.col + run.length - 1), (SHORT)run.row };
+        WriteConsoleOutputA(m_console, m_buffer.data(), size, origin, &region);
+        offset += (size_t)run.length;
+    }
+    return cells * sizeof(CHAR_INFO);
+}
+#endif
+
+ConsoleRenderer::ConsoleRenderer(std::unique_ptr<ConsoleBackend> backend, int width, int height)
+    : m_backend(std::move(backend)), m_next(width, height), m_shown(width, height) {
+}
+
+FrameBuffer& ConsoleRenderer::BeginFrame() {
+    m_frameStart = std::chrono::steady_clock::now();
+    m_next.Clear(7);
+    return m_next;
+}
+
+void ConsoleRenderer::Present() {
+    m_runs.clear();
+    int cellsChanged = 0;
+
+    for (int row = 0; row < m_next.Height(); row++) {
+        int col = 0;
+        while (col < m_next.Width()) {
+            if (!m_fullRepaint && m_next.At(row, col) == m_shown.At(row, col)) {
+                col++;
+                continue;
+            }
+
+            int start = col;
+            int end = col + 1;      // One past the last changed cell
+            for (col = end; col < m_next.Width() && col < end + RUN_MERGE_GAP; col++) {
+                if (m_fullRepaint || m_next.At(row, col) != m_shown.At(row, col)) {
+                    cellsChanged++;
+                    end = col + 1;
+                }
+            }
+            cellsChanged++;
+            col = end;
+            m_runs.push_back({ row, start, end - start });
+        }
+    }
+
+    m_stats.bytesWritten = m_backend->Write(m_next, m_runs);
+    m_stats.cellsChanged = cellsChanged;
+    m_stats.frames++;
+    m_fullRepaint = false;
+    std::swap(m_next, m_shown);
+
+    m_stats.frameMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_frameStart).count();
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+// One character cell. attr uses Windows console colors: 1 blue, 2 green,
+// 4 red, 8 bright; both backends understand it.
+struct ConsoleCell {
+    char ch;
+    uint8_t attr;
+
+    bool operator==(const ConsoleCell& other) const { return ch == other.ch && attr == other.attr; }
+    bool operator!=(const ConsoleCell& other) const { return !(*this == other); }
+};
+
+// Off-screen frame: draw into it with printf-style calls, then hand it to
+// a ConsoleRenderer. Text past the right or bottom edge is dropped.
+class FrameBuffer {
+public:
+    FrameBuffer(int width, int height);
+
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+
+    // Blank every cell and move the cursor home
+    void Clear(uint8_t attr);
+
+    void SetColor(uint8_t attr) { m_attr = attr; }
+    void MoveTo(int row, int col);
+
+    // Write at the cursor in the current color; '\n' moves to the next row
+    void Print(const char* format, ...);
+    void Write(const char* text, size_t length);
+
+    const ConsoleCell& At(int row, int col) const { return m_cells[(size_t)row * m_width + col]; }
+
+private:
+    int m_width;
+    int m_height;
+    int m_row = 0;
+    int m_col = 0;
+    uint8_t m_attr = 7;
+    std::vector<ConsoleCell> m_cells;
+};
+
+// Consecutive changed cells on one row
+struct CellRun {
+    int row;
+    int col;
+    int length;
+};
+
+// Where frames go. Write() gets every changed run of a frame, emits them
+// with as few writes as the platform allows and returns the bytes written.
+class ConsoleBackend {
+public:
+    virtual ~ConsoleBackend() {}
+    virtual size_t Write(const FrameBuffer& frame, const std::vector<CellRun>& runs) = 0;
+};
+
+// ANSI/VT escape sequences to a stream; works on any terminal, including
+// Windows 10+ consoles with virtual terminal processing enabled
+class AnsiConsoleBackend : public ConsoleBackend {
+public:
+    explicit AnsiConsoleBackend(FILE* out);
+    size_t Write(const FrameBuffer& frame, const std::vector<CellRun>& runs) override;
+
+private:
+    FILE* m_out;
+    std::string m_buffer;       // Reused between frames
+    bool m_first = true;
+};
+
+#ifdef _WIN32
+// One WriteConsoleOutput rectangle per changed run, from one buffer per frame
+class Win32ConsoleBackend : public ConsoleBackend {
+public:
+    explicit Win32ConsoleBackend(HANDLE console);
+    size_t Write(const FrameBuffer& frame, const std::vector<CellRun>& runs) override;
+
+private:
+    HANDLE m_console;
+    std::vector<CHAR_INFO> m_buffer;    // Reused between frames
+};
+#endif
+
+// Cost of the last presented frame
+struct RenderStats {
+    uint64_t frames;
+    double frameMs;             // BeginFrame() to the end of Present()
+    size_t bytesWritten;
+    int cellsChanged;
+};
+
+// Double-buffered renderer: diffs each frame against the previous one and
+// sends only the changed runs to the backend
+class ConsoleRenderer {
+public:
+    ConsoleRenderer(std::unique_ptr<ConsoleBackend> backend, int width, int height);
+
+    // Start a frame: returns the cleared buffer to draw into
+    FrameBuffer& BeginFrame();
+    void Present();
+
+    // Repaint everything next frame, e.g. after something else wrote to the console
+    void Invalidate() { m_fullRepaint = true; }
+
+    const RenderStats& Stats() const { return m_stats; }
+
+private:
+    std::unique_ptr<ConsoleBackend> m_backend;
+    FrameBuffer m_next;
+    FrameBuffer m_shown;
+    std::vector<CellRun> m_runs;
+    bool m_fullRepaint = true;
+    std::chrono::steady_clock::time_point m_frameStart;
+    RenderStats m_stats = {};
+};
@@ -3,17 +3,47 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <iphlpapi.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <iostream>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <vector>
 #include <conio.h>
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <sstream>
 #include <algorithm>
 #include <regex>
 
+#include "AnomalyDetector.h"
+#include "CacheControl.h"
+#include "CacheSnoop.h"
+#include "CacheSource.h"
+#include "ConnectProbe.h"
+#include "ConsoleRenderer.h"
+#include "DnsClient.h"
+#include "EntryIndex.h"
+#include "EntryTable.h"
+#include "EventLoop.h"
+#include "FleetSender.h"
+#include "LatencyHistogram.h"
+#include "MetricsServer.h"
+#include "ProbeEngine.h"
+#include "ProbeScheduler.h"
+#include "ProbeStore.h"
+#include "RateLimit.h"
+#include "ResolverCompare.h"
+#include "TraceFile.h"
+
 // Link with libraries
 #pragma comment(lib, "ws2_32.lib")
 #pragma comment(lib, "iphlpapi.lib")
@@ -28,16 +58,34 @@
 #define COLOR_WHITE     15
 #define COLOR_GRAY      8
 
-// Cache entry structure
-struct CacheEntry {
-    std::string hostname;
-    std::string recordType;
-    std::string ipAddress;
-    int ttl;
-    DWORD lastResponseTime;
-    bool isReachable;
-    bool isStale;
+// Probe bookkeeping for one cache entry, row for row with g_entries. The
+// hostname, address, TTL, last response time and status flags live in the
+// table's columns; this is what only the monitor's probe paths read.
+struct EntryProbeState {
+    int failures;                   // Consecutive failed probes
+    PackedAddress upstreamAddress;  // First address from the last direct probe
     std::chrono::steady_clock::time_point lastTested;
+    std::chrono::steady_clock::time_point expiresAt;    // When the cached TTL runs out
+    std::shared_ptr<LatencyHistogram> latency;          // Every probe of this entry
+    uint32_t storeId;                                   // Host id in the probe store
+    uint32_t lookups;                                   // Times the cache was seen refilling the name
+    std::chrono::steady_clock::time_point connectStarted;   // Start of the latest connect round
+    int connectExpected;                                // Attempts in that round
+    int connectSeen;                                    // Of which finished
+    ConnectOutcome connectOutcome;                      // Best outcome so far; valid once connectTested
+    uint32_t connectMs;                                 // Its connect time
+    bool connectTested;
+    HostDetector detector;                              // Latency and failure baselines; reset when the address changes
+    uint32_t fleetProbes;                               // Probes since the last fleet report
+    uint32_t fleetFailures;                             // Of those, how many got no usable answer
+};
+
+// Outcome of merging a fresh cache snapshot into the current list
+struct RefreshDelta {
+    int added;          // New hostname/record pairs, queued for testing
+    int removed;        // Gone from the cache
+    int changed;        // Cached address changed, history reset and queued for testing
+    int unchanged;      // Probe history carried over
 };
 
 // Cache statistics
@@ -47,24 +95,219 @@ struct CacheStats {
     int staleEntries;
     int timeoutEntries;
     int slowEntries;
+    int changedEntries;
+    int negativeEntries;    // Cached NXDOMAIN, counted apart from reachable and timeouts
+    int unreachableEntries; // Resolve, but refused or ignored every connect probe
     double avgResponseTime;
     double healthPercentage;
     int pagesTotal;
     int currentPage;
-    bool needsFlush;
+    bool needsFlush;        // The whole cache's latency or failure rate has shifted up
+    int activeAlerts;       // Hosts and the global series currently alerting
+};
+
+// One row of the entry table as published to the UI
+struct EntryRow {
+    std::string hostname;
+    RecordKind kind;
+    std::string ipAddress;      // First address
+    int moreAddresses;          // Further addresses of the same type
+    std::string target;         // CNAME target
+    uint32_t ttl;
+    DWORD lastResponseTime;
+    bool isReachable;
+    bool isStale;
+    bool addressChanged;
+    bool isNegative;
+    bool isUnreachable;
+    bool connectTested;
+    ConnectOutcome connectOutcome;
+    uint32_t connectMs;
+    LatencySnapshot history;    // Copy of the entry's histogram at publish time
+};
+
+// Everything the UI draws. Built by the monitor thread after each cycle and
+// never modified once published, so the UI thread can draw it without locks.
+struct MonitorSnapshot {
+    CacheStats stats;
+    std::vector<EntryRow> page;             // Entries on the current page
+    EntryView view;                         // Which entries are paged through, in what order
+    size_t viewEntries;                     // How many the view has
+    ProbeEngineStats probeStats;            // Active probe backend
+    double probeRate;                       // Its adaptive rate, window and ceiling
+    int probeWindow;
+    double probeCeiling;
+    RateTrend probeTrend;
+    uint32_t probeIntervalP95;              // Last interval the rate controller judged
+    double probeIntervalTimeouts;
+    bool connectProbes;
+    ProbeEngineStats connectStats;
+    bool evicted;                           // lastEviction is set
+    EvictionReport lastEviction;
+    std::vector<AnomalyAlert> alerts;       // Top alerts, active ones by score first
+    bool directProbes;
+    std::string directServer;
+    RefreshDelta lastRefresh;
+    LatencySnapshot shortWindow;
+    LatencySnapshot longWindow;
+    bool paused;
+    bool refreshing;                        // Parser thread is reading the cache
+};
+
+// Requests from the UI thread to the monitor thread
+enum class MonitorCommand {
+    TogglePause,
+    ToggleDirect,
+    NextPage,
+    PreviousPage,
+    NextFilter,
+    NextSort,
+    SetSuffix,      // To g_commandSuffix
+    Evict
+};
+
+// Formats the metrics server can ask the monitor thread for
+enum class ExportFormat {
+    Prometheus,
+    HostLines,      // One JSON object per cache entry
+    Alerts          // One JSON object per alert, ranked
+};
+
+// A pending export; the requesting thread waits until done
+struct ExportRequest {
+    ExportFormat format;
+    std::string body;
+    bool done;
+};
+
+// Requests to the parser thread, most drastic wins
+enum class ParseRequest {
+    None,
+    Refresh,
+    Evict,      // Evict the planned entries and warm up, then refresh
+    Flush       // Flush the OS cache, then refresh and start over
 };
 
-// Global variables
-static BOOL g_shouldExit = FALSE;
+// Global variables. Three threads: the UI thread (main) draws published
+// snapshots and turns keys into commands; the parser thread reads the OS
+// cache; the monitor thread owns the cache list and everything probe related.
+static std::atomic<bool> g_shouldExit{ false };
 static HANDLE g_exitEvent = NULL;
-static std::vector<CacheEntry> g_cacheEntries;
-static CacheStats g_stats = { 0 };
 static HANDLE g_consoleHandle = NULL;
-static bool g_pauseMonitoring = false;
+static std::atomic<bool> g_pauseMonitoring{ false };
+static std::unique_ptr<ConsoleRenderer> g_renderer;        // UI thread only
+static EventLoop g_uiLoop;                                 // The UI thread blocks on it; Wake() when a snapshot is published
+static double g_uiWakeupsPerSec = 0;                       // UI thread only
+static bool g_editingSuffix = false;                       // UI thread only: typing a domain after [/]
+static std::string g_suffixInput;                          // UI thread only: empty each time [/] starts
+static const int SCREEN_WIDTH = 90;
+static const int SCREEN_HEIGHT = 40;
+
+// Monitor thread only
+static EntryTable g_entries;                         // The cache list, indexed by hostname and record type
+static std::vector<EntryProbeState> g_entryState;   // Row for row with g_entries
+static std::vector<uint32_t> g_probeRow;            // Row probed on each row's behalf: itself, or where its CNAME chain ends
+static std::vector<uint32_t> g_aliasStart;          // Aliases of row r are g_aliasRows[g_aliasStart[r] .. g_aliasStart[r + 1])
+static std::vector<uint32_t> g_aliasRows;
+static RefreshDelta g_lastRefresh = { 0 };
+static EvictionReport g_lastEviction = {};
+static bool g_evicted = false;
+static CacheStats g_stats = { 0 };
 static int g_currentPage = 0;
+static AnomalyDetector g_anomalies;                 // Fed by every probe; the detectors live in g_entryState
+static uint64_t g_changes = 0;                      // Bumped by anything the UI shows; a snapshot is due when it moves
+
+// Hand-offs between threads
+static std::shared_ptr<const MonitorSnapshot> g_snapshot;   // Latest published; std::atomic_load/store only
+static std::mutex g_monitorLock;                            // Guards the next seven
+static std::condition_variable g_monitorWake;
+static std::vector<MonitorCommand> g_commands;
+static std::string g_commandSuffix;                         // For MonitorCommand::SetSuffix
+static std::vector<ExportRequest*> g_exportRequests;
+static std::condition_variable g_exportDone;
+static EntryTable g_parsedEntries;
+static bool g_parsedReady = false;
+static bool g_resultsReady = false;                         // An engine queued a probe result
+static bool g_parsedReset = false;                          // Parsed after a flush; drop history
+static EvictionReport g_parsedEviction = {};
+static bool g_parsedEvicted = false;                        // Parsed after an eviction; g_parsedEviction is its report
+static std::mutex g_parseLock;                              // Guards the next three
+static std::condition_variable g_parseWake;
+static ParseRequest g_parseRequest = ParseRequest::Refresh; // Initial load
+static EvictionPlan g_evictionPlan;                         // For ParseRequest::Evict
+static std::atomic<bool> g_parsing{ false };
+
 static const int ENTRIES_PER_PAGE = 8;
 static const int TEST_TIMEOUT_MS = 3000;
 static const int SLOW_RESPONSE_THRESHOLD = 200;
+static const int MAX_CNAME_CHAIN = 8;              // Longer chains are treated as loops
+static const int MAX_SNOOP_LISTED = 50;            // Names --snoop lists before it only counts them
+static const int PROBE_CONCURRENCY = 16;
+static const int PROBE_QUEUE_DEPTH = PROBE_CONCURRENCY * 2;
+static const int AUTO_REFRESH_INTERVAL_MS = 10000;
+static const int MONITOR_EXPIRY_CHECK_MS = 250;    // Monitor cycle while getaddrinfo probes are in flight; only Poll() expires them
+static const int UI_FRAME_MS = 50;                 // Least time between redraws
+static const int UI_HEARTBEAT_MS = 1000;           // A snapshot at least this often, for the clock and the rates
+static const size_t MAX_SUFFIX_INPUT = 64;         // Longest domain typed after [/]
+static const double DEFAULT_PROBE_BUDGET = 50.0;   // Ceiling on probes started per second
+static ProbeScheduler g_scheduler;                 // Entries not currently being probed, by due time
+static ProbeSchedulePolicy g_schedulePolicy;
+static EntryTally g_tally(SLOW_RESPONSE_THRESHOLD); // Health counts of g_entries, kept current by SetEntryResult()
+static EntryIndex g_index(SLOW_RESPONSE_THRESHOLD); // Filtered and sorted views of g_entries, kept current the same way
+static EntryView g_view;                           // Monitor thread only, like the rest of the paging state
+static size_t g_viewEntries = 0;
+static std::vector<uint32_t> g_pageRows;           // Rows on the current page of g_view
+
+// Probe pacing for one resolver path. The rate controller moves the bucket's
+// rate and the probe window; neither ever goes past the ceiling.
+struct ProbeBudget {
+    AdaptiveRate control;
+    TokenBucket bucket;
+};
+
+ProbeBudget MakeProbeBudget() {
+    AdaptiveRateConfig config;
+    config.maxRate = DEFAULT_PROBE_BUDGET;
+    config.maxWindow = PROBE_QUEUE_DEPTH;
+    config.latencyTarget = SLOW_RESPONSE_THRESHOLD;
+    config.cooldown = std::chrono::milliseconds(TEST_TIMEOUT_MS);
+    AdaptiveRate control(config);
+    return { control, TokenBucket(control.Rate(), PROBE_QUEUE_DEPTH) };
+}
+
+static ProbeBudget g_systemBudget = MakeProbeBudget();    // Lookups through the OS resolver
+static ProbeBudget g_directBudget = MakeProbeBudget();    // Queries straight to the DNS server
+static const int LATENCY_SLOT_SECONDS = 10;
+static const int LATENCY_SHORT_WINDOW = 60;        // Seconds shown in the health panel
+static const int LATENCY_LONG_WINDOW = 900;
+static LatencyWindow g_latencyWindow(LATENCY_SLOT_SECONDS, LATENCY_LONG_WINDOW / LATENCY_SLOT_SECONDS);
+static std::unique_ptr<ProbeEngine> g_probeEngine;
+static std::unique_ptr<DnsClient> g_dnsClient;     // Null when no DNS server was found
+static bool g_directProbes = false;                // Query the server directly instead of getaddrinfo
+static bool g_headless = false;                    // No console UI; results go to the metrics server
+static const int MONITOR_IDLE_MAX_MS = 1000;       // Monitor sleep cap when nothing is due
+static const int EXPORT_TIMEOUT_MS = 5000;
+static LatencyHistogram g_latencyTotal;            // Every probe since start, for the Prometheus histogram
+static std::unique_ptr<MetricsServer> g_metricsServer;
+static const char* DEFAULT_STORE_PATH = "dnsmonitor";  // What --query reads when not given --store
+static const uint64_t DEFAULT_STORE_RECORDS = 1 << 20;  // 32 MB; about two days at 5 probes/sec
+static std::unique_ptr<ProbeStore> g_probeStore;    // Null when history is disabled
+static std::unique_ptr<ConnectProbe> g_connectProbe;   // Null unless --connect
+static std::vector<uint16_t> g_connectPorts = { 443 }; // Tried on every cached address
+static std::unordered_map<std::string, std::vector<uint16_t>> g_hostPorts;  // --connect-port: "host" or "*.domain"
+static const int MAX_CONNECT_ADDRESSES = 4;        // Addresses per entry in one connect round
+static const int CONNECT_IN_FLIGHT = 4096;
+static std::shared_ptr<CacheControl> g_cacheControl;   // The OS resolver cache; parser thread only
+static std::unique_ptr<CacheSource> g_cacheSource(     // Parser thread only once it runs
+    new CommandCacheSource(CacheFormat::DisplayDns, DefaultCacheCommand(CacheFormat::DisplayDns)));
+static bool g_localCache = true;                    // The source is this machine's cache, which [F] and [X] act on
+static const size_t PARTIAL_SNAPSHOT_ROWS = 4096;   // First hand-over of a load the monitor waits on; then every doubling
+static std::unique_ptr<TraceWriter> g_traceWriter;  // Null unless --record; monitor thread only
+static std::chrono::steady_clock::time_point g_traceStart;
+static int g_warmCount = 32;                        // Names looked up again after an eviction
+static std::unique_ptr<FleetSender> g_fleetSender;  // Null unless --report; Submit() from the monitor thread
+static int g_fleetIntervalSeconds = 10;
+static std::chrono::steady_clock::time_point g_nextFleetReport;
 
 // Console utilities
 void SetConsoleColor(int color) {
@@ -72,253 +315,625 @@ void SetConsoleColor(int color) {
 }
 
 void SetConsoleSize() {
-    system("mode con: cols=90 lines=25");
+    char command[64];
+    snprintf(command, sizeof(command), "mode con: cols=%d lines=%d", SCREEN_WIDTH, SCREEN_HEIGHT);
+    system(command);
 }
 
-// Parse DNS cache output
-std::vector<CacheEntry> ParseDNSCache() {
-    std::vector<CacheEntry> entries;
-
-    // Create a temporary file to capture ipconfig output
-    char tempFile[MAX_PATH];
-    GetTempPathA(MAX_PATH, tempFile);
-    strcat_s(tempFile, "dns_cache_temp.txt");
+// Read the cache through the configured source, streaming the dump into a
+// table as it arrives. With onPartial, the table so far is also handed over
+// once it reaches PARTIAL_SNAPSHOT_ROWS rows and again each time it doubles.
+EntryTable ParseDNSCache(const std::function<void(const EntryTable&)>& onPartial = nullptr) {
+    EntryTable entries;
+    size_t nextPartial = PARTIAL_SNAPSHOT_ROWS;
+    g_cacheSource->Read([&](const CacheRecord& record) {
+        AddCacheRecord(entries, record);
+        if (onPartial && entries.Size() >= nextPartial) {
+            onPartial(entries);
+            nextPartial = entries.Size() * 2;
+        }
+    }, &g_shouldExit);
+    return entries;
+}
 
-    std::string command = "ipconfig /displaydns > ";
-    command += tempFile;
-    system(command.c_str());
+bool OnScreen(size_t row) {
+    return std::find(g_pageRows.begin(), g_pageRows.end(), (uint32_t)row) != g_pageRows.end();
+}
 
-    // Read the file
-    FILE* file = nullptr;
-    fopen_s(&file, tempFile, "r");
-    if (!file) return entries;
+// (Re)queue an entry on the scheduler unless a probe for it is in flight.
+// An alias queues the row probed on its behalf, which is on screen if any
+// of its aliases is.
+void ScheduleEntry(size_t index) {
+    index = g_probeRow[index];
+    if (g_entries.Flags(index) & ENTRY_PENDING) return;
+
+    const EntryProbeState& state = g_entryState[index];
+    ProbeUrgency urgency;
+    urgency.lastTested = state.lastTested;
+    urgency.expiresAt = state.expiresAt;
+    urgency.failures = state.failures;
+    urgency.visible = OnScreen(index);
+    for (uint32_t i = g_aliasStart[index]; i < g_aliasStart[index + 1] && !urgency.visible; i++) {
+        urgency.visible = OnScreen(g_aliasRows[i]);
+    }
+    g_scheduler.Schedule(index, ProbeDueTime(urgency, g_schedulePolicy));
+}
 
-    char line[1024];
-    CacheEntry currentEntry;
-    bool inEntry = false;
+// Find the rows on the current page of the view, moving the page back if
+// the view got shorter, and requeue the rows that came into or went out of
+// sight. Cheap enough to run before every snapshot.
+void UpdatePage() {
+    std::vector<uint32_t> rows;
+    g_viewEntries = g_index.Query(g_entries, g_view, (size_t)g_currentPage * ENTRIES_PER_PAGE, ENTRIES_PER_PAGE, rows);
+    int pages = (int)((g_viewEntries + ENTRIES_PER_PAGE - 1) / ENTRIES_PER_PAGE);
+    if (g_currentPage > 0 && g_currentPage >= pages) {
+        g_currentPage = pages > 0 ? pages - 1 : 0;
+        rows.clear();
+        g_index.Query(g_entries, g_view, (size_t)g_currentPage * ENTRIES_PER_PAGE, ENTRIES_PER_PAGE, rows);
+    }
+    if (rows == g_pageRows) return;
 
-    while (fgets(line, sizeof(line), file)) {
-        std::string lineStr(line);
+    rows.swap(g_pageRows);
+    for (uint32_t row : rows) {
+        if (row < g_entries.Size()) ScheduleEntry(row);
+    }
+    for (uint32_t row : g_pageRows) {
+        ScheduleEntry(row);
+    }
+}
 
-        // Remove trailing newline
-        if (!lineStr.empty() && lineStr.back() == '\n') {
-            lineStr.pop_back();
-        }
-        if (!lineStr.empty() && lineStr.back() == '\r') {
-            lineStr.pop_back();
+// Where a CNAME chain ends: the target's A, AAAA or NXDOMAIN row, else the
+// last CNAME whose target is not cached. A loop, or a chain longer than
+// MAX_CNAME_CHAIN, ends at the alias itself. Other rows end at themselves.
+size_t ChainEnd(size_t row) {
+    size_t current = row;
+    for (int depth = 0; depth < MAX_CNAME_CHAIN; depth++) {
+        uint32_t target;
+        if (g_entries.Kind(current) != RecordKind::CNAME || !g_entries.TargetId(current, target)) return current;
+
+        size_t next;
+        if (g_entries.FindHostId(target, RecordKind::A, next) || g_entries.FindHostId(target, RecordKind::AAAA, next) ||
+            g_entries.FindHostId(target, RecordKind::NameError, next)) {
+            return next;
         }
+        if (!g_entries.FindHostId(target, RecordKind::CNAME, next)) return current;
+        current = next;
+    }
+    return row;
+}
 
-        // Skip empty lines and headers
-        if (lineStr.empty() || lineStr.find("Windows IP Configuration") != std::string::npos) {
-            continue;
+// Change a row's flags and response time. Everything that does so after a
+// merge goes through here so the health counts stay current without a rescan.
+void SetEntryResult(size_t row, uint8_t flags, uint32_t responseMs) {
+    uint8_t oldFlags = g_entries.Flags(row);
+    uint32_t oldResponseMs = g_entries.ResponseMs(row);
+    g_entries.Flags(row) = flags;
+    g_entries.ResponseMs(row) = responseMs;
+    g_tally.Update(g_entries, row, oldFlags, oldResponseMs);
+    g_index.Update(g_entries, row, oldFlags, oldResponseMs);
+    g_changes++;
+}
+
+// Give an alias the latest result of the row probed on its behalf
+void CopyProbeResult(size_t from, size_t to) {
+    const uint8_t shared = ENTRY_REACHABLE | ENTRY_CHANGED | ENTRY_NEGATIVE | ENTRY_UNREACHABLE;
+    SetEntryResult(to, (g_entries.Flags(to) & ~shared) | (g_entries.Flags(from) & shared), g_entries.ResponseMs(from));
+}
+
+// Rebuild the alias graph after the entry list changed. Each row is probed
+// through the end of its chain, so aliases of a shared target cost one
+// probe; they also share its history.
+void ResolveAliases() {
+    size_t rows = g_entries.Size();
+    g_probeRow.resize(rows);
+    g_aliasStart.assign(rows + 1, 0);
+    for (size_t row = 0; row < rows; row++) {
+        g_probeRow[row] = (uint32_t)ChainEnd(row);
+        if (g_probeRow[row] != row) {
+            g_aliasStart[g_probeRow[row] + 1]++;
         }
+    }
+    for (size_t row = 0; row < rows; row++) {
+        g_aliasStart[row + 1] += g_aliasStart[row];
+    }
 
-        // Check for separator lines
-        if (lineStr.find("-------") != std::string::npos) {
-            if (inEntry && !currentEntry.hostname.empty()) {
-                entries.push_back(currentEntry);
+    g_aliasRows.resize(g_aliasStart[rows]);
+    std::vector<uint32_t> next(g_aliasStart.begin(), g_aliasStart.end() - 1);
+    for (size_t row = 0; row < rows; row++) {
+        size_t probe = g_probeRow[row];
+        if (probe == row) {
+            // No longer the alias of a negative entry
+            if (g_entries.Kind(row) != RecordKind::NameError) {
+                SetEntryResult(row, g_entries.Flags(row) & ~ENTRY_NEGATIVE, g_entries.ResponseMs(row));
             }
-            currentEntry = CacheEntry();
-            inEntry = true;
             continue;
         }
+        g_aliasRows[next[probe]++] = (uint32_t)row;
+        g_entryState[row].latency = g_entryState[probe].latency;
+        CopyProbeResult(probe, row);
+    }
+}
+
+// Merge a fresh snapshot into g_entries. Unchanged entries keep their
+// probe history; only added entries and entries whose address changed come
+// in untested, so a refresh does not trigger a full re-probe.
+RefreshDelta MergeCacheSnapshot(EntryTable& snapshot) {
+    RefreshDelta delta = { 0 };
+    auto now = std::chrono::steady_clock::now();
+    auto forceTest = now - std::chrono::minutes(10);    // Due as soon as it is merged in
+    std::vector<EntryProbeState> states(snapshot.Size());
+    std::vector<uint32_t> previousRows(snapshot.Size(), EntryIndex::NO_ROW);
+
+    for (size_t row = 0; row < snapshot.Size(); row++) {
+        EntryProbeState& state = states[row];
+        size_t current;
+        bool known = g_entries.Find(snapshot.Hostname(row), snapshot.Kind(row), current);
+        if (known) {
+            previousRows[row] = (uint32_t)current;
+        }
 
-        if (inEntry) {
-            // Parse record name
-            if (lineStr.find("Record Name") != std::string::npos) {
-                size_t colonPos = lineStr.find(':');
-                if (colonPos != std::string::npos) {
-                    currentEntry.hostname = lineStr.substr(colonPos + 1);
-                    // Trim whitespace
-                    currentEntry.hostname.erase(0, currentEntry.hostname.find_first_not_of(" \t"));
-                    currentEntry.hostname.erase(currentEntry.hostname.find_last_not_of(" \t") + 1);
-                }
-            }
-            // Parse record type
-            else if (lineStr.find("Record Type") != std::string::npos) {
-                size_t colonPos = lineStr.find(':');
-                if (colonPos != std::string::npos) {
-                    currentEntry.recordType = lineStr.substr(colonPos + 1);
-                    currentEntry.recordType.erase(0, currentEntry.recordType.find_first_not_of(" \t"));
-                    currentEntry.recordType.erase(currentEntry.recordType.find_last_not_of(" \t") + 1);
-                }
+        if (known && snapshot.Target(row) == g_entries.Target(current) && snapshot.SameAddresses(row, g_entries, current)) {
+            delta.unchanged++;
+            state = std::move(g_entryState[current]);
+            // A TTL that went up means the name expired and something resolved it again
+            if (snapshot.Ttl(row) > g_entries.Ttl(current)) {
+                state.lookups++;
             }
-            // Parse TTL
-            else if (lineStr.find("Time To Live") != std::string::npos) {
-                size_t colonPos = lineStr.find(':');
-                if (colonPos != std::string::npos) {
-                    std::string ttlStr = lineStr.substr(colonPos + 1);
-                    ttlStr.erase(0, ttlStr.find_first_not_of(" \t"));
-                    currentEntry.ttl = atoi(ttlStr.c_str());
-                }
+            snapshot.ResponseMs(row) = g_entries.ResponseMs(current);
+            snapshot.Flags(row) = (g_entries.Flags(current) & ~ENTRY_STALE) | (snapshot.Flags(row) & ENTRY_STALE);
+        }
+        else {
+            if (known) {
+                delta.changed++;
+                state.storeId = g_entryState[current].storeId;
+                state.lookups = g_entryState[current].lookups + 1;
             }
-            // Parse IP address (A record)
-            else if (lineStr.find("A (Host) Record") != std::string::npos) {
-                size_t colonPos = lineStr.find(':');
-                if (colonPos != std::string::npos) {
-                    currentEntry.ipAddress = lineStr.substr(colonPos + 1);
-                    currentEntry.ipAddress.erase(0, currentEntry.ipAddress.find_first_not_of(" \t"));
-                    currentEntry.ipAddress.erase(currentEntry.ipAddress.find_last_not_of(" \t") + 1);
-                }
+            else {
+                delta.added++;
+                state.storeId = g_probeStore ? g_probeStore->HostId(std::string(snapshot.Hostname(row))) : 0;
+                state.lookups = 1;
             }
+            state.failures = 0;
+            state.lastTested = forceTest;
+            state.latency = std::make_shared<LatencyHistogram>();
+            state.connectExpected = 0;
+            state.connectSeen = 0;
+            state.connectTested = false;
         }
+        state.expiresAt = now + std::chrono::seconds(snapshot.Ttl(row));
     }
+    delta.removed = (int)g_entries.Size() - delta.changed - delta.unchanged;
+
+    std::swap(g_entries, snapshot);
+    g_entryState.swap(states);
+    g_tally.Rebuild(g_entries);
+    g_index.Rebuild(g_entries, &previousRows);
+    ResolveAliases();
+
+    // Positions moved, so find the page again and requeue everything;
+    // in-flight entries requeue when their result lands
+    g_pageRows.clear();
+    UpdatePage();
+    g_scheduler.Clear();
+    for (size_t i = 0; i < g_entries.Size(); i++) {
+        ScheduleEntry(i);
+    }
+    return delta;
+}
 
-    // Add the last entry
-    if (inEntry && !currentEntry.hostname.empty()) {
-        entries.push_back(currentEntry);
+// Defined with the metrics export below
+void StreamHostStatus(size_t row);
+void StreamCacheStats();
+void StreamEviction();
+
+// Name an entry goes by on the alert board: the hostname, with the record
+// type appended for anything but A, so a host's A and AAAA alerts stay apart
+std::string AlertHost(size_t row) {
+    std::string host(g_entries.Hostname(row));
+    if (g_entries.Kind(row) != RecordKind::A) {
+        host += '/';
+        host += RecordKindName(g_entries.Kind(row));
     }
+    return host;
+}
 
-    fclose(file);
-    DeleteFileA(tempFile);
+// The probed entry an alert board name belongs to; false if it is gone
+bool FindAlertRow(const std::string& host, size_t& row) {
+    size_t slash = host.find('/');
+    RecordKind kind = RecordKind::A;
+    if (slash != std::string::npos) {
+        std::string type = host.substr(slash + 1);
+        kind = type == "AAAA" ? RecordKind::AAAA : type == "CNAME" ? RecordKind::CNAME : RecordKind::Other;
+    }
+    return g_entries.Find(std::string_view(host).substr(0, slash), kind, row) && g_probeRow[row] == row;
+}
 
-    // Filter for A records only and remove duplicates
-    std::vector<CacheEntry> filteredEntries;
-    std::map<std::string, bool> seenHosts;
+// Milliseconds since recording started
+uint64_t TraceTime() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - g_traceStart).count();
+}
 
-    for (const auto& entry : entries) {
-        if (entry.recordType == "1" || entry.recordType.find("A") != std::string::npos) {
-            if (!entry.hostname.empty() && !entry.ipAddress.empty()) {
-                if (seenHosts.find(entry.hostname) == seenHosts.end()) {
-                    seenHosts[entry.hostname] = true;
-                    CacheEntry newEntry = entry;
-                    newEntry.lastResponseTime = 0;
-                    newEntry.isReachable = false;
-                    newEntry.isStale = (entry.ttl <= 0);
-                    newEntry.lastTested = std::chrono::steady_clock::now() - std::chrono::minutes(10); // Force initial test
-                    filteredEntries.push_back(newEntry);
-                }
-            }
+// Merge the parser thread's latest result, if any
+void ApplyParsedEntries() {
+    EntryTable parsed;
+    bool reset;
+    bool evicted;
+    {
+        std::lock_guard<std::mutex> lock(g_monitorLock);
+        if (!g_parsedReady) return;
+        std::swap(parsed, g_parsedEntries);
+        reset = g_parsedReset;
+        evicted = g_parsedEvicted;
+        if (evicted) {
+            g_lastEviction = g_parsedEviction;
+            g_evicted = true;
         }
+        g_parsedReady = false;
+        g_parsedReset = false;
+        g_parsedEvicted = false;
+    }
+    if (evicted) {
+        StreamEviction();
     }
 
-    return filteredEntries;
+    if (g_traceWriter) {
+        g_traceWriter->WriteSnapshot(TraceTime(), parsed);
+    }
+    if (reset) {
+        g_entries.Clear();
+        g_entryState.clear();
+        g_scheduler.Clear();
+    }
+    g_lastRefresh = MergeCacheSnapshot(parsed);
+    g_changes++;
+
+    // Entries that left, or came back with a new address and a fresh detector, cannot clear their own alerts
+    g_anomalies.Prune([](const AnomalyAlert& alert) {
+        size_t row;
+        if (!FindAlertRow(alert.host, row)) return false;
+        const HostDetector& detector = g_entryState[row].detector;
+        return alert.kind == AlertKind::Latency ? detector.latency.alarm : detector.failures.alarm;
+    }, time(nullptr));
+    StreamCacheStats();
 }
 
-// Test connectivity to a cached entry
-DWORD TestCacheEntry(const std::string& hostname) {
-    auto startTime = std::chrono::steady_clock::now();
+// Find the entry a probe result belongs to. Refreshes can move entries, so
+// fall back to the index; false if the entry is gone or is now an alias.
+bool FindProbedEntry(size_t index, const std::string& hostname, size_t& row) {
+    if (index < g_entries.Size() && g_entries.Hostname(index) == hostname && g_probeRow[index] == index) {
+        row = index;
+        return true;
+    }
+    for (RecordKind kind : { RecordKind::A, RecordKind::AAAA, RecordKind::CNAME, RecordKind::NameError }) {
+        if (g_entries.Find(hostname, kind, row) && g_probeRow[row] == row) return true;
+    }
+    return false;
+}
 
-    struct addrinfo hints = { 0 };
-    struct addrinfo* result = nullptr;
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+// Hand a probe result on to the aliases it was made for
+void UpdateAliases(size_t row) {
+    for (uint32_t i = g_aliasStart[row]; i < g_aliasStart[row + 1]; i++) {
+        CopyProbeResult(row, g_aliasRows[i]);
+        StreamHostStatus(g_aliasRows[i]);
+    }
+}
 
-    // Set a timeout for the DNS lookup
-    int status = getaddrinfo(hostname.c_str(), nullptr, &hints, &result);
+// "443,80" into ports; false, leaving ports alone, unless every item is a valid port
+bool ParsePortList(const char* text, std::vector<uint16_t>& ports) {
+    std::vector<uint16_t> parsed;
+    while (*text) {
+        char* end;
+        long port = strtol(text, &end, 10);
+        if (end == text || port <= 0 || port > 65535 || (*end != ',' && *end != '\0')) return false;
+        parsed.push_back((uint16_t)port);
+        text = *end == ',' ? end + 1 : end;
+    }
+    if (parsed.empty()) return false;
+    ports = std::move(parsed);
+    return true;
+}
 
-    auto endTime = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-    DWORD responseTime = static_cast<DWORD>(duration.count());
+// Ports to connect to on a host's addresses: its own --connect-port list, the
+// list of the closest "*.domain" pattern that covers it, or the default
+const std::vector<uint16_t>& ConnectPortsFor(std::string_view hostname) {
+    auto it = g_hostPorts.find(std::string(hostname));
+    if (it != g_hostPorts.end()) return it->second;
 
-    if (result) {
-        freeaddrinfo(result);
+    for (size_t dot = hostname.find('.'); dot != std::string_view::npos; dot = hostname.find('.', dot + 1)) {
+        it = g_hostPorts.find("*" + std::string(hostname.substr(dot)));
+        if (it != g_hostPorts.end()) return it->second;
     }
+    return g_connectPorts;
+}
 
-    // Return timeout if it takes too long or fails
-    if (status != 0 || responseTime > TEST_TIMEOUT_MS) {
-        return MAXDWORD;
+// Connect to an entry's cached addresses after its name was probed. Rounds
+// never overlap, so every connect result belongs to the latest one.
+void StartConnectRound(size_t row, std::chrono::steady_clock::time_point now) {
+    RecordKind kind = g_entries.Kind(row);
+    if (!g_connectProbe || (kind != RecordKind::A && kind != RecordKind::AAAA)) return;
+
+    EntryProbeState& state = g_entryState[row];
+    if (state.connectSeen < state.connectExpected &&
+        now < state.connectStarted + std::chrono::milliseconds(g_connectProbe->Config().deadlineMs)) {
+        return;
     }
 
-    return responseTime;
+    std::string hostname(g_entries.Hostname(row));
+    const std::vector<uint16_t>& ports = ConnectPortsFor(hostname);
+    std::vector<PackedAddress> addresses;
+    g_entries.Addresses(row, addresses);
+    addresses.resize((std::min)(addresses.size(), (size_t)MAX_CONNECT_ADDRESSES));
+
+    state.connectStarted = now;
+    state.connectExpected = (int)(addresses.size() * ports.size());
+    state.connectSeen = 0;
+    for (const auto& address : addresses) {
+        for (uint16_t port : ports) {
+            g_connectProbe->Submit(row, hostname, address, port);
+        }
+    }
 }
 
-// Update cache entry statuses
-void UpdateCacheEntries() {
-    if (g_cacheEntries.empty()) return;
-
-    auto now = std::chrono::steady_clock::now();
-
-    // Test more entries each cycle, but prioritize untested ones
-    int testsPerCycle = min(10, (int)g_cacheEntries.size());
-    static int testIndex = 0;
+// Apply finished connect attempts. An entry is unreachable once a whole
+// round has come back without a single connection.
+void CollectConnectResults() {
+    if (!g_connectProbe) return;
+
+    std::vector<ConnectResult> results;
+    g_connectProbe->Poll(results);
+    for (const auto& result : results) {
+        // Refreshes can move entries; results for addresses no longer cached are dropped
+        size_t row = result.id;
+        if (row >= g_entries.Size() || g_entries.Hostname(row) != result.hostname || !g_entries.HasAddress(row, result.address)) {
+            RecordKind kind = result.address.IsV4() ? RecordKind::A : RecordKind::AAAA;
+            if (!g_entries.Find(result.hostname, kind, row) || !g_entries.HasAddress(row, result.address)) continue;
+        }
 
-    // First, try to find untested entries
-    std::vector<int> untestedIndices;
-    for (int i = 0; i < g_cacheEntries.size(); i++) {
-        auto timeSinceTest = std::chrono::duration_cast<std::chrono::seconds>(now - g_cacheEntries[i].lastTested);
-        if (timeSinceTest.count() > 300) { // Haven't been tested in 5 minutes
-            untestedIndices.push_back(i);
+        EntryProbeState& state = g_entryState[row];
+        if (state.connectSeen == 0 || result.outcome < state.connectOutcome ||
+            (result.outcome == state.connectOutcome && result.connectMs < state.connectMs)) {
+            state.connectOutcome = result.outcome;
+            state.connectMs = result.connectMs;
         }
+        state.connectSeen++;
+        state.connectTested = true;
+
+        bool connected = state.connectOutcome == ConnectOutcome::Connected;
+        if (!connected && state.connectSeen < state.connectExpected) continue;
+        SetEntryResult(row, (g_entries.Flags(row) & ~ENTRY_UNREACHABLE) | (connected ? 0 : ENTRY_UNREACHABLE),
+            g_entries.ResponseMs(row));
+        StreamHostStatus(row);
+        UpdateAliases(row);
     }
+}
 
-    // Test untested entries first
-    int testsPerformed = 0;
-    for (int idx : untestedIndices) {
-        if (testsPerformed >= testsPerCycle) break;
+// Whether a live answer still contains any address the cache holds for the entry
+bool AnswerHasCachedAddress(const DnsQueryResult& answer, size_t row) {
+    std::vector<PackedAddress> addresses;
+    g_entries.Addresses(row, addresses);
+    for (const auto& address : addresses) {
+        if (DnsAnswerHasAddress(answer, FormatAddress(address))) return true;
+    }
+    return false;
+}
 
-        auto& entry = g_cacheEntries[idx];
-        DWORD responseTime = TestCacheEntry(entry.hostname);
+// Add a probe's response time to the entry's histogram and the global window;
+// PROBE_TIMEOUT is only for probes that got no answer in time. An error
+// answer keeps its latency and is counted as an error as well.
+void RecordLatency(EntryProbeState& entry, uint32_t responseTime, bool error, std::chrono::steady_clock::time_point now) {
+    if (responseTime == PROBE_TIMEOUT) {
+        entry.latency->RecordTimeout();
+        g_latencyWindow.RecordTimeout(now);
+        g_latencyTotal.RecordTimeout();
+        return;
+    }
 
-        entry.lastResponseTime = responseTime;
-        entry.isReachable = (responseTime != MAXDWORD);
-        entry.lastTested = now;
-        testsPerformed++;
+    entry.latency->Record(responseTime);
+    g_latencyWindow.Record(now, responseTime);
+    g_latencyTotal.Record(responseTime);
+    if (error) {
+        entry.latency->RecordError();
+        g_latencyWindow.RecordError(now);
+        g_latencyTotal.RecordError();
     }
+}
 
-    // Fill remaining test slots with regular rotation
-    for (int i = testsPerformed; i < testsPerCycle; i++) {
-        if (testIndex >= g_cacheEntries.size()) {
-            testIndex = 0;
-        }
+// Append a probe result to the on-disk history, and to the trace when recording
+void StoreProbe(size_t row, StoredOutcome outcome, uint32_t responseTime, const PackedAddress& address, bool direct) {
+    if (g_traceWriter) {
+        g_traceWriter->WriteProbe(TraceTime(), g_entries.Hostname(row), g_entries.Kind(row), outcome, responseTime, direct);
+    }
+    if (!g_probeStore) return;
+
+    ProbeRecord record = {};
+    record.timestamp = (uint32_t)time(nullptr);
+    record.hostId = g_entryState[row].storeId;
+    record.latencyMs = responseTime;
+    record.outcome = (uint8_t)outcome;
+    if (address.IsV4()) {
+        record.family = 4;
+        memcpy(record.address, address.bytes + 12, 4);
+    }
+    else if (!address.IsEmpty()) {
+        record.family = 6;
+        memcpy(record.address, address.bytes, sizeof(record.address));
+    }
+    g_probeStore->Append(record);
+}
 
-        auto& entry = g_cacheEntries[testIndex];
+// Apply finished probes from the engine and the direct client to the cache list
+void CollectProbeResults() {
+    auto now = std::chrono::steady_clock::now();
+    time_t wallNow = time(nullptr);
+
+    std::vector<ProbeResult> results;
+    g_probeEngine->Poll(results);
+    for (const auto& result : results) {
+        // Failed lookups carry PROBE_TIMEOUT as their response time, not a latency
+        if (result.outcome == ProbeOutcome::Failed) {
+            g_systemBudget.control.RecordError();
+        }
+        else {
+            g_systemBudget.control.Record(result.responseTime, result.outcome == ProbeOutcome::Timeout);
+        }
+        size_t row;
+        if (!FindProbedEntry(result.id, result.hostname, row)) continue;
+
+        EntryProbeState& state = g_entryState[row];
+        bool reachable = (result.outcome == ProbeOutcome::Ok);
+
+        // A cached NXDOMAIN is expected to fail; resolving means the name came back
+        bool negative = (g_entries.Flags(row) & ENTRY_NEGATIVE) != 0;
+        bool changed = negative && reachable;
+        uint8_t cleared = ENTRY_REACHABLE | ENTRY_PENDING | (negative ? ENTRY_CHANGED : 0);
+        SetEntryResult(row, (g_entries.Flags(row) & ~cleared) | (reachable ? ENTRY_REACHABLE : 0) | (changed ? ENTRY_CHANGED : 0),
+            result.responseTime);
+        // A failed lookup was still answered (NXDOMAIN, SERVFAIL); like the direct path, it keeps its latency
+        RecordLatency(state, result.elapsedMs, result.outcome == ProbeOutcome::Failed, now);
+        // The engine only reports whether the name resolved, so no address is recorded
+        StoreProbe(row, changed ? StoredOutcome::Changed : reachable ? StoredOutcome::Ok :
+            result.outcome == ProbeOutcome::Timeout ? StoredOutcome::Timeout : StoredOutcome::Failed,
+            result.responseTime, PackedAddress(), false);
+        state.failures = reachable || negative ? 0 : state.failures + 1;
+        state.lastTested = now;
+        state.fleetProbes++;
+        state.fleetFailures += reachable || negative ? 0 : 1;
+        if (!negative) {
+            g_anomalies.Observe(state.detector, AlertHost(row), { result.responseTime, !reachable }, wallNow);
+        }
+        ScheduleEntry(row);
+        StreamHostStatus(row);
+        UpdateAliases(row);
+        StartConnectRound(row, now);
+    }
 
-        // Only test if it's been a while since last test
-        auto timeSinceTest = std::chrono::duration_cast<std::chrono::seconds>(now - entry.lastTested);
-        if (timeSinceTest.count() > 15) { // Test every 15 seconds
-            DWORD responseTime = TestCacheEntry(entry.hostname);
+    if (!g_dnsClient) return;
 
-            entry.lastResponseTime = responseTime;
-            entry.isReachable = (responseTime != MAXDWORD);
-            entry.lastTested = now;
+    std::vector<DnsQueryResult> answers;
+    g_dnsClient->Poll(answers);
+    for (const auto& answer : answers) {
+        // A send that failed never reached the resolver's answer, so it counts like a timeout
+        if (answer.status == DnsQueryStatus::Ok) {
+            g_directBudget.control.Record(answer.responseTime, false);
         }
-
-        testIndex++;
+        else if (answer.status == DnsQueryStatus::Timeout || answer.status == DnsQueryStatus::NetworkError) {
+            g_directBudget.control.Record(answer.responseTime, true);
+        }
+        else {
+            g_directBudget.control.RecordError();
+        }
+        size_t row;
+        if (!FindProbedEntry(answer.id, answer.hostname, row)) continue;
+
+        EntryProbeState& state = g_entryState[row];
+        bool reachable = (answer.status == DnsQueryStatus::Ok);
+        bool negative = (g_entries.Flags(row) & ENTRY_NEGATIVE) != 0;
+        RecordLatency(state, answer.responseTime,
+            answer.status == DnsQueryStatus::NameError || answer.status == DnsQueryStatus::ServerError, now);
+        state.failures = reachable || negative ? 0 : state.failures + 1;
+        state.lastTested = now;
+        state.fleetProbes++;
+        state.fleetFailures += reachable || negative ? 0 : 1;
+
+        // Compare the live answer with what the local cache is handing out:
+        // none of the cached addresses left, or a cached NXDOMAIN that now resolves
+        PackAddress(DnsFirstAddress(answer, answer.type), state.upstreamAddress);
+        bool changed = negative ? reachable : reachable && !state.upstreamAddress.IsEmpty() &&
+            g_entries.AddressCount(row) > 0 && !AnswerHasCachedAddress(answer, row);
+        SetEntryResult(row, (g_entries.Flags(row) & ~(ENTRY_REACHABLE | ENTRY_CHANGED | ENTRY_PENDING)) |
+            (reachable ? ENTRY_REACHABLE : 0) | (changed ? ENTRY_CHANGED : 0), answer.responseTime);
+        StoreProbe(row, changed ? StoredOutcome::Changed : reachable ? StoredOutcome::Ok :
+            answer.status == DnsQueryStatus::Timeout ? StoredOutcome::Timeout : StoredOutcome::Failed,
+            answer.responseTime, state.upstreamAddress, true);
+        if (!negative) {
+            g_anomalies.Observe(state.detector, AlertHost(row), { answer.responseTime, !reachable }, wallNow);
+        }
+        ScheduleEntry(row);
+        StreamHostStatus(row);
+        UpdateAliases(row);
+        StartConnectRound(row, now);
     }
 }
 
-// Calculate cache statistics
-void CalculateStats() {
-    g_stats.totalEntries = g_cacheEntries.size();
-    g_stats.reachableEntries = 0;
-    g_stats.staleEntries = 0;
-    g_stats.timeoutEntries = 0;
-    g_stats.slowEntries = 0;
+// Pacing for the backend new probes go to
+ProbeBudget& ActiveBudget() {
+    return g_directProbes && g_dnsClient ? g_directBudget : g_systemBudget;
+}
 
-    DWORD totalResponseTime = 0;
-    int validResponses = 0;
+// Probes queued or in flight on whichever backend is active
+int PendingProbes() {
+    int pending = (int)g_probeEngine->Pending();
+    if (g_dnsClient) {
+        pending += (int)g_dnsClient->Pending();
+    }
+    return pending;
+}
 
-    for (const auto& entry : g_cacheEntries) {
-        if (entry.isStale) {
-            g_stats.staleEntries++;
-        }
+// Queue a probe for an entry on the active backend. AAAA entries ask for
+// IPv6; NXDOMAIN and unresolved CNAME entries only need the name to exist.
+void SubmitProbe(int index) {
+    g_entries.Flags(index) |= ENTRY_PENDING;    // Not counted, so no SetEntryResult()
+    g_changes++;
+    std::string hostname(g_entries.Hostname(index));
+    RecordKind kind = g_entries.Kind(index);
+    if (g_directProbes && g_dnsClient) {
+        g_dnsClient->Submit(index, hostname, kind == RecordKind::AAAA ? DNS_TYPE_AAAA : DNS_TYPE_A);
+    }
+    else {
+        g_probeEngine->Submit(index, hostname, kind == RecordKind::A ? ProbeFamily::IPv4 :
+            kind == RecordKind::AAAA ? ProbeFamily::IPv6 : ProbeFamily::Any);
+    }
+}
 
-        if (entry.isReachable) {
-            g_stats.reachableEntries++;
-            totalResponseTime += entry.lastResponseTime;
-            validResponses++;
+// Update cache entry statuses
+void UpdateCacheEntries() {
+    CollectProbeResults();
+    CollectConnectResults();
+    g_anomalies.Tick(time(nullptr));
 
-            if (entry.lastResponseTime > SLOW_RESPONSE_THRESHOLD) {
-                g_stats.slowEntries++;
-            }
-        }
-        else {
-            g_stats.timeoutEntries++;
+    auto now = std::chrono::steady_clock::now();
+    for (ProbeBudget* budget : { &g_systemBudget, &g_directBudget }) {
+        if (budget->control.Update(now)) {
+            budget->bucket.SetRate(budget->control.Rate(), now);
         }
     }
+    if (g_entries.Empty() || g_pauseMonitoring) return;
 
-    g_stats.avgResponseTime = validResponses > 0 ? (double)totalResponseTime / validResponses : 0.0;
-    g_stats.healthPercentage = g_stats.totalEntries > 0 ?
-        ((double)g_stats.reachableEntries / g_stats.totalEntries) * 100.0 : 0.0;
+    // Keep the engine topped up, most urgent first, within the active
+    // resolver's adaptive window and rate
+    ProbeBudget& budget = ActiveBudget();
+    int slots = budget.control.Window() - PendingProbes();
+
+    while (slots > 0 && !g_scheduler.Empty() && g_scheduler.NextDue() <= now && budget.bucket.TryTake(now)) {
+        SubmitProbe((int)g_scheduler.Pop());
+        slots--;
+    }
+}
 
-    g_stats.pagesTotal = (g_stats.totalEntries + ENTRIES_PER_PAGE - 1) / ENTRIES_PER_PAGE;
+// Calculate cache statistics
+void CalculateStats() {
+    // Kept current as results land, so this costs the same for any cache size;
+    // it classifies entries the same way as CountEntries() in trace replay
+    EntryCounts counts = g_tally.Counts();
+    g_stats.totalEntries = counts.total;
+    g_stats.reachableEntries = counts.reachable;
+    g_stats.staleEntries = counts.stale;
+    g_stats.timeoutEntries = counts.timeouts;
+    g_stats.slowEntries = counts.slow;
+    g_stats.changedEntries = counts.changed;
+    g_stats.negativeEntries = counts.negative;
+    g_stats.unreachableEntries = counts.unreachable;
+    g_stats.avgResponseTime = counts.avgResponseMs;
+    g_stats.healthPercentage = counts.HealthPercentage();
+
+    g_stats.pagesTotal = (int)((g_viewEntries + ENTRIES_PER_PAGE - 1) / ENTRIES_PER_PAGE);
     g_stats.currentPage = g_currentPage + 1;
 
-    // Determine if cache needs flushing
-    g_stats.needsFlush = (g_stats.healthPercentage < 60.0 && g_stats.totalEntries > 10) ||
-        (g_stats.avgResponseTime > 300.0 && validResponses > 5) ||
-        (g_stats.staleEntries > g_stats.totalEntries / 2);
+    // Flush advice follows the detectors, not fixed limits: the whole cache
+    // has to have moved away from its own baseline
+    g_stats.needsFlush = g_anomalies.GlobalAlert();
+    g_stats.activeAlerts = (int)g_anomalies.ActiveAlerts();
 }
 
 // Get response time color
@@ -330,248 +945,1207 @@ int GetResponseTimeColor(DWORD responseTime) {
 }
 
 // Get status indicator
-const char* GetStatusIndicator(bool isReachable, DWORD responseTime, bool isStale) {
+const char* GetStatusIndicator(bool isReachable, DWORD responseTime, bool isStale, bool addressChanged, bool isNegative,
+    bool isUnreachable) {
+    if (isNegative) return addressChanged ? "Changed" : "NXDomain";
     if (isStale) return "Stale";
     if (!isReachable) return "Missing";
+    if (isUnreachable) return "NoConn";
+    if (addressChanged) return "Changed";
     if (responseTime <= 50) return "Fast";
     if (responseTime <= SLOW_RESPONSE_THRESHOLD) return "Ok";
     return "Slow";
 }
 
-// Display current page of cache entries
-void DisplayCacheEntries() {
-    int startIndex = g_currentPage * ENTRIES_PER_PAGE;
-    int endIndex = min(startIndex + ENTRIES_PER_PAGE, (int)g_cacheEntries.size());
+// Append printf-style output to a string
+void AppendFormat(std::string& out, const char* format, ...) {
+    char text[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length > 0) {
+        out.append(text, (size_t)length < sizeof(text) ? (size_t)length : sizeof(text) - 1);
+    }
+}
 
-    SetConsoleColor(COLOR_MAGENTA);
-    printf("DNS CACHE ENTRIES (Page %d of %d):\n", g_stats.currentPage, g_stats.pagesTotal);
-    SetConsoleColor(COLOR_GRAY);
-    printf("----------------------------------------------------------------------------------------\n");
-    SetConsoleColor(COLOR_WHITE);
-    printf("Status  %-35s  %-15s  TTL    Response\n", "Hostname", "IP Address");
-    SetConsoleColor(COLOR_GRAY);
-    printf("----------------------------------------------------------------------------------------\n");
+// Append a quoted JSON string or Prometheus label value; both escape the same way
+// for the characters that can appear in host names and addresses
+void AppendQuoted(std::string& out, std::string_view value) {
+    out += '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if (c == '\n') {
+            out += "\\n";
+        }
+        else if ((unsigned char)c >= 0x20) {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// One JSON line describing an entry and its probe history
+void AppendHostLine(std::string& out, size_t row) {
+    const EntryProbeState& state = g_entryState[row];
+    LatencySnapshot history = state.latency->Snapshot();
+    uint8_t flags = g_entries.Flags(row);
+    bool reachable = (flags & ENTRY_REACHABLE) != 0;
+    bool stale = (flags & ENTRY_STALE) != 0;
+    bool changed = (flags & ENTRY_CHANGED) != 0;
+    bool negative = (flags & ENTRY_NEGATIVE) != 0;
+    bool unreachable = (flags & ENTRY_UNREACHABLE) != 0;
+
+    out += "{\"type\":\"host\",\"host\":";
+    AppendQuoted(out, g_entries.Hostname(row));
+    AppendFormat(out, ",\"recordType\":\"%s\",\"address\":", RecordKindName(g_entries.Kind(row)));
+    AppendQuoted(out, FormatAddress(g_entries.Address(row)));
+    out += ",\"addresses\":[";
+    std::vector<PackedAddress> addresses;
+    g_entries.Addresses(row, addresses);
+    for (size_t i = 0; i < addresses.size(); i++) {
+        if (i > 0) out += ',';
+        AppendQuoted(out, FormatAddress(addresses[i]));
+    }
+    out += "],\"target\":";
+    AppendQuoted(out, g_entries.Target(row));
+    AppendFormat(out, ",\"ttl\":%lu,\"status\":\"%s\",\"reachable\":%s,\"stale\":%s,\"changed\":%s,\"negative\":%s,",
+        (unsigned long)g_entries.Ttl(row), history.Samples() + history.timeouts > 0 ?
+            GetStatusIndicator(reachable, g_entries.ResponseMs(row), stale, changed, negative, unreachable) : "Untested",
+        reachable ? "true" : "false", stale ? "true" : "false", changed ? "true" : "false", negative ? "true" : "false");
+    const EntryProbeState& connect = g_entryState[g_probeRow[row]];
+    if (connect.connectTested) {
+        AppendFormat(out, "\"connect\":\"%s\",\"connectMs\":%lu,", ConnectOutcomeName(connect.connectOutcome),
+            (unsigned long)connect.connectMs);
+    }
+    out += "\"upstream\":";
+    AppendQuoted(out, FormatAddress(state.upstreamAddress));
+    AppendFormat(out, ",\"responseMs\":%lu,\"p50Ms\":%lu,\"p99Ms\":%lu,\"maxMs\":%lu,\"probes\":%llu,\"timeouts\":%llu,\"errors\":%llu}\n",
+        (unsigned long)g_entries.ResponseMs(row),
+        (unsigned long)history.Percentile(0.50), (unsigned long)history.Percentile(0.99), (unsigned long)history.maxLatency,
+        (unsigned long long)(history.Samples() + history.timeouts), (unsigned long long)history.timeouts,
+        (unsigned long long)history.errors);
+}
+
+// Send an entry's new state to anyone following the event stream
+void StreamHostStatus(size_t row) {
+    if (!g_metricsServer || g_metricsServer->StreamClients() == 0) return;
+
+    std::string line;
+    AppendHostLine(line, row);
+    line.pop_back();
+    g_metricsServer->Publish(line);
+}
+
+// Send the cache-wide numbers after a refresh to anyone following the event stream
+void StreamCacheStats() {
+    if (!g_metricsServer || g_metricsServer->StreamClients() == 0) return;
+
+    CalculateStats();
+    std::string line;
+    AppendFormat(line, "{\"type\":\"stats\",\"entries\":%d,\"reachable\":%d,\"stale\":%d,\"timeouts\":%d,"
+        "\"slow\":%d,\"changed\":%d,\"negative\":%d,\"unreachable\":%d,\"health\":%.1f,\"avgResponseMs\":%.1f,\"needsFlush\":%s,"
+        "\"alerts\":%d,\"added\":%d,\"removed\":%d,\"addressChanged\":%d}",
+        g_stats.totalEntries, g_stats.reachableEntries, g_stats.staleEntries, g_stats.timeoutEntries,
+        g_stats.slowEntries, g_stats.changedEntries, g_stats.negativeEntries, g_stats.unreachableEntries, g_stats.healthPercentage, g_stats.avgResponseTime,
+        g_stats.needsFlush ? "true" : "false", g_stats.activeAlerts, g_lastRefresh.added, g_lastRefresh.removed, g_lastRefresh.changed);
+    g_metricsServer->Publish(line);
+}
+
+// Outcome of an eviction, once its refresh has been merged
+void StreamEviction() {
+    if (!g_metricsServer || g_metricsServer->StreamClients() == 0) return;
+
+    const EvictionReport& report = g_lastEviction;
+    std::string line;
+    AppendFormat(line, "{\"type\":\"eviction\",\"evicted\":%d,\"evictFailed\":%d,\"flushedAll\":%s,\"kept\":%d,"
+        "\"warmed\":%d,\"warmFailed\":%d,\"evictMs\":%lu,\"warmMs\":%lu,\"savedLookups\":%d}",
+        report.evicted, report.evictFailed, report.flushedAll ? "true" : "false", report.kept,
+        report.warmed, report.warmFailed, (unsigned long)report.evictMs, (unsigned long)report.warmMs, report.savedLookups);
+    g_metricsServer->Publish(line);
+}
+
+// One JSON line for an alert; latency baselines are in ms, failure baselines a fraction
+void AppendAlertLine(std::string& out, const AnomalyAlert& alert) {
+    out += "{\"type\":\"alert\",\"host\":";
+    AppendQuoted(out, alert.host);
+    AppendFormat(out, ",\"kind\":\"%s\",\"active\":%s,\"score\":%.2f,\"baseline\":%.3f,\"current\":%.3f,"
+        "\"raised\":%lld,\"cleared\":%lld}\n",
+        AlertKindName(alert.kind), alert.cleared == 0 ? "true" : "false", alert.score, alert.baseline, alert.current,
+        (long long)alert.raised, (long long)alert.cleared);
+}
+
+// Each alert as it is raised or cleared, to anyone following the event stream
+void StreamAlert(const AnomalyAlert& alert) {
+    if (!g_metricsServer || g_metricsServer->StreamClients() == 0) return;
+
+    std::string line;
+    AppendAlertLine(line, alert);
+    line.pop_back();
+    g_metricsServer->Publish(line);
+}
+
+// HELP and TYPE lines for one Prometheus metric
+void AppendMetricHeader(std::string& out, const char* name, const char* type, const char* help) {
+    AppendFormat(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// Cache statistics, latency and per-host status in the Prometheus text format
+std::string FormatPrometheus() {
+    std::string out;
+    auto now = std::chrono::steady_clock::now();
+
+    struct { const char* name; const char* help; double value; } gauges[] = {
+        { "dnsmonitor_cache_entries", "Entries in the resolver cache being monitored.", (double)g_stats.totalEntries },
+        { "dnsmonitor_cache_reachable_entries", "Entries whose last probe resolved.", (double)g_stats.reachableEntries },
+        { "dnsmonitor_cache_stale_entries", "Entries with an expired TTL.", (double)g_stats.staleEntries },
+        { "dnsmonitor_cache_timeout_entries", "Entries whose last probe failed or timed out.", (double)g_stats.timeoutEntries },
+        { "dnsmonitor_cache_slow_entries", "Entries slower than the slow threshold.", (double)g_stats.slowEntries },
+        { "dnsmonitor_cache_changed_entries", "Entries whose upstream answer no longer contains the cached address.", (double)g_stats.changedEntries },
+        { "dnsmonitor_cache_negative_entries", "Cached NXDOMAIN entries.", (double)g_stats.negativeEntries },
+        { "dnsmonitor_cache_unreachable_entries", "Entries whose cached addresses took no connect probe.", (double)g_stats.unreachableEntries },
+        { "dnsmonitor_cache_health_ratio", "Reachable entries over all entries except cached NXDOMAIN.", g_stats.healthPercentage / 100.0 },
+        { "dnsmonitor_response_time_avg_ms", "Mean last response time of reachable entries.", g_stats.avgResponseTime },
+        { "dnsmonitor_cache_needs_flush", "1 while the cache-wide latency or failure rate has shifted up from its baseline.", g_stats.needsFlush ? 1.0 : 0.0 },
+        { "dnsmonitor_alerts_active", "Hosts and cache-wide series whose latency or failure rate has shifted up.", (double)g_stats.activeAlerts },
+        { "dnsmonitor_probe_rate", "Probes per second the rate controller currently allows.", ActiveBudget().control.Rate() },
+        { "dnsmonitor_probe_rate_ceiling", "Hard ceiling on probes per second (--probe-rate).", ActiveBudget().control.Config().maxRate },
+        { "dnsmonitor_probe_window", "Probes the rate controller allows queued or in flight.", (double)ActiveBudget().control.Window() },
+    };
+    for (const auto& gauge : gauges) {
+        AppendMetricHeader(out, gauge.name, "gauge", gauge.help);
+        AppendFormat(out, "%s %g\n", gauge.name, gauge.value);
+    }
+
+    // Whole-run histogram
+    LatencySnapshot total = g_latencyTotal.Snapshot();
+    AppendMetricHeader(out, "dnsmonitor_probe_latency_ms", "histogram", "Response time of answered probes.");
+    uint64_t cumulative = 0;
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        cumulative += total.counts[i];
+        if (total.counts[i] == 0 && i + 1 < LATENCY_BUCKETS - 1 && total.counts[i + 1] == 0) continue;
+        AppendFormat(out, "dnsmonitor_probe_latency_ms_bucket{le=\"%lu\"} %llu\n",
+            (unsigned long)LatencyBucketLimit(i), (unsigned long long)cumulative);
+    }
+    AppendFormat(out, "dnsmonitor_probe_latency_ms_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)total.Samples());
+    AppendFormat(out, "dnsmonitor_probe_latency_ms_sum %llu\n", (unsigned long long)total.sum);
+    AppendFormat(out, "dnsmonitor_probe_latency_ms_count %llu\n", (unsigned long long)total.Samples());
+    AppendMetricHeader(out, "dnsmonitor_probe_timeouts_total", "counter", "Probes that got no answer before the deadline.");
+    AppendFormat(out, "dnsmonitor_probe_timeouts_total %llu\n", (unsigned long long)total.timeouts);
+    AppendMetricHeader(out, "dnsmonitor_probe_errors_total", "counter",
+        "Probes answered with an error (NXDOMAIN, SERVFAIL); also counted in the latency histogram.");
+    AppendFormat(out, "dnsmonitor_probe_errors_total %llu\n", (unsigned long long)total.errors);
+
+    // Sliding windows, as the health panel shows them
+    struct { const char* label; int seconds; } windows[] = { { "1m", LATENCY_SHORT_WINDOW }, { "15m", LATENCY_LONG_WINDOW } };
+    AppendMetricHeader(out, "dnsmonitor_window_latency_ms", "gauge", "Probe latency quantiles over a sliding window.");
+    for (const auto& window : windows) {
+        LatencySnapshot counts = g_latencyWindow.Snapshot(now, window.seconds);
+        double quantiles[] = { 0.5, 0.9, 0.99 };
+        for (double q : quantiles) {
+            AppendFormat(out, "dnsmonitor_window_latency_ms{window=\"%s\",quantile=\"%g\"} %lu\n",
+                window.label, q, (unsigned long)counts.Percentile(q));
+        }
+        AppendFormat(out, "dnsmonitor_window_latency_ms{window=\"%s\",quantile=\"1\"} %lu\n",
+            window.label, (unsigned long)counts.maxLatency);
+    }
+    AppendMetricHeader(out, "dnsmonitor_window_timeout_ratio", "gauge", "Timed out probes over all probes in a sliding window.");
+    for (const auto& window : windows) {
+        AppendFormat(out, "dnsmonitor_window_timeout_ratio{window=\"%s\"} %g\n",
+            window.label, g_latencyWindow.Snapshot(now, window.seconds).TimeoutRate() / 100.0);
+    }
+    AppendMetricHeader(out, "dnsmonitor_window_error_ratio", "gauge", "Probes answered with an error over all probes in a sliding window.");
+    for (const auto& window : windows) {
+        AppendFormat(out, "dnsmonitor_window_error_ratio{window=\"%s\"} %g\n",
+            window.label, g_latencyWindow.Snapshot(now, window.seconds).ErrorRate() / 100.0);
+    }
+
+    // Per domain suffix (--stats-suffix)
+    if (g_tally.Suffixes() > 0) {
+        struct { const char* name; const char* help; } suffixGauges[] = {
+            { "dnsmonitor_suffix_entries", "Entries under a domain suffix." },
+            { "dnsmonitor_suffix_reachable_entries", "Entries under a domain suffix whose last probe resolved." },
+            { "dnsmonitor_suffix_timeout_entries", "Entries under a domain suffix whose last probe failed or timed out." },
+            { "dnsmonitor_suffix_slow_entries", "Entries under a domain suffix slower than the slow threshold." },
+            { "dnsmonitor_suffix_health_ratio", "Reachable entries over all but cached NXDOMAIN, under a domain suffix." },
+            { "dnsmonitor_suffix_response_time_avg_ms", "Mean last response time of reachable entries under a domain suffix." },
+        };
+        for (size_t gauge = 0; gauge < sizeof(suffixGauges) / sizeof(suffixGauges[0]); gauge++) {
+            AppendMetricHeader(out, suffixGauges[gauge].name, "gauge", suffixGauges[gauge].help);
+            for (size_t i = 0; i < g_tally.Suffixes(); i++) {
+                EntryCounts counts = g_tally.SuffixCounts(i);
+                double values[] = { (double)counts.total, (double)counts.reachable, (double)counts.timeouts,
+                    (double)counts.slow, counts.HealthPercentage() / 100.0, counts.avgResponseMs };
+                AppendFormat(out, "%s{suffix=", suffixGauges[gauge].name);
+                AppendQuoted(out, g_tally.Suffix(i));
+                AppendFormat(out, "} %g\n", values[gauge]);
+            }
+        }
+    }
+
+    // Per host
+    AppendMetricHeader(out, "dnsmonitor_host_up", "gauge", "1 when the entry's last probe resolved.");
+    for (size_t row = 0; row < g_entries.Size(); row++) {
+        if (g_entries.Flags(row) & ENTRY_NEGATIVE) continue;
+        out += "dnsmonitor_host_up{host=";
+        AppendQuoted(out, g_entries.Hostname(row));
+        AppendFormat(out, ",type=\"%s\",address=", RecordKindName(g_entries.Kind(row)));
+        AppendQuoted(out, FormatAddress(g_entries.Address(row)));
+        AppendFormat(out, "} %d\n", (g_entries.Flags(row) & ENTRY_REACHABLE) ? 1 : 0);
+    }
+    AppendMetricHeader(out, "dnsmonitor_host_latency_p99_ms", "gauge", "99th percentile response time of the entry's probes.");
+    for (size_t row = 0; row < g_entries.Size(); row++) {
+        LatencySnapshot history = g_entryState[row].latency->Snapshot();
+        if (history.Samples() == 0) continue;
+        out += "dnsmonitor_host_latency_p99_ms{host=";
+        AppendQuoted(out, g_entries.Hostname(row));
+        AppendFormat(out, ",type=\"%s\"} %lu\n", RecordKindName(g_entries.Kind(row)), (unsigned long)history.Percentile(0.99));
+    }
+    if (g_connectProbe) {
+        AppendMetricHeader(out, "dnsmonitor_host_connect_up", "gauge", "1 when a cached address of the entry took a connection.");
+        for (size_t row = 0; row < g_entries.Size(); row++) {
+            const EntryProbeState& connect = g_entryState[g_probeRow[row]];
+            if (!connect.connectTested) continue;
+            out += "dnsmonitor_host_connect_up{host=";
+            AppendQuoted(out, g_entries.Hostname(row));
+            AppendFormat(out, ",type=\"%s\"} %d\n", RecordKindName(g_entries.Kind(row)),
+                connect.connectOutcome == ConnectOutcome::Connected ? 1 : 0);
+        }
+        AppendMetricHeader(out, "dnsmonitor_host_connect_ms", "gauge", "Fastest TCP connect to a cached address in the last round.");
+        for (size_t row = 0; row < g_entries.Size(); row++) {
+            const EntryProbeState& connect = g_entryState[g_probeRow[row]];
+            if (!connect.connectTested || connect.connectOutcome != ConnectOutcome::Connected) continue;
+            out += "dnsmonitor_host_connect_ms{host=";
+            AppendQuoted(out, g_entries.Hostname(row));
+            AppendFormat(out, ",type=\"%s\"} %lu\n", RecordKindName(g_entries.Kind(row)), (unsigned long)connect.connectMs);
+        }
+    }
+    AppendMetricHeader(out, "dnsmonitor_host_address_changed", "gauge",
+        "1 when upstream no longer returns a cached address, or a cached NXDOMAIN now resolves.");
+    for (size_t row = 0; row < g_entries.Size(); row++) {
+        if (!(g_entries.Flags(row) & ENTRY_CHANGED)) continue;
+        out += "dnsmonitor_host_address_changed{host=";
+        AppendQuoted(out, g_entries.Hostname(row));
+        AppendFormat(out, ",type=\"%s\"} 1\n", RecordKindName(g_entries.Kind(row)));
+    }
+    AppendMetricHeader(out, "dnsmonitor_alert_score", "gauge",
+        "Shift of an active alert over its baseline, in baseline deviations. host=\"*\" is the whole cache.");
+    std::vector<AnomalyAlert> alerts;
+    g_anomalies.Ranked(alerts, g_anomalies.ActiveAlerts());
+    for (const auto& alert : alerts) {
+        out += "dnsmonitor_alert_score{host=";
+        AppendQuoted(out, alert.host);
+        AppendFormat(out, ",kind=\"%s\"} %g\n", AlertKindName(alert.kind), alert.score);
+    }
+    return out;
+}
+
+// Format pending export requests for the metrics server
+void ApplyExports() {
+    std::vector<ExportRequest*> requests;
+    {
+        std::lock_guard<std::mutex> lock(g_monitorLock);
+        requests.swap(g_exportRequests);
+    }
+    if (requests.empty()) return;
+
+    CalculateStats();
+    for (ExportRequest* request : requests) {
+        std::string body;
+        if (request->format == ExportFormat::Prometheus) {
+            body = FormatPrometheus();
+        }
+        else if (request->format == ExportFormat::Alerts) {
+            std::vector<AnomalyAlert> alerts;
+            g_anomalies.Ranked(alerts, g_anomalies.Config().maxAlerts);
+            for (const auto& alert : alerts) {
+                AppendAlertLine(body, alert);
+            }
+        }
+        else {
+            for (size_t row = 0; row < g_entries.Size(); row++) {
+                AppendHostLine(body, row);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(g_monitorLock);
+        request->body.swap(body);
+        request->done = true;
+    }
+    g_exportDone.notify_all();
+}
 
-    for (int i = startIndex; i < endIndex; i++) {
-        const auto& entry = g_cacheEntries[i];
+// Display current page of cache entries
+void DisplayCacheEntries(FrameBuffer& frame, const MonitorSnapshot& snapshot) {
+    frame.SetColor(COLOR_MAGENTA);
+    frame.Print("DNS CACHE ENTRIES (Page %d of %d):", snapshot.stats.currentPage, snapshot.stats.pagesTotal);
+    frame.SetColor(COLOR_GRAY);
+    if (g_editingSuffix) {
+        frame.Print("   domain: %s_", g_suffixInput.c_str());
+    }
+    else {
+        const EntryView& view = snapshot.view;
+        if (view.filter != EntryFilter::All || view.sort != EntrySort::Cache || !view.suffix.empty()) {
+            frame.Print("   %llu %s", (unsigned long long)snapshot.viewEntries, EntryFilterName(view.filter));
+            if (!view.suffix.empty()) frame.Print(" under %s", view.suffix.c_str());
+            if (view.sort != EntrySort::Cache) frame.Print(", %s first", EntrySortName(view.sort));
+        }
+    }
+    frame.Print("\n");
+    frame.SetColor(COLOR_GRAY);
+    frame.Print("----------------------------------------------------------------------------------------\n");
+    frame.SetColor(COLOR_WHITE);
+    // Connect probes take their column out of the hostname and address
+    bool connect = snapshot.connectProbes;
+    int hostWidth = connect ? 24 : 28;
+    int addressWidth = connect ? 19 : 24;
+    frame.Print("%-8s  %-*s  %-*s  TTL    %sResponse   p99\n", "Status", hostWidth, "Hostname", addressWidth, "Address",
+        connect ? "Connect  " : "");
+    frame.SetColor(COLOR_GRAY);
+    frame.Print("----------------------------------------------------------------------------------------\n");
+
+    for (const auto& entry : snapshot.page) {
 
         // Status indicator
-        SetConsoleColor(GetResponseTimeColor(entry.lastResponseTime));
-        printf("  %s    ", GetStatusIndicator(entry.isReachable, entry.lastResponseTime, entry.isStale));
+        frame.SetColor(entry.addressChanged ? COLOR_MAGENTA : entry.isNegative ? COLOR_GRAY : GetResponseTimeColor(entry.lastResponseTime));
+        frame.Print("%-8s  ", GetStatusIndicator(entry.isReachable, entry.lastResponseTime, entry.isStale, entry.addressChanged,
+            entry.isNegative, entry.isUnreachable));
 
         // Hostname (truncated if too long)
-        SetConsoleColor(COLOR_WHITE);
+        frame.SetColor(COLOR_WHITE);
         std::string hostname = entry.hostname;
-        if (hostname.length() > 35) {
-            hostname = hostname.substr(0, 32) + "...";
+        if (hostname.length() > (size_t)hostWidth) {
+            hostname = hostname.substr(0, hostWidth - 3) + "...";
         }
-        printf("%-35s  ", hostname.c_str());
-
-        // IP Address
-        SetConsoleColor(COLOR_CYAN);
-        printf("%-15s  ", entry.ipAddress.c_str());
+        frame.Print("%-*s  ", hostWidth, hostname.c_str());
+
+        // Address and a count of any others, the alias target, or - for NXDOMAIN
+        std::string address = entry.kind == RecordKind::CNAME ? "> " + entry.target :
+            entry.kind == RecordKind::NameError ? "-" : entry.ipAddress;
+        std::string more = entry.moreAddresses > 0 ? " +" + std::to_string(entry.moreAddresses) : "";
+        if (address.length() + more.length() > (size_t)addressWidth) {
+            address = address.substr(0, addressWidth - 3 - more.length()) + "...";
+        }
+        frame.SetColor(COLOR_CYAN);
+        frame.Print("%-*s  ", addressWidth, (address + more).c_str());
 
         // TTL
-        SetConsoleColor(entry.isStale ? COLOR_RED : COLOR_WHITE);
-        printf("%4d   ", entry.ttl);
+        frame.SetColor(entry.isStale ? COLOR_RED : COLOR_WHITE);
+        frame.Print("%4lu   ", (unsigned long)entry.ttl);
+
+        // Fastest connect to a cached address, or why none succeeded
+        if (connect) {
+            if (!entry.connectTested) {
+                frame.SetColor(COLOR_GRAY);
+                frame.Print("%7s  ", "-");
+            }
+            else if (entry.connectOutcome == ConnectOutcome::Connected) {
+                frame.SetColor(GetResponseTimeColor(entry.connectMs));
+                frame.Print("%5lums  ", (unsigned long)entry.connectMs);
+            }
+            else {
+                frame.SetColor(COLOR_RED);
+                frame.Print("%7s  ", entry.connectOutcome == ConnectOutcome::Refused ? "REFUSED" :
+                    entry.connectOutcome == ConnectOutcome::Unreachable ? "UNREACH" : "TIMEOUT");
+            }
+        }
 
         // Response time
-        if (entry.isReachable && entry.lastResponseTime > 0) {
-            SetConsoleColor(GetResponseTimeColor(entry.lastResponseTime));
-            printf("%4lums", entry.lastResponseTime);
+        if ((entry.isReachable || entry.isNegative) && entry.lastResponseTime > 0 && entry.lastResponseTime != MAXDWORD) {
+            frame.SetColor(GetResponseTimeColor(entry.lastResponseTime));
+            frame.Print("%4lums", entry.lastResponseTime);
+        }
+        else if (entry.isNegative) {
+            frame.SetColor(COLOR_GRAY);
+            frame.Print("   -  ");
         }
         else if (entry.lastResponseTime == MAXDWORD) {
-            SetConsoleColor(COLOR_RED);
-            printf("TIMEOUT");
+            frame.SetColor(COLOR_RED);
+            frame.Print("TIMEOUT");
         }
         else {
-            SetConsoleColor(COLOR_GRAY);
-            printf("UNTESTED");
+            frame.SetColor(COLOR_GRAY);
+            frame.Print("UNTESTED");
         }
 
-        printf("\n");
+        // Tail latency over every probe of this entry
+        if (entry.history.Samples() > 0) {
+            uint32_t p99 = entry.history.Percentile(0.99);
+            frame.SetColor(GetResponseTimeColor(p99));
+            frame.Print("%*lums", entry.lastResponseTime == MAXDWORD ? 5 : 6, (unsigned long)p99);
+        }
+
+        frame.Print("\n");
     }
 
-    if (g_cacheEntries.empty()) {
-        SetConsoleColor(COLOR_YELLOW);
-        printf("No DNS cache entries found. Cache may be empty.\n");
+    if (snapshot.stats.totalEntries == 0) {
+        frame.SetColor(COLOR_YELLOW);
+        frame.Print(snapshot.refreshing ? "Reading DNS cache...\n" : "No DNS cache entries found. Cache may be empty.\n");
     }
 
-    printf("\n");
+    frame.Print("\n");
 }
 
-// Display cache statistics and health assessment
-void DisplayCacheHealth() {
-    SetConsoleColor(COLOR_MAGENTA);
-    printf("CACHE HEALTH ANALYSIS:\n");
-    SetConsoleColor(COLOR_GRAY);
-    printf("----------------------------------------------------------------------------------------\n");
+// One health panel line: percentiles, timeout and error rates over a window
+void PrintLatencyWindow(FrameBuffer& frame, const char* label, const LatencySnapshot& window) {
+    uint32_t values[] = { window.Percentile(0.50), window.Percentile(0.90), window.Percentile(0.99), window.maxLatency };
+    const char* names[] = { "p50", "p90", "p99", "max" };
 
-    SetConsoleColor(COLOR_WHITE);
-    printf("Total Entries: %d   Reachable: %d   Stale: %d   Timeouts: %d   Slow: %d\n",
-        g_stats.totalEntries, g_stats.reachableEntries, g_stats.staleEntries,
-        g_stats.timeoutEntries, g_stats.slowEntries);
+    frame.SetColor(COLOR_WHITE);
+    frame.Print("%s: ", label);
+    for (int i = 0; i < 4; i++) {
+        frame.SetColor(GetResponseTimeColor(values[i]));
+        frame.Print("%s %lums   ", names[i], (unsigned long)values[i]);
+    }
+    frame.SetColor(window.timeouts > 0 ? COLOR_RED : COLOR_WHITE);
+    frame.Print("Timeouts: %.1f%%  ", window.TimeoutRate());
+    frame.SetColor(window.errors > 0 ? COLOR_YELLOW : COLOR_WHITE);
+    frame.Print("Errors: %.1f%%\n", window.ErrorRate());
+}
 
-    printf("Health: ");
-    if (g_stats.healthPercentage >= 80.0) {
-        SetConsoleColor(COLOR_GREEN);
-        printf("%.1f%% EXCELLENT", g_stats.healthPercentage);
+// Display cache statistics and health assessment
+void DisplayCacheHealth(FrameBuffer& frame, const MonitorSnapshot& snapshot) {
+    const CacheStats& stats = snapshot.stats;
+
+    frame.SetColor(COLOR_MAGENTA);
+    frame.Print("CACHE HEALTH ANALYSIS:\n");
+    frame.SetColor(COLOR_GRAY);
+    frame.Print("----------------------------------------------------------------------------------------\n");
+
+    frame.SetColor(COLOR_WHITE);
+    frame.Print("Entries: %d  Reachable: %d  Stale: %d  Timeouts: %d  Slow: %d  Changed: %d  NXDOMAIN: %d\n",
+        stats.totalEntries, stats.reachableEntries, stats.staleEntries,
+        stats.timeoutEntries, stats.slowEntries, stats.changedEntries, stats.negativeEntries);
+
+    frame.Print("Health: ");
+    if (stats.healthPercentage >= 80.0) {
+        frame.SetColor(COLOR_GREEN);
+        frame.Print("%.1f%% EXCELLENT", stats.healthPercentage);
     }
-    else if (g_stats.healthPercentage >= 60.0) {
-        SetConsoleColor(COLOR_YELLOW);
-        printf("%.1f%% GOOD", g_stats.healthPercentage);
+    else if (stats.healthPercentage >= 60.0) {
+        frame.SetColor(COLOR_YELLOW);
+        frame.Print("%.1f%% GOOD", stats.healthPercentage);
     }
     else {
-        SetConsoleColor(COLOR_RED);
-        printf("%.1f%% POOR", g_stats.healthPercentage);
+        frame.SetColor(COLOR_RED);
+        frame.Print("%.1f%% POOR", stats.healthPercentage);
     }
 
-    printf("   Avg Response: ");
-    SetConsoleColor(GetResponseTimeColor((DWORD)g_stats.avgResponseTime));
-    printf("%.1fms", g_stats.avgResponseTime);
-
-    printf("\n");
+    frame.Print("   Avg Response: ");
+    frame.SetColor(GetResponseTimeColor((DWORD)stats.avgResponseTime));
+    frame.Print("%.1fms", stats.avgResponseTime);
+
+    frame.Print("\n");
+
+    // Throughput and tail latency of the active probe backend
+    const ProbeEngineStats& probeStats = snapshot.probeStats;
+    frame.SetColor(COLOR_WHITE);
+    frame.Print("Probes: %.1f/s   In Flight: %d   Queued: %d   p50: %lums   p95: %lums   p99: %lums   %s %s\n",
+        probeStats.probesPerSec, probeStats.inFlight, probeStats.queued,
+        (unsigned long)probeStats.p50, (unsigned long)probeStats.p95, (unsigned long)probeStats.p99,
+        snapshot.directProbes ? "Direct:" : "Via OS", snapshot.directServer.c_str());
+    frame.SetColor(snapshot.probeTrend == RateTrend::Decrease ? COLOR_YELLOW : COLOR_WHITE);
+    frame.Print("Probe Rate: %.1f/s of %.0f   Window: %d   %s   (interval p95: ",
+        snapshot.probeRate, snapshot.probeCeiling, snapshot.probeWindow,
+        snapshot.probeTrend == RateTrend::Decrease ? "Backing off" : snapshot.probeTrend == RateTrend::Increase ? "Rising" : "Steady");
+    if (snapshot.probeIntervalP95 == PROBE_TIMEOUT) {
+        frame.Print("timeout");
+    }
+    else {
+        frame.Print("%lums", (unsigned long)snapshot.probeIntervalP95);
+    }
+    frame.Print(", %.1f%% timeouts)\n", snapshot.probeIntervalTimeouts * 100.0);
+    if (snapshot.connectProbes) {
+        const ProbeEngineStats& connectStats = snapshot.connectStats;
+        frame.Print("Connects: %.1f/s   In Flight: %d   Queued: %d   p50: %lums   p95: %lums   p99: %lums   Unreachable: %d\n",
+            connectStats.probesPerSec, connectStats.inFlight, connectStats.queued,
+            (unsigned long)connectStats.p50, (unsigned long)connectStats.p95, (unsigned long)connectStats.p99,
+            stats.unreachableEntries);
+    }
+    PrintLatencyWindow(frame, "Latency  1 min", snapshot.shortWindow);
+    PrintLatencyWindow(frame, "Latency 15 min", snapshot.longWindow);
+    frame.SetColor(COLOR_WHITE);
+    frame.Print("Last Refresh: +%d added   -%d removed   %d address changed   %d kept\n",
+        snapshot.lastRefresh.added, snapshot.lastRefresh.removed, snapshot.lastRefresh.changed,
+        snapshot.lastRefresh.unchanged);
+    if (snapshot.evicted) {
+        const EvictionReport& eviction = snapshot.lastEviction;
+        frame.Print("Last Evict: %d evicted%s   %d kept   %d warmed in %lums   %d cold lookups saved\n",
+            eviction.evicted, eviction.flushedAll ? " (full flush)" : "", eviction.kept, eviction.warmed,
+            (unsigned long)eviction.warmMs, eviction.savedLookups);
+    }
 
-    // Health recommendation
-    SetConsoleColor(COLOR_WHITE);
-    printf("Recommendation: ");
-    if (g_stats.needsFlush) {
-        SetConsoleColor(COLOR_RED);
-        printf("FLUSH DNS CACHE - Poor performance detected");
+    // Health recommendation, with the top alert when there is one
+    frame.SetColor(COLOR_WHITE);
+    frame.Print("Recommendation: ");
+    const AnomalyAlert* top = !snapshot.alerts.empty() && snapshot.alerts[0].cleared == 0 ? &snapshot.alerts[0] : nullptr;
+    if (stats.needsFlush) {
+        frame.SetColor(COLOR_RED);
+        frame.Print("EVICT BAD ENTRIES [F] - Cache-wide shift");
     }
-    else if (g_stats.healthPercentage < 80.0) {
-        SetConsoleColor(COLOR_YELLOW);
-        printf("MONITOR - Some entries may need attention");
+    else if (top) {
+        frame.SetColor(COLOR_YELLOW);
+        frame.Print("MONITOR - %d alert%s", stats.activeAlerts, stats.activeAlerts == 1 ? "" : "s");
+    }
+    else if (stats.healthPercentage < 80.0) {
+        frame.SetColor(COLOR_YELLOW);
+        frame.Print("MONITOR - Some entries may need attention");
     }
     else {
-        SetConsoleColor(COLOR_GREEN);
-        printf("HEALTHY - Cache performing well");
+        frame.SetColor(COLOR_GREEN);
+        frame.Print("HEALTHY - Cache performing well");
+    }
+    if (top) {
+        std::string host = top->host == GLOBAL_ALERT_HOST ? "all hosts" : top->host;
+        if (host.length() > 24) {
+            host = host.substr(0, 21) + "...";
+        }
+        if (top->kind == AlertKind::Latency) {
+            frame.Print(": %s latency %.0fms -> %.0fms (%.1f)", host.c_str(), top->baseline, top->current, top->score);
+        }
+        else {
+            frame.Print(": %s failures %.0f%% -> %.0f%% (%.1f)", host.c_str(), top->baseline * 100.0, top->current * 100.0,
+                top->score);
+        }
     }
 
-    printf("\n\n");
+    frame.Print("\n\n");
 }
 
 // Display legend
-void DisplayLegend() {
-    SetConsoleColor(COLOR_MAGENTA);
-    printf("LEGEND:\n");
-    SetConsoleColor(COLOR_GRAY);
-    printf("----------------------------------------------------------------------------------------\n");
-    SetConsoleColor(COLOR_WHITE);
-    printf("Status: ");
-    SetConsoleColor(COLOR_GREEN);
-    printf("Fast (<50ms)  ");
-    SetConsoleColor(COLOR_YELLOW);
-    printf("OK (<200ms)  ");
-    SetConsoleColor(COLOR_RED);
-    printf("Slow (>200ms)  Timeout  Stale");
-    printf("\n\n");
+void DisplayLegend(FrameBuffer& frame) {
+    frame.SetColor(COLOR_MAGENTA);
+    frame.Print("LEGEND:\n");
+    frame.SetColor(COLOR_GRAY);
+    frame.Print("----------------------------------------------------------------------------------------\n");
+    frame.SetColor(COLOR_WHITE);
+    frame.Print("Status: ");
+    frame.SetColor(COLOR_GREEN);
+    frame.Print("Fast (<50ms)  ");
+    frame.SetColor(COLOR_YELLOW);
+    frame.Print("OK (<200ms)  ");
+    frame.SetColor(COLOR_RED);
+    frame.Print("Slow (>200ms)  Timeout  Stale  ");
+    frame.SetColor(COLOR_MAGENTA);
+    frame.Print("Changed (upstream differs)\n");
+    frame.SetColor(COLOR_GRAY);
+    frame.Print("        NXDomain (cached negative answer)   > alias target   +N more addresses");
+    frame.Print("\n\n");
 }
 
-// Display main interface
-void DisplayInterface() {
-    static int refreshCount = 0;
-
-    if (refreshCount % 10 == 0) {
-        system("cls");
-    }
-    refreshCount++;
-
-    COORD coord = { 0, 0 };
-    SetConsoleCursorPosition(g_consoleHandle, coord);
+// Display main interface, drawn off screen; only the cells that changed since the last frame are written
+void DisplayInterface(const MonitorSnapshot& snapshot) {
+    RenderStats renderStats = g_renderer->Stats();
+    FrameBuffer& frame = g_renderer->BeginFrame();
 
     // Title and time
     SYSTEMTIME st;
     GetLocalTime(&st);
-    SetConsoleColor(COLOR_CYAN);
-    printf("========================================================================================\n");
-    printf("                     DNS CACHE HEALTH MONITOR - %02d:%02d:%02d                     \n",
+    frame.SetColor(COLOR_CYAN);
+    frame.Print("========================================================================================\n");
+    frame.Print("                     DNS CACHE HEALTH MONITOR - %02d:%02d:%02d                     \n",
         st.wHour, st.wMinute, st.wSecond);
-    printf("========================================================================================\n");
+    frame.Print("========================================================================================\n");
 
-    if (g_pauseMonitoring) {
-        SetConsoleColor(COLOR_YELLOW);
-        printf("                                    [PAUSED]                                    \n");
+    if (snapshot.paused) {
+        frame.SetColor(COLOR_YELLOW);
+        frame.Print("                                    [PAUSED]                                    \n");
     }
-    printf("\n");
+    else if (snapshot.refreshing) {
+        frame.SetColor(COLOR_YELLOW);
+        frame.Print("                                  [REFRESHING]                                  \n");
+    }
+    frame.Print("\n");
 
-    DisplayCacheHealth();
-    DisplayCacheEntries();
-    DisplayLegend();
+    DisplayCacheHealth(frame, snapshot);
+    DisplayCacheEntries(frame, snapshot);
+    DisplayLegend(frame);
 
     // Controls
-    SetConsoleColor(COLOR_MAGENTA);
-    printf("CONTROLS:\n");
-    SetConsoleColor(COLOR_GRAY);
-    printf("----------------------------------------------------------------------------------------\n");
-    SetConsoleColor(COLOR_WHITE);
-    printf("[F] Flush DNS Cache   [R] Refresh Cache List   [P] Pause/Resume   [Q] Quit\n");
-    printf("[N] Next Page   [B] Previous Page   [V] View Full Cache   [C] Network Config\n");
-
-    SetConsoleColor(COLOR_RESET);
-    fflush(stdout);
+    frame.SetColor(COLOR_MAGENTA);
+    frame.Print("CONTROLS:\n");
+    frame.SetColor(COLOR_GRAY);
+    frame.Print("----------------------------------------------------------------------------------------\n");
+    frame.SetColor(COLOR_WHITE);
+    frame.Print("[F] Evict Bad Entries   [R] Refresh Cache List   [P] Pause/Resume   [Q] Quit\n");
+    frame.Print("[N] Next Page   [B] Previous Page   [V] View Full Cache   [C] Network Config\n");
+    frame.Print("[D] Direct Probes (bypass OS cache)   [X] Flush Whole Cache\n");
+    frame.Print("[T] Status Filter   [S] Sort   [/] Domain Filter (Enter to apply, Esc to cancel)\n");
+
+    // Cost of the previous frame, and how often this thread woke to draw it
+    frame.SetColor(COLOR_GRAY);
+    frame.Print("Frame: %.2fms   %llu bytes   %d cells changed   %.1f wakeups/s\n",
+        renderStats.frameMs, (unsigned long long)renderStats.bytesWritten, renderStats.cellsChanged, g_uiWakeupsPerSec);
+
+    g_renderer->Present();
 }
 
-// Process user input
-void ProcessInput() {
-    if (_kbhit()) {
-        int key = _getch();
+// Ask every thread to finish its current step and exit
+void RequestExit() {
+    g_shouldExit = true;
+    if (g_exitEvent) {
+        SetEvent(g_exitEvent);      // Also ends the UI thread's wait
+    }
 
-        switch (key) {
-        case 'F':
-        case 'f':
-            system("ipconfig /flushdns");
-            g_cacheEntries.clear();
-            printf("\n\nDNS cache flushed! Refreshing cache list...\n");
+    // Take each lock once so a thread about to wait cannot miss the wakeup
+    { std::lock_guard<std::mutex> lock(g_monitorLock); }
+    g_monitorWake.notify_all();
+    g_exportDone.notify_all();
+    { std::lock_guard<std::mutex> lock(g_parseLock); }
+    g_parseWake.notify_all();
+}
+
+// Queue a command for the monitor thread
+void PostCommand(MonitorCommand command) {
+    {
+        std::lock_guard<std::mutex> lock(g_monitorLock);
+        g_commands.push_back(command);
+    }
+    g_monitorWake.notify_one();
+}
+
+// Narrow the view to a domain and the names under it; "" shows every name
+void PostSuffix(const std::string& suffix) {
+    {
+        std::lock_guard<std::mutex> lock(g_monitorLock);
+        g_commandSuffix = suffix;
+        g_commands.push_back(MonitorCommand::SetSuffix);
+    }
+    g_monitorWake.notify_one();
+}
+
+// Have the monitor thread format an export; runs on the metrics server's page thread
+bool RequestExport(ExportFormat format, std::string& body) {
+    ExportRequest request = { format, std::string(), false };
+    std::unique_lock<std::mutex> lock(g_monitorLock);
+    g_exportRequests.push_back(&request);
+    g_monitorWake.notify_one();
+
+    bool done = g_exportDone.wait_for(lock, std::chrono::milliseconds(EXPORT_TIMEOUT_MS), [&] {
+        return request.done || g_shouldExit;
+    });
+    if (!request.done) {
+        // Withdraw it so the monitor thread never writes to it after we return
+        g_exportRequests.erase(std::remove(g_exportRequests.begin(), g_exportRequests.end(), &request),
+            g_exportRequests.end());
+        return false;
+    }
+    body.swap(request.body);
+    return done;
+}
+
+// Pages served by the metrics server
+bool ServeMetricsPage(const std::string& path, std::string& contentType, std::string& body) {
+    if (path == "/metrics") {
+        contentType = "text/plain; version=0.0.4";
+        return RequestExport(ExportFormat::Prometheus, body);
+    }
+    if (path == "/hosts") {
+        contentType = "application/x-ndjson";
+        return RequestExport(ExportFormat::HostLines, body);
+    }
+    if (path == "/alerts") {
+        contentType = "application/x-ndjson";
+        return RequestExport(ExportFormat::Alerts, body);
+    }
+    return false;
+}
+
+// Ask the parser thread to re-read the cache
+void RequestParse(ParseRequest request, EvictionPlan* plan = nullptr) {
+    {
+        std::lock_guard<std::mutex> lock(g_parseLock);
+        if (request > g_parseRequest) {
+            g_parseRequest = request;
+        }
+        if (plan) {
+            g_evictionPlan = std::move(*plan);
+        }
+    }
+    g_parseWake.notify_one();
+}
+
+// Choose what an eviction removes: names with a stale, unreachable or
+// changed entry. Eviction works on whole names, so a bad A record takes the
+// AAAA with it. Names that still resolve are warmed again, busiest first;
+// if the backend has to flush everything, the busiest healthy names are.
+EvictionPlan BuildEvictionPlan() {
+    EvictionPlan plan;
+    std::unordered_set<uint32_t> evict;
+    for (size_t row = 0; row < g_entries.Size(); row++) {
+        if (g_entries.Flags(row) & (ENTRY_STALE | ENTRY_UNREACHABLE | ENTRY_CHANGED)) {
+            evict.insert(g_entries.HostId(row));
+        }
+    }
+
+    std::unordered_set<uint32_t> seen;
+    std::unordered_set<uint32_t> ranked;
+    std::vector<std::pair<uint32_t, size_t>> resolvable;    // Lookups, a healthy row of the name
+    for (size_t row = 0; row < g_entries.Size(); row++) {
+        uint32_t hostId = g_entries.HostId(row);
+        uint8_t flags = g_entries.Flags(row);
+        if (seen.insert(hostId).second && evict.count(hostId)) {
+            plan.evict.push_back(std::string(g_entries.Hostname(row)));
+        }
+        if ((flags & ENTRY_REACHABLE) && !(flags & (ENTRY_NEGATIVE | ENTRY_UNREACHABLE)) && ranked.insert(hostId).second) {
+            resolvable.push_back({ g_entryState[row].lookups, row });
+        }
+    }
+    plan.kept = (int)(seen.size() - evict.size());
+
+    std::stable_sort(resolvable.begin(), resolvable.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (const auto& name : resolvable) {
+        std::string hostname(g_entries.Hostname(name.second));
+        if (evict.count(g_entries.HostId(name.second)) && (int)plan.warm.size() < g_warmCount) {
+            plan.warm.push_back(hostname);
+        }
+        if ((int)plan.warmAfterFlush.size() < g_warmCount) {
+            plan.warmAfterFlush.push_back(hostname);
+        }
+    }
+    return plan;
+}
+
+// Parser thread: reads the OS cache on request and every AUTO_REFRESH_INTERVAL_MS
+// unless paused, and hands the result to the monitor thread
+void ParserThread() {
+    auto nextRefresh = std::chrono::steady_clock::now() + std::chrono::milliseconds(AUTO_REFRESH_INTERVAL_MS);
+    std::unique_lock<std::mutex> lock(g_parseLock);
+    bool firstLoad = true;
+
+    while (!g_shouldExit) {
+        g_parseWake.wait_until(lock, nextRefresh, [] {
+            return g_shouldExit || g_parseRequest != ParseRequest::None;
+        });
+        if (g_shouldExit) break;
+
+        ParseRequest request = g_parseRequest;
+        g_parseRequest = ParseRequest::None;
+        EvictionPlan plan = std::move(g_evictionPlan);
+        g_evictionPlan = EvictionPlan();
+        if (request == ParseRequest::None) {
+            nextRefresh = std::chrono::steady_clock::now() + std::chrono::milliseconds(AUTO_REFRESH_INTERVAL_MS);
+            if (g_pauseMonitoring) continue;
+            request = ParseRequest::Refresh;
+        }
+        lock.unlock();
+
+        g_parsing = true;
+        { std::lock_guard<std::mutex> monitorLock(g_monitorLock); }
+        g_monitorWake.notify_one();     // Shows [REFRESHING]
+        EvictionReport eviction = {};
+        if (request == ParseRequest::Flush) {
+            g_cacheControl->FlushAll();
             Sleep(1000);
-            g_cacheEntries = ParseDNSCache();
+        }
+        else if (request == ParseRequest::Evict) {
+            eviction = RunEviction(g_cacheControl, plan);
+        }
+
+        // Until the first load, or a load after a flush, is read the monitor
+        // has nothing to probe. Partial tables are supersets of each other, so
+        // merging one drops nothing; the final table settles removals.
+        bool reset = request == ParseRequest::Flush;
+        auto publishPartial = [&](const EntryTable& partial) {
+            EntryTable copy(partial);
+            {
+                std::lock_guard<std::mutex> monitorLock(g_monitorLock);
+                std::swap(g_parsedEntries, copy);
+                g_parsedReady = true;
+                g_parsedReset = g_parsedReset || reset;
+            }
+            reset = false;
+            g_monitorWake.notify_one();
+        };
+        std::function<void(const EntryTable&)> onPartial;
+        if (firstLoad || request == ParseRequest::Flush) {
+            onPartial = publishPartial;
+        }
+        firstLoad = false;
+
+        EntryTable entries = ParseDNSCache(onPartial);
+        {
+            std::lock_guard<std::mutex> monitorLock(g_monitorLock);
+            std::swap(g_parsedEntries, entries);
+            g_parsedReady = true;
+            g_parsedReset = g_parsedReset || reset;
+            if (request == ParseRequest::Evict) {
+                g_parsedEviction = eviction;
+                g_parsedEvicted = true;
+            }
+        }
+        g_parsing = false;
+        g_monitorWake.notify_one();
+
+        lock.lock();
+        nextRefresh = std::chrono::steady_clock::now() + std::chrono::milliseconds(AUTO_REFRESH_INTERVAL_MS);
+    }
+}
+
+// Apply commands queued by the UI thread
+void ApplyCommands() {
+    std::vector<MonitorCommand> commands;
+    std::string suffix;
+    {
+        std::lock_guard<std::mutex> lock(g_monitorLock);
+        commands.swap(g_commands);
+        suffix.swap(g_commandSuffix);
+    }
+    if (commands.empty()) return;
+    g_changes++;
+
+    // The page's rows are requeued by UpdatePage() before the next snapshot
+    int pages = (int)((g_viewEntries + ENTRIES_PER_PAGE - 1) / ENTRIES_PER_PAGE);
+    for (MonitorCommand command : commands) {
+        switch (command) {
+        case MonitorCommand::TogglePause:
+            g_pauseMonitoring = !g_pauseMonitoring;
+            break;
+
+        case MonitorCommand::ToggleDirect:
+            if (g_dnsClient) {
+                g_directProbes = !g_directProbes;
+            }
+            break;
+
+        case MonitorCommand::NextPage:
+            if (g_currentPage < pages - 1) {
+                g_currentPage++;
+            }
+            break;
+
+        case MonitorCommand::PreviousPage:
+            if (g_currentPage > 0) {
+                g_currentPage--;
+            }
+            break;
+
+        case MonitorCommand::NextFilter:
+            g_view.filter = (EntryFilter)(((int)g_view.filter + 1) % (int)EntryFilter::Count);
+            g_currentPage = 0;
+            break;
+
+        case MonitorCommand::NextSort:
+            g_view.sort = (EntrySort)(((int)g_view.sort + 1) % (int)EntrySort::Count);
+            g_currentPage = 0;
+            break;
+
+        case MonitorCommand::SetSuffix:
+            g_view.suffix = suffix;
+            g_currentPage = 0;
+            break;
+
+        case MonitorCommand::Evict: {
+            EvictionPlan plan = BuildEvictionPlan();
+            RequestParse(ParseRequest::Evict, &plan);
+            break;
+        }
+        }
+    }
+}
+
+// Copy what the UI needs into a new snapshot and publish it
+void PublishSnapshot() {
+    auto snapshot = std::make_shared<MonitorSnapshot>();
+    auto now = std::chrono::steady_clock::now();
+
+    snapshot->stats = g_stats;
+    snapshot->view = g_view;
+    snapshot->viewEntries = g_viewEntries;
+    for (size_t i : g_pageRows) {
+        uint8_t flags = g_entries.Flags(i);
+        EntryRow row;
+        row.hostname = std::string(g_entries.Hostname(i));
+        row.kind = g_entries.Kind(i);
+        row.ipAddress = FormatAddress(g_entries.Address(i));
+        row.moreAddresses = (std::max)((int)g_entries.AddressCount(i) - 1, 0);
+        row.target = std::string(g_entries.Target(i));
+        row.ttl = g_entries.Ttl(i);
+        row.lastResponseTime = g_entries.ResponseMs(i);
+        row.isReachable = (flags & ENTRY_REACHABLE) != 0;
+        row.isStale = (flags & ENTRY_STALE) != 0;
+        row.addressChanged = (flags & ENTRY_CHANGED) != 0;
+        row.isNegative = (flags & ENTRY_NEGATIVE) != 0;
+        row.isUnreachable = (flags & ENTRY_UNREACHABLE) != 0;
+        const EntryProbeState& connect = g_entryState[g_probeRow[i]];
+        row.connectTested = connect.connectTested;
+        row.connectOutcome = connect.connectOutcome;
+        row.connectMs = connect.connectMs;
+        row.history = g_entryState[i].latency->Snapshot();
+        snapshot->page.push_back(std::move(row));
+    }
+
+    snapshot->directProbes = g_directProbes && g_dnsClient;
+    snapshot->probeStats = snapshot->directProbes ? g_dnsClient->GetStats() : g_probeEngine->GetStats();
+    const AdaptiveRate& control = ActiveBudget().control;
+    snapshot->probeRate = control.Rate();
+    snapshot->probeWindow = control.Window();
+    snapshot->probeCeiling = control.Config().maxRate;
+    snapshot->probeTrend = control.Trend();
+    snapshot->probeIntervalP95 = control.LastP95();
+    snapshot->probeIntervalTimeouts = control.LastTimeoutRate();
+    if (snapshot->directProbes) {
+        snapshot->directServer = g_dnsClient->Config().server;
+    }
+    snapshot->connectProbes = g_connectProbe != nullptr;
+    if (g_connectProbe) {
+        snapshot->connectStats = g_connectProbe->GetStats();
+    }
+    snapshot->evicted = g_evicted;
+    snapshot->lastEviction = g_lastEviction;
+    g_anomalies.Ranked(snapshot->alerts, 1);
+    snapshot->lastRefresh = g_lastRefresh;
+    snapshot->shortWindow = g_latencyWindow.Snapshot(now, LATENCY_SHORT_WINDOW);
+    snapshot->longWindow = g_latencyWindow.Snapshot(now, LATENCY_LONG_WINDOW);
+    snapshot->paused = g_pauseMonitoring;
+    snapshot->refreshing = g_parsing;
+
+    std::atomic_store(&g_snapshot, std::shared_ptr<const MonitorSnapshot>(std::move(snapshot)));
+}
+
+// How long the monitor thread may sleep: until the next probe is due. Results,
+// commands, parses and exports wake it sooner; a full probe window waits for
+// a result, and getaddrinfo probes need Poll() to notice their deadlines.
+std::chrono::milliseconds MonitorWait() {
+    std::chrono::milliseconds idle(g_probeEngine->Pending() > 0 ? MONITOR_EXPIRY_CHECK_MS : MONITOR_IDLE_MAX_MS);
+    if (g_scheduler.Empty() || g_pauseMonitoring || PendingProbes() >= ActiveBudget().control.Window()) {
+        return idle;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto untilDue = g_scheduler.NextDue() > now ? g_scheduler.NextDue() - now : ActiveBudget().bucket.Delay(now);
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(untilDue) + std::chrono::milliseconds(1);
+    return (std::min)(wait, idle);
+}
+
+// Hand the fleet collector this monitor's counts and every probed entry,
+// once per --report-interval. The whole list goes to the sender each time;
+// it passes on only entries whose result changed or that were probed since.
+void ReportToFleet() {
+    auto now = std::chrono::steady_clock::now();
+    if (!g_fleetSender || now < g_nextFleetReport) return;
+    g_nextFleetReport = now + std::chrono::seconds(g_fleetIntervalSeconds);
+
+    CalculateStats();
+    FleetReport report = {};
+    report.timestamp = (uint64_t)time(nullptr);
+    report.full = true;
+    report.summary.entries = (uint32_t)g_stats.totalEntries;
+    report.summary.reachable = (uint32_t)g_stats.reachableEntries;
+    report.summary.stale = (uint32_t)g_stats.staleEntries;
+    report.summary.timeouts = (uint32_t)g_stats.timeoutEntries;
+    report.summary.slow = (uint32_t)g_stats.slowEntries;
+    report.summary.changed = (uint32_t)g_stats.changedEntries;
+    report.summary.negative = (uint32_t)g_stats.negativeEntries;
+    report.summary.unreachable = (uint32_t)g_stats.unreachableEntries;
+    report.summary.avgResponseMs = (uint32_t)g_stats.avgResponseTime;
+    report.summary.activeAlerts = (uint32_t)g_stats.activeAlerts;
+    report.summary.needsFlush = g_stats.needsFlush ? 1 : 0;
+
+    for (size_t row = 0; row < g_entries.Size(); row++) {
+        EntryProbeState& state = g_entryState[row];
+        LatencySnapshot history = state.latency->Snapshot();
+        if (history.Samples() + history.timeouts == 0) continue;     // Untested; nothing to merge
+
+        report.hosts.push_back({ AlertHost(row), (uint8_t)(g_entries.Flags(row) & ~ENTRY_PENDING), g_entries.ResponseMs(row),
+            state.fleetProbes, state.fleetFailures, false, 0 });
+        state.fleetProbes = 0;
+        state.fleetFailures = 0;
+    }
+    g_fleetSender->Submit(report);
+}
+
+// Engine callback: a probe result is queued. Runs on an engine thread with
+// the engine's lock held, which is safe because nothing calls into an engine
+// while holding g_monitorLock.
+void NotifyProbeResult() {
+    {
+        std::lock_guard<std::mutex> lock(g_monitorLock);
+        g_resultsReady = true;
+    }
+    g_monitorWake.notify_one();
+}
+
+// Monitor thread: owns the cache list. Merges parser results, runs probes and
+// answers metrics exports, sleeping until one of them has work. With a UI it
+// publishes a snapshot when something shown changed, at most once a cycle,
+// and at least every UI_HEARTBEAT_MS.
+void MonitorThread() {
+    uint64_t published = 0;         // g_changes as of the last snapshot
+    bool refreshing = false;        // [REFRESHING] as of the last snapshot
+    auto heartbeat = std::chrono::steady_clock::now();
+    while (!g_shouldExit) {
+        ApplyCommands();
+        ApplyParsedEntries();
+
+        // Probes run on the engine; this only collects results and tops up the queue
+        UpdateCacheEntries();
+        ApplyExports();
+        ReportToFleet();
+
+        std::chrono::milliseconds wait = MonitorWait();
+        if (!g_headless) {
+            auto now = std::chrono::steady_clock::now();
+            if (g_changes != published || g_parsing != refreshing || now >= heartbeat) {
+                published = g_changes;
+                refreshing = g_parsing;
+                heartbeat = now + std::chrono::milliseconds(UI_HEARTBEAT_MS);
+                UpdatePage();
+                CalculateStats();
+                PublishSnapshot();
+                g_uiLoop.Wake();
+            }
+            auto untilHeartbeat = std::chrono::duration_cast<std::chrono::milliseconds>(heartbeat - now);
+            wait = (std::min)(wait, untilHeartbeat + std::chrono::milliseconds(1));
+        }
+
+        std::unique_lock<std::mutex> lock(g_monitorLock);
+        g_monitorWake.wait_for(lock, wait, [&] {
+            return g_shouldExit || !g_commands.empty() || !g_exportRequests.empty() || g_parsedReady ||
+                g_resultsReady || (!g_headless && g_parsing != refreshing);
+        });
+        g_resultsReady = false;
+    }
+}
+
+// Drop console input _getch() would not return: key releases, bare modifier
+// keys, mouse and focus events. The input handle stays signaled while any
+// record is queued, so leaving them would wake the UI thread again at once.
+// True if the window was resized.
+bool DiscardNonKeyInput(HANDLE input) {
+    bool resized = false;
+    INPUT_RECORD record;
+    DWORD count;
+    while (PeekConsoleInputA(input, &record, 1, &count) && count == 1) {
+        if (record.EventType == KEY_EVENT && record.Event.KeyEvent.bKeyDown && record.Event.KeyEvent.uChar.AsciiChar != 0) {
+            break;
+        }
+        if (record.EventType == WINDOW_BUFFER_SIZE_EVENT) {
+            resized = true;
+        }
+        ReadConsoleInputA(input, &record, 1, &count);
+    }
+    return resized;
+}
+
+// Process user input. Runs on the UI thread, so nothing here may wait on
+// probes. True if the screen has to be drawn again whether or not the
+// monitor publishes anything.
+bool ProcessInput(HANDLE input) {
+    bool redraw = false;
+    for (;;) {
+        if (DiscardNonKeyInput(input)) {
+            g_renderer->Invalidate();
+            redraw = true;
+        }
+        if (!_kbhit()) break;
+        int key = _getch();
+
+        // While a domain is typed after [/] every key goes to it
+        if (g_editingSuffix) {
+            if (key == '\r') {
+                g_editingSuffix = false;
+                PostSuffix(g_suffixInput);
+            }
+            else if (key == 27) {
+                g_editingSuffix = false;
+                g_suffixInput.clear();
+            }
+            else if (key == '\b') {
+                if (!g_suffixInput.empty()) g_suffixInput.pop_back();
+            }
+            else if (key == 0 || key == 0xE0) {
+                _getch();   // Second half of a function or arrow key
+            }
+            else if (key > ' ' && key < 127 && g_suffixInput.size() < MAX_SUFFIX_INPUT) {
+                g_suffixInput.push_back((char)key);
+            }
+            redraw = true;
+            continue;
+        }
+
+        switch (key) {
+        case 'F':
+        case 'f':
+            if (g_localCache) {
+                PostCommand(MonitorCommand::Evict);
+            }
+            break;
+
+        case 'X':
+        case 'x':
+            if (g_localCache) {
+                RequestParse(ParseRequest::Flush);
+            }
             break;
 
         case 'R':
         case 'r':
-            printf("\n\nRefreshing DNS cache list...\n");
-            g_cacheEntries = ParseDNSCache();
-            g_currentPage = 0;
-            Sleep(1000);
+            RequestParse(ParseRequest::Refresh);
             break;
 
         case 'V':
         case 'v':
+            system("cls");
             system("ipconfig /displaydns | more");
+            g_renderer->Invalidate();
+            redraw = true;
             break;
 
         case 'C':
         case 'c':
+            system("cls");
             system("ipconfig /all | more");
+            g_renderer->Invalidate();
+            redraw = true;
             break;
 
         case 'P':
         case 'p':
-            g_pauseMonitoring = !g_pauseMonitoring;
+            PostCommand(MonitorCommand::TogglePause);
+            break;
+
+        case 'D':
+        case 'd':
+            PostCommand(MonitorCommand::ToggleDirect);
             break;
 
         case 'N': 
 		case 'n':
-            if (g_currentPage < g_stats.pagesTotal - 1) {
-                g_currentPage++;
-            }
+            PostCommand(MonitorCommand::NextPage);
             break;
 
         case 'B':
 		case 'b':
-            if (g_currentPage > 0) {
-                g_currentPage--;
-            }
+            PostCommand(MonitorCommand::PreviousPage);
+            break;
+
+        case 'T':
+        case 't':
+            PostCommand(MonitorCommand::NextFilter);
+            break;
+
+        case 'S':
+        case 's':
+            PostCommand(MonitorCommand::NextSort);
+            break;
+
+        case '/':
+            g_editingSuffix = true;
+            g_suffixInput.clear();
+            redraw = true;
             break;
 
         case 'Q':
         case 'q':
         case 27: // Escape
-            g_shouldExit = TRUE;
-            SetEvent(g_exitEvent);
+            RequestExit();
             break;
         }
     }
+    return redraw;
 }
 
 // Console control handler
@@ -580,10 +2154,7 @@ BOOL WINAPI ConsoleCtrlHandler(DWORD dwCtrlType) {
     case CTRL_C_EVENT:
     case CTRL_BREAK_EVENT:
     case CTRL_CLOSE_EVENT:
-        g_shouldExit = TRUE;
-        if (g_exitEvent) {
-            SetEvent(g_exitEvent);
-        }
+        RequestExit();
         return TRUE;
     }
     return FALSE;
@@ -596,53 +2167,733 @@ BOOL InitializeWinsock() {
     return (result == 0);
 }
 
-// Main monitoring loop
+// Main monitoring loop: starts the worker threads, then sleeps on this thread
+// until a key, a new snapshot or exit, and draws only when there is
+// something new, at most once per UI_FRAME_MS
 void MonitorDNS() {
-    const int UPDATE_INTERVAL_MS = 5000; // 5 seconds
-    auto lastUpdate = std::chrono::steady_clock::now();
-
-    // Initial cache load
-    g_cacheEntries = ParseDNSCache();
-
+    std::thread parser(ParserThread);
+    std::thread monitor(MonitorThread);
+
+    HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+    g_uiLoop.Watch(input, EVENT_INPUT);
+    g_uiLoop.Watch(g_exitEvent, EVENT_EXIT);
+
+    std::shared_ptr<const MonitorSnapshot> drawn;
+    bool redraw = false;
+    auto nextFrame = std::chrono::steady_clock::now();
+    auto rateStart = nextFrame;
+    uint64_t rateWaits = 0;
     while (!g_shouldExit) {
+        redraw = ProcessInput(input) || redraw;
+
+        std::shared_ptr<const MonitorSnapshot> snapshot = std::atomic_load(&g_snapshot);
+        bool due = snapshot && (snapshot != drawn || redraw);
         auto now = std::chrono::steady_clock::now();
-        auto timeSinceUpdate = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastUpdate);
+        if (due && now >= nextFrame) {
+            double seconds = std::chrono::duration<double>(now - rateStart).count();
+            if (seconds >= 1.0) {
+                uint64_t waits = g_uiLoop.Stats().waits;
+                g_uiWakeupsPerSec = (waits - rateWaits) / seconds;
+                rateWaits = waits;
+                rateStart = now;
+            }
+
+            DisplayInterface(*snapshot);
+            drawn = snapshot;
+            redraw = false;
+            due = false;
+            nextFrame = now + std::chrono::milliseconds(UI_FRAME_MS);
+        }
+
+        g_uiLoop.Wait(due ? nextFrame : std::chrono::steady_clock::time_point::max());
+    }
+
+    monitor.join();
+    parser.join();
+}
+
+// Headless mode: the same parser and monitor threads, no console UI. Results
+// are served on the metrics endpoint until Ctrl+C or the service stops us.
+int RunHeadless(const MetricsServerConfig& config) {
+    g_headless = true;
+    g_metricsServer.reset(new MetricsServer(config, ServeMetricsPage));
+    if (!g_metricsServer->Start()) {
+        printf("Cannot listen on %s:%u\n", config.address.c_str(), (unsigned)config.port);
+        g_metricsServer.reset();
+        return 1;
+    }
+    printf("Serving http://%s:%u/metrics, /hosts, /alerts and %s%s\n", config.address.c_str(), (unsigned)config.port,
+        config.streamPath.c_str(), g_directProbes ? " (direct probes)" : "");
+
+    std::thread parser(ParserThread);
+    std::thread monitor(MonitorThread);
+    WaitForSingleObject(g_exitEvent, INFINITE);
+    RequestExit();
+    monitor.join();
+    parser.join();
+
+    g_metricsServer.reset();
+    return 0;
+}
+
+// Compare upstream resolvers on the cached hostname set (namebench-style)
+int RunResolverComparison(const ResolverCompareConfig& config) {
+    EntryTable entries = ParseDNSCache();
+    std::vector<CompareTarget> targets;
+    for (size_t row = 0; row < entries.Size(); row++) {
+        if (entries.Kind(row) != RecordKind::A) continue;   // The comparison asks each resolver for A records
+        targets.push_back({ std::string(entries.Hostname(row)), FormatAddress(entries.Address(row)) });
+    }
+
+    SetConsoleColor(COLOR_CYAN);
+    printf("Comparing %d resolvers on %d cached hostnames (max %.0f queries/sec each)\n",
+        (int)config.resolvers.size(), (int)targets.size(), config.queriesPerSecond);
+    SetConsoleColor(COLOR_RESET);
+
+    std::vector<ResolverReport> reports = CompareResolvers(targets, config, [](int done, int total) {
+        if (done % 10 == 0 || done == total) {
+            printf("\rQueried %d of %d...", done, total);
+            fflush(stdout);
+        }
+    });
+    printf("\n\n");
+
+    SetConsoleColor(COLOR_WHITE);
+    printf("%-28s  %7s  %7s  %7s  %7s  %8s  %9s\n", "Resolver", "Queries", "p50", "p95", "p99", "Timeouts", "Disagree");
+    SetConsoleColor(COLOR_GRAY);
+    printf("----------------------------------------------------------------------------------------\n");
+
+    for (const auto& report : reports) {
+        SetConsoleColor(COLOR_WHITE);
+        printf("%-28s  ", report.server.c_str());
+        if (!report.usable) {
+            SetConsoleColor(COLOR_RED);
+            printf("invalid resolver address\n");
+            continue;
+        }
+
+        printf("%7d  ", report.queries);
+        SetConsoleColor(GetResponseTimeColor(report.p50));
+        printf("%5lums  ", (unsigned long)report.p50);
+        SetConsoleColor(GetResponseTimeColor(report.p95));
+        printf("%5lums  ", (unsigned long)report.p95);
+        SetConsoleColor(GetResponseTimeColor(report.p99));
+        printf("%5lums  ", (unsigned long)report.p99);
+        SetConsoleColor(report.timeouts > 0 ? COLOR_RED : COLOR_GREEN);
+        printf("%7.1f%%  ", report.timeoutRate);
+        SetConsoleColor(report.disagreements > 0 ? COLOR_MAGENTA : COLOR_GREEN);
+        printf("%8.1f%%\n", report.disagreementRate);
+    }
+
+    SetConsoleColor(COLOR_RESET);
+    return 0;
+}
+
+// Ask the resolver, without recursion, which cached addresses it still
+// holds, and list the names where it and the local cache have parted ways
+int RunCacheSnoop(const CacheSnoopConfig& config) {
+    EntryTable entries = ParseDNSCache();
+    std::vector<SnoopTarget> targets;
+    for (size_t row = 0; row < entries.Size(); row++) {
+        RecordKind kind = entries.Kind(row);
+        if (kind != RecordKind::A && kind != RecordKind::AAAA) continue;
+        targets.push_back({ std::string(entries.Hostname(row)), kind == RecordKind::A ? DNS_TYPE_A : DNS_TYPE_AAAA,
+            FormatAddress(entries.Address(row)), entries.Ttl(row) });
+    }
 
-        if (!g_pauseMonitoring && timeSinceUpdate.count() >= UPDATE_INTERVAL_MS) {
-            UpdateCacheEntries();
-            lastUpdate = now;
+    SetConsoleColor(COLOR_CYAN);
+    printf("Checking %s's cache for %d cached addresses without recursion (%d at a time)\n",
+        config.server.c_str(), (int)targets.size(), config.batchSize);
+    SetConsoleColor(COLOR_RESET);
+
+    CacheSnoopReport report = SnoopResolverCache(targets, config, [](int done, int total) {
+        if (done % 100 == 0 || done == total) {
+            printf("\rQueried %d of %d...", done, total);
+            fflush(stdout);
         }
+    });
+    printf("\n\n");
+    if (!report.usable) {
+        SetConsoleColor(COLOR_RED);
+        printf("Invalid resolver address %s\n", config.server.c_str());
+        SetConsoleColor(COLOR_RESET);
+        return 1;
+    }
+    if (report.refused > 0 && report.refused == report.queries) {
+        SetConsoleColor(COLOR_YELLOW);
+        printf("%s refuses non-recursive queries, so its cache cannot be checked\n", config.server.c_str());
+        SetConsoleColor(COLOR_RESET);
+        return 1;
+    }
 
-        CalculateStats();
-        DisplayInterface();
-        ProcessInput();
+    // Names that differ: another address upstream, gone from upstream while
+    // still cached here, or a TTL that shows the two copies are not the same
+    SetConsoleColor(COLOR_WHITE);
+    printf("%-40s  %-5s  %-10s  %9s  %9s  %s\n", "Hostname", "Type", "Upstream", "Local TTL", "Up TTL", "Address");
+    SetConsoleColor(COLOR_GRAY);
+    printf("----------------------------------------------------------------------------------------\n");
+    int listed = 0;
+    for (size_t i = 0; i < targets.size(); i++) {
+        const SnoopTarget& target = targets[i];
+        const SnoopResult& result = report.results[i];
+        bool moved = result.status == SnoopStatus::Cached && !result.addressMatches;
+        bool gone = result.status == SnoopStatus::NotCached || result.status == SnoopStatus::Negative;
+        bool diverged = result.status == SnoopStatus::Cached &&
+            (result.ttlDelta > (int64_t)config.ttlSlack || result.ttlDelta < -(int64_t)config.ttlSlack);
+        if (!moved && !gone && !diverged) continue;
+        if (++listed > MAX_SNOOP_LISTED) continue;
 
-        Sleep(200);
+        SetConsoleColor(COLOR_WHITE);
+        printf("%-40.40s  %-5s  ", target.hostname.c_str(), target.type == DNS_TYPE_A ? "A" : "AAAA");
+        SetConsoleColor(moved ? COLOR_MAGENTA : gone ? COLOR_YELLOW : COLOR_CYAN);
+        printf("%-10s  ", SnoopStatusName(result.status));
+        SetConsoleColor(COLOR_WHITE);
+        printf("%8lus  ", (unsigned long)target.cachedTtl);
+        if (result.status == SnoopStatus::Cached) {
+            printf("%8lus  ", (unsigned long)result.upstreamTtl);
+        }
+        else {
+            printf("%9s  ", "-");
+        }
+        printf("%s\n", moved ? "differs" : "");
+    }
+    if (listed > MAX_SNOOP_LISTED) {
+        SetConsoleColor(COLOR_GRAY);
+        printf("... and %d more\n", listed - MAX_SNOOP_LISTED);
+    }
+
+    SetConsoleColor(COLOR_WHITE);
+    printf("\nCached upstream: %d   Not cached: %d   NXDOMAIN: %d   Refused: %d   Timeouts: %d   Errors: %d\n",
+        report.cached, report.notCached, report.negative, report.refused, report.timeouts, report.errors);
+    SetConsoleColor(report.addressMismatches > 0 ? COLOR_MAGENTA : COLOR_GREEN);
+    printf("Address differs: %d   ", report.addressMismatches);
+    SetConsoleColor(report.upstreamNewer + report.localOutlives > 0 ? COLOR_CYAN : COLOR_GREEN);
+    printf("Newer copy upstream: %d   Local copy outlives upstream: %d\n", report.upstreamNewer, report.localOutlives);
+    SetConsoleColor(COLOR_GRAY);
+    printf("%d queries in %.2fs, no recursion asked for\n", report.queries, report.seconds);
+    SetConsoleColor(COLOR_RESET);
+    return 0;
+}
+
+// Options for reading back the probe history
+struct HistoryQuery {
+    std::string path = DEFAULT_STORE_PATH;
+    std::string host;               // Empty for a per-host summary
+    int hours = 24;
+    int bucketMinutes = 60;         // Row size of the single-host timeline
+};
+
+// Per-host totals for the history summary
+struct HostHistory {
+    LatencyHistogram latency;
+    uint32_t probes = 0;
+    uint32_t failures = 0;
+    uint32_t lastOk = 0;
+    uint32_t failingSince = 0;      // Start of the current run of failures, 0 if the last probe succeeded
+};
+
+void PrintHistoryTime(uint32_t timestamp) {
+    char text[32] = "-";
+    if (timestamp != 0) {
+        time_t value = (time_t)timestamp;
+        struct tm local;
+        localtime_s(&local, &value);
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M", &local);
     }
+    printf("%-16s", text);
+}
+
+// Print a host's latency and availability over time, one row per bucket
+int PrintHostTimeline(const ProbeStore& store, const HistoryQuery& query, uint32_t from, uint32_t to) {
+    uint32_t hostId;
+    if (!store.FindHost(query.host, hostId)) {
+        printf("No history for %s\n", query.host.c_str());
+        return 1;
+    }
+
+    SetConsoleColor(COLOR_WHITE);
+    printf("%s, last %d hours\n\n", query.host.c_str(), query.hours);
+    printf("%-16s  %6s  %6s  %7s  %7s  %7s  %s\n", "Time", "Probes", "Avail", "p50", "p99", "Max", "Address");
+    SetConsoleColor(COLOR_GRAY);
+    printf("----------------------------------------------------------------------------------------\n");
+
+    uint32_t step = (uint32_t)query.bucketMinutes * 60;
+    for (uint32_t start = from - from % step; start < to; start += step) {
+        LatencyHistogram latency;
+        uint32_t probes = 0;
+        uint32_t ok = 0;
+        std::string address;
+        store.Scan(start, start + step, hostId, [&](const ProbeRecord& record) {
+            probes++;
+            if (record.outcome == (uint8_t)StoredOutcome::Ok || record.outcome == (uint8_t)StoredOutcome::Changed) {
+                ok++;
+                latency.Record(record.latencyMs);
+                if (record.family != 0) address = RecordAddress(record);
+            }
+        });
+        if (probes == 0) continue;
+
+        LatencySnapshot counts = latency.Snapshot();
+        double available = 100.0 * ok / probes;
+        SetConsoleColor(COLOR_WHITE);
+        PrintHistoryTime(start);
+        printf("  %6lu  ", (unsigned long)probes);
+        SetConsoleColor(available >= 99.0 ? COLOR_GREEN : available >= 90.0 ? COLOR_YELLOW : COLOR_RED);
+        printf("%5.1f%%  ", available);
+        SetConsoleColor(GetResponseTimeColor(counts.Percentile(0.50)));
+        printf("%5lums  ", (unsigned long)counts.Percentile(0.50));
+        SetConsoleColor(GetResponseTimeColor(counts.Percentile(0.99)));
+        printf("%5lums  ", (unsigned long)counts.Percentile(0.99));
+        SetConsoleColor(GetResponseTimeColor(counts.maxLatency));
+        printf("%5lums  ", (unsigned long)counts.maxLatency);
+        SetConsoleColor(COLOR_CYAN);
+        printf("%s\n", address.c_str());
+    }
+    SetConsoleColor(COLOR_RESET);
+    return 0;
+}
+
+// Print every host's availability and latency over the window, least available first
+int PrintHistorySummary(const ProbeStore& store, const HistoryQuery& query, uint32_t from, uint32_t to) {
+    std::vector<HostHistory> hosts(store.HostCount());
+    size_t records = store.Scan(from, to, PROBE_STORE_ANY_HOST, [&](const ProbeRecord& record) {
+        if (record.hostId >= hosts.size()) return;     // Added to the dictionary after we loaded it
+        HostHistory& host = hosts[record.hostId];
+        host.probes++;
+        if (record.outcome == (uint8_t)StoredOutcome::Ok || record.outcome == (uint8_t)StoredOutcome::Changed) {
+            host.latency.Record(record.latencyMs);
+            host.lastOk = record.timestamp;
+            host.failingSince = 0;
+        }
+        else {
+            host.failures++;
+            if (host.failingSince == 0) host.failingSince = record.timestamp;
+        }
+    });
+
+    std::vector<uint32_t> order;
+    for (uint32_t id = 0; id < hosts.size(); id++) {
+        if (hosts[id].probes > 0) order.push_back(id);
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return (double)hosts[a].failures / hosts[a].probes > (double)hosts[b].failures / hosts[b].probes;
+    });
+
+    SetConsoleColor(COLOR_WHITE);
+    printf("%llu probes of %d hosts, last %d hours\n\n", (unsigned long long)records, (int)order.size(), query.hours);
+    printf("%-32s  %6s  %6s  %7s  %7s  %-16s  %s\n", "Host", "Probes", "Avail", "p50", "p99", "Last OK", "Failing Since");
+    SetConsoleColor(COLOR_GRAY);
+    printf("----------------------------------------------------------------------------------------------------\n");
+
+    for (uint32_t id : order) {
+        const HostHistory& host = hosts[id];
+        LatencySnapshot counts = host.latency.Snapshot();
+        double available = 100.0 * (host.probes - host.failures) / host.probes;
+
+        SetConsoleColor(COLOR_WHITE);
+        printf("%-32.32s  %6lu  ", store.HostName(id).c_str(), (unsigned long)host.probes);
+        SetConsoleColor(available >= 99.0 ? COLOR_GREEN : available >= 90.0 ? COLOR_YELLOW : COLOR_RED);
+        printf("%5.1f%%  ", available);
+        SetConsoleColor(GetResponseTimeColor(counts.Percentile(0.50)));
+        printf("%5lums  ", (unsigned long)counts.Percentile(0.50));
+        SetConsoleColor(GetResponseTimeColor(counts.Percentile(0.99)));
+        printf("%5lums  ", (unsigned long)counts.Percentile(0.99));
+        SetConsoleColor(COLOR_GRAY);
+        PrintHistoryTime(host.lastOk);
+        SetConsoleColor(host.failingSince ? COLOR_RED : COLOR_GRAY);
+        printf("  ");
+        PrintHistoryTime(host.failingSince);
+        printf("\n");
+    }
+    SetConsoleColor(COLOR_RESET);
+    return 0;
+}
+
+// Read the probe history written by earlier runs
+int RunHistoryQuery(const HistoryQuery& query) {
+    ProbeStore store;
+    if (!store.Open(query.path, DEFAULT_STORE_RECORDS, true)) {
+        printf("Cannot open probe history %s.probes\n", query.path.c_str());
+        return 1;
+    }
+
+    uint32_t to = (uint32_t)time(nullptr) + 1;
+    uint32_t from = to - (uint32_t)query.hours * 3600;
+    if (!query.host.empty()) {
+        return PrintHostTimeline(store, query, from, to);
+    }
+    return PrintHistorySummary(store, query, from, to);
+}
+
+// Print command line usage
+void PrintUsage() {
+    printf("Usage: DNSMonitor [--probe-rate <probes/sec>] [--direct] [--headless [--port <port>] [--listen <address>]] [--warm <names>]\n");
+    printf("                  [--connect [--connect-ports <ports>] [--connect-port <host>=<ports>]... [--connect-timeout <ms>]] [--record <trace>]\n");
+    printf("                  [--stats-suffix <domain>]... [--report <collector[:port]> [--report-interval <s>] [--report-name <name>]]\n");
+    printf("                  [--cache-format <format>] [--cache-command <command> | --cache-file <path>]\n");
+    printf("                  [--filter <status>] [--sort <order>] [--domain <suffix>]\n");
+    printf("       DNSMonitor --compare <server[:port]>... [--rate <queries/sec>] [--timeout <ms>]\n");
+    printf("       DNSMonitor --snoop [<server[:port]>] [--rate <queries/sec>] [--batch <n>] [--timeout <ms>]\n");
+    printf("       DNSMonitor --query [--store <path>] [--host <name>] [--hours <n>] [--bucket <minutes>]\n");
+    printf("  (no options)   Interactive cache health monitor\n");
+    printf("  --probe-rate   Ceiling on probes started per second (default %.0f); below it the rate adapts to the resolver\n",
+        DEFAULT_PROBE_BUDGET);
+    printf("  --direct       Start with direct probes (bypass the OS cache)\n");
+    printf("  --headless     No console UI; serve /metrics (Prometheus), /hosts, /alerts and /events (JSON lines)\n");
+    printf("  --port         Metrics port (default %u); --listen sets the address (default 127.0.0.1)\n",
+        (unsigned)MetricsServerConfig().port);
+    printf("  --store        Keep probe history in <path>.probes and <path>.hosts (off unless given; --query reads %s\n",
+        DEFAULT_STORE_PATH);
+    printf("                 unless given). One monitor per store; a store another monitor has open is refused\n");
+    printf("  --store-records  Records kept before the oldest are overwritten (default %llu)\n",
+        (unsigned long long)DEFAULT_STORE_RECORDS);
+    printf("  --warm         Names looked up again after [F] evicts bad entries (default %d; 0 disables)\n", g_warmCount);
+    printf("  --record       Write cache snapshots and probe results to a trace; replay it with DNSMonitorBench --replay\n");
+    printf("  --stats-suffix Also keep health counts for a domain and the names under it, exported per suffix; repeatable (up to %d)\n",
+        (int)EntryTally::MAX_SUFFIXES);
+    printf("  --report       Stream counts and probe results to a DNSCollector (port 9154 unless given), every %d s\n",
+        g_fleetIntervalSeconds);
+    printf("                 or --report-interval; --report-name sets this monitor's name (default the computer name)\n");
+    printf("  --cache-format Dump format to read: displaydns (default), unbound, dnsmasq or resolved\n");
+    printf("  --cache-command  Command printing the dump, e.g. \"ssh ns1 unbound-control dump_cache\"; defaults to the\n");
+    printf("                 format's own (ipconfig, unbound-control, resolvectl). --cache-file reads a dump file instead.\n");
+    printf("                 [F] and [X] act on this machine's cache, so they are off for any other source\n");
+    printf("  --filter       Entries listed at start: all (default), failing, slow, stale, changed, nxdomain or unreachable; [T] cycles\n");
+    printf("  --sort         Order at start: cache (default), slowest or recent-failures, ranking the top %d; [S] cycles\n",
+        (int)EntryIndex::TOP_K);
+    printf("  --domain       List only a domain and the names under it; [/] changes it\n");
+    printf("  --connect      TCP connect to each entry's cached addresses after it resolves\n");
+    printf("  --connect-ports  Comma-separated ports tried on every address (default 443)\n");
+    printf("  --connect-port   Ports for one host, or for a domain as *.example.com; repeatable\n");
+    printf("  --connect-timeout  Connect deadline in ms (default %lu)\n", (unsigned long)ConnectProbeConfig().deadlineMs);
+    printf("  --compare      Compare resolvers on the cached hostnames; defaults to the system server\n");
+    printf("  --snoop        Ask the resolver with non-recursive (RD=0) queries which cached names it still holds, and\n");
+    printf("                 list those whose address or TTL differs; --batch queries on the wire at once (default %d),\n",
+        CacheSnoopConfig().batchSize);
+    printf("                 --rate a ceiling (default %.0f; 0 for none). Defaults to the system server\n",
+        CacheSnoopConfig().queriesPerSecond);
+    printf("  --query        Summarize the probe history per host, or one host's timeline with --host\n");
 }
 
 // Main function
-int main() {
+int main(int argc, char* argv[]) {
     g_consoleHandle = GetStdHandle(STD_OUTPUT_HANDLE);
 
-    SetConsoleSize();
-    SetConsoleTitleA("DNS Cache Health Monitor");
-
     if (!InitializeWinsock()) {
         printf("Failed to initialize Winsock\n");
         return 1;
     }
 
+    if (argc > 1 && strcmp(argv[1], "--compare") == 0) {
+        int status = 1;
+        ResolverCompareConfig compareConfig;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+                compareConfig.queriesPerSecond = atof(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+                compareConfig.deadlineMs = (uint32_t)atoi(argv[++i]);
+            }
+            else {
+                compareConfig.resolvers.push_back(argv[i]);
+            }
+        }
+
+        std::string systemServer;
+        if (compareConfig.resolvers.empty() && GetSystemDnsServer(systemServer)) {
+            compareConfig.resolvers.push_back(systemServer);
+        }
+        if (compareConfig.queriesPerSecond > 0.0 && !compareConfig.resolvers.empty()) {
+            status = RunResolverComparison(compareConfig);
+        }
+        else {
+            PrintUsage();
+        }
+
+        WSACleanup();
+        return status;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--snoop") == 0) {
+        CacheSnoopConfig snoopConfig;
+        bool valid = true;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+                snoopConfig.queriesPerSecond = atof(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                snoopConfig.batchSize = atoi(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+                snoopConfig.deadlineMs = (uint32_t)atoi(argv[++i]);
+            }
+            else if (argv[i][0] != '-' && snoopConfig.server.empty()) {
+                snoopConfig.server = argv[i];
+            }
+            else {
+                valid = false;
+            }
+        }
+
+        int status = 1;
+        if (snoopConfig.server.empty()) {
+            GetSystemDnsServer(snoopConfig.server);
+        }
+        if (valid && !snoopConfig.server.empty() && snoopConfig.queriesPerSecond >= 0.0) {
+            status = RunCacheSnoop(snoopConfig);
+        }
+        else {
+            PrintUsage();
+        }
+
+        WSACleanup();
+        return status;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--query") == 0) {
+        HistoryQuery query;
+        bool valid = true;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--store") == 0 && i + 1 < argc) {
+                query.path = argv[++i];
+            }
+            else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
+                query.host = argv[++i];
+            }
+            else if (strcmp(argv[i], "--hours") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                query.hours = atoi(argv[++i]);
+            }
+            else if (strcmp(argv[i], "--bucket") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                query.bucketMinutes = atoi(argv[++i]);
+            }
+            else {
+                valid = false;
+            }
+        }
+
+        int status = 1;
+        if (valid) {
+            status = RunHistoryQuery(query);
+        }
+        else {
+            PrintUsage();
+        }
+        WSACleanup();
+        return status;
+    }
+
+    bool headless = false;
+    bool direct = false;
+    MetricsServerConfig metricsConfig;
+    std::string storePath;
+    uint64_t storeRecords = DEFAULT_STORE_RECORDS;
+    std::string recordPath;
+    FleetSenderConfig fleetConfig;
+    CacheFormat cacheFormat = CacheFormat::DisplayDns;
+    std::string cacheCommand;
+    std::string cacheFile;
+    bool connect = false;
+    ConnectProbeConfig connectConfig;
+    connectConfig.maxInFlight = CONNECT_IN_FLIGHT;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--probe-rate") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0.0) {
+            for (ProbeBudget* budget : { &g_systemBudget, &g_directBudget }) {
+                budget->control.SetCeiling(atof(argv[i + 1]));
+                budget->bucket.SetRate(budget->control.Rate());
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--direct") == 0) {
+            direct = true;
+        }
+        else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        }
+        else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            metricsConfig.port = (uint16_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            metricsConfig.address = argv[++i];
+        }
+        else if (strcmp(argv[i], "--store") == 0 && i + 1 < argc) {
+            storePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--store-records") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            storeRecords = (uint64_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            fleetConfig.collector = argv[++i];
+        }
+        else if (strcmp(argv[i], "--report-interval") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            g_fleetIntervalSeconds = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--report-name") == 0 && i + 1 < argc) {
+            fleetConfig.monitor = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache-format") == 0 && i + 1 < argc && ParseCacheFormat(argv[i + 1], cacheFormat)) {
+            i++;
+        }
+        else if (strcmp(argv[i], "--cache-command") == 0 && i + 1 < argc) {
+            cacheCommand = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cache-file") == 0 && i + 1 < argc) {
+            cacheFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stats-suffix") == 0 && i + 1 < argc && g_tally.AddSuffix(g_entries, argv[i + 1]) >= 0) {
+            i++;
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc && ParseEntryFilter(argv[i + 1], g_view.filter)) {
+            i++;
+        }
+        else if (strcmp(argv[i], "--sort") == 0 && i + 1 < argc && ParseEntrySort(argv[i + 1], g_view.sort)) {
+            i++;
+        }
+        else if (strcmp(argv[i], "--domain") == 0 && i + 1 < argc) {
+            g_view.suffix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--warm") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+            g_warmCount = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--connect") == 0) {
+            connect = true;
+        }
+        else if (strcmp(argv[i], "--connect-ports") == 0 && i + 1 < argc && ParsePortList(argv[i + 1], g_connectPorts)) {
+            i++;
+        }
+        else if (strcmp(argv[i], "--connect-port") == 0 && i + 1 < argc && strchr(argv[i + 1], '=') &&
+            ParsePortList(strchr(argv[i + 1], '=') + 1, g_hostPorts[std::string(argv[i + 1], strchr(argv[i + 1], '='))])) {
+            i++;
+        }
+        else if (strcmp(argv[i], "--connect-timeout") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            connectConfig.deadlineMs = (uint32_t)atoi(argv[++i]);
+        }
+        else {
+            PrintUsage();
+            WSACleanup();
+            return 1;
+        }
+    }
+
+    // Any source other than ipconfig is a cache somewhere else
+    if (!cacheFile.empty()) {
+        g_cacheSource.reset(new FileCacheSource(cacheFormat, cacheFile));
+        g_localCache = false;
+    }
+    else if (!cacheCommand.empty() || cacheFormat != CacheFormat::DisplayDns) {
+        if (cacheCommand.empty() && !DefaultCacheCommand(cacheFormat)) {
+            printf("%s has no dump command; give one with --cache-command or a file with --cache-file\n",
+                CacheFormatName(cacheFormat));
+            WSACleanup();
+            return 1;
+        }
+        g_cacheSource.reset(new CommandCacheSource(cacheFormat, cacheCommand.empty() ? DefaultCacheCommand(cacheFormat) : cacheCommand));
+        g_localCache = false;
+    }
+
+    if (!headless) {
+        SetConsoleSize();
+        SetConsoleTitleA("DNS Cache Health Monitor");
+    }
+
     g_exitEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
     if (!g_exitEvent) {
         printf("Failed to create exit event\n");
+        WSACleanup();
+        return 1;
+    }
+    if (!g_uiLoop.Open()) {
+        printf("Failed to open the UI event loop\n");
+        CloseHandle(g_exitEvent);
+        WSACleanup();
         return 1;
     }
 
+    ProbeEngineConfig probeConfig;
+    probeConfig.maxConcurrency = PROBE_CONCURRENCY;
+    probeConfig.deadlineMs = TEST_TIMEOUT_MS;
+    probeConfig.onResult = NotifyProbeResult;
+    g_probeEngine.reset(new ProbeEngine(probeConfig));
+
+    // Direct probes go to the first configured DNS server
+    DnsClientConfig dnsConfig;
+    dnsConfig.deadlineMs = TEST_TIMEOUT_MS;
+    dnsConfig.onResult = NotifyProbeResult;
+    if (GetSystemDnsServer(dnsConfig.server)) {
+        g_dnsClient.reset(new DnsClient(dnsConfig));
+        if (!g_dnsClient->Start()) {
+            g_dnsClient.reset();
+        }
+    }
+
+    g_directProbes = direct && g_dnsClient;
+    g_cacheControl = std::make_shared<SystemCacheControl>();
+    g_anomalies.SetListener(StreamAlert);
+
+    if (connect) {
+        connectConfig.onResult = NotifyProbeResult;
+        g_connectProbe.reset(new ConnectProbe(connectConfig));
+        if (!g_connectProbe->Start()) {
+            printf("Cannot start connect probes; continuing without them\n");
+            g_connectProbe.reset();
+        }
+    }
+
+    // Probe history, when asked for
+    if (!storePath.empty()) {
+        g_probeStore.reset(new ProbeStore());
+        if (!g_probeStore->Open(storePath, storeRecords, false)) {
+            printf("Cannot open probe history %s.probes: not a probe store, or another monitor is writing to it\n",
+                storePath.c_str());
+            WSACleanup();
+            return 1;
+        }
+    }
+
+    // Snapshots and probe results for replay; started before the first parse lands
+    if (!recordPath.empty()) {
+        g_traceWriter.reset(new TraceWriter());
+        g_traceStart = std::chrono::steady_clock::now();
+        if (!g_traceWriter->Open(recordPath, time(nullptr))) {
+            printf("Cannot create trace %s; continuing without it\n", recordPath.c_str());
+            g_traceWriter.reset();
+        }
+    }
+
+    // Fleet reports; the sender keeps reconnecting, so an unreachable collector is not fatal
+    if (!fleetConfig.collector.empty()) {
+        if (fleetConfig.monitor.empty()) {
+            char name[MAX_COMPUTERNAME_LENGTH + 1];
+            DWORD length = sizeof(name);
+            fleetConfig.monitor = GetComputerNameA(name, &length) ? std::string(name, length) : "dnsmonitor";
+        }
+        g_fleetSender.reset(new FleetSender(fleetConfig));
+        if (!g_fleetSender->Start()) {
+            printf("Cannot report to %s; continuing without fleet reports\n", fleetConfig.collector.c_str());
+            g_fleetSender.reset();
+        }
+    }
+
     SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
-    MonitorDNS();
+    int status = 0;
+    if (headless) {
+        status = RunHeadless(metricsConfig);
+    }
+    else {
+        g_renderer.reset(new ConsoleRenderer(std::unique_ptr<ConsoleBackend>(new Win32ConsoleBackend(g_consoleHandle)),
+            SCREEN_WIDTH, SCREEN_HEIGHT));
+        MonitorDNS();
+    }
 
+    g_fleetSender.reset();
+    g_connectProbe.reset();
+    g_dnsClient.reset();
+    g_probeEngine.reset();
+    g_probeStore.reset();
+    g_traceWriter.reset();
     CloseHandle(g_exitEvent);
     WSACleanup();
-    return 0;
+    return status;
 }
\ No newline at end of file
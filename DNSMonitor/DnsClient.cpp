@@ -0,0 +1,541 @@
+#include "DnsClient.h"
+#include "Platform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <iphlpapi.h>
+#pragma comment(lib, "iphlpapi.lib")
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static const int IO_MAX_WAIT_MS = 250;          // Bounds shutdown latency
+static const int UDP_RECEIVE_BUFFER = 1 << 20;  // Room for bursts of replies
+
+enum DnsTcpState {
+    TCP_NONE,
+    TCP_CONNECTING,
+    TCP_SENDING,
+    TCP_READING
+};
+
+// A query waiting for a slot, or on the wire
+struct DnsPendingQuery {
+    size_t id;
+    std::string hostname;
+    uint16_t type;
+    uint16_t queryId;
+    std::vector<uint8_t> query;
+    Clock::time_point sent;
+    Clock::time_point deadline;
+
+    SOCKET tcp = INVALID_SOCKET;
+    DnsTcpState tcpState = TCP_NONE;
+    size_t tcpSent = 0;
+    std::vector<uint8_t> tcpBuffer;     // Outgoing frame, then the reply
+};
+
+struct DnsClientState {
+    std::mutex lock;
+    std::condition_variable workReady;
+    std::condition_variable resultReady;
+
+    DnsClientConfig config;
+    struct sockaddr_storage server;
+    socklen_t serverLength = 0;
+    SOCKET udp = INVALID_SOCKET;
+    bool stopping = false;
+
+    std::deque<DnsPendingQuery> backlog;
+    std::unordered_map<uint16_t, DnsPendingQuery> inFlight;
+    std::vector<DnsQueryResult> results;
+    std::mt19937 random;
+
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t timedOut = 0;
+    ProbeSampleWindow samples;
+};
+
+static uint32_t ElapsedMs(Clock::time_point from, Clock::time_point to) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
+}
+
+static bool SameAddress(const struct sockaddr_storage& a, const struct sockaddr_storage& b) {
+    if (a.ss_family != b.ss_family) return false;
+    if (a.ss_family == AF_INET) {
+        const struct sockaddr_in* x = (const struct sockaddr_in*)&a;
+        const struct sockaddr_in* y = (const struct sockaddr_in*)&b;
+        return x->sin_port == y->sin_port && memcmp(&x->sin_addr, &y->sin_addr, sizeof(x->sin_addr)) == 0;
+    }
+    const struct sockaddr_in6* x = (const struct sockaddr_in6*)&a;
+    const struct sockaddr_in6* y = (const struct sockaddr_in6*)&b;
+    return x->sin6_port == y->sin6_port && memcmp(&x->sin6_addr, &y->sin6_addr, sizeof(x->sin6_addr)) == 0;
+}
+
+static void CloseTcpLocked(DnsPendingQuery& pending) {
+    if (pending.tcp != INVALID_SOCKET) {
+        closesocket(pending.tcp);
+        pending.tcp = INVALID_SOCKET;
+    }
+}
+
+// Hand a finished query back to the owner and free its ID
+static void FinishLocked(DnsClientState& state, uint16_t queryId, DnsQueryStatus status,
+    const DnsMessage* response, Clock::time_point now) {
+    auto it = state.inFlight.find(queryId);
+    if (it == state.inFlight.end()) return;
+    DnsPendingQuery& pending = it->second;
+
+    DnsQueryResult result = {};
+    result.id = pending.id;
+    result.hostname = pending.hostname;
+    result.type = pending.type;
+    result.status = status;
+    result.usedTcp = pending.tcpState != TCP_NONE;
+    result.responseTime = PROBE_TIMEOUT;
+
+    uint32_t latency = (std::min)(ElapsedMs(pending.sent, now), state.config.deadlineMs);
+    if (response) {
+        result.rcode = response->Rcode();
+        result.flags = response->flags;
+        result.answers = response->answers;
+        result.authority = response->authority;
+        result.responseTime = latency;
+    }
+
+    if (status == DnsQueryStatus::Timeout || status == DnsQueryStatus::NetworkError) {
+        state.timedOut++;
+    }
+    else {
+        state.completed++;
+        if (status != DnsQueryStatus::Ok) state.failed++;
+    }
+    state.samples.Record(now, latency);
+
+    CloseTcpLocked(pending);
+    state.inFlight.erase(it);
+    state.results.push_back(std::move(result));
+    state.resultReady.notify_all();
+    if (state.config.onResult) state.config.onResult();
+}
+
+// Put a query on the wire under a fresh ID
+static void SendLocked(DnsClientState& state, DnsPendingQuery pending) {
+    uint16_t queryId;
+    do {
+        queryId = (uint16_t)(state.random() & 0xFFFF);
+    } while (state.inFlight.count(queryId));
+
+    pending.queryId = queryId;
+    EncodeDnsQuery(queryId, pending.hostname, pending.type, state.config.recursionDesired, pending.query);
+    pending.sent = Clock::now();
+    pending.deadline = pending.sent + std::chrono::milliseconds(state.config.deadlineMs);
+
+    int sent = sendto(state.udp, (const char*)pending.query.data(), (int)pending.query.size(), 0,
+        (const struct sockaddr*)&state.server, state.serverLength);
+
+    state.inFlight.emplace(queryId, std::move(pending));
+    if (sent < 0) {
+        FinishLocked(state, queryId, DnsQueryStatus::NetworkError, nullptr, Clock::now());
+    }
+}
+
+static void FillSlotsLocked(DnsClientState& state) {
+    while (!state.backlog.empty() && (int)state.inFlight.size() < state.config.maxInFlight) {
+        DnsPendingQuery pending = std::move(state.backlog.front());
+        state.backlog.pop_front();
+        SendLocked(state, std::move(pending));
+    }
+}
+
+static void ExpireLocked(DnsClientState& state, Clock::time_point now) {
+    std::vector<uint16_t> expired;
+    for (const auto& item : state.inFlight) {
+        if (now >= item.second.deadline) {
+            expired.push_back(item.first);
+        }
+    }
+    for (uint16_t queryId : expired) {
+        FinishLocked(state, queryId, DnsQueryStatus::Timeout, nullptr, now);
+    }
+}
+
+static DnsQueryStatus StatusForRcode(uint8_t rcode) {
+    if (rcode == DNS_RCODE_NOERROR) return DnsQueryStatus::Ok;
+    if (rcode == DNS_RCODE_NXDOMAIN) return DnsQueryStatus::NameError;
+    return DnsQueryStatus::ServerError;
+}
+
+// Retry a truncated query over TCP on a non-blocking socket
+static void StartTcpLocked(DnsClientState& state, DnsPendingQuery& pending, Clock::time_point now) {
+    pending.tcp = socket(state.server.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (pending.tcp == INVALID_SOCKET || !SetSocketNonBlocking(pending.tcp)) {
+        pending.tcpState = TCP_CONNECTING;
+        FinishLocked(state, pending.queryId, DnsQueryStatus::NetworkError, nullptr, now);
+        return;
+    }
+
+    pending.tcpBuffer.clear();
+    pending.tcpBuffer.push_back((uint8_t)(pending.query.size() >> 8));
+    pending.tcpBuffer.push_back((uint8_t)(pending.query.size() & 0xFF));
+    pending.tcpBuffer.insert(pending.tcpBuffer.end(), pending.query.begin(), pending.query.end());
+    pending.tcpSent = 0;
+
+    int status = connect(pending.tcp, (const struct sockaddr*)&state.server, state.serverLength);
+    if (status == 0) {
+        pending.tcpState = TCP_SENDING;
+    }
+    else if (SocketWouldBlock(LastSocketError())) {
+        pending.tcpState = TCP_CONNECTING;
+    }
+    else {
+        pending.tcpState = TCP_CONNECTING;
+        FinishLocked(state, pending.queryId, DnsQueryStatus::NetworkError, nullptr, now);
+    }
+}
+
+static void HandleUdpReplyLocked(DnsClientState& state, const uint8_t* data, size_t length, Clock::time_point now) {
+    DnsMessage response;
+    if (!DecodeDnsMessage(data, length, response) || !response.IsResponse()) return;
+
+    auto it = state.inFlight.find(response.id);
+    if (it == state.inFlight.end()) return;
+    DnsPendingQuery& pending = it->second;
+    if (pending.tcpState != TCP_NONE) return;   // Late duplicate of a truncated answer
+
+    // The question must echo ours, or the reply is stray or spoofed
+    if (response.questions.size() != 1 ||
+        response.questions[0].type != pending.type ||
+        !DnsNamesEqual(response.questions[0].name, pending.hostname)) {
+        return;
+    }
+
+    if (response.IsTruncated() && state.config.tcpFallback) {
+        StartTcpLocked(state, pending, now);
+        return;
+    }
+    FinishLocked(state, response.id, StatusForRcode(response.Rcode()), &response, now);
+}
+
+// Advance a TCP retry after poll reported activity on its socket
+static void HandleTcpLocked(DnsClientState& state, uint16_t queryId, short revents, Clock::time_point now) {
+    auto it = state.inFlight.find(queryId);
+    if (it == state.inFlight.end()) return;
+    DnsPendingQuery& pending = it->second;
+
+    if (pending.tcpState == TCP_CONNECTING) {
+        int error = 0;
+        socklen_t errorLength = sizeof(error);
+        if (getsockopt(pending.tcp, SOL_SOCKET, SO_ERROR, (char*)&error, &errorLength) != 0 || error != 0 ||
+            (revents & (POLLERR | POLLHUP))) {
+            FinishLocked(state, queryId, DnsQueryStatus::NetworkError, nullptr, now);
+            return;
+        }
+        pending.tcpState = TCP_SENDING;
+    }
+
+    if (pending.tcpState == TCP_SENDING) {
+        int sent = send(pending.tcp, (const char*)pending.tcpBuffer.data() + pending.tcpSent,
+            (int)(pending.tcpBuffer.size() - pending.tcpSent), 0);
+        if (sent < 0) {
+            if (!SocketWouldBlock(LastSocketError())) {
+                FinishLocked(state, queryId, DnsQueryStatus::NetworkError, nullptr, now);
+            }
+            return;
+        }
+        pending.tcpSent += sent;
+        if (pending.tcpSent == pending.tcpBuffer.size()) {
+            pending.tcpBuffer.clear();
+            pending.tcpState = TCP_READING;
+        }
+        return;
+    }
+
+    if (pending.tcpState == TCP_READING) {
+        uint8_t buffer[4096];
+        int received = recv(pending.tcp, (char*)buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            if (received == 0 || !SocketWouldBlock(LastSocketError())) {
+                FinishLocked(state, queryId, DnsQueryStatus::NetworkError, nullptr, now);
+            }
+            return;
+        }
+        pending.tcpBuffer.insert(pending.tcpBuffer.end(), buffer, buffer + received);
+        if (pending.tcpBuffer.size() < 2) return;
+
+        size_t frameLength = ((size_t)pending.tcpBuffer[0] << 8) | pending.tcpBuffer[1];
+        if (pending.tcpBuffer.size() < frameLength + 2) return;
+
+        DnsMessage response;
+        if (!DecodeDnsMessage(pending.tcpBuffer.data() + 2, frameLength, response) ||
+            response.id != queryId) {
+            FinishLocked(state, queryId, DnsQueryStatus::NetworkError, nullptr, now);
+            return;
+        }
+        FinishLocked(state, queryId, StatusForRcode(response.Rcode()), &response, now);
+    }
+}
+
+static void RunIoLoop(std::shared_ptr<DnsClientState> state) {
+    std::vector<SocketPollFd> fds;
+    std::vector<uint16_t> tcpIds;
+    std::vector<uint8_t> datagram(DNS_MESSAGE_MAX);
+
+    std::unique_lock<std::mutex> guard(state->lock);
+    for (;;) {
+        state->workReady.wait(guard, [&] {
+            return state->stopping || !state->inFlight.empty() || !state->backlog.empty();
+        });
+        if (state->stopping) break;
+
+        auto now = Clock::now();
+        FillSlotsLocked(*state);
+        ExpireLocked(*state, now);
+
+        fds.clear();
+        tcpIds.clear();
+        SocketPollFd udpFd = {};
+        udpFd.fd = state->udp;
+        udpFd.events = POLLIN;
+        fds.push_back(udpFd);
+
+        auto wakeAt = now + std::chrono::milliseconds(IO_MAX_WAIT_MS);
+        for (const auto& item : state->inFlight) {
+            const DnsPendingQuery& pending = item.second;
+            wakeAt = (std::min)(wakeAt, pending.deadline);
+            if (pending.tcp == INVALID_SOCKET) continue;
+
+            SocketPollFd tcpFd = {};
+            tcpFd.fd = pending.tcp;
+            tcpFd.events = pending.tcpState == TCP_READING ? POLLIN : POLLOUT;
+            fds.push_back(tcpFd);
+            tcpIds.push_back(item.first);
+        }
+        int timeoutMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - now).count() + 1;
+
+        guard.unlock();
+        int ready = PollSockets(fds.data(), fds.size(), timeoutMs);
+        guard.lock();
+        if (ready <= 0) continue;
+
+        now = Clock::now();
+        if (fds[0].revents & POLLIN) {
+            // Drain every queued datagram before going back to poll
+            for (;;) {
+                struct sockaddr_storage from;
+                socklen_t fromLength = sizeof(from);
+                int received = recvfrom(state->udp, (char*)datagram.data(), (int)datagram.size(), 0,
+                    (struct sockaddr*)&from, &fromLength);
+                if (received < 0) {
+                    if (SocketTransientError(LastSocketError())) continue;
+                    break;
+                }
+                if (SameAddress(from, state->server)) {
+                    HandleUdpReplyLocked(*state, datagram.data(), received, now);
+                }
+            }
+        }
+        for (size_t i = 1; i < fds.size(); i++) {
+            if (fds[i].revents) {
+                HandleTcpLocked(*state, tcpIds[i - 1], fds[i].revents, now);
+            }
+        }
+    }
+
+    for (auto& item : state->inFlight) {
+        CloseTcpLocked(item.second);
+    }
+}
+
+DnsClient::DnsClient(const DnsClientConfig& config)
+    : m_config(config), m_state(std::make_shared<DnsClientState>()) {
+    if (m_config.maxInFlight < 1) m_config.maxInFlight = 1;
+    if (m_config.maxInFlight > 60000) m_config.maxInFlight = 60000;   // Leave IDs to pick from
+    m_state->config = m_config;
+    m_state->random.seed(std::random_device()());
+}
+
+DnsClient::~DnsClient() {
+    {
+        std::lock_guard<std::mutex> guard(m_state->lock);
+        m_state->stopping = true;
+        m_state->workReady.notify_all();
+    }
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    if (m_state->udp != INVALID_SOCKET) {
+        closesocket(m_state->udp);
+    }
+}
+
+bool DnsClient::Start() {
+    if (!ParseSocketAddress(m_config.server, 53, m_state->server, m_state->serverLength)) {
+        return false;
+    }
+
+    SOCKET udp = socket(m_state->server.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+    if (udp == INVALID_SOCKET) {
+        return false;
+    }
+    if (!SetSocketNonBlocking(udp)) {
+        closesocket(udp);
+        return false;
+    }
+    int bufferSize = UDP_RECEIVE_BUFFER;
+    setsockopt(udp, SOL_SOCKET, SO_RCVBUF, (const char*)&bufferSize, sizeof(bufferSize));
+
+    m_state->udp = udp;
+    m_thread = std::thread(RunIoLoop, m_state);
+    return true;
+}
+
+void DnsClient::Submit(size_t id, const std::string& hostname, uint16_t type) {
+    DnsPendingQuery pending;
+    pending.id = id;
+    pending.hostname = hostname;
+    pending.type = type;
+    pending.queryId = 0;
+
+    std::unique_lock<std::mutex> guard(m_state->lock);
+    m_state->submitted++;
+    if (m_state->udp == INVALID_SOCKET || m_state->stopping) {
+        DnsQueryResult result = {};
+        result.id = id;
+        result.hostname = hostname;
+        result.type = type;
+        result.status = DnsQueryStatus::NetworkError;
+        result.responseTime = PROBE_TIMEOUT;
+        m_state->results.push_back(std::move(result));
+        m_state->resultReady.notify_all();
+
+        // On the caller's thread, which may be the one onResult signals
+        guard.unlock();
+        if (m_config.onResult) m_config.onResult();
+        return;
+    }
+
+    if ((int)m_state->inFlight.size() < m_config.maxInFlight && m_state->backlog.empty()) {
+        SendLocked(*m_state, std::move(pending));
+    }
+    else {
+        m_state->backlog.push_back(std::move(pending));
+    }
+    m_state->workReady.notify_one();
+}
+
+size_t DnsClient::Poll(std::vector<DnsQueryResult>& results) {
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    size_t count = m_state->results.size();
+    for (auto& result : m_state->results) {
+        results.push_back(std::move(result));
+    }
+    m_state->results.clear();
+    return count;
+}
+
+size_t DnsClient::Wait(std::vector<DnsQueryResult>& results, uint32_t timeoutMs) {
+    std::unique_lock<std::mutex> guard(m_state->lock);
+    m_state->resultReady.wait_for(guard, std::chrono::milliseconds(timeoutMs),
+        [&] { return !m_state->results.empty(); });
+
+    size_t count = m_state->results.size();
+    for (auto& result : m_state->results) {
+        results.push_back(std::move(result));
+    }
+    m_state->results.clear();
+    return count;
+}
+
+size_t DnsClient::Pending() const {
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    return m_state->backlog.size() + m_state->inFlight.size() + m_state->results.size();
+}
+
+ProbeEngineStats DnsClient::GetStats() const {
+    ProbeEngineStats stats = {};
+
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    stats.submitted = m_state->submitted;
+    stats.completed = m_state->completed;
+    stats.failed = m_state->failed;
+    stats.timedOut = m_state->timedOut;
+    stats.queued = (int)m_state->backlog.size();
+    stats.inFlight = (int)m_state->inFlight.size();
+    m_state->samples.Fill(stats, Clock::now());
+    return stats;
+}
+
+bool GetSystemDnsServer(std::string& server) {
+#ifdef _WIN32
+    ULONG size = 0;
+    if (GetNetworkParams(nullptr, &size) != ERROR_BUFFER_OVERFLOW) {
+        return false;
+    }
+    std::vector<char> buffer(size);
+    FIXED_INFO* info = (FIXED_INFO*)buffer.data();
+    if (GetNetworkParams(info, &size) != ERROR_SUCCESS) {
+        return false;
+    }
+    server = info->DnsServerList.IpAddress.String;
+    return !server.empty();
+#else
+    std::ifstream resolvConf("/etc/resolv.conf");
+    std::string line;
+    while (std::getline(resolvConf, line)) {
+        std::istringstream fields(line);
+        std::string keyword;
+        if (fields >> keyword && keyword == "nameserver" && fields >> server) {
+            return true;
+        }
+    }
+    return false;
+#endif
+}
+
+// Compare addresses in binary so IPv6 spellings do not matter
+static bool ParseAddressBytes(const std::string& text, std::vector<uint8_t>& bytes) {
+    uint8_t buffer[16];
+    if (inet_pton(AF_INET, text.c_str(), buffer) == 1) {
+        bytes.assign(buffer, buffer + 4);
+        return true;
+    }
+    if (inet_pton(AF_INET6, text.c_str(), buffer) == 1) {
+        bytes.assign(buffer, buffer + 16);
+        return true;
+    }
+    return false;
+}
+
+bool DnsAnswerHasAddress(const DnsQueryResult& result, const std::string& address) {
+    std::vector<uint8_t> wanted;
+    if (!ParseAddressBytes(address, wanted)) return false;
+
+    for (const auto& record : result.answers) {
+        if ((record.type == DNS_TYPE_A || record.type == DNS_TYPE_AAAA) && record.rdata == wanted) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string DnsFirstAddress(const DnsQueryResult& result, uint16_t type) {
+    for (const auto& record : result.answers) {
+        if (record.type == type && !record.data.empty()) {
+            return record.data;
+        }
+    }
+    return std::string();
+}
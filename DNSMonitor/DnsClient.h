@@ -0,0 +1,88 @@
+#pragma once
+
+#include "DnsWire.h"
+#include "ProbeEngine.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How a direct query ended
+enum class DnsQueryStatus {
+    Ok,             // NOERROR, possibly with no answers
+    NameError,      // NXDOMAIN
+    ServerError,    // SERVFAIL, REFUSED and other rcodes
+    Timeout,        // No answer before the deadline
+    NetworkError    // Send failed, or the TCP retry could not complete
+};
+
+struct DnsQueryResult {
+    size_t id;                      // Caller supplied id
+    std::string hostname;
+    uint16_t type;
+    DnsQueryStatus status;
+    uint8_t rcode;
+    uint16_t flags;                 // Response header flags (AA, RA, ...)
+    uint32_t responseTime;          // Milliseconds, PROBE_TIMEOUT on Timeout/NetworkError
+    bool usedTcp;                   // Answer came from the TCP retry after truncation
+    std::vector<DnsRecord> answers;
+    std::vector<DnsRecord> authority;
+};
+
+struct DnsClientConfig {
+    std::string server;             // "ip", "ip:port" or "[ipv6]:port"
+    uint32_t deadlineMs = 3000;     // Per query, UDP and TCP retry together
+    int maxInFlight = 1024;         // Queries on the wire at once; the rest wait
+    bool recursionDesired = true;
+    bool tcpFallback = true;
+    std::function<void()> onResult; // As in ProbeEngineConfig; timeouts call it too
+};
+
+struct DnsClientState;
+
+// Sends queries straight to one resolver, bypassing the OS cache. All
+// queries share a single UDP socket and are matched back by query ID;
+// truncated answers are retried over TCP. Replies are read on a private
+// I/O thread so response times are not skewed by how often the owner polls.
+class DnsClient {
+public:
+    explicit DnsClient(const DnsClientConfig& config);
+    ~DnsClient();
+
+    DnsClient(const DnsClient&) = delete;
+    DnsClient& operator=(const DnsClient&) = delete;
+
+    // Open the socket and start the I/O thread; false if the server is unusable
+    bool Start();
+
+    // Queue a query; never blocks
+    void Submit(size_t id, const std::string& hostname, uint16_t type);
+
+    // Append completed queries to results without blocking
+    size_t Poll(std::vector<DnsQueryResult>& results);
+
+    // Like Poll, but waits up to timeoutMs for at least one result
+    size_t Wait(std::vector<DnsQueryResult>& results, uint32_t timeoutMs);
+
+    // Waiting, on the wire, and completed but not yet collected
+    size_t Pending() const;
+
+    const DnsClientConfig& Config() const { return m_config; }
+    ProbeEngineStats GetStats() const;
+
+private:
+    DnsClientConfig m_config;
+    std::shared_ptr<DnsClientState> m_state;
+    std::thread m_thread;
+};
+
+// First DNS server configured on this machine
+bool GetSystemDnsServer(std::string& server);
+
+// True if any A/AAAA answer matches address
+bool DnsAnswerHasAddress(const DnsQueryResult& result, const std::string& address);
+
+// First A/AAAA answer of the given type, or empty
+std::string DnsFirstAddress(const DnsQueryResult& result, uint16_t type);
@@ -0,0 +1,261 @@
+#include "DnsWire.h"
+#include "Platform.h"
+
+#include <cctype>
+
+static const size_t DNS_HEADER_SIZE = 12;
+static const int DNS_MAX_POINTERS = 64;         // Compression loop guard
+
+static void PutU16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back((uint8_t)(value >> 8));
+    out.push_back((uint8_t)(value & 0xFF));
+}
+
+static void PutU32(std::vector<uint8_t>& out, uint32_t value) {
+    PutU16(out, (uint16_t)(value >> 16));
+    PutU16(out, (uint16_t)(value & 0xFFFF));
+}
+
+static uint16_t GetU16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t GetU32(const uint8_t* p) {
+    return ((uint32_t)GetU16(p) << 16) | GetU16(p + 2);
+}
+
+// Encode a dotted name as length-prefixed labels
+static bool PutName(std::vector<uint8_t>& out, const std::string& name) {
+    size_t start = 0;
+    size_t total = 0;
+    while (start < name.size()) {
+        size_t dot = name.find('.', start);
+        if (dot == std::string::npos) dot = name.size();
+
+        size_t labelLength = dot - start;
+        if (labelLength == 0 || labelLength > 63) return false;
+        total += labelLength + 1;
+        if (total > 254) return false;
+
+        out.push_back((uint8_t)labelLength);
+        out.insert(out.end(), name.begin() + start, name.begin() + dot);
+        start = dot + 1;
+    }
+    out.push_back(0);
+    return true;
+}
+
+// Decode a possibly compressed name starting at offset; advances offset past it
+static bool GetName(const uint8_t* data, size_t length, size_t& offset, std::string& name) {
+    name.clear();
+    size_t position = offset;
+    bool jumped = false;
+    int pointers = 0;
+
+    for (;;) {
+        if (position >= length) return false;
+        uint8_t labelLength = data[position];
+
+        if ((labelLength & 0xC0) == 0xC0) {
+            if (position + 1 >= length || ++pointers > DNS_MAX_POINTERS) return false;
+            size_t target = ((labelLength & 0x3F) << 8) | data[position + 1];
+            if (!jumped) {
+                offset = position + 2;
+                jumped = true;
+            }
+            position = target;
+            continue;
+        }
+        if (labelLength & 0xC0) return false;
+
+        position++;
+        if (labelLength == 0) break;
+        if (position + labelLength > length) return false;
+
+        if (!name.empty()) name += '.';
+        name.append((const char*)data + position, labelLength);
+        if (name.size() > 254) return false;
+        position += labelLength;
+    }
+
+    if (!jumped) {
+        offset = position;
+    }
+    return true;
+}
+
+static bool GetRecord(const uint8_t* data, size_t length, size_t& offset, DnsRecord& record) {
+    if (!GetName(data, length, offset, record.name)) return false;
+    if (offset + 10 > length) return false;
+
+    record.type = GetU16(data + offset);
+    record.rclass = GetU16(data + offset + 2);
+    record.ttl = GetU32(data + offset + 4);
+    uint16_t rdLength = GetU16(data + offset + 8);
+    offset += 10;
+    if (offset + rdLength > length) return false;
+
+    record.rdata.assign(data + offset, data + offset + rdLength);
+    record.data.clear();
+
+    char text[INET6_ADDRSTRLEN];
+    if (record.type == DNS_TYPE_A && rdLength == 4) {
+        if (inet_ntop(AF_INET, (void*)(data + offset), text, sizeof(text))) record.data = text;
+    }
+    else if (record.type == DNS_TYPE_AAAA && rdLength == 16) {
+        if (inet_ntop(AF_INET6, (void*)(data + offset), text, sizeof(text))) record.data = text;
+    }
+    else if (record.type == DNS_TYPE_CNAME || record.type == DNS_TYPE_NS || record.type == DNS_TYPE_PTR) {
+        size_t nameOffset = offset;
+        if (!GetName(data, length, nameOffset, record.data)) return false;
+    }
+
+    offset += rdLength;
+    return true;
+}
+
+static bool PutRecord(std::vector<uint8_t>& out, const DnsRecord& record) {
+    if (!PutName(out, record.name)) return false;
+    PutU16(out, record.type);
+    PutU16(out, record.rclass);
+    PutU32(out, record.ttl);
+
+    std::vector<uint8_t> rdata;
+    if (record.type == DNS_TYPE_A && !record.data.empty()) {
+        uint8_t address[4];
+        if (inet_pton(AF_INET, record.data.c_str(), address) != 1) return false;
+        rdata.assign(address, address + 4);
+    }
+    else if (record.type == DNS_TYPE_AAAA && !record.data.empty()) {
+        uint8_t address[16];
+        if (inet_pton(AF_INET6, record.data.c_str(), address) != 1) return false;
+        rdata.assign(address, address + 16);
+    }
+    else if ((record.type == DNS_TYPE_CNAME || record.type == DNS_TYPE_NS || record.type == DNS_TYPE_PTR) &&
+        !record.data.empty()) {
+        if (!PutName(rdata, record.data)) return false;
+    }
+    else {
+        rdata = record.rdata;
+    }
+
+    if (rdata.size() > 0xFFFF) return false;
+    PutU16(out, (uint16_t)rdata.size());
+    out.insert(out.end(), rdata.begin(), rdata.end());
+    return true;
+}
+
+void EncodeDnsQuery(uint16_t id, const std::string& name, uint16_t type,
+    bool recursionDesired, std::vector<uint8_t>& out) {
+    out.clear();
+    PutU16(out, id);
+    PutU16(out, recursionDesired ? DNS_FLAG_RD : 0);
+    PutU16(out, 1);     // QDCOUNT
+    PutU16(out, 0);
+    PutU16(out, 0);
+    PutU16(out, 0);
+
+    std::string trimmed = name;
+    if (!trimmed.empty() && trimmed.back() == '.') trimmed.pop_back();
+    if (!PutName(out, trimmed)) {
+        // Unencodable names go out as the root so the server answers FORMERR/NXDOMAIN
+        out.resize(DNS_HEADER_SIZE);
+        out.push_back(0);
+    }
+    PutU16(out, type);
+    PutU16(out, DNS_CLASS_IN);
+}
+
+bool EncodeDnsMessage(const DnsMessage& message, std::vector<uint8_t>& out) {
+    out.clear();
+    PutU16(out, message.id);
+    PutU16(out, message.flags);
+    PutU16(out, (uint16_t)message.questions.size());
+    PutU16(out, (uint16_t)message.answers.size());
+    PutU16(out, (uint16_t)message.authority.size());
+    PutU16(out, (uint16_t)message.additional.size());
+
+    for (const auto& question : message.questions) {
+        if (!PutName(out, question.name)) return false;
+        PutU16(out, question.type);
+        PutU16(out, question.qclass);
+    }
+    for (const auto& record : message.answers) {
+        if (!PutRecord(out, record)) return false;
+    }
+    for (const auto& record : message.authority) {
+        if (!PutRecord(out, record)) return false;
+    }
+    for (const auto& record : message.additional) {
+        if (!PutRecord(out, record)) return false;
+    }
+    return out.size() <= DNS_MESSAGE_MAX;
+}
+
+bool DecodeDnsMessage(const uint8_t* data, size_t length, DnsMessage& message) {
+    if (length < DNS_HEADER_SIZE) return false;
+
+    message.id = GetU16(data);
+    message.flags = GetU16(data + 2);
+    uint16_t questionCount = GetU16(data + 4);
+    uint16_t answerCount = GetU16(data + 6);
+    uint16_t authorityCount = GetU16(data + 8);
+    uint16_t additionalCount = GetU16(data + 10);
+
+    message.questions.clear();
+    message.answers.clear();
+    message.authority.clear();
+    message.additional.clear();
+
+    size_t offset = DNS_HEADER_SIZE;
+    for (int i = 0; i < questionCount; i++) {
+        DnsQuestion question;
+        if (!GetName(data, length, offset, question.name)) return false;
+        if (offset + 4 > length) return false;
+        question.type = GetU16(data + offset);
+        question.qclass = GetU16(data + offset + 2);
+        offset += 4;
+        message.questions.push_back(std::move(question));
+    }
+
+    // A truncated UDP answer may stop mid-section; keep what parsed cleanly
+    bool truncated = (message.flags & DNS_FLAG_TC) != 0;
+    std::vector<DnsRecord>* sections[] = { &message.answers, &message.authority, &message.additional };
+    uint16_t counts[] = { answerCount, authorityCount, additionalCount };
+    for (int section = 0; section < 3; section++) {
+        for (int i = 0; i < counts[section]; i++) {
+            DnsRecord record;
+            if (!GetRecord(data, length, offset, record)) return truncated;
+            sections[section]->push_back(std::move(record));
+        }
+    }
+    return true;
+}
+
+bool DnsNamesEqual(const std::string& a, const std::string& b) {
+    size_t lengthA = a.size();
+    size_t lengthB = b.size();
+    if (lengthA > 0 && a[lengthA - 1] == '.') lengthA--;
+    if (lengthB > 0 && b[lengthB - 1] == '.') lengthB--;
+    if (lengthA != lengthB) return false;
+
+    for (size_t i = 0; i < lengthA; i++) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+    }
+    return true;
+}
+
+std::string DnsTypeName(uint16_t type) {
+    switch (type) {
+    case DNS_TYPE_A: return "A";
+    case DNS_TYPE_NS: return "NS";
+    case DNS_TYPE_CNAME: return "CNAME";
+    case DNS_TYPE_SOA: return "SOA";
+    case DNS_TYPE_PTR: return "PTR";
+    case DNS_TYPE_MX: return "MX";
+    case DNS_TYPE_TXT: return "TXT";
+    case DNS_TYPE_AAAA: return "AAAA";
+    case DNS_TYPE_SRV: return "SRV";
+    }
+    return "TYPE" + std::to_string(type);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// DNS message encoding and decoding (RFC 1035), enough for probing:
+// questions, answers with name compression, and the record types the
+// cache monitor cares about in presentation form.
+
+// Record types
+static const uint16_t DNS_TYPE_A = 1;
+static const uint16_t DNS_TYPE_NS = 2;
+static const uint16_t DNS_TYPE_CNAME = 5;
+static const uint16_t DNS_TYPE_SOA = 6;
+static const uint16_t DNS_TYPE_PTR = 12;
+static const uint16_t DNS_TYPE_MX = 15;
+static const uint16_t DNS_TYPE_TXT = 16;
+static const uint16_t DNS_TYPE_AAAA = 28;
+static const uint16_t DNS_TYPE_SRV = 33;
+
+static const uint16_t DNS_CLASS_IN = 1;
+
+// Header flag bits
+static const uint16_t DNS_FLAG_QR = 0x8000;    // Response
+static const uint16_t DNS_FLAG_AA = 0x0400;    // Authoritative answer
+static const uint16_t DNS_FLAG_TC = 0x0200;    // Truncated
+static const uint16_t DNS_FLAG_RD = 0x0100;    // Recursion desired
+static const uint16_t DNS_FLAG_RA = 0x0080;    // Recursion available
+
+// Response codes
+static const uint8_t DNS_RCODE_NOERROR = 0;
+static const uint8_t DNS_RCODE_FORMERR = 1;
+static const uint8_t DNS_RCODE_SERVFAIL = 2;
+static const uint8_t DNS_RCODE_NXDOMAIN = 3;
+static const uint8_t DNS_RCODE_REFUSED = 5;
+
+static const size_t DNS_UDP_MAX = 512;          // Classic UDP payload limit
+static const size_t DNS_MESSAGE_MAX = 65535;    // TCP length prefix limit
+
+struct DnsQuestion {
+    std::string name;
+    uint16_t type;
+    uint16_t qclass;
+};
+
+// Resource record. data holds the presentation form for A, AAAA, CNAME,
+// NS and PTR; rdata always holds the raw bytes.
+struct DnsRecord {
+    std::string name;
+    uint16_t type;
+    uint16_t rclass;
+    uint32_t ttl;
+    std::string data;
+    std::vector<uint8_t> rdata;
+};
+
+struct DnsMessage {
+    uint16_t id;
+    uint16_t flags;
+    std::vector<DnsQuestion> questions;
+    std::vector<DnsRecord> answers;
+    std::vector<DnsRecord> authority;
+    std::vector<DnsRecord> additional;
+
+    uint8_t Rcode() const { return (uint8_t)(flags & 0x000F); }
+    bool IsResponse() const { return (flags & DNS_FLAG_QR) != 0; }
+    bool IsTruncated() const { return (flags & DNS_FLAG_TC) != 0; }
+};
+
+// Build a single-question query
+void EncodeDnsQuery(uint16_t id, const std::string& name, uint16_t type,
+    bool recursionDesired, std::vector<uint8_t>& out);
+
+// Build any message (used by stand-in servers). Names are not compressed.
+bool EncodeDnsMessage(const DnsMessage& message, std::vector<uint8_t>& out);
+
+// Parse a message; false if it is malformed
+bool DecodeDnsMessage(const uint8_t* data, size_t length, DnsMessage& message);
+
+// Names compare case-insensitively and ignore a trailing dot
+bool DnsNamesEqual(const std::string& a, const std::string& b);
+
+// Short name for a record type ("A", "AAAA", "TYPE65")
+std::string DnsTypeName(uint16_t type);
@@ -0,0 +1,490 @@
+#include "EntryIndex.h"
+
+#include <algorithm>
+#include <cctype>
+
+static const char* FILTER_NAMES[] = { "all", "failing", "slow", "stale", "changed", "nxdomain", "unreachable" };
+static const char* SORT_NAMES[] = { "cache", "slowest", "recent-failures" };
+
+const char* EntryFilterName(EntryFilter filter) {
+    return filter < EntryFilter::Count ? FILTER_NAMES[(int)filter] : "unknown";
+}
+
+const char* EntrySortName(EntrySort sort) {
+    return sort < EntrySort::Count ? SORT_NAMES[(int)sort] : "unknown";
+}
+
+bool ParseEntryFilter(std::string_view name, EntryFilter& filter) {
+    for (int i = 0; i < (int)EntryFilter::Count; i++) {
+        if (name == FILTER_NAMES[i]) {
+            filter = (EntryFilter)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParseEntrySort(std::string_view name, EntrySort& sort) {
+    for (int i = 0; i < (int)EntrySort::Count; i++) {
+        if (name == SORT_NAMES[i]) {
+            sort = (EntrySort)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int PopCount(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (int)((x * 0x0101010101010101ull) >> 56);
+}
+
+// Index of the lowest set bit; x is not zero
+static int LowestBit(uint64_t x) {
+    return PopCount((x & (0 - x)) - 1);
+}
+
+static const size_t BLOCK_SHIFT = 12;      // 4096 rows, 64 words, per block count
+
+void RowSet::Reset(size_t rows) {
+    m_rows = rows;
+    m_count = 0;
+    m_words.assign((rows + 63) / 64, 0);
+    m_blockCounts.assign((rows + (1 << BLOCK_SHIFT) - 1) >> BLOCK_SHIFT, 0);
+}
+
+void RowSet::Set(size_t row, bool member) {
+    uint64_t bit = 1ull << (row & 63);
+    uint64_t& word = m_words[row >> 6];
+    if (((word & bit) != 0) == member) return;
+    word ^= bit;
+    if (member) {
+        m_count++;
+        m_blockCounts[row >> BLOCK_SHIFT]++;
+    }
+    else {
+        m_count--;
+        m_blockCounts[row >> BLOCK_SHIFT]--;
+    }
+}
+
+bool RowSet::Select(size_t k, size_t& row) const {
+    if (k >= m_count) return false;
+    size_t block = 0;
+    while (k >= m_blockCounts[block]) {
+        k -= m_blockCounts[block];
+        block++;
+    }
+    size_t word = block << (BLOCK_SHIFT - 6);
+    for (;; word++) {
+        size_t bits = (size_t)PopCount(m_words[word]);
+        if (k < bits) break;
+        k -= bits;
+    }
+    uint64_t bits = m_words[word];
+    for (; k > 0; k--) {
+        bits &= bits - 1;
+    }
+    row = word * 64 + LowestBit(bits);
+    return true;
+}
+
+bool RowSet::Next(size_t row, size_t& next) const {
+    size_t start = row + 1;
+    if (start >= m_rows) return false;
+    size_t word = start >> 6;
+    uint64_t bits = m_words[word] & (~0ull << (start & 63));
+    while (bits == 0) {
+        word++;
+        // Skip whole empty blocks
+        while ((word & 63) == 0 && (word >> 6) < m_blockCounts.size() && m_blockCounts[word >> 6] == 0) {
+            word += 64;
+        }
+        if (word >= m_words.size()) return false;
+        bits = m_words[word];
+    }
+    next = word * 64 + LowestBit(bits);
+    return true;
+}
+
+size_t RowSet::MemoryBytes() const {
+    return m_words.capacity() * sizeof(uint64_t) + m_blockCounts.capacity() * sizeof(uint32_t);
+}
+
+// Take the rightmost label off name, lowercased into label; false when none is left
+static bool PopLabel(std::string_view& name, std::string& label) {
+    while (!name.empty() && name.back() == '.') {
+        name.remove_suffix(1);
+    }
+    if (name.empty()) return false;
+    size_t dot = name.rfind('.');
+    std::string_view part = dot == std::string_view::npos ? name : name.substr(dot + 1);
+    name = dot == std::string_view::npos ? std::string_view() : name.substr(0, dot);
+    label.resize(part.size());
+    for (size_t i = 0; i < part.size(); i++) {
+        label[i] = (char)tolower((unsigned char)part[i]);
+    }
+    return true;
+}
+
+// Open addressing with linear probes: the slot holding key, or the empty
+// slot where it belongs
+size_t SuffixTrie::ChildSlot(uint64_t key) const {
+    size_t mask = m_children.size() - 1;
+    size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    while (m_children[slot].second != 0 && m_children[slot].first != key) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void SuffixTrie::GrowChildren() {
+    std::vector<std::pair<uint64_t, uint32_t>> old;
+    old.swap(m_children);
+    m_children.assign(old.size() * 2, std::make_pair(0ull, 0u));
+    for (const auto& child : old) {
+        if (child.second != 0) m_children[ChildSlot(child.first)] = child;
+    }
+}
+
+void SuffixTrie::Build(const EntryTable& entries) {
+    size_t rows = entries.Size();
+    m_labels.Clear();
+    m_labels.Reserve(rows, rows * 8);
+    size_t slots = 64;
+    while (slots < rows * 2) {
+        slots *= 2;
+    }
+    m_children.assign(slots, std::make_pair(0ull, 0u));
+
+    // Walk every name in from its top-level label, adding nodes as needed.
+    // Children always come after their parent.
+    std::vector<uint32_t> rowNode(rows);
+    std::vector<uint32_t> parent(1, 0);
+    std::vector<uint32_t> firstChild(1, 0);     // 0 is none; the root is nobody's child
+    std::vector<uint32_t> nextSibling(1, 0);
+    std::vector<uint32_t> total(1, 0);          // Rows ending at the node, then in its subtree
+    std::string label;
+    for (size_t row = 0; row < rows; row++) {
+        std::string_view name = entries.Hostname(row);
+        uint32_t node = 0;
+        while (PopLabel(name, label)) {
+            uint64_t key = (uint64_t)node << 32 | m_labels.Intern(label);
+            size_t slot = ChildSlot(key);
+            if (m_children[slot].second == 0) {
+                uint32_t child = (uint32_t)parent.size();
+                m_children[slot] = std::make_pair(key, child);
+                parent.push_back(node);
+                firstChild.push_back(0);
+                nextSibling.push_back(firstChild[node]);
+                firstChild[node] = child;
+                total.push_back(0);
+                // At most half full
+                if (parent.size() * 2 > m_children.size()) GrowChildren();
+                node = child;
+            }
+            else {
+                node = m_children[slot].second;
+            }
+        }
+        rowNode[row] = node;
+        total[node]++;
+    }
+
+    size_t nodes = parent.size();
+    std::vector<uint32_t> own(total);
+    for (size_t node = nodes - 1; node > 0; node--) {
+        total[parent[node]] += total[node];
+    }
+
+    // Depth first: a node's own rows, then each child's subtree
+    m_ranges.assign(nodes, std::make_pair(0u, 0u));
+    m_ranges[0] = std::make_pair(0u, total[0]);
+    for (size_t node = 0; node < nodes; node++) {
+        uint32_t cursor = m_ranges[node].first + own[node];
+        for (uint32_t child = firstChild[node]; child != 0; child = nextSibling[child]) {
+            m_ranges[child] = std::make_pair(cursor, cursor + total[child]);
+            cursor += total[child];
+        }
+    }
+
+    m_order.resize(rows);
+    m_position.resize(rows);
+    std::vector<uint32_t> fill(nodes);
+    for (size_t node = 0; node < nodes; node++) {
+        fill[node] = m_ranges[node].first;
+    }
+    for (size_t row = 0; row < rows; row++) {
+        uint32_t position = fill[rowNode[row]]++;
+        m_order[position] = (uint32_t)row;
+        m_position[row] = position;
+    }
+}
+
+std::pair<uint32_t, uint32_t> SuffixTrie::Range(std::string_view suffix) const {
+    if (m_ranges.empty()) return std::make_pair(0u, 0u);
+    uint32_t node = 0;
+    std::string label;
+    while (PopLabel(suffix, label)) {
+        uint32_t id;
+        if (!m_labels.Find(label, id)) return std::make_pair(0u, 0u);
+        size_t slot = ChildSlot((uint64_t)node << 32 | id);
+        if (m_children[slot].second == 0) return std::make_pair(0u, 0u);
+        node = m_children[slot].second;
+    }
+    return m_ranges[node];
+}
+
+size_t SuffixTrie::MemoryBytes() const {
+    return m_labels.MemoryBytes() + m_ranges.capacity() * sizeof(m_ranges[0]) + m_children.capacity() * sizeof(m_children[0]) +
+        m_order.capacity() * sizeof(uint32_t) + m_position.capacity() * sizeof(uint32_t);
+}
+
+// Classified as EntrySums::Apply() counts: a cached NXDOMAIN is only
+// negative, and an entry is reachable only if connect probes did not rule
+// it out. Failing leaves out entries that were never probed.
+static bool FilterMatches(EntryFilter filter, uint8_t flags, uint32_t responseMs, uint32_t slowMs) {
+    bool negative = (flags & ENTRY_NEGATIVE) != 0;
+    bool unreachable = !negative && (flags & ENTRY_UNREACHABLE) != 0;
+    bool reachable = !negative && !unreachable && (flags & ENTRY_REACHABLE) != 0;
+    switch (filter) {
+    case EntryFilter::Failing: return !negative && !unreachable && !reachable && responseMs != 0;
+    case EntryFilter::Slow: return reachable && responseMs > slowMs;
+    case EntryFilter::Stale: return (flags & ENTRY_STALE) != 0;
+    case EntryFilter::Changed: return (flags & ENTRY_CHANGED) != 0;
+    case EntryFilter::Negative: return negative;
+    case EntryFilter::Unreachable: return unreachable;
+    default: return true;
+    }
+}
+
+static bool IsReachable(uint8_t flags) {
+    return (flags & (ENTRY_NEGATIVE | ENTRY_UNREACHABLE | ENTRY_REACHABLE)) == ENTRY_REACHABLE;
+}
+
+static int LatencyBucket(uint32_t responseMs) {
+    if (responseMs < 64) return (int)responseMs;
+    int width = 0;
+    for (uint32_t value = responseMs; value != 0; value >>= 1) {
+        width++;
+    }
+    // The six bits after the leading one pick the bucket within the doubling
+    return 64 + (width - 7) * 64 + (int)((responseMs >> (width - 7)) & 63);
+}
+
+EntryIndex::EntryIndex(uint32_t slowMs)
+    : m_slowMs(slowMs) {
+}
+
+void EntryIndex::Rebuild(const EntryTable& entries, const std::vector<uint32_t>* previousRows) {
+    size_t rows = entries.Size();
+    m_trie.Build(entries);
+    for (int filter = 1; filter < (int)EntryFilter::Count; filter++) {
+        m_sets[filter].Reset(rows);
+    }
+    for (auto& bucket : m_buckets) {
+        bucket.clear();
+    }
+    m_bucketOf.assign(rows, 0);
+    m_bucketPos.assign(rows, 0);
+
+    // Failure recency follows each entry to its new row, in the same order
+    std::vector<uint64_t> failedAt(rows, 0);
+    m_failures.clear();
+    m_failedRows = 0;
+    if (previousRows) {
+        for (size_t row = 0; row < rows && row < previousRows->size(); row++) {
+            uint32_t previous = (*previousRows)[row];
+            if (previous == NO_ROW || previous >= m_failedAt.size() || m_failedAt[previous] == 0) continue;
+            failedAt[row] = m_failedAt[previous];
+            m_failures.push_back({ failedAt[row], (uint32_t)row });
+            m_failedRows++;
+        }
+        std::sort(m_failures.begin(), m_failures.end());
+    }
+    m_failedAt.swap(failedAt);
+
+    for (size_t row = 0; row < rows; row++) {
+        Classify(row, entries.Flags(row), entries.ResponseMs(row));
+    }
+}
+
+void EntryIndex::Update(const EntryTable& entries, size_t row, uint8_t oldFlags, uint32_t oldResponseMs) {
+    if (row >= m_bucketOf.size()) return;
+    uint8_t flags = entries.Flags(row);
+    uint32_t responseMs = entries.ResponseMs(row);
+    bool failed = FilterMatches(EntryFilter::Failing, flags, responseMs, m_slowMs) ||
+        FilterMatches(EntryFilter::Unreachable, flags, responseMs, m_slowMs);
+    if (failed) {
+        RecordFailure(row);     // Every failed result, so a repeat failure moves to the front
+    }
+    if (flags == oldFlags && responseMs == oldResponseMs) return;
+    Classify(row, flags, responseMs);
+}
+
+void EntryIndex::Classify(size_t row, uint8_t flags, uint32_t responseMs) {
+    for (int filter = 1; filter < (int)EntryFilter::Count; filter++) {
+        m_sets[filter].Set(row, FilterMatches((EntryFilter)filter, flags, responseMs, m_slowMs));
+    }
+    if (IsReachable(flags)) {
+        BucketInsert(row, responseMs);
+    }
+    else {
+        BucketRemove(row);
+    }
+}
+
+void EntryIndex::BucketRemove(size_t row) {
+    if (m_bucketOf[row] == 0) return;
+    std::vector<uint32_t>& bucket = m_buckets[m_bucketOf[row] - 1];
+    uint32_t moved = bucket.back();
+    bucket[m_bucketPos[row]] = moved;
+    m_bucketPos[moved] = m_bucketPos[row];
+    bucket.pop_back();
+    m_bucketOf[row] = 0;
+}
+
+void EntryIndex::BucketInsert(size_t row, uint32_t responseMs) {
+    int bucket = LatencyBucket(responseMs);
+    if (m_bucketOf[row] == bucket + 1) return;
+    BucketRemove(row);
+    m_bucketOf[row] = (uint16_t)(bucket + 1);
+    m_bucketPos[row] = (uint32_t)m_buckets[bucket].size();
+    m_buckets[bucket].push_back((uint32_t)row);
+}
+
+void EntryIndex::RecordFailure(size_t row) {
+    if (m_failedAt[row] == 0) {
+        m_failedRows++;
+    }
+    m_failedAt[row] = ++m_sequence;
+    m_failures.push_back({ m_sequence, (uint32_t)row });
+    if (m_failures.size() > 2 * m_failedRows + 1024) {
+        CompactFailures();
+    }
+}
+
+// Drop superseded failures; what is left stays in order
+void EntryIndex::CompactFailures() {
+    auto stale = std::remove_if(m_failures.begin(), m_failures.end(), [this](const std::pair<uint64_t, uint32_t>& failure) {
+        return m_failedAt[failure.second] != failure.first;
+    });
+    m_failures.erase(stale, m_failures.end());
+}
+
+bool EntryIndex::Matches(EntryFilter filter, size_t row) const {
+    return filter == EntryFilter::All || filter >= EntryFilter::Count || m_sets[(int)filter].Test(row);
+}
+
+bool EntryIndex::InSuffix(std::pair<uint32_t, uint32_t> range, bool any, size_t row) const {
+    if (any) return true;
+    uint32_t position = m_trie.Position(row);
+    return position >= range.first && position < range.second;
+}
+
+// Whole buckets from the slowest down until TOP_K rows are in; only the
+// bucket that crosses TOP_K is sorted beyond what it needs to give
+void EntryIndex::CollectSlowest(const EntryTable& entries, const EntryView& view, std::pair<uint32_t, uint32_t> range,
+    bool any, std::vector<uint32_t>& ranked) const {
+    auto slower = [&entries](uint32_t a, uint32_t b) {
+        uint32_t msA = entries.ResponseMs(a);
+        uint32_t msB = entries.ResponseMs(b);
+        return msA > msB || (msA == msB && a < b);
+    };
+    for (int bucket = LATENCY_BUCKETS - 1; bucket >= 0 && ranked.size() < TOP_K; bucket--) {
+        size_t start = ranked.size();
+        for (uint32_t row : m_buckets[bucket]) {
+            if (Matches(view.filter, row) && InSuffix(range, any, row)) {
+                ranked.push_back(row);
+            }
+        }
+        if (ranked.size() > TOP_K) {
+            std::partial_sort(ranked.begin() + start, ranked.begin() + TOP_K, ranked.end(), slower);
+            ranked.resize(TOP_K);
+        }
+        else {
+            std::sort(ranked.begin() + start, ranked.end(), slower);
+        }
+    }
+}
+
+void EntryIndex::CollectRecentFailures(const EntryView& view, std::pair<uint32_t, uint32_t> range, bool any,
+    std::vector<uint32_t>& ranked) const {
+    for (size_t i = m_failures.size(); i > 0 && ranked.size() < TOP_K; i--) {
+        const auto& failure = m_failures[i - 1];
+        uint32_t row = failure.second;
+        if (m_failedAt[row] != failure.first || !Matches(view.filter, row) || !InSuffix(range, any, row)) continue;
+        ranked.push_back(row);
+    }
+}
+
+size_t EntryIndex::Query(const EntryTable& entries, const EntryView& view, size_t first, size_t count,
+    std::vector<uint32_t>& rows) const {
+    size_t size = (std::min)(entries.Size(), m_bucketOf.size());
+    bool any = view.suffix.empty();
+    std::pair<uint32_t, uint32_t> range = any ? std::make_pair(0u, (uint32_t)size) : m_trie.Range(view.suffix);
+
+    if (view.sort == EntrySort::Slowest || view.sort == EntrySort::RecentFailure) {
+        std::vector<uint32_t> ranked;
+        if (view.sort == EntrySort::Slowest) {
+            CollectSlowest(entries, view, range, any, ranked);
+        }
+        else {
+            CollectRecentFailures(view, range, any, ranked);
+        }
+        for (size_t i = first; i < ranked.size() && i < first + count; i++) {
+            rows.push_back(ranked[i]);
+        }
+        return ranked.size();
+    }
+
+    const RowSet* set = view.filter == EntryFilter::All || view.filter >= EntryFilter::Count ? nullptr : &m_sets[(int)view.filter];
+    if (any && !set) {
+        for (size_t row = first; row < size && row < first + count; row++) {
+            rows.push_back((uint32_t)row);
+        }
+        return size;
+    }
+    if (any) {
+        size_t row;
+        if (set->Select(first, row)) {
+            for (size_t added = 0; added < count; added++) {
+                rows.push_back((uint32_t)row);
+                if (!set->Next(row, row)) break;
+            }
+        }
+        return set->Count();
+    }
+
+    const std::vector<uint32_t>& order = m_trie.Order();
+    if (!set) {
+        for (size_t i = range.first + first; i < range.second && i < range.first + first + count; i++) {
+            rows.push_back(order[i]);
+        }
+        return range.second - range.first;
+    }
+    size_t matched = 0;
+    for (uint32_t i = range.first; i < range.second; i++) {
+        uint32_t row = order[i];
+        if (!set->Test(row)) continue;
+        if (matched >= first && matched < first + count) {
+            rows.push_back(row);
+        }
+        matched++;
+    }
+    return matched;
+}
+
+size_t EntryIndex::MemoryBytes() const {
+    size_t bytes = m_trie.MemoryBytes() + m_bucketOf.capacity() * sizeof(uint16_t) + m_bucketPos.capacity() * sizeof(uint32_t) +
+        m_failedAt.capacity() * sizeof(uint64_t) + m_failures.capacity() * sizeof(m_failures[0]);
+    for (const auto& set : m_sets) {
+        bytes += set.MemoryBytes();
+    }
+    for (const auto& bucket : m_buckets) {
+        bytes += bucket.capacity() * sizeof(uint32_t);
+    }
+    return bytes;
+}
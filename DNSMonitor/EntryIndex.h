@@ -0,0 +1,147 @@
+#pragma once
+
+#include "EntryTable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Statuses a view can be narrowed to, classified as EntrySums counts them
+enum class EntryFilter : uint8_t {
+    All,
+    Failing,        // Probed and did not resolve: the timeouts that have been tested
+    Slow,           // Reachable, slower than the threshold
+    Stale,
+    Changed,
+    Negative,       // Cached NXDOMAIN
+    Unreachable,    // Resolve, but no cached address takes connections
+    Count
+};
+
+// Orders a view can be in
+enum class EntrySort : uint8_t {
+    Cache,          // Cache order; by domain, a zone at a time, when a suffix is set
+    Slowest,        // Reachable entries, slowest first
+    RecentFailure,  // Entries that have failed, latest failure first
+    Count
+};
+
+const char* EntryFilterName(EntryFilter filter);    // "all", "failing", "slow", ...
+const char* EntrySortName(EntrySort sort);          // "cache", "slowest", "recent-failures"
+bool ParseEntryFilter(std::string_view name, EntryFilter& filter);
+bool ParseEntrySort(std::string_view name, EntrySort& sort);
+
+struct EntryView {
+    EntryFilter filter = EntryFilter::All;
+    EntrySort sort = EntrySort::Cache;
+    std::string suffix;             // "" for every name; else the name and every name under it
+};
+
+// A set of rows as a bitmap with a population count per block of 4096, so
+// membership changes are O(1) and the k-th member is found without a scan
+// of the whole table
+class RowSet {
+public:
+    void Reset(size_t rows);
+    void Set(size_t row, bool member);
+    bool Test(size_t row) const { return (m_words[row >> 6] >> (row & 63)) & 1; }
+    size_t Count() const { return m_count; }
+
+    // The k-th member in row order; false if there are not that many
+    bool Select(size_t k, size_t& row) const;
+    // The first member after row; false if there is none
+    bool Next(size_t row, size_t& next) const;
+
+    size_t MemoryBytes() const;
+
+private:
+    std::vector<uint64_t> m_words;
+    std::vector<uint32_t> m_blockCounts;
+    size_t m_rows = 0;
+    size_t m_count = 0;
+};
+
+// Hostnames in a trie of their labels read from the right, "com" then
+// "example" then "www", with the rows laid out in the trie's depth-first
+// order. Every name under a suffix is then one contiguous range of that
+// order, found with one lookup per label of the suffix. Case is ignored.
+class SuffixTrie {
+public:
+    void Build(const EntryTable& entries);
+
+    // Range of Order() holding the suffix and every name under it; empty if none
+    std::pair<uint32_t, uint32_t> Range(std::string_view suffix) const;
+    const std::vector<uint32_t>& Order() const { return m_order; }
+    uint32_t Position(size_t row) const { return m_position[row]; }
+
+    size_t Nodes() const { return m_ranges.size(); }
+    size_t MemoryBytes() const;
+
+private:
+    size_t ChildSlot(uint64_t key) const;
+    void GrowChildren();
+
+    StringArena m_labels;
+    std::vector<std::pair<uint32_t, uint32_t>> m_ranges;    // Per node, its range of m_order; node 0 is the root
+    std::vector<std::pair<uint64_t, uint32_t>> m_children;  // (parent << 32 | label, child) hashed by key; child 0 is empty
+    std::vector<uint32_t> m_order;                          // Rows in trie order
+    std::vector<uint32_t> m_position;                       // Per row, its place in m_order
+};
+
+// Filtered and sorted views of a table kept current as results land, so
+// the page on screen is found in milliseconds on a million entries instead
+// of by sorting them. After a table is replaced call Rebuild(); after that
+// every change to a row's flags or response time must be reported with
+// Update(), which is O(1) amortized. Sorted views rank at most TOP_K rows.
+class EntryIndex {
+public:
+    static const size_t TOP_K = 1000;
+    static const uint32_t NO_ROW = 0xFFFFFFFF;
+
+    explicit EntryIndex(uint32_t slowMs);
+
+    // previousRows, if given, holds for each row its row in the table before
+    // the refresh, or NO_ROW, so failure recency carries over
+    void Rebuild(const EntryTable& entries, const std::vector<uint32_t>* previousRows = nullptr);
+    // row used to have oldFlags and oldResponseMs; entries holds its new values
+    void Update(const EntryTable& entries, size_t row, uint8_t oldFlags, uint32_t oldResponseMs);
+
+    // Append up to count rows of the view, starting with its first-th, to
+    // rows. Returns how many rows the view has.
+    size_t Query(const EntryTable& entries, const EntryView& view, size_t first, size_t count,
+        std::vector<uint32_t>& rows) const;
+
+    bool Matches(EntryFilter filter, size_t row) const;
+    const SuffixTrie& Trie() const { return m_trie; }
+    size_t MemoryBytes() const;
+
+private:
+    // Response times below 64ms get a bucket each; above, each doubling is
+    // split into 64, so a bucket spans under 2% of its times
+    static const int LATENCY_BUCKETS = 64 + 26 * 64;
+
+    void Classify(size_t row, uint8_t flags, uint32_t responseMs);
+    void BucketRemove(size_t row);
+    void BucketInsert(size_t row, uint32_t responseMs);
+    void RecordFailure(size_t row);
+    void CompactFailures();
+    bool InSuffix(std::pair<uint32_t, uint32_t> range, bool any, size_t row) const;
+    void CollectSlowest(const EntryTable& entries, const EntryView& view, std::pair<uint32_t, uint32_t> range,
+        bool any, std::vector<uint32_t>& ranked) const;
+    void CollectRecentFailures(const EntryView& view, std::pair<uint32_t, uint32_t> range, bool any,
+        std::vector<uint32_t>& ranked) const;
+
+    uint32_t m_slowMs;
+    SuffixTrie m_trie;
+    RowSet m_sets[(int)EntryFilter::Count];             // Index 0, All, is unused
+    std::vector<uint32_t> m_buckets[LATENCY_BUCKETS];   // Reachable rows by response time
+    std::vector<uint16_t> m_bucketOf;                   // Per row, its bucket + 1; 0 is none
+    std::vector<uint32_t> m_bucketPos;                  // Per row, its place in the bucket
+    std::vector<uint64_t> m_failedAt;                   // Per row, sequence of its last failure; 0 is never
+    std::vector<std::pair<uint64_t, uint32_t>> m_failures;  // (sequence, row) in order; stale ones are skipped
+    uint64_t m_sequence = 0;
+    size_t m_failedRows = 0;
+};
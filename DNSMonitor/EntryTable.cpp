@@ -0,0 +1,462 @@
+#include "EntryTable.h"
+#include "DnsWire.h"
+#include "Platform.h"
+
+#include <cctype>
+#include <cstring>
+
+static const uint8_t V4_MAPPED_PREFIX[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+
+// FNV-1a; hostnames are short, so this beats anything fancier
+static uint32_t HashText(std::string_view text) {
+    uint32_t hash = 2166136261u;
+    for (char c : text) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    return hash;
+}
+
+RecordKind RecordKindFromType(uint16_t type) {
+    switch (type) {
+    case DNS_TYPE_A: return RecordKind::A;
+    case DNS_TYPE_AAAA: return RecordKind::AAAA;
+    case DNS_TYPE_CNAME: return RecordKind::CNAME;
+    default: return RecordKind::Other;
+    }
+}
+
+uint16_t RecordKindType(RecordKind kind) {
+    switch (kind) {
+    case RecordKind::A: return DNS_TYPE_A;
+    case RecordKind::AAAA: return DNS_TYPE_AAAA;
+    case RecordKind::CNAME: return DNS_TYPE_CNAME;
+    default: return 0;
+    }
+}
+
+const char* RecordKindName(RecordKind kind) {
+    switch (kind) {
+    case RecordKind::A: return "A";
+    case RecordKind::AAAA: return "AAAA";
+    case RecordKind::CNAME: return "CNAME";
+    case RecordKind::NameError: return "NXDOMAIN";
+    default: return "OTHER";
+    }
+}
+
+bool PackedAddress::IsV4() const {
+    return memcmp(bytes, V4_MAPPED_PREFIX, sizeof(V4_MAPPED_PREFIX)) == 0;
+}
+
+bool PackedAddress::IsEmpty() const {
+    static const uint8_t zero[16] = {};
+    return memcmp(bytes, zero, sizeof(bytes)) == 0;
+}
+
+bool PackedAddress::operator==(const PackedAddress& other) const {
+    return memcmp(bytes, other.bytes, sizeof(bytes)) == 0;
+}
+
+bool PackAddress(std::string_view text, PackedAddress& address) {
+    address = PackedAddress();
+    char buffer[INET6_ADDRSTRLEN];
+    if (text.empty() || text.size() >= sizeof(buffer)) return false;
+    memcpy(buffer, text.data(), text.size());
+    buffer[text.size()] = '\0';
+
+    if (inet_pton(AF_INET, buffer, address.bytes + 12) == 1) {
+        memcpy(address.bytes, V4_MAPPED_PREFIX, sizeof(V4_MAPPED_PREFIX));
+        return true;
+    }
+    if (inet_pton(AF_INET6, buffer, address.bytes) == 1) {
+        return true;
+    }
+    address = PackedAddress();
+    return false;
+}
+
+std::string FormatAddress(const PackedAddress& address) {
+    char text[INET6_ADDRSTRLEN] = "";
+    if (address.IsEmpty()) {
+        return text;
+    }
+    if (address.IsV4()) {
+        inet_ntop(AF_INET, (void*)(address.bytes + 12), text, sizeof(text));
+    }
+    else {
+        inet_ntop(AF_INET6, (void*)address.bytes, text, sizeof(text));
+    }
+    return text;
+}
+
+StringArena::StringArena()
+    : m_offsets(1, 0) {
+}
+
+size_t StringArena::Slot(std::string_view text, uint32_t hash) const {
+    size_t mask = m_slots.size() - 1;
+    size_t slot = hash & mask;
+    while (m_slots[slot] != 0 && Get(m_slots[slot] - 1) != text) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void StringArena::Rehash(size_t slots) {
+    m_slots.assign(slots, 0);
+    for (uint32_t id = 0; id < Size(); id++) {
+        m_slots[Slot(Get(id), HashText(Get(id)))] = id + 1;
+    }
+}
+
+uint32_t StringArena::Intern(std::string_view text) {
+    // At most half full, so probe runs stay short
+    if ((Size() + 1) * 2 > m_slots.size()) {
+        Rehash(m_slots.empty() ? 64 : m_slots.size() * 2);
+    }
+
+    size_t slot = Slot(text, HashText(text));
+    if (m_slots[slot] != 0) {
+        return m_slots[slot] - 1;
+    }
+
+    uint32_t id = (uint32_t)Size();
+    m_bytes.insert(m_bytes.end(), text.begin(), text.end());
+    m_offsets.push_back((uint32_t)m_bytes.size());
+    m_slots[slot] = id + 1;
+    return id;
+}
+
+bool StringArena::Find(std::string_view text, uint32_t& id) const {
+    if (m_slots.empty()) return false;
+    size_t slot = Slot(text, HashText(text));
+    if (m_slots[slot] == 0) return false;
+    id = m_slots[slot] - 1;
+    return true;
+}
+
+void StringArena::Reserve(size_t strings, size_t bytes) {
+    m_bytes.reserve(bytes);
+    m_offsets.reserve(strings + 1);
+    size_t slots = 64;
+    while (slots < strings * 2) {
+        slots *= 2;
+    }
+    if (slots > m_slots.size()) {
+        Rehash(slots);
+    }
+}
+
+void StringArena::Clear() {
+    m_bytes.clear();
+    m_offsets.assign(1, 0);
+    m_slots.clear();
+}
+
+size_t StringArena::MemoryBytes() const {
+    return m_bytes.capacity() + m_offsets.capacity() * sizeof(uint32_t) + m_slots.capacity() * sizeof(uint32_t);
+}
+
+size_t EntryTable::Slot(uint32_t hostId, RecordKind kind) const {
+    uint64_t key = ((uint64_t)hostId << 8) | (uint8_t)kind;
+    size_t mask = m_index.size() - 1;
+    size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+    while (m_index[slot] != 0) {
+        size_t row = m_index[slot] - 1;
+        if (m_hostIds[row] == hostId && m_kinds[row] == kind) break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void EntryTable::Rehash(size_t slots) {
+    m_index.assign(slots, 0);
+    for (size_t row = 0; row < Size(); row++) {
+        m_index[Slot(m_hostIds[row], m_kinds[row])] = (uint32_t)row + 1;
+    }
+}
+
+size_t EntryTable::Add(std::string_view hostname, RecordKind kind, const PackedAddress& address, uint32_t ttl) {
+    if ((Size() + 1) * 2 > m_index.size()) {
+        Rehash(m_index.empty() ? 64 : m_index.size() * 2);
+    }
+
+    size_t row = Size();
+    uint32_t hostId = m_hosts.Intern(hostname);
+    m_index[Slot(hostId, kind)] = (uint32_t)row + 1;
+    m_hostIds.push_back(hostId);
+    m_kinds.push_back(kind);
+    m_addresses.push_back(address);
+    m_ttl.push_back(ttl);
+    m_responseMs.push_back(0);
+    // A negative entry's TTL running out is not a health problem
+    m_flags.push_back(kind == RecordKind::NameError ? ENTRY_NEGATIVE : ttl == 0 ? ENTRY_STALE : 0);
+    m_targets.push_back(0);
+    m_moreAddresses.push_back(0);
+    return row;
+}
+
+bool EntryTable::Find(std::string_view hostname, RecordKind kind, size_t& row) const {
+    uint32_t hostId;
+    if (m_index.empty() || !m_hosts.Find(hostname, hostId)) return false;
+    return FindHostId(hostId, kind, row);
+}
+
+bool EntryTable::FindHostId(uint32_t hostId, RecordKind kind, size_t& row) const {
+    if (m_index.empty()) return false;
+    size_t slot = Slot(hostId, kind);
+    if (m_index[slot] == 0) return false;
+    row = m_index[slot] - 1;
+    return true;
+}
+
+bool EntryTable::AddAddress(size_t row, const PackedAddress& address) {
+    if (address.IsEmpty() || HasAddress(row, address)) return false;
+    if (m_addresses[row].IsEmpty()) {
+        m_addresses[row] = address;
+        return true;
+    }
+
+    // Keep cache order: append at the end of the chain. Grow the pool before
+    // taking a pointer into it.
+    m_pool.push_back({ address, 0 });
+    uint32_t* link = &m_moreAddresses[row];
+    while (*link != 0) {
+        link = &m_pool[*link - 1].next;
+    }
+    *link = (uint32_t)m_pool.size();
+    return true;
+}
+
+size_t EntryTable::AddressCount(size_t row) const {
+    if (m_addresses[row].IsEmpty()) return 0;
+    size_t count = 1;
+    for (uint32_t link = m_moreAddresses[row]; link != 0; link = m_pool[link - 1].next) {
+        count++;
+    }
+    return count;
+}
+
+bool EntryTable::HasAddress(size_t row, const PackedAddress& address) const {
+    if (address.IsEmpty()) return false;
+    if (m_addresses[row] == address) return true;
+    for (uint32_t link = m_moreAddresses[row]; link != 0; link = m_pool[link - 1].next) {
+        if (m_pool[link - 1].address == address) return true;
+    }
+    return false;
+}
+
+void EntryTable::Addresses(size_t row, std::vector<PackedAddress>& addresses) const {
+    addresses.clear();
+    if (m_addresses[row].IsEmpty()) return;
+    addresses.push_back(m_addresses[row]);
+    for (uint32_t link = m_moreAddresses[row]; link != 0; link = m_pool[link - 1].next) {
+        addresses.push_back(m_pool[link - 1].address);
+    }
+}
+
+bool EntryTable::SameAddresses(size_t row, const EntryTable& other, size_t otherRow) const {
+    // Chains hold no duplicates, so equal counts plus containment is equality
+    if (AddressCount(row) != other.AddressCount(otherRow)) return false;
+    if (m_addresses[row].IsEmpty()) return true;
+    if (!other.HasAddress(otherRow, m_addresses[row])) return false;
+    for (uint32_t link = m_moreAddresses[row]; link != 0; link = m_pool[link - 1].next) {
+        if (!other.HasAddress(otherRow, m_pool[link - 1].address)) return false;
+    }
+    return true;
+}
+
+void EntryTable::SetTarget(size_t row, std::string_view target) {
+    m_targets[row] = target.empty() ? 0 : m_hosts.Intern(target) + 1;
+}
+
+std::string_view EntryTable::Target(size_t row) const {
+    return m_targets[row] != 0 ? m_hosts.Get(m_targets[row] - 1) : std::string_view();
+}
+
+bool EntryTable::TargetId(size_t row, uint32_t& hostId) const {
+    if (m_targets[row] == 0) return false;
+    hostId = m_targets[row] - 1;
+    return true;
+}
+
+void EntryTable::Reserve(size_t rows) {
+    m_hosts.Reserve(rows, rows * 32);
+    m_hostIds.reserve(rows);
+    m_kinds.reserve(rows);
+    m_addresses.reserve(rows);
+    m_ttl.reserve(rows);
+    m_responseMs.reserve(rows);
+    m_flags.reserve(rows);
+    m_targets.reserve(rows);
+    m_moreAddresses.reserve(rows);
+    size_t slots = 64;
+    while (slots < rows * 2) {
+        slots *= 2;
+    }
+    if (slots > m_index.size()) {
+        Rehash(slots);
+    }
+}
+
+void EntryTable::Clear() {
+    m_hosts.Clear();
+    m_hostIds.clear();
+    m_kinds.clear();
+    m_addresses.clear();
+    m_ttl.clear();
+    m_responseMs.clear();
+    m_flags.clear();
+    m_targets.clear();
+    m_moreAddresses.clear();
+    m_pool.clear();
+    m_index.clear();
+}
+
+size_t EntryTable::MemoryBytes() const {
+    return m_hosts.MemoryBytes() + m_hostIds.capacity() * sizeof(uint32_t) + m_kinds.capacity() * sizeof(RecordKind) +
+        m_addresses.capacity() * sizeof(PackedAddress) + m_ttl.capacity() * sizeof(uint32_t) +
+        m_responseMs.capacity() * sizeof(uint32_t) + m_flags.capacity() + m_targets.capacity() * sizeof(uint32_t) +
+        m_moreAddresses.capacity() * sizeof(uint32_t) + m_pool.capacity() * sizeof(PooledAddress) +
+        m_index.capacity() * sizeof(uint32_t);
+}
+
+double EntryCounts::HealthPercentage() const {
+    int probed = total - negative;
+    return probed > 0 ? (double)reachable / probed * 100.0 : 0.0;
+}
+
+void EntrySums::Apply(uint8_t flags, uint32_t responseMs, uint32_t slowMs, int sign) {
+    total += sign;
+    if (flags & ENTRY_STALE) {
+        stale += sign;
+    }
+    if (flags & ENTRY_CHANGED) {
+        changed += sign;
+    }
+
+    // Not expected to resolve, so neither reachable nor a timeout
+    if (flags & ENTRY_NEGATIVE) {
+        negative += sign;
+        return;
+    }
+
+    // Resolving is not enough when the addresses it gives take no connections
+    if (flags & ENTRY_UNREACHABLE) {
+        unreachable += sign;
+    }
+    else if (flags & ENTRY_REACHABLE) {
+        reachable += sign;
+        totalResponseMs += (uint64_t)(int64_t)sign * responseMs;
+        if (responseMs > slowMs) {
+            slow += sign;
+        }
+    }
+    else {
+        timeouts += sign;
+    }
+}
+
+EntryCounts EntrySums::Counts() const {
+    EntryCounts counts;
+    counts.total = total;
+    counts.reachable = reachable;
+    counts.stale = stale;
+    counts.timeouts = timeouts;
+    counts.slow = slow;
+    counts.changed = changed;
+    counts.negative = negative;
+    counts.unreachable = unreachable;
+    counts.avgResponseMs = reachable > 0 ? (double)totalResponseMs / reachable : 0.0;
+    return counts;
+}
+
+EntryCounts CountEntries(const EntryTable& entries, uint32_t slowMs) {
+    EntrySums sums;
+    for (size_t row = 0; row < entries.Size(); row++) {
+        sums.Apply(entries.Flags(row), entries.ResponseMs(row), slowMs, 1);
+    }
+    return sums.Counts();
+}
+
+EntryTally::EntryTally(uint32_t slowMs)
+    : m_slowMs(slowMs) {
+}
+
+// The name itself or any name under it, ignoring case
+static bool HasSuffix(std::string_view hostname, std::string_view suffix) {
+    if (hostname.size() < suffix.size()) return false;
+    size_t start = hostname.size() - suffix.size();
+    if (start > 0 && hostname[start - 1] != '.') return false;
+    for (size_t i = 0; i < suffix.size(); i++) {
+        if (tolower((unsigned char)hostname[start + i]) != tolower((unsigned char)suffix[i])) return false;
+    }
+    return true;
+}
+
+uint32_t EntryTally::SuffixMask(std::string_view hostname) const {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < m_suffixes.size(); i++) {
+        if (HasSuffix(hostname, m_suffixes[i])) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+void EntryTally::Rebuild(const EntryTable& entries) {
+    m_all = EntrySums();
+    for (auto& sums : m_suffixSums) {
+        sums = EntrySums();
+    }
+    m_rowSuffixes.assign(entries.Size(), 0);
+
+    for (size_t row = 0; row < entries.Size(); row++) {
+        uint8_t flags = entries.Flags(row);
+        uint32_t responseMs = entries.ResponseMs(row);
+        m_all.Apply(flags, responseMs, m_slowMs, 1);
+        if (m_suffixes.empty()) continue;
+
+        uint32_t mask = SuffixMask(entries.Hostname(row));
+        m_rowSuffixes[row] = mask;
+        for (size_t i = 0; mask != 0; i++, mask >>= 1) {
+            if (mask & 1) {
+                m_suffixSums[i].Apply(flags, responseMs, m_slowMs, 1);
+            }
+        }
+    }
+}
+
+void EntryTally::Update(const EntryTable& entries, size_t row, uint8_t oldFlags, uint32_t oldResponseMs) {
+    uint8_t flags = entries.Flags(row);
+    uint32_t responseMs = entries.ResponseMs(row);
+    m_all.Apply(oldFlags, oldResponseMs, m_slowMs, -1);
+    m_all.Apply(flags, responseMs, m_slowMs, 1);
+
+    uint32_t mask = row < m_rowSuffixes.size() ? m_rowSuffixes[row] : 0;
+    for (size_t i = 0; mask != 0; i++, mask >>= 1) {
+        if (mask & 1) {
+            m_suffixSums[i].Apply(oldFlags, oldResponseMs, m_slowMs, -1);
+            m_suffixSums[i].Apply(flags, responseMs, m_slowMs, 1);
+        }
+    }
+}
+
+int EntryTally::AddSuffix(const EntryTable& entries, std::string_view suffix) {
+    while (!suffix.empty() && suffix.front() == '.') {
+        suffix.remove_prefix(1);
+    }
+    while (!suffix.empty() && suffix.back() == '.') {
+        suffix.remove_suffix(1);
+    }
+    if (suffix.empty()) return -1;
+    for (size_t i = 0; i < m_suffixes.size(); i++) {
+        if (m_suffixes[i].size() == suffix.size() && HasSuffix(m_suffixes[i], suffix)) return (int)i;
+    }
+    if (m_suffixes.size() >= MAX_SUFFIXES) return -1;
+
+    m_suffixes.emplace_back(suffix);
+    m_suffixSums.emplace_back();
+    Rebuild(entries);
+    return (int)m_suffixes.size() - 1;
+}
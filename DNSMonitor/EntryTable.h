@@ -0,0 +1,213 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Record types the monitor distinguishes, one byte per entry
+enum class RecordKind : uint8_t {
+    A,
+    AAAA,
+    CNAME,
+    NameError,      // Cached NXDOMAIN: the name is known not to exist
+    Other
+};
+
+RecordKind RecordKindFromType(uint16_t type);
+uint16_t RecordKindType(RecordKind kind);       // 0 for NameError and Other
+const char* RecordKindName(RecordKind kind);    // "A", "AAAA", "CNAME", "NXDOMAIN", "OTHER"
+
+// Binary IPv4 or IPv6 address. IPv4 is stored IPv4-mapped (::ffff:a.b.c.d)
+// so both fit the same 16 bytes; all zeros means no address.
+struct PackedAddress {
+    uint8_t bytes[16] = {};
+
+    bool IsV4() const;
+    bool IsEmpty() const;
+    bool operator==(const PackedAddress& other) const;
+    bool operator!=(const PackedAddress& other) const { return !(*this == other); }
+};
+
+// Parse a textual address; false (and an empty address) if it does not parse
+bool PackAddress(std::string_view text, PackedAddress& address);
+std::string FormatAddress(const PackedAddress& address);   // "" when empty
+
+// Interned strings: each distinct string is stored once, back to back in one
+// buffer, and named by a dense 32-bit id. Ids never change until Clear().
+class StringArena {
+public:
+    StringArena();
+
+    uint32_t Intern(std::string_view text);
+    bool Find(std::string_view text, uint32_t& id) const;
+    std::string_view Get(uint32_t id) const {
+        return std::string_view(m_bytes.data() + m_offsets[id], m_offsets[id + 1] - m_offsets[id]);
+    }
+
+    size_t Size() const { return m_offsets.size() - 1; }
+    void Reserve(size_t strings, size_t bytes);
+    void Clear();
+    size_t MemoryBytes() const;
+
+private:
+    size_t Slot(std::string_view text, uint32_t hash) const;
+    void Rehash(size_t slots);
+
+    std::vector<char> m_bytes;
+    std::vector<uint32_t> m_offsets;    // Start of string id; one extra at the end
+    std::vector<uint32_t> m_slots;      // Open-addressed hash table of id + 1; 0 is empty
+};
+
+// Bits of EntryTable::Flags()
+enum EntryFlag : uint8_t {
+    ENTRY_REACHABLE = 1 << 0,   // Last probe resolved
+    ENTRY_STALE = 1 << 1,       // Cached TTL has run out
+    ENTRY_CHANGED = 1 << 2,     // Upstream no longer returns the cached address
+    ENTRY_PENDING = 1 << 3,     // Probe queued or in flight
+    ENTRY_NEGATIVE = 1 << 4,    // Cached NXDOMAIN
+    ENTRY_UNREACHABLE = 1 << 5  // Connect probes found no cached address taking connections
+};
+
+// Cache entries stored column by column. Hostnames are interned, addresses
+// are binary and record types are one byte, so an entry costs tens of bytes
+// instead of three heap strings. The columns the stats and render passes
+// read (TTL, response time, flags) are separate arrays so those passes
+// touch only contiguous memory.
+//
+// A row is one (hostname, record type). Its first address sits in the
+// address column; any further addresses of the same type are chained in a
+// side pool, since most names have exactly one. CNAME rows carry their
+// target, interned alongside the hostnames so it can be looked up by id.
+class EntryTable {
+public:
+    // Append a row; the caller makes sure (hostname, kind) is not present yet
+    size_t Add(std::string_view hostname, RecordKind kind, const PackedAddress& address, uint32_t ttl);
+    bool Find(std::string_view hostname, RecordKind kind, size_t& row) const;
+    bool FindHostId(uint32_t hostId, RecordKind kind, size_t& row) const;
+
+    // Another address for a row; false if empty or already present
+    bool AddAddress(size_t row, const PackedAddress& address);
+    size_t AddressCount(size_t row) const;
+    bool HasAddress(size_t row, const PackedAddress& address) const;
+    void Addresses(size_t row, std::vector<PackedAddress>& addresses) const;
+    // Same set of addresses as otherRow of other, in any order
+    bool SameAddresses(size_t row, const EntryTable& other, size_t otherRow) const;
+
+    // CNAME target; "" and false when the row has none
+    void SetTarget(size_t row, std::string_view target);
+    std::string_view Target(size_t row) const;
+    bool TargetId(size_t row, uint32_t& hostId) const;
+
+    size_t Size() const { return m_hostIds.size(); }
+    bool Empty() const { return m_hostIds.empty(); }
+    void Reserve(size_t rows);
+    void Clear();
+
+    std::string_view Hostname(size_t row) const { return m_hosts.Get(m_hostIds[row]); }
+    uint32_t HostId(size_t row) const { return m_hostIds[row]; }
+    RecordKind Kind(size_t row) const { return m_kinds[row]; }
+    const PackedAddress& Address(size_t row) const { return m_addresses[row]; }
+
+    uint32_t& Ttl(size_t row) { return m_ttl[row]; }
+    uint32_t Ttl(size_t row) const { return m_ttl[row]; }
+    uint32_t& ResponseMs(size_t row) { return m_responseMs[row]; }
+    uint32_t ResponseMs(size_t row) const { return m_responseMs[row]; }
+    uint8_t& Flags(size_t row) { return m_flags[row]; }
+    uint8_t Flags(size_t row) const { return m_flags[row]; }
+
+    // Heap bytes held, for the benchmark and diagnostics
+    size_t MemoryBytes() const;
+
+private:
+    struct PooledAddress {
+        PackedAddress address;
+        uint32_t next;                  // Pool index + 1; 0 ends the chain
+    };
+
+    size_t Slot(uint32_t hostId, RecordKind kind) const;
+    void Rehash(size_t slots);
+
+    StringArena m_hosts;                // Hostnames and CNAME targets
+    std::vector<uint32_t> m_hostIds;
+    std::vector<RecordKind> m_kinds;
+    std::vector<PackedAddress> m_addresses;
+    std::vector<uint32_t> m_ttl;
+    std::vector<uint32_t> m_responseMs;
+    std::vector<uint8_t> m_flags;
+    std::vector<uint32_t> m_targets;    // Target id + 1; 0 is none
+    std::vector<uint32_t> m_moreAddresses;  // Pool index + 1 of the second address; 0 is none
+    std::vector<PooledAddress> m_pool;
+    std::vector<uint32_t> m_index;      // Open-addressed (host, kind) -> row + 1; 0 is empty
+};
+
+// Health counts over a table, from the flags and response time columns only
+struct EntryCounts {
+    int total;
+    int reachable;
+    int stale;
+    int timeouts;           // Neither reachable nor cached NXDOMAIN, nor unreachable
+    int slow;               // Reachable, slower than the threshold
+    int changed;
+    int negative;           // Cached NXDOMAIN, counted apart from reachable and timeouts
+    int unreachable;        // Resolve, but refused or ignored every connect probe
+    double avgResponseMs;   // Over reachable entries
+
+    // Reachable entries over all but cached NXDOMAIN, in percent
+    double HealthPercentage() const;
+};
+
+EntryCounts CountEntries(const EntryTable& entries, uint32_t slowMs);
+
+// Running sums behind EntryCounts; one entry is added or taken out in O(1)
+struct EntrySums {
+    int total = 0;
+    int reachable = 0;
+    int stale = 0;
+    int timeouts = 0;
+    int slow = 0;
+    int changed = 0;
+    int negative = 0;
+    int unreachable = 0;
+    uint64_t totalResponseMs = 0;
+
+    // sign is +1 to count an entry with these flags and response time, -1 to uncount it
+    void Apply(uint8_t flags, uint32_t responseMs, uint32_t slowMs, int sign);
+    EntryCounts Counts() const;
+};
+
+// EntryCounts kept current as entries change instead of recounted, for the
+// whole table and for hostname suffixes ("example.com" covers the name and
+// every name under it). Reads are O(1). After a table is replaced or
+// rebuilt call Rebuild(); after that every change to a row's flags or
+// response time must be reported with Update(), which is O(1) plus one
+// step per suffix the row matches. At most MAX_SUFFIXES suffixes.
+class EntryTally {
+public:
+    static const size_t MAX_SUFFIXES = 32;
+
+    explicit EntryTally(uint32_t slowMs);
+
+    void Rebuild(const EntryTable& entries);
+    // row used to have oldFlags and oldResponseMs; entries holds its new values
+    void Update(const EntryTable& entries, size_t row, uint8_t oldFlags, uint32_t oldResponseMs);
+
+    EntryCounts Counts() const { return m_all.Counts(); }
+
+    // Start counting a suffix; its index, or -1 if it is empty or there are too many.
+    // Adding a suffix already counted returns its index.
+    int AddSuffix(const EntryTable& entries, std::string_view suffix);
+    size_t Suffixes() const { return m_suffixes.size(); }
+    const std::string& Suffix(size_t index) const { return m_suffixes[index]; }
+    EntryCounts SuffixCounts(size_t index) const { return m_suffixSums[index].Counts(); }
+
+private:
+    uint32_t SuffixMask(std::string_view hostname) const;
+
+    uint32_t m_slowMs;
+    EntrySums m_all;
+    std::vector<std::string> m_suffixes;
+    std::vector<EntrySums> m_suffixSums;
+    std::vector<uint32_t> m_rowSuffixes;    // Per row, bit i set if it matches suffix i
+};
@@ -0,0 +1,128 @@
+#include "EventLoop.h"
+
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+// Milliseconds until deadline, rounded up so the wait never returns early;
+// -1 for no deadline
+static long long WaitMilliseconds(Clock::time_point deadline) {
+    if (deadline == Clock::time_point::max()) return -1;
+    auto remaining = deadline - Clock::now();
+    if (remaining <= Clock::duration::zero()) return 0;
+    auto ms = (long long)std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+    return (std::min)(ms, (long long)INT32_MAX - 1);
+}
+
+EventLoop::EventLoop()
+#ifdef _WIN32
+    : m_wake(nullptr),
+#else
+    : m_wakeRead(-1), m_wakeWrite(-1),
+#endif
+    m_waits(0), m_wakes(0), m_inputs(0), m_timeouts(0), m_blockedMicroseconds(0) {
+}
+
+EventLoop::~EventLoop() {
+#ifdef _WIN32
+    if (m_wake) CloseHandle(m_wake);
+#else
+    if (m_wakeRead >= 0) close(m_wakeRead);
+    if (m_wakeWrite >= 0) close(m_wakeWrite);
+#endif
+}
+
+bool EventLoop::Open() {
+#ifdef _WIN32
+    // Auto-reset: the wait that reports a wake also clears it
+    m_wake = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    return m_wake != nullptr;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    m_wakeRead = fds[0];
+    m_wakeWrite = fds[1];
+    return SetSocketNonBlocking(m_wakeRead) && SetSocketNonBlocking(m_wakeWrite);
+#endif
+}
+
+void EventLoop::Watch(EventSource source, uint32_t reason) {
+    m_watched.push_back({ source, reason });
+}
+
+void EventLoop::Wake() {
+#ifdef _WIN32
+    SetEvent(m_wake);
+#else
+    // A full pipe already holds a wake the waiter has not drained
+    char byte = 0;
+    ssize_t written = write(m_wakeWrite, &byte, 1);
+    (void)written;
+#endif
+}
+
+uint32_t EventLoop::Wait(Clock::time_point deadline) {
+    auto start = Clock::now();
+    long long timeoutMs = WaitMilliseconds(deadline);
+    uint32_t reasons = 0;
+
+#ifdef _WIN32
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    DWORD count = 0;
+    handles[count++] = m_wake;
+    for (const auto& watched : m_watched) {
+        if (count == MAXIMUM_WAIT_OBJECTS) break;
+        handles[count++] = watched.source;
+    }
+
+    DWORD result = WaitForMultipleObjects(count, handles, FALSE, timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs);
+    if (result == WAIT_OBJECT_0) {
+        reasons |= EVENT_WAKE;
+    }
+    else if (result > WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + count) {
+        reasons |= m_watched[result - WAIT_OBJECT_0 - 1].reason;
+    }
+#else
+    m_fds.resize(1 + m_watched.size());
+    m_fds[0].fd = m_wakeRead;
+    m_fds[0].events = POLLIN;
+    m_fds[0].revents = 0;
+    for (size_t i = 0; i < m_watched.size(); i++) {
+        m_fds[i + 1].fd = m_watched[i].source;
+        m_fds[i + 1].events = POLLIN;
+        m_fds[i + 1].revents = 0;
+    }
+
+    if (PollSockets(m_fds.data(), m_fds.size(), (int)timeoutMs) > 0) {
+        if (m_fds[0].revents) {
+            char drain[64];
+            while (read(m_wakeRead, drain, sizeof(drain)) > 0) {
+            }
+            reasons |= EVENT_WAKE;
+        }
+        for (size_t i = 0; i < m_watched.size(); i++) {
+            if (m_fds[i + 1].revents) reasons |= m_watched[i].reason;
+        }
+    }
+#endif
+
+    m_waits++;
+    if (reasons == 0) {
+        reasons = EVENT_TIMEOUT;
+        m_timeouts++;
+    }
+    if (reasons & EVENT_WAKE) m_wakes++;
+    if (reasons & ~(uint32_t)(EVENT_WAKE | EVENT_TIMEOUT)) m_inputs++;
+    m_blockedMicroseconds += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    return reasons;
+}
+
+EventLoopStats EventLoop::Stats() const {
+    EventLoopStats stats;
+    stats.waits = m_waits;
+    stats.wakes = m_wakes;
+    stats.inputs = m_inputs;
+    stats.timeouts = m_timeouts;
+    stats.blockedSeconds = m_blockedMicroseconds / 1e6;
+    return stats;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Why Wait() returned; several can be set at once
+enum : uint32_t {
+    EVENT_WAKE = 1,     // Wake() was called
+    EVENT_INPUT = 2,    // A source watched with this reason is ready
+    EVENT_EXIT = 4,     // Likewise; separate so shutdown can be watched beside input
+    EVENT_TIMEOUT = 8   // The deadline passed with nothing else ready
+};
+
+#ifdef _WIN32
+typedef HANDLE EventSource;     // Any waitable handle: console input, an event
+#else
+typedef int EventSource;        // A descriptor, ready when readable
+#endif
+
+struct EventLoopStats {
+    uint64_t waits;             // Wait() calls
+    uint64_t wakes;             // Returns for EVENT_WAKE
+    uint64_t inputs;            // Returns for a watched source
+    uint64_t timeouts;
+    double blockedSeconds;      // Time spent inside Wait()
+};
+
+// Blocks one thread until another thread calls Wake(), a watched source is
+// ready or a deadline passes, so the thread does no work while nothing
+// happens. WaitForMultipleObjects on Windows; poll() on a self-pipe
+// elsewhere. Watched sources are level-triggered: the owner has to consume
+// what made one ready, or the next Wait() returns at once.
+class EventLoop {
+public:
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Create the wake signal; false if the platform refuses
+    bool Open();
+
+    // Return from Wait() with reason when source is ready. Only the waiting
+    // thread watches sources.
+    void Watch(EventSource source, uint32_t reason);
+
+    // Make the current or next Wait() return EVENT_WAKE. Any thread; wakes
+    // that arrive before the waiter gets to them coalesce.
+    void Wake();
+
+    // Block until something is ready or deadline passes; time_point::max()
+    // waits with no deadline. Returns the reasons, EVENT_TIMEOUT if none.
+    uint32_t Wait(std::chrono::steady_clock::time_point deadline);
+
+    EventLoopStats Stats() const;
+
+private:
+    struct Watched {
+        EventSource source;
+        uint32_t reason;
+    };
+
+#ifdef _WIN32
+    HANDLE m_wake;
+#else
+    int m_wakeRead;
+    int m_wakeWrite;
+    std::vector<SocketPollFd> m_fds;
+#endif
+    std::vector<Watched> m_watched;
+
+    std::atomic<uint64_t> m_waits;
+    std::atomic<uint64_t> m_wakes;
+    std::atomic<uint64_t> m_inputs;
+    std::atomic<uint64_t> m_timeouts;
+    std::atomic<uint64_t> m_blockedMicroseconds;
+};
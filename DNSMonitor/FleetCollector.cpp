@@ -0,0 +1,476 @@
+#include "FleetCollector.h"
+#include "EntryTable.h"
+#include "Platform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+static const uint32_t NO_SLOT = 0xFFFFFFFF;
+static const size_t RECEIVE_BUFFER = 64 * 1024;
+
+// One hostname's totals over the monitors of one worker
+struct FleetTotals {
+    uint32_t monitors = 0;
+    uint32_t failing = 0;
+    uint32_t changed = 0;
+    uint32_t stale = 0;
+    uint32_t slow = 0;
+    uint32_t answered = 0;      // Monitors where it resolved
+    uint64_t probes = 0;
+    uint64_t failures = 0;
+    uint64_t responseMs = 0;    // Summed over answered
+    uint64_t excessMs = 0;      // Response time beyond slowMs, summed
+
+    // sign is +1 to count one monitor's view of the host, -1 to uncount it
+    void Apply(uint8_t flags, uint32_t lastMs, uint32_t slowMs, int sign) {
+        monitors += sign;
+        if (flags & ENTRY_STALE) stale += sign;
+        if (flags & ENTRY_CHANGED) changed += sign;
+        if (flags & ENTRY_NEGATIVE) return;     // Not expected to resolve
+        if ((flags & ENTRY_UNREACHABLE) || !(flags & ENTRY_REACHABLE)) {
+            failing += sign;
+            return;
+        }
+        answered += sign;
+        responseMs += (uint64_t)(int64_t)sign * lastMs;
+        if (lastMs > slowMs) {
+            slow += sign;
+            excessMs += (uint64_t)(int64_t)sign * (lastMs - slowMs);
+        }
+    }
+};
+
+// Per worker: the hostnames its monitors have reported, by slot
+struct FleetShard {
+    mutable std::mutex lock;        // Held by the worker while applying a report, and by Ranked()
+    std::unordered_map<std::string, uint32_t> slots;
+    std::vector<std::string> names;
+    std::vector<FleetTotals> totals;
+};
+
+// What one monitor last said about one host, by the stream's name number
+struct FleetSeen {
+    uint32_t slot = NO_SLOT;
+    uint32_t report = 0;        // Number of the last report that listed it
+    uint32_t responseMs = 0;
+    uint8_t flags = 0;
+    bool present = false;       // Counted in the shard totals
+};
+
+struct FleetConnection {
+    SOCKET sock = INVALID_SOCKET;
+    FleetDecoder decoder;
+    std::string monitor;
+    bool hello = false;
+    uint32_t reports = 0;
+    std::vector<FleetSeen> seen;
+};
+
+struct FleetWorker {
+    FleetShard shard;
+    std::vector<FleetConnection> connections;     // Only touched by the worker's thread
+    std::atomic<int> count{ 0 };                  // Connections, counting those still in the inbox
+
+    std::mutex inboxLock;
+    std::vector<SOCKET> inbox;                    // Accepted by worker 0, not yet taken
+    SOCKET wake = INVALID_SOCKET;                 // Written when the inbox gets a connection
+};
+
+struct FleetCollectorState {
+    FleetCollectorConfig config;
+    SOCKET listener = INVALID_SOCKET;
+    SOCKET wake = INVALID_SOCKET;       // UDP socket connected to itself; written once to stop every worker
+    uint16_t port = 0;
+    std::atomic<bool> stopping{ false };
+    std::vector<std::unique_ptr<FleetWorker>> workers;
+
+    std::atomic<int> connections{ 0 };
+    std::atomic<uint32_t> monitors{ 0 };
+    std::atomic<uint64_t> reports{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+    std::atomic<uint64_t> hostUpdates{ 0 };
+    std::atomic<uint64_t> protocolErrors{ 0 };
+};
+
+static uint32_t ShardSlot(FleetShard& shard, const std::string& host) {
+    auto it = shard.slots.find(host);
+    if (it != shard.slots.end()) return it->second;
+    uint32_t slot = (uint32_t)shard.names.size();
+    shard.slots.emplace(host, slot);
+    shard.names.push_back(host);
+    shard.totals.emplace_back();
+    return slot;
+}
+
+// Take everything the connection contributed out of the shard
+static void Withdraw(FleetCollectorState& state, FleetShard& shard, FleetConnection& connection) {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    for (auto& seen : connection.seen) {
+        if (!seen.present) continue;
+        shard.totals[seen.slot].Apply(seen.flags, seen.responseMs, state.config.slowMs, -1);
+        seen.present = false;
+    }
+}
+
+static void ApplyReport(FleetCollectorState& state, FleetShard& shard, FleetConnection& connection, const FleetReport& report) {
+    uint32_t slowMs = state.config.slowMs;
+    uint32_t number = ++connection.reports;
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+    for (const auto& host : report.hosts) {
+        if (host.id >= connection.seen.size()) {
+            connection.seen.resize(host.id + 1);
+        }
+        FleetSeen& seen = connection.seen[host.id];
+        if (seen.slot == NO_SLOT) {
+            seen.slot = ShardSlot(shard, host.host);
+        }
+        FleetTotals& totals = shard.totals[seen.slot];
+
+        if (seen.present) {
+            totals.Apply(seen.flags, seen.responseMs, slowMs, -1);
+            seen.present = false;
+        }
+        if (host.removed) continue;
+
+        seen.flags = host.flags;
+        seen.responseMs = host.responseMs;
+        seen.report = number;
+        seen.present = true;
+        totals.Apply(seen.flags, seen.responseMs, slowMs, 1);
+        totals.probes += host.probes;
+        totals.failures += host.failures;
+    }
+
+    // A full report lists everything; what it left out is gone
+    if (report.full) {
+        for (auto& seen : connection.seen) {
+            if (seen.present && seen.report != number) {
+                shard.totals[seen.slot].Apply(seen.flags, seen.responseMs, slowMs, -1);
+                seen.present = false;
+            }
+        }
+    }
+
+    state.reports++;
+    state.hostUpdates += report.hosts.size();
+}
+
+// Read and apply what the monitor sent; false if the connection should be dropped
+static bool ReadConnection(FleetCollectorState& state, FleetWorker& worker, FleetConnection& connection, std::vector<uint8_t>& buffer) {
+    for (;;) {
+        int received = recv(connection.sock, (char*)buffer.data(), (int)buffer.size(), 0);
+        if (received == 0) return false;
+        if (received < 0) return SocketWouldBlock(LastSocketError());
+        state.bytes += received;
+        connection.decoder.Append(buffer.data(), (size_t)received);
+
+        std::string monitor;
+        FleetReport report;
+        for (;;) {
+            FleetFrame frame = connection.decoder.Next(monitor, report);
+            if (frame == FleetFrame::None) break;
+            if (frame == FleetFrame::Error) {
+                state.protocolErrors++;
+                return false;
+            }
+            if (frame == FleetFrame::Hello) {
+                // A new stream on the same connection starts from nothing
+                Withdraw(state, worker.shard, connection);
+                connection.seen.clear();
+                connection.reports = 0;
+                connection.monitor = monitor;
+                if (!connection.hello) {
+                    connection.hello = true;
+                    state.monitors++;
+                }
+                continue;
+            }
+            ApplyReport(state, worker.shard, connection, report);
+        }
+        if ((size_t)received < buffer.size()) return true;
+    }
+}
+
+static void CloseConnection(FleetCollectorState& state, FleetWorker& worker, size_t index) {
+    FleetConnection& connection = worker.connections[index];
+    Withdraw(state, worker.shard, connection);
+    if (connection.hello) {
+        state.monitors--;
+    }
+    closesocket(connection.sock);
+    worker.connections.erase(worker.connections.begin() + index);
+    worker.count--;
+    state.connections--;
+}
+
+// Wake socket: loopback UDP connected to its own address
+static SOCKET OpenWakeSocket() {
+    struct sockaddr_storage address;
+    socklen_t length;
+    ParseSocketAddress("127.0.0.1", 0, address, length);
+    SOCKET wake = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wake == INVALID_SOCKET) return INVALID_SOCKET;
+    if (bind(wake, (struct sockaddr*)&address, length) != 0 || getsockname(wake, (struct sockaddr*)&address, &length) != 0 ||
+        connect(wake, (struct sockaddr*)&address, length) != 0 || !SetSocketNonBlocking(wake)) {
+        closesocket(wake);
+        return INVALID_SOCKET;
+    }
+    return wake;
+}
+
+static void AddConnection(FleetWorker& worker, SOCKET sock) {
+    worker.connections.emplace_back();
+    worker.connections.back().sock = sock;
+}
+
+// Worker 0 accepts for everyone and gives each connection to the worker with the fewest
+static void AcceptConnections(FleetCollectorState& state, FleetWorker& self) {
+    for (;;) {
+        SOCKET sock = accept(state.listener, nullptr, nullptr);
+        if (sock == INVALID_SOCKET) return;
+        if (state.connections >= state.config.maxMonitors || !SetSocketNonBlocking(sock)) {
+            closesocket(sock);
+            continue;
+        }
+
+        FleetWorker* target = &self;
+        for (const auto& worker : state.workers) {
+            if (worker->count < target->count) target = worker.get();
+        }
+        target->count++;
+        state.connections++;
+        if (target == &self) {
+            AddConnection(self, sock);
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> guard(target->inboxLock);
+            target->inbox.push_back(sock);
+        }
+        char byte = 0;
+        send(target->wake, &byte, 1, 0);
+    }
+}
+
+static void TakeInbox(FleetWorker& worker) {
+    char drain[256];
+    while (recv(worker.wake, drain, sizeof(drain), 0) > 0) {
+    }
+    std::vector<SOCKET> arrived;
+    {
+        std::lock_guard<std::mutex> guard(worker.inboxLock);
+        arrived.swap(worker.inbox);
+    }
+    for (SOCKET sock : arrived) {
+        AddConnection(worker, sock);
+    }
+}
+
+static void RunWorker(std::shared_ptr<FleetCollectorState> statePtr, size_t index) {
+    FleetCollectorState& state = *statePtr;
+    FleetWorker& worker = *state.workers[index];
+    std::vector<SocketPollFd> fds;
+    std::vector<uint8_t> buffer(RECEIVE_BUFFER);
+    bool accepting = index == 0;
+
+    while (!state.stopping) {
+        fds.clear();
+        fds.push_back({});
+        fds.back().fd = state.wake;
+        fds.back().events = POLLIN;
+        fds.push_back({});
+        fds.back().fd = worker.wake;
+        fds.back().events = POLLIN;
+        if (accepting) {
+            fds.push_back({});
+            fds.back().fd = state.listener;
+            fds.back().events = POLLIN;
+        }
+        size_t first = fds.size();
+        for (const auto& connection : worker.connections) {
+            fds.push_back({});
+            fds.back().fd = connection.sock;
+            fds.back().events = POLLIN;
+        }
+
+        // No timeout: connections, handoffs or shutdown wake us
+        if (PollSockets(fds.data(), fds.size(), -1) < 0) {
+            if (SocketTransientError(LastSocketError())) continue;
+            break;
+        }
+        if (state.stopping) break;
+
+        // Connections first: their poll slots are positional and the inbox and accepting append
+        size_t polled = fds.size() - first;
+        for (size_t i = (std::min)(polled, worker.connections.size()); i-- > 0;) {
+            short revents = fds[first + i].revents;
+            if (!revents) continue;
+            bool keep = (revents & POLLIN) != 0 && ReadConnection(state, worker, worker.connections[i], buffer);
+            if (!keep) {
+                CloseConnection(state, worker, i);
+            }
+        }
+
+        if (fds[1].revents) {
+            TakeInbox(worker);
+        }
+        if (accepting && (fds[2].revents & POLLIN)) {
+            AcceptConnections(state, worker);
+        }
+    }
+
+    TakeInbox(worker);
+    for (size_t i = worker.connections.size(); i-- > 0;) {
+        CloseConnection(state, worker, i);
+    }
+}
+
+FleetCollector::FleetCollector(const FleetCollectorConfig& config)
+    : m_config(config), m_state(std::make_shared<FleetCollectorState>()) {
+    m_config.threads = (std::max)(m_config.threads, 1);
+    m_state->config = m_config;
+}
+
+FleetCollector::~FleetCollector() {
+    Stop();
+}
+
+bool FleetCollector::Start() {
+    struct sockaddr_storage address;
+    socklen_t length;
+    if (!ParseSocketAddress(m_config.address, m_config.port, address, length)) {
+        return false;
+    }
+
+    SOCKET listener = socket(address.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        return false;
+    }
+#ifndef _WIN32
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+#endif
+    if (bind(listener, (struct sockaddr*)&address, length) != 0 || listen(listener, SOMAXCONN) != 0 ||
+        getsockname(listener, (struct sockaddr*)&address, &length) != 0 || !SetSocketNonBlocking(listener)) {
+        closesocket(listener);
+        return false;
+    }
+    m_state->port = ntohs(address.ss_family == AF_INET6 ?
+        ((struct sockaddr_in6*)&address)->sin6_port : ((struct sockaddr_in*)&address)->sin_port);
+
+    m_state->listener = listener;
+    m_state->wake = OpenWakeSocket();
+    for (int i = 0; i < m_config.threads; i++) {
+        m_state->workers.push_back(std::make_unique<FleetWorker>());
+        m_state->workers.back()->wake = OpenWakeSocket();
+    }
+    for (const auto& worker : m_state->workers) {
+        if (m_state->wake == INVALID_SOCKET || worker->wake == INVALID_SOCKET) {
+            Stop();
+            return false;
+        }
+    }
+    for (int i = 0; i < m_config.threads; i++) {
+        m_threads.emplace_back(RunWorker, m_state, (size_t)i);
+    }
+    return true;
+}
+
+void FleetCollector::Stop() {
+    if (!m_threads.empty()) {
+        // Never drained, so every worker's poll() sees it
+        m_state->stopping = true;
+        char byte = 0;
+        send(m_state->wake, &byte, 1, 0);
+        for (auto& thread : m_threads) {
+            thread.join();
+        }
+        m_threads.clear();
+    }
+    if (m_state->listener != INVALID_SOCKET) {
+        closesocket(m_state->listener);
+        m_state->listener = INVALID_SOCKET;
+    }
+    if (m_state->wake != INVALID_SOCKET) {
+        closesocket(m_state->wake);
+        m_state->wake = INVALID_SOCKET;
+    }
+    for (const auto& worker : m_state->workers) {
+        if (worker->wake != INVALID_SOCKET) {
+            closesocket(worker->wake);
+            worker->wake = INVALID_SOCKET;
+        }
+    }
+}
+
+uint16_t FleetCollector::Port() const {
+    return m_state->port;
+}
+
+void FleetCollector::Ranked(std::vector<FleetHostRank>& out, size_t max) const {
+    // The same hostname has totals in every shard with a monitor reporting it
+    std::unordered_map<std::string, FleetTotals> merged;
+    for (const auto& worker : m_state->workers) {
+        const FleetShard& shard = worker->shard;
+        std::lock_guard<std::mutex> guard(shard.lock);
+        for (size_t slot = 0; slot < shard.totals.size(); slot++) {
+            const FleetTotals& totals = shard.totals[slot];
+            if (totals.monitors == 0) continue;
+            FleetTotals& sum = merged[shard.names[slot]];
+            sum.monitors += totals.monitors;
+            sum.failing += totals.failing;
+            sum.changed += totals.changed;
+            sum.stale += totals.stale;
+            sum.slow += totals.slow;
+            sum.answered += totals.answered;
+            sum.probes += totals.probes;
+            sum.failures += totals.failures;
+            sum.responseMs += totals.responseMs;
+            sum.excessMs += totals.excessMs;
+        }
+    }
+
+    out.clear();
+    for (const auto& item : merged) {
+        const FleetTotals& totals = item.second;
+        uint64_t impact = (uint64_t)(totals.failing + totals.changed) * m_config.failureCostMs + totals.excessMs;
+        if (impact == 0) continue;
+
+        FleetHostRank rank;
+        rank.host = item.first;
+        rank.monitors = totals.monitors;
+        rank.failing = totals.failing;
+        rank.changed = totals.changed;
+        rank.stale = totals.stale;
+        rank.slow = totals.slow;
+        rank.probes = totals.probes;
+        rank.failures = totals.failures;
+        rank.avgResponseMs = totals.answered > 0 ? (uint32_t)(totals.responseMs / totals.answered) : 0;
+        rank.impact = impact;
+        out.push_back(rank);
+    }
+
+    auto byImpact = [](const FleetHostRank& a, const FleetHostRank& b) {
+        return a.impact != b.impact ? a.impact > b.impact : a.host < b.host;
+    };
+    if (out.size() > max) {
+        std::partial_sort(out.begin(), out.begin() + max, out.end(), byImpact);
+        out.resize(max);
+    }
+    else {
+        std::sort(out.begin(), out.end(), byImpact);
+    }
+}
+
+FleetCollectorStats FleetCollector::Stats() const {
+    FleetCollectorStats stats;
+    stats.monitors = m_state->monitors;
+    stats.reports = m_state->reports;
+    stats.bytes = m_state->bytes;
+    stats.hostUpdates = m_state->hostUpdates;
+    stats.protocolErrors = m_state->protocolErrors;
+    return stats;
+}
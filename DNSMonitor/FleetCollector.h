@@ -0,0 +1,76 @@
+#pragma once
+
+#include "FleetReport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FleetCollectorConfig {
+    std::string address = "0.0.0.0";
+    uint16_t port = 9154;               // 0 picks a free port; see Port()
+    int threads = 4;
+    int maxMonitors = 20000;
+    uint32_t slowMs = 200;              // As the monitors' slow threshold
+    uint32_t failureCostMs = 3000;      // What one monitor failing a host weighs against latency
+};
+
+// One hostname across the fleet
+struct FleetHostRank {
+    std::string host;
+    uint32_t monitors;          // Monitors that have it cached
+    uint32_t failing;           // Of those, where its last probe timed out or no address took connections
+    uint32_t changed;           // Where upstream no longer returns the cached address
+    uint32_t stale;
+    uint32_t slow;
+    uint64_t probes;            // Reported since the collector started
+    uint64_t failures;
+    uint32_t avgResponseMs;     // Over the monitors where it resolved
+    uint64_t impact;            // (failing + changed) * failureCostMs + response time beyond slowMs, summed
+};
+
+struct FleetCollectorStats {
+    uint32_t monitors;          // Connected and past the hello
+    uint64_t reports;
+    uint64_t bytes;
+    uint64_t hostUpdates;
+    uint64_t protocolErrors;    // Connections dropped for a bad frame
+};
+
+struct FleetCollectorState;
+
+// Receives FleetReport streams from monitors and keeps per-hostname totals
+// over all of them. Connections are spread over a few worker threads, each
+// polling its own; the first also accepts and hands every new connection to
+// the worker with the fewest. Every worker keeps totals for the monitors it
+// serves in its own shard, so applying a report takes no lock shared with
+// other workers. Ranked() merges the shards when asked.
+class FleetCollector {
+public:
+    explicit FleetCollector(const FleetCollectorConfig& config);
+    ~FleetCollector();
+
+    FleetCollector(const FleetCollector&) = delete;
+    FleetCollector& operator=(const FleetCollector&) = delete;
+
+    // Bind, listen and start the workers; false if the port is unavailable
+    bool Start();
+    void Stop();
+
+    // The bound port, once started
+    uint16_t Port() const;
+
+    // Hostnames by descending impact, at most max of them; only hosts with
+    // a non-zero impact are listed
+    void Ranked(std::vector<FleetHostRank>& out, size_t max) const;
+
+    FleetCollectorStats Stats() const;
+
+private:
+    FleetCollectorConfig m_config;
+    std::shared_ptr<FleetCollectorState> m_state;
+    std::vector<std::thread> m_threads;
+};
@@ -0,0 +1,275 @@
+#include "FleetReport.h"
+
+#include <cstring>
+
+static const char FLEET_MAGIC[8] = { 'D', 'N', 'S', 'F', 'L', 'E', 'E', 'T' };
+static const uint32_t FLEET_VERSION = 1;
+static const uint8_t FRAME_HELLO = 1;
+static const uint8_t FRAME_REPORT = 2;
+static const uint8_t HOST_REMOVED = 0x80;      // In the flags byte; EntryFlag bits stay below it
+static const size_t MAX_FLEET_NAME = 1024;
+static const size_t SUMMARY_FIELDS = sizeof(FleetSummary) / sizeof(uint32_t);
+
+// The summary as an array, so it can be delta-encoded field by field
+static uint32_t* SummaryFields(FleetSummary& summary) {
+    return reinterpret_cast<uint32_t*>(&summary);
+}
+
+static const uint32_t* SummaryFields(const FleetSummary& summary) {
+    return reinterpret_cast<const uint32_t*>(&summary);
+}
+
+FleetEncoder::FleetEncoder()
+    : m_out(nullptr), m_nameBytes(0), m_lastSummary(), m_lastTimestamp(0) {
+}
+
+void FleetEncoder::PutVarint(uint64_t value) {
+    while (value >= 0x80) {
+        m_out->push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    m_out->push_back((uint8_t)value);
+}
+
+// Zigzag, so small differences either way stay one byte
+void FleetEncoder::PutSigned(int64_t value) {
+    PutVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+// Frames are a 4-byte little-endian length, then the type byte and payload
+static size_t BeginFrame(std::vector<uint8_t>& out, uint8_t type) {
+    size_t start = out.size();
+    out.resize(start + 4);
+    out.push_back(type);
+    return start;
+}
+
+static void EndFrame(std::vector<uint8_t>& out, size_t start) {
+    uint32_t length = (uint32_t)(out.size() - start - 4);
+    for (int i = 0; i < 4; i++) {
+        out[start + i] = (uint8_t)(length >> (8 * i));
+    }
+}
+
+void FleetEncoder::Hello(const std::string& monitor, std::vector<uint8_t>& out) {
+    m_names.clear();
+    m_nameBytes = 0;
+    m_lastResponseMs.clear();
+    m_lastSummary = FleetSummary();
+    m_lastTimestamp = 0;
+
+    m_out = &out;
+    size_t start = BeginFrame(out, FRAME_HELLO);
+    out.insert(out.end(), FLEET_MAGIC, FLEET_MAGIC + sizeof(FLEET_MAGIC));
+    PutVarint(FLEET_VERSION);
+    std::string name = monitor.substr(0, MAX_FLEET_NAME);
+    PutVarint(name.size());
+    out.insert(out.end(), name.begin(), name.end());
+    EndFrame(out, start);
+}
+
+void FleetEncoder::Encode(const FleetReport& report, std::vector<uint8_t>& out) {
+    m_out = &out;
+    size_t start = BeginFrame(out, FRAME_REPORT);
+    PutSigned((int64_t)(report.timestamp - m_lastTimestamp));
+    m_lastTimestamp = report.timestamp;
+    out.push_back(report.full ? 1 : 0);
+
+    const uint32_t* fields = SummaryFields(report.summary);
+    uint32_t* last = SummaryFields(m_lastSummary);
+    for (size_t i = 0; i < SUMMARY_FIELDS; i++) {
+        PutSigned((int64_t)fields[i] - (int64_t)last[i]);
+        last[i] = fields[i];
+    }
+
+    PutVarint(report.hosts.size());
+    for (const auto& host : report.hosts) {
+        // Number + 1 of a name sent before, or 0 and the name itself
+        std::string name = host.host.substr(0, MAX_FLEET_NAME);
+        auto it = m_names.find(name);
+        uint32_t id;
+        if (it != m_names.end()) {
+            id = it->second;
+            PutVarint((uint64_t)id + 1);
+        }
+        else {
+            id = (uint32_t)m_names.size();
+            m_names.emplace(name, id);
+            m_nameBytes += name.size();
+            m_lastResponseMs.push_back(0);
+            PutVarint(0);
+            PutVarint(name.size());
+            out.insert(out.end(), name.begin(), name.end());
+        }
+
+        if (host.removed) {
+            out.push_back(HOST_REMOVED);
+            continue;
+        }
+        out.push_back(host.flags & ~HOST_REMOVED);
+        PutSigned((int64_t)host.responseMs - (int64_t)m_lastResponseMs[id]);
+        m_lastResponseMs[id] = host.responseMs;
+        PutVarint(host.probes);
+        PutVarint(host.failures);
+    }
+    EndFrame(out, start);
+}
+
+bool FleetEncoder::NeedsHello() const {
+    return m_names.size() >= FLEET_MAX_NAMES / 2 || m_nameBytes >= FLEET_MAX_NAME_BYTES / 2;
+}
+
+// Bounds-checked reads from one frame
+struct FleetCursor {
+    const uint8_t* data;
+    size_t length;
+    size_t position = 0;
+
+    bool Byte(uint8_t& value) {
+        if (position >= length) return false;
+        value = data[position++];
+        return true;
+    }
+
+    bool Varint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!Byte(byte)) return false;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool Signed(int64_t& value) {
+        uint64_t raw;
+        if (!Varint(raw)) return false;
+        value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+        return true;
+    }
+
+    bool Text(std::string& text) {
+        uint64_t size;
+        if (!Varint(size) || size > MAX_FLEET_NAME || size > length - position) return false;
+        text.assign((const char*)data + position, (size_t)size);
+        position += (size_t)size;
+        return true;
+    }
+};
+
+FleetDecoder::FleetDecoder()
+    : m_position(0), m_helloSeen(false), m_nameBytes(0), m_lastSummary(), m_lastTimestamp(0) {
+}
+
+void FleetDecoder::Append(const uint8_t* data, size_t length) {
+    // Drop what has been consumed before growing
+    if (m_position > 0 && m_position == m_buffer.size()) {
+        m_buffer.clear();
+        m_position = 0;
+    }
+    else if (m_position > 64 * 1024) {
+        m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_position);
+        m_position = 0;
+    }
+    m_buffer.insert(m_buffer.end(), data, data + length);
+}
+
+bool FleetDecoder::ReadReport(const uint8_t* data, size_t length, FleetReport& report) {
+    FleetCursor cursor = { data, length };
+    int64_t timestampDelta;
+    uint8_t full;
+    if (!cursor.Signed(timestampDelta) || !cursor.Byte(full) || full > 1) return false;
+    m_lastTimestamp += (uint64_t)timestampDelta;
+    report.timestamp = m_lastTimestamp;
+    report.full = full != 0;
+
+    uint32_t* last = SummaryFields(m_lastSummary);
+    for (size_t i = 0; i < SUMMARY_FIELDS; i++) {
+        int64_t delta;
+        if (!cursor.Signed(delta)) return false;
+        last[i] = (uint32_t)((int64_t)last[i] + delta);
+    }
+    report.summary = m_lastSummary;
+
+    // Every host takes at least a reference and a flags byte, so a count
+    // beyond that is a lie; hosts are only kept as they parse
+    uint64_t count;
+    if (!cursor.Varint(count) || count > (length - cursor.position) / 2) return false;
+    report.hosts.clear();
+    for (uint64_t i = 0; i < count; i++) {
+        report.hosts.emplace_back();
+        FleetHostUpdate& host = report.hosts.back();
+        uint64_t reference;
+        if (!cursor.Varint(reference)) return false;
+        uint32_t id;
+        if (reference == 0) {
+            if (!cursor.Text(host.host)) return false;
+            if (m_names.size() >= FLEET_MAX_NAMES || m_nameBytes + host.host.size() > FLEET_MAX_NAME_BYTES) return false;
+            id = (uint32_t)m_names.size();
+            m_names.push_back(host.host);
+            m_nameBytes += host.host.size();
+            m_lastResponseMs.push_back(0);
+        }
+        else {
+            if (reference > m_names.size()) return false;
+            id = (uint32_t)(reference - 1);
+            host.host = m_names[id];
+        }
+        host.id = id;
+
+        if (!cursor.Byte(host.flags)) return false;
+        host.removed = (host.flags & HOST_REMOVED) != 0;
+        if (host.removed) {
+            host.flags = 0;
+            host.responseMs = 0;
+            host.probes = 0;
+            host.failures = 0;
+            continue;
+        }
+
+        int64_t responseDelta;
+        uint64_t probes;
+        uint64_t failures;
+        if (!cursor.Signed(responseDelta) || !cursor.Varint(probes) || !cursor.Varint(failures)) return false;
+        m_lastResponseMs[id] = (uint32_t)((int64_t)m_lastResponseMs[id] + responseDelta);
+        host.responseMs = m_lastResponseMs[id];
+        host.probes = (uint32_t)probes;
+        host.failures = (uint32_t)failures;
+    }
+    return cursor.position == length;
+}
+
+FleetFrame FleetDecoder::Next(std::string& monitor, FleetReport& report) {
+    if (Buffered() < 4) return FleetFrame::None;
+    const uint8_t* header = m_buffer.data() + m_position;
+    uint32_t length = (uint32_t)header[0] | ((uint32_t)header[1] << 8) | ((uint32_t)header[2] << 16) | ((uint32_t)header[3] << 24);
+    if (length == 0 || length > FLEET_MAX_FRAME) return FleetFrame::Error;
+    if (Buffered() < 4 + (size_t)length) return FleetFrame::None;
+
+    const uint8_t* frame = header + 4;
+    m_position += 4 + (size_t)length;
+    uint8_t type = frame[0];
+    FleetCursor cursor = { frame + 1, (size_t)length - 1 };
+
+    if (type == FRAME_HELLO) {
+        uint64_t version;
+        if (cursor.length < sizeof(FLEET_MAGIC) || memcmp(cursor.data, FLEET_MAGIC, sizeof(FLEET_MAGIC)) != 0) {
+            return FleetFrame::Error;
+        }
+        cursor.position = sizeof(FLEET_MAGIC);
+        if (!cursor.Varint(version) || version != FLEET_VERSION || !cursor.Text(monitor)) return FleetFrame::Error;
+
+        m_helloSeen = true;
+        m_names.clear();
+        m_nameBytes = 0;
+        m_lastResponseMs.clear();
+        m_lastSummary = FleetSummary();
+        m_lastTimestamp = 0;
+        return FleetFrame::Hello;
+    }
+    if (type == FRAME_REPORT && m_helloSeen && ReadReport(cursor.data, cursor.length, report)) {
+        return FleetFrame::Report;
+    }
+    return FleetFrame::Error;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Wire format between monitors and the fleet collector. A monitor keeps one
+// TCP stream open and sends a hello, then a report every interval. Reports
+// are delta-encoded against the previous one on the same stream: the
+// summary as varint differences, hostnames by number once they have been
+// sent, response times as the difference from the host's previous value.
+// So a report of a few changed hosts is tens of bytes. Both ends keep the
+// stream's dictionary; a new connection starts a new one.
+
+// One host on one monitor. Hosts are named as on the alert board: the
+// hostname, with "/AAAA" and so on appended for anything but A records.
+struct FleetHostUpdate {
+    std::string host;
+    uint8_t flags;              // EntryFlag bits
+    uint32_t responseMs;        // Last probe; PROBE_TIMEOUT when it got no answer
+    uint32_t probes;            // Since the previous report
+    uint32_t failures;          // Of those
+    bool removed;               // Gone from the monitor's cache; the rest is unused
+    uint32_t id;                // Set by the decoder: the stream's number for host, counting from 0
+};
+
+// The monitor's CacheStats
+struct FleetSummary {
+    uint32_t entries;
+    uint32_t reachable;
+    uint32_t stale;
+    uint32_t timeouts;
+    uint32_t slow;
+    uint32_t changed;
+    uint32_t negative;
+    uint32_t unreachable;
+    uint32_t avgResponseMs;
+    uint32_t activeAlerts;
+    uint32_t needsFlush;        // 0 or 1
+};
+
+struct FleetReport {
+    uint64_t timestamp;         // Unix time
+    bool full;                  // hosts is everything the monitor has; any host it had before and left out is gone
+    FleetSummary summary;
+    std::vector<FleetHostUpdate> hosts;     // Hosts that changed since the previous report, or all when full
+};
+
+static const size_t FLEET_MAX_FRAME = 16 << 20;
+
+// A stream's name dictionary is bounded; a decoder drops a stream that
+// defines more. The encoder wants a new stream at half of either limit.
+static const size_t FLEET_MAX_NAMES = 1 << 20;
+static const size_t FLEET_MAX_NAME_BYTES = 64 << 20;
+
+// Writes one stream. Hello() starts it; Encode() appends a framed report.
+class FleetEncoder {
+public:
+    FleetEncoder();
+
+    // Start a stream for the named monitor, forgetting the previous one's dictionary
+    void Hello(const std::string& monitor, std::vector<uint8_t>& out);
+    void Encode(const FleetReport& report, std::vector<uint8_t>& out);
+
+    // The dictionary is half full: Hello() again, then send a full report
+    bool NeedsHello() const;
+
+private:
+    void PutVarint(uint64_t value);
+    void PutSigned(int64_t value);
+
+    std::vector<uint8_t>* m_out;
+    std::unordered_map<std::string, uint32_t> m_names;
+    size_t m_nameBytes;
+    std::vector<uint32_t> m_lastResponseMs;     // By name number
+    FleetSummary m_lastSummary;
+    uint64_t m_lastTimestamp;
+};
+
+enum class FleetFrame {
+    None,           // Need more bytes
+    Hello,
+    Report,
+    Error           // Not a fleet stream, or a damaged frame; drop the connection
+};
+
+// Reads one stream. Append() what arrives, then call Next() until it says None.
+class FleetDecoder {
+public:
+    FleetDecoder();
+
+    void Append(const uint8_t* data, size_t length);
+
+    // monitor is set by a hello, report by a report
+    FleetFrame Next(std::string& monitor, FleetReport& report);
+
+    size_t Buffered() const { return m_buffer.size() - m_position; }
+
+private:
+    bool ReadReport(const uint8_t* data, size_t length, FleetReport& report);
+
+    std::vector<uint8_t> m_buffer;
+    size_t m_position;
+    bool m_helloSeen;
+    std::vector<std::string> m_names;
+    size_t m_nameBytes;
+    std::vector<uint32_t> m_lastResponseMs;
+    FleetSummary m_lastSummary;
+    uint64_t m_lastTimestamp;
+};
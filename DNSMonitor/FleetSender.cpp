@@ -0,0 +1,330 @@
+#include "FleetSender.h"
+#include "Platform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint16_t FLEET_DEFAULT_PORT = 9154;
+
+// A host as last submitted, and whether the collector has heard it yet
+struct FleetPendingHost {
+    FleetHostUpdate update;
+    bool dirty;
+    uint32_t submission;            // Last Submit() that listed it
+};
+
+struct FleetSenderState {
+    std::mutex lock;                // Guards everything down to dirty
+    bool stopping = false;
+    bool submitted = false;         // A report arrived since the last one was written
+    uint64_t timestamp = 0;
+    FleetSummary summary = {};
+    std::unordered_map<std::string, FleetPendingHost> hosts;
+    std::vector<std::string> dirty;
+    uint32_t submissions = 0;
+
+    FleetSenderConfig config;
+    struct sockaddr_storage address;
+    socklen_t addressLength = 0;
+    SOCKET wake = INVALID_SOCKET;   // UDP socket connected to itself; one byte wakes poll()
+
+    std::atomic<bool> connected{ false };
+    std::atomic<uint32_t> connects{ 0 };
+    std::atomic<uint64_t> reports{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+};
+
+// Encode what the collector has not heard: every host when full, else the
+// dirty ones. False if nothing was submitted since the last report.
+static bool TakeReport(FleetSenderState& state, FleetEncoder& encoder, bool full, std::vector<uint8_t>& out) {
+    FleetReport report;
+    {
+        std::lock_guard<std::mutex> guard(state.lock);
+        if (!full && !state.submitted) return false;
+        report.timestamp = state.timestamp;
+        report.full = full;
+        report.summary = state.summary;
+
+        if (full) {
+            for (auto& item : state.hosts) {
+                report.hosts.push_back(item.second.update);
+                item.second.dirty = false;
+            }
+        }
+        else {
+            for (const auto& host : state.dirty) {
+                auto it = state.hosts.find(host);
+                if (it == state.hosts.end() || !it->second.dirty) continue;
+                report.hosts.push_back(it->second.update);
+                it->second.dirty = false;
+            }
+        }
+        state.dirty.clear();
+        state.submitted = false;
+
+        // Counted once sent; removed hosts are forgotten once the collector is told
+        for (const auto& host : report.hosts) {
+            if (host.removed) {
+                state.hosts.erase(host.host);
+                continue;
+            }
+            FleetHostUpdate& kept = state.hosts[host.host].update;
+            kept.probes = 0;
+            kept.failures = 0;
+        }
+    }
+
+    // A full report restates what is there; nothing in it needs removing
+    if (full) {
+        auto removed = std::remove_if(report.hosts.begin(), report.hosts.end(),
+            [](const FleetHostUpdate& host) { return host.removed; });
+        report.hosts.erase(removed, report.hosts.end());
+    }
+    encoder.Encode(report, out);
+    state.reports++;
+    return true;
+}
+
+static void RunSender(std::shared_ptr<FleetSenderState> statePtr) {
+    FleetSenderState& state = *statePtr;
+    SOCKET sock = INVALID_SOCKET;
+    bool connecting = false;
+    bool connected = false;
+    FleetEncoder encoder;
+    std::vector<uint8_t> outgoing;
+    size_t sent = 0;
+    Clock::time_point retryAt = Clock::now();
+
+    auto disconnect = [&]() {
+        if (sock != INVALID_SOCKET) closesocket(sock);
+        sock = INVALID_SOCKET;
+        connecting = false;
+        connected = false;
+        outgoing.clear();
+        sent = 0;
+        retryAt = Clock::now() + std::chrono::milliseconds(state.config.reconnectMs);
+        state.connected = false;
+    };
+    auto established = [&]() {
+        connecting = false;
+        connected = true;
+        state.connected = true;
+        state.connects++;
+        encoder.Hello(state.config.monitor, outgoing);
+        TakeReport(state, encoder, true, outgoing);
+    };
+
+    std::vector<SocketPollFd> fds;
+    for (;;) {
+        if (sock == INVALID_SOCKET && Clock::now() >= retryAt) {
+            sock = socket(state.address.ss_family, SOCK_STREAM, IPPROTO_TCP);
+            if (sock == INVALID_SOCKET || !SetSocketNonBlocking(sock)) {
+                disconnect();
+            }
+            else if (connect(sock, (struct sockaddr*)&state.address, state.addressLength) == 0) {
+                established();
+            }
+            else if (SocketWouldBlock(LastSocketError())) {
+                connecting = true;
+            }
+            else {
+                disconnect();
+            }
+        }
+
+        if (connected && outgoing.size() - sent < state.config.maxBacklog) {
+            // Names the collector must remember are bounded per stream; start over before the limit
+            if (encoder.NeedsHello()) {
+                encoder.Hello(state.config.monitor, outgoing);
+                TakeReport(state, encoder, true, outgoing);
+            }
+            else {
+                TakeReport(state, encoder, false, outgoing);
+            }
+        }
+        while (connected && sent < outgoing.size()) {
+            int written = send(sock, (const char*)outgoing.data() + sent, (int)(outgoing.size() - sent), SOCKET_SEND_FLAGS);
+            if (written < 0) {
+                if (!SocketWouldBlock(LastSocketError())) disconnect();
+                break;
+            }
+            sent += written;
+            state.bytes += written;
+        }
+        if (connected && sent == outgoing.size()) {
+            outgoing.clear();
+            sent = 0;
+        }
+
+        fds.clear();
+        fds.push_back({});
+        fds.back().fd = state.wake;
+        fds.back().events = POLLIN;
+        if (sock != INVALID_SOCKET) {
+            fds.push_back({});
+            fds.back().fd = sock;
+            fds.back().events = connecting || !outgoing.empty() ? POLLOUT : POLLIN;
+        }
+
+        int timeoutMs = -1;
+        if (sock == INVALID_SOCKET) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(retryAt - Clock::now()).count();
+            timeoutMs = (int)(std::max)((long long)0, (long long)wait);
+        }
+        if (PollSockets(fds.data(), fds.size(), timeoutMs) < 0 && !SocketTransientError(LastSocketError())) {
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(state.lock);
+            if (state.stopping) break;
+        }
+        if (fds[0].revents) {
+            char drain[256];
+            while (recv(state.wake, drain, sizeof(drain), 0) > 0) {
+            }
+        }
+        if (fds.size() < 2 || !fds[1].revents) continue;
+
+        short revents = fds[1].revents;
+        if (connecting) {
+            int error = 0;
+            socklen_t errorLength = sizeof(error);
+            if (getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &errorLength) != 0 || error != 0 ||
+                (revents & (POLLERR | POLLHUP | POLLNVAL))) {
+                disconnect();
+            }
+            else {
+                established();
+            }
+        }
+        else if (revents & (POLLIN | POLLERR | POLLHUP | POLLNVAL)) {
+            // The collector never writes; readable means it closed or reset the connection
+            char byte;
+            int received = recv(sock, &byte, 1, 0);
+            if (received == 0 || (received < 0 && !SocketWouldBlock(LastSocketError()))) {
+                disconnect();
+            }
+        }
+    }
+
+    if (sock != INVALID_SOCKET) closesocket(sock);
+    state.connected = false;
+}
+
+FleetSender::FleetSender(const FleetSenderConfig& config)
+    : m_config(config), m_state(std::make_shared<FleetSenderState>()) {
+    m_state->config = config;
+}
+
+FleetSender::~FleetSender() {
+    Stop();
+}
+
+bool FleetSender::Start() {
+    if (!ParseSocketAddress(m_config.collector, FLEET_DEFAULT_PORT, m_state->address, m_state->addressLength)) {
+        return false;
+    }
+
+    // Wake socket: loopback UDP connected to its own address
+    struct sockaddr_storage wakeAddress;
+    socklen_t wakeLength;
+    ParseSocketAddress("127.0.0.1", 0, wakeAddress, wakeLength);
+    SOCKET wake = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wake == INVALID_SOCKET || bind(wake, (struct sockaddr*)&wakeAddress, wakeLength) != 0 ||
+        getsockname(wake, (struct sockaddr*)&wakeAddress, &wakeLength) != 0 ||
+        connect(wake, (struct sockaddr*)&wakeAddress, wakeLength) != 0 || !SetSocketNonBlocking(wake)) {
+        if (wake != INVALID_SOCKET) closesocket(wake);
+        return false;
+    }
+
+    m_state->wake = wake;
+    m_thread = std::thread(RunSender, m_state);
+    return true;
+}
+
+void FleetSender::Stop() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            m_state->stopping = true;
+        }
+        char byte = 0;
+        send(m_state->wake, &byte, 1, 0);
+        m_thread.join();
+    }
+    if (m_state->wake != INVALID_SOCKET) {
+        closesocket(m_state->wake);
+        m_state->wake = INVALID_SOCKET;
+    }
+}
+
+void FleetSender::Submit(const FleetReport& report) {
+    {
+        std::lock_guard<std::mutex> guard(m_state->lock);
+        m_state->timestamp = report.timestamp;
+        m_state->summary = report.summary;
+        m_state->submitted = true;
+        uint32_t submission = ++m_state->submissions;
+
+        for (const auto& host : report.hosts) {
+            auto it = m_state->hosts.find(host.host);
+            if (it == m_state->hosts.end()) {
+                // Nothing to tell about a host the collector never heard of
+                if (host.removed) continue;
+                it = m_state->hosts.emplace(host.host, FleetPendingHost{ host, false, 0 }).first;
+                it->second.update.probes = 0;
+                it->second.update.failures = 0;
+            }
+            else if (!host.removed && !it->second.update.removed && host.probes == 0 &&
+                host.flags == it->second.update.flags && host.responseMs == it->second.update.responseMs) {
+                it->second.submission = submission;
+                continue;
+            }
+
+            FleetPendingHost& pending = it->second;
+            pending.submission = submission;
+            uint32_t probes = pending.update.probes + host.probes;
+            uint32_t failures = pending.update.failures + host.failures;
+            pending.update = host;
+            pending.update.probes = host.removed ? 0 : probes;
+            pending.update.failures = host.removed ? 0 : failures;
+            if (!pending.dirty) {
+                pending.dirty = true;
+                m_state->dirty.push_back(host.host);
+            }
+        }
+
+        if (report.full) {
+            for (auto& item : m_state->hosts) {
+                FleetPendingHost& pending = item.second;
+                if (pending.submission == submission || pending.update.removed) continue;
+                pending.update.removed = true;
+                pending.update.probes = 0;
+                pending.update.failures = 0;
+                if (!pending.dirty) {
+                    pending.dirty = true;
+                    m_state->dirty.push_back(item.first);
+                }
+            }
+        }
+    }
+
+    char byte = 0;
+    send(m_state->wake, &byte, 1, 0);
+}
+
+FleetSenderStats FleetSender::Stats() const {
+    FleetSenderStats stats;
+    stats.connected = m_state->connected;
+    stats.connects = m_state->connects;
+    stats.reports = m_state->reports;
+    stats.bytes = m_state->bytes;
+    return stats;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "FleetReport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+struct FleetSenderConfig {
+    std::string collector;              // "host:port"; port 9154 if left out
+    std::string monitor;                // Name the collector knows this monitor by
+    int reconnectMs = 5000;
+    size_t maxBacklog = 1024 * 1024;    // Unsent bytes past which reports wait and coalesce
+};
+
+struct FleetSenderStats {
+    bool connected;
+    uint32_t connects;
+    uint64_t reports;
+    uint64_t bytes;
+};
+
+struct FleetSenderState;
+
+// Monitor side of the fleet stream. Submit() hands over what changed; the
+// sender thread keeps one TCP connection to the collector and writes it
+// out, reconnecting after failures. Until a report is written, later
+// submissions for the same host replace earlier ones, so a slow or absent
+// collector costs memory per host, not per report. Every connection starts
+// with a full report of the hosts last known.
+class FleetSender {
+public:
+    explicit FleetSender(const FleetSenderConfig& config);
+    ~FleetSender();
+
+    FleetSender(const FleetSender&) = delete;
+    FleetSender& operator=(const FleetSender&) = delete;
+
+    // Start the sender thread; false if the collector address does not parse
+    bool Start();
+    void Stop();
+
+    // report.hosts holds the hosts that changed, or with report.full every
+    // host the monitor has: hosts it leaves out are then reported removed,
+    // and hosts it repeats with the same result and no new probes are not resent
+    void Submit(const FleetReport& report);
+
+    FleetSenderStats Stats() const;
+
+private:
+    FleetSenderConfig m_config;
+    std::shared_ptr<FleetSenderState> m_state;
+    std::thread m_thread;
+};
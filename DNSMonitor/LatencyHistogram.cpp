@@ -0,0 +1,180 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+
+static int BucketIndex(uint32_t milliseconds) {
+    if (milliseconds < (uint32_t)LATENCY_EXACT_BUCKETS) {
+        return (int)milliseconds;
+    }
+
+    int octave = 0;     // floor(log2(milliseconds)), at least 3 here
+    for (uint32_t v = milliseconds; v > 1; v >>= 1) {
+        octave++;
+    }
+    int sub = (int)(milliseconds >> (octave - 2)) & (LATENCY_SUB_BUCKETS - 1);
+    int index = LATENCY_EXACT_BUCKETS + (octave - 3) * LATENCY_SUB_BUCKETS + sub;
+    return (std::min)(index, LATENCY_BUCKETS - 1);
+}
+
+// Width of a bucket; the exact buckets are one millisecond wide
+static uint32_t BucketWidth(int index) {
+    if (index < LATENCY_EXACT_BUCKETS) {
+        return 1;
+    }
+    int octave = (index - LATENCY_EXACT_BUCKETS) / LATENCY_SUB_BUCKETS + 3;
+    return 1u << (octave - 2);
+}
+
+// Smallest latency that lands in a bucket
+static uint32_t BucketLow(int index) {
+    if (index < LATENCY_EXACT_BUCKETS) {
+        return (uint32_t)index;
+    }
+    int sub = (index - LATENCY_EXACT_BUCKETS) % LATENCY_SUB_BUCKETS;
+    return (uint32_t)(LATENCY_SUB_BUCKETS + sub) * BucketWidth(index);
+}
+
+// Midpoint of a bucket's range, reported for percentiles that land in it
+static uint32_t BucketValue(int index) {
+    return BucketLow(index) + BucketWidth(index) / 2;
+}
+
+uint32_t LatencyBucketLimit(int index) {
+    return index + 1 < LATENCY_BUCKETS ? BucketLow(index + 1) - 1 : 0xFFFFFFFF;
+}
+
+void LatencySnapshot::Add(const LatencySnapshot& other) {
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        counts[i] += other.counts[i];
+    }
+    timeouts += other.timeouts;
+    errors += other.errors;
+    sum += other.sum;
+    maxLatency = (std::max)(maxLatency, other.maxLatency);
+}
+
+uint64_t LatencySnapshot::Samples() const {
+    uint64_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        total += counts[i];
+    }
+    return total;
+}
+
+uint32_t LatencySnapshot::Percentile(double p) const {
+    uint64_t total = Samples();
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(p * (total - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return (std::min)(BucketValue(i), maxLatency);
+        }
+    }
+    return maxLatency;
+}
+
+double LatencySnapshot::TimeoutRate() const {
+    uint64_t total = Samples() + timeouts;
+    return total > 0 ? 100.0 * timeouts / total : 0.0;
+}
+
+double LatencySnapshot::ErrorRate() const {
+    uint64_t total = Samples() + timeouts;
+    return total > 0 ? 100.0 * errors / total : 0.0;
+}
+
+void LatencyHistogram::Record(uint32_t milliseconds) {
+    m_counts[BucketIndex(milliseconds)].fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(milliseconds, std::memory_order_relaxed);
+
+    uint32_t seen = m_max.load(std::memory_order_relaxed);
+    while (milliseconds > seen && !m_max.compare_exchange_weak(seen, milliseconds, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::RecordTimeout() {
+    m_timeouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::RecordError() {
+    m_errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Clear() {
+    for (auto& count : m_counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    m_timeouts.store(0, std::memory_order_relaxed);
+    m_errors.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+}
+
+LatencySnapshot LatencyHistogram::Snapshot() const {
+    LatencySnapshot snapshot;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        snapshot.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+    }
+    snapshot.timeouts = m_timeouts.load(std::memory_order_relaxed);
+    snapshot.errors = m_errors.load(std::memory_order_relaxed);
+    snapshot.maxLatency = m_max.load(std::memory_order_relaxed);
+    snapshot.sum = m_sum.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+LatencyWindow::LatencyWindow(int slotSeconds, int slots)
+    : m_slotSeconds((std::max)(slotSeconds, 1)), m_slotCount((std::max)(slots, 1)),
+      m_slots(new Slot[(size_t)m_slotCount]) {
+}
+
+int64_t LatencyWindow::Epoch(Clock::time_point now) const {
+    return std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count() / m_slotSeconds;
+}
+
+LatencyHistogram* LatencyWindow::Current(Clock::time_point now) {
+    int64_t epoch = Epoch(now);
+    Slot& slot = m_slots[(size_t)(epoch % m_slotCount)];
+
+    // First sample of a new slot period claims the slot and clears it
+    int64_t seen = slot.epoch.load(std::memory_order_acquire);
+    if (seen > epoch) {
+        return nullptr;     // Sample older than the whole window
+    }
+    if (seen < epoch && slot.epoch.compare_exchange_strong(seen, epoch, std::memory_order_acq_rel)) {
+        slot.histogram.Clear();
+    }
+    return &slot.histogram;
+}
+
+void LatencyWindow::Record(Clock::time_point now, uint32_t milliseconds) {
+    LatencyHistogram* histogram = Current(now);
+    if (histogram) histogram->Record(milliseconds);
+}
+
+void LatencyWindow::RecordTimeout(Clock::time_point now) {
+    LatencyHistogram* histogram = Current(now);
+    if (histogram) histogram->RecordTimeout();
+}
+
+void LatencyWindow::RecordError(Clock::time_point now) {
+    LatencyHistogram* histogram = Current(now);
+    if (histogram) histogram->RecordError();
+}
+
+LatencySnapshot LatencyWindow::Snapshot(Clock::time_point now, int seconds) const {
+    LatencySnapshot total;
+    int64_t current = Epoch(now);
+    int slots = (std::min)((seconds + m_slotSeconds - 1) / m_slotSeconds, m_slotCount);
+
+    for (int64_t epoch = current - slots + 1; epoch <= current; epoch++) {
+        if (epoch < 0) continue;
+        const Slot& slot = m_slots[(size_t)(epoch % m_slotCount)];
+        if (slot.epoch.load(std::memory_order_acquire) == epoch) {
+            total.Add(slot.histogram.Snapshot());
+        }
+    }
+    return total;
+}
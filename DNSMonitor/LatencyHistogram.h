@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bucket layout: 0-7 ms exactly, then four buckets per power of two up to
+// about two minutes. Percentiles are accurate to within about 12%.
+static const int LATENCY_EXACT_BUCKETS = 8;
+static const int LATENCY_SUB_BUCKETS = 4;
+static const int LATENCY_BUCKETS = LATENCY_EXACT_BUCKETS + LATENCY_SUB_BUCKETS * 14;
+
+// Largest latency, in milliseconds, that lands in bucket index
+uint32_t LatencyBucketLimit(int index);
+
+// Plain copy of histogram counts; can be summed across histograms and windows
+struct LatencySnapshot {
+    uint64_t counts[LATENCY_BUCKETS] = {};
+    uint64_t timeouts = 0;
+    uint64_t errors = 0;                        // Answered with an error (NXDOMAIN, SERVFAIL); also in counts
+    uint64_t sum = 0;                           // Milliseconds over all answered probes
+    uint32_t maxLatency = 0;
+
+    void Add(const LatencySnapshot& other);
+
+    uint64_t Samples() const;                   // Answered probes, timeouts excluded
+    uint32_t Percentile(double p) const;        // Milliseconds; 0 when there are no samples
+    double TimeoutRate() const;                 // Percent of all probes
+    double ErrorRate() const;                   // Percent of all probes
+};
+
+// Fixed-size log-bucketed latency histogram. Record() is a handful of
+// relaxed atomic operations, so probe threads can share one without locking.
+class LatencyHistogram {
+public:
+    void Record(uint32_t milliseconds);
+    void RecordTimeout();
+    void RecordError();                         // On top of Record() for the same probe
+    void Clear();
+
+    LatencySnapshot Snapshot() const;
+
+private:
+    std::atomic<uint32_t> m_counts[LATENCY_BUCKETS] = {};
+    std::atomic<uint32_t> m_timeouts{ 0 };
+    std::atomic<uint32_t> m_errors{ 0 };
+    std::atomic<uint32_t> m_max{ 0 };
+    std::atomic<uint64_t> m_sum{ 0 };
+};
+
+// Sliding-window latency: a ring of histograms, one per time slot. Recording
+// is lock-free; a sample racing a slot's rotation may be dropped.
+class LatencyWindow {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Keeps slots * slotSeconds of history
+    LatencyWindow(int slotSeconds, int slots);
+
+    void Record(Clock::time_point now, uint32_t milliseconds);
+    void RecordTimeout(Clock::time_point now);
+    void RecordError(Clock::time_point now);
+
+    // Counts for the last `seconds`, rounded up to whole slots
+    LatencySnapshot Snapshot(Clock::time_point now, int seconds) const;
+
+private:
+    struct Slot {
+        std::atomic<int64_t> epoch{ -1 };
+        LatencyHistogram histogram;
+    };
+
+    int64_t Epoch(Clock::time_point now) const;
+    LatencyHistogram* Current(Clock::time_point now);
+
+    int m_slotSeconds;
+    int m_slotCount;
+    std::unique_ptr<Slot[]> m_slots;
+};
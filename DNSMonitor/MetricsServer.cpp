@@ -0,0 +1,406 @@
+#include "MetricsServer.h"
+#include "Platform.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+// A connected HTTP client
+struct MetricsClient {
+    SOCKET sock = INVALID_SOCKET;
+    uint64_t id = 0;            // Matches page answers to the client that asked
+    std::string request;        // Bytes of the request read so far
+    std::string outgoing;
+    size_t sent = 0;
+    Clock::time_point deadline; // Dropped if the request, or sending the answer, is not done by then
+    bool streaming = false;     // Answered with the stream headers; receives Publish() lines
+    bool waitingForPage = false;    // Handed to the page thread; no deadline until it answers
+    bool closeWhenSent = false;
+};
+
+// A plain GET for the page thread, and its answer
+struct MetricsPage {
+    uint64_t client;
+    std::string path;
+    bool found;
+    std::string contentType;
+    std::string body;
+};
+
+struct MetricsServerState {
+    std::mutex lock;            // Guards stopping, pending, pageRequests and pageAnswers
+    bool stopping = false;
+    std::string pending;        // Published lines not yet copied to the stream clients
+    std::vector<MetricsPage> pageRequests;
+    std::vector<MetricsPage> pageAnswers;
+    std::condition_variable pageWake;
+
+    MetricsServerConfig config;
+    MetricsPageFn pages;
+    SOCKET listener = INVALID_SOCKET;
+    SOCKET wake = INVALID_SOCKET;   // UDP socket connected to itself; one byte wakes poll()
+    std::vector<MetricsClient> clients;
+    uint64_t nextClientId = 0;
+    std::atomic<int> streamClients{ 0 };
+};
+
+static void Wake(MetricsServerState& state) {
+    char byte = 0;
+    send(state.wake, &byte, 1, 0);
+}
+
+static void CloseClient(MetricsServerState& state, size_t index) {
+    if (state.clients[index].streaming) {
+        state.streamClients--;
+    }
+    closesocket(state.clients[index].sock);
+    state.clients.erase(state.clients.begin() + index);
+}
+
+static void Respond(MetricsClient& client, const char* status, const std::string& contentType, const std::string& body) {
+    char header[256];
+    snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %llu\r\nConnection: close\r\n\r\n",
+        status, contentType.c_str(), (unsigned long long)body.size());
+    client.outgoing = header;
+    client.outgoing += body;
+    client.closeWhenSent = true;
+}
+
+// Clients that must make progress by their deadline: not streaming and not waiting on a page
+static bool HasDeadline(const MetricsClient& client) {
+    return !client.streaming && !client.waitingForPage;
+}
+
+// Answer a complete request; false if the client should be dropped
+static bool HandleRequest(MetricsServerState& state, MetricsClient& client) {
+    size_t lineEnd = client.request.find("\r\n");
+    std::string line = client.request.substr(0, lineEnd);
+
+    size_t methodEnd = line.find(' ');
+    size_t pathEnd = line.find(' ', methodEnd + 1);
+    if (methodEnd == std::string::npos || pathEnd == std::string::npos) {
+        return false;
+    }
+    if (line.compare(0, methodEnd, "GET") != 0) {
+        Respond(client, "405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+        return true;
+    }
+
+    std::string path = line.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+    path = path.substr(0, path.find('?'));
+
+    if (path == state.config.streamPath) {
+        client.outgoing = "HTTP/1.0 200 OK\r\nContent-Type: application/x-ndjson\r\n"
+            "Cache-Control: no-cache\r\nConnection: close\r\n\r\n";
+        client.streaming = true;
+        state.streamClients++;
+        return true;
+    }
+
+    // Pages may wait on their owner, so they are built off this thread
+    {
+        std::lock_guard<std::mutex> guard(state.lock);
+        state.pageRequests.push_back({ client.id, path, false, std::string(), std::string() });
+    }
+    state.pageWake.notify_one();
+    client.waitingForPage = true;
+    return true;
+}
+
+// Build requested pages one at a time; the server thread keeps serving meanwhile
+static void RunPageLoop(std::shared_ptr<MetricsServerState> statePtr) {
+    MetricsServerState& state = *statePtr;
+    std::unique_lock<std::mutex> lock(state.lock);
+    for (;;) {
+        state.pageWake.wait(lock, [&] { return state.stopping || !state.pageRequests.empty(); });
+        if (state.stopping) break;
+
+        MetricsPage page = std::move(state.pageRequests.front());
+        state.pageRequests.erase(state.pageRequests.begin());
+        lock.unlock();
+        page.found = state.pages && state.pages(page.path, page.contentType, page.body);
+        lock.lock();
+
+        state.pageAnswers.push_back(std::move(page));
+        lock.unlock();
+        Wake(state);
+        lock.lock();
+    }
+}
+
+// Read what the client sent; false if it should be dropped
+static bool ReadClient(MetricsServerState& state, MetricsClient& client) {
+    char buffer[1024];
+    int received = recv(client.sock, buffer, sizeof(buffer), 0);
+    if (received == 0) {
+        return false;
+    }
+    if (received < 0) {
+        return SocketWouldBlock(LastSocketError());
+    }
+
+    // Clients with their answer coming have nothing more to say; ignore anything they send
+    if (client.streaming || client.waitingForPage || client.closeWhenSent) {
+        return true;
+    }
+
+    client.request.append(buffer, received);
+    if (client.request.size() > state.config.maxRequestBytes) {
+        return false;
+    }
+    if (client.request.find("\r\n\r\n") == std::string::npos && client.request.find("\n\n") == std::string::npos) {
+        return true;
+    }
+    return HandleRequest(state, client);
+}
+
+// Send queued bytes; false if the client should be dropped
+static bool WriteClient(MetricsClient& client) {
+    while (client.sent < client.outgoing.size()) {
+        int sent = send(client.sock, client.outgoing.data() + client.sent,
+            (int)(client.outgoing.size() - client.sent), SOCKET_SEND_FLAGS);
+        if (sent < 0) {
+            return SocketWouldBlock(LastSocketError());
+        }
+        client.sent += sent;
+    }
+
+    client.outgoing.clear();
+    client.sent = 0;
+    return !client.closeWhenSent;
+}
+
+static void AcceptClients(MetricsServerState& state) {
+    for (;;) {
+        SOCKET sock = accept(state.listener, nullptr, nullptr);
+        if (sock == INVALID_SOCKET) {
+            return;
+        }
+        if ((int)state.clients.size() >= state.config.maxClients || !SetSocketNonBlocking(sock)) {
+            closesocket(sock);
+            continue;
+        }
+
+        MetricsClient client;
+        client.sock = sock;
+        client.id = state.nextClientId++;
+        client.deadline = Clock::now() + std::chrono::milliseconds(state.config.requestTimeoutMs);
+        state.clients.push_back(client);
+    }
+}
+
+// Queue finished pages for their clients, and hand published lines to every
+// stream client, dropping any that fell too far behind
+static void DistributePending(MetricsServerState& state) {
+    char drain[256];
+    while (recv(state.wake, drain, sizeof(drain), 0) > 0) {
+    }
+
+    std::string lines;
+    std::vector<MetricsPage> answers;
+    {
+        std::lock_guard<std::mutex> guard(state.lock);
+        lines.swap(state.pending);
+        answers.swap(state.pageAnswers);
+    }
+
+    // A client that left while its page was built is simply gone
+    for (auto& page : answers) {
+        for (auto& client : state.clients) {
+            if (client.id != page.client) continue;
+            if (page.found) {
+                Respond(client, "200 OK", page.contentType, page.body);
+            }
+            else {
+                Respond(client, "404 Not Found", "text/plain", "Not found\n");
+            }
+            client.waitingForPage = false;
+            client.deadline = Clock::now() + std::chrono::milliseconds(state.config.requestTimeoutMs);
+            break;
+        }
+    }
+    if (lines.empty()) return;
+
+    for (size_t i = state.clients.size(); i-- > 0;) {
+        MetricsClient& client = state.clients[i];
+        if (!client.streaming) continue;
+        if (client.outgoing.size() - client.sent + lines.size() > state.config.maxStreamBacklog) {
+            CloseClient(state, i);
+            continue;
+        }
+        client.outgoing += lines;
+    }
+}
+
+static void RunServerLoop(std::shared_ptr<MetricsServerState> statePtr) {
+    MetricsServerState& state = *statePtr;
+    std::vector<SocketPollFd> fds;
+
+    for (;;) {
+        // Sleep no longer than the nearest client deadline
+        auto now = Clock::now();
+        int timeoutMs = -1;
+        for (const auto& client : state.clients) {
+            if (!HasDeadline(client)) continue;
+            auto left = std::chrono::ceil<std::chrono::milliseconds>(client.deadline - now).count();
+            int wait = (int)(std::max)(left, (decltype(left))0);
+            timeoutMs = timeoutMs < 0 ? wait : (std::min)(timeoutMs, wait);
+        }
+
+        fds.clear();
+        fds.push_back({});
+        fds.back().fd = state.listener;
+        fds.back().events = POLLIN;
+        fds.push_back({});
+        fds.back().fd = state.wake;
+        fds.back().events = POLLIN;
+        for (const auto& client : state.clients) {
+            fds.push_back({});
+            fds.back().fd = client.sock;
+            fds.back().events = POLLIN | (client.outgoing.empty() ? 0 : POLLOUT);
+        }
+
+        // Otherwise no timeout: sockets, finished pages or Publish()/shutdown wake us
+        if (PollSockets(fds.data(), fds.size(), timeoutMs) < 0) {
+            if (SocketTransientError(LastSocketError())) continue;
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(state.lock);
+            if (state.stopping) break;
+        }
+
+        if (fds[1].revents) {
+            DistributePending(state);
+        }
+
+        // Clients first: their poll slots are positional and accepting appends
+        size_t polled = fds.size() - 2;
+        for (size_t i = (std::min)(polled, state.clients.size()); i-- > 0;) {
+            short revents = fds[i + 2].revents;
+            if (state.clients[i].sock != fds[i + 2].fd) continue;   // Moved by a stream drop
+
+            bool keep = true;
+            if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                keep = (revents & POLLIN) != 0 && ReadClient(state, state.clients[i]);
+            }
+            else if (revents & POLLIN) {
+                keep = ReadClient(state, state.clients[i]);
+            }
+            if (keep && !state.clients[i].outgoing.empty()) {
+                keep = WriteClient(state.clients[i]);
+            }
+            if (!keep) {
+                CloseClient(state, i);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            AcceptClients(state);
+        }
+
+        // Idle or slow clients would otherwise hold their slot for good
+        now = Clock::now();
+        for (size_t i = state.clients.size(); i-- > 0;) {
+            if (HasDeadline(state.clients[i]) && now >= state.clients[i].deadline) {
+                CloseClient(state, i);
+            }
+        }
+    }
+
+    for (size_t i = state.clients.size(); i-- > 0;) {
+        CloseClient(state, i);
+    }
+}
+
+MetricsServer::MetricsServer(const MetricsServerConfig& config, MetricsPageFn pages)
+    : m_config(config), m_state(std::make_shared<MetricsServerState>()) {
+    m_state->config = config;
+    m_state->pages = std::move(pages);
+}
+
+MetricsServer::~MetricsServer() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(m_state->lock);
+            m_state->stopping = true;
+        }
+        Wake(*m_state);
+        m_state->pageWake.notify_all();
+        m_thread.join();
+        m_pageThread.join();
+    }
+    if (m_state->listener != INVALID_SOCKET) {
+        closesocket(m_state->listener);
+    }
+    if (m_state->wake != INVALID_SOCKET) {
+        closesocket(m_state->wake);
+    }
+}
+
+bool MetricsServer::Start() {
+    struct sockaddr_storage address;
+    socklen_t length;
+    if (!ParseSocketAddress(m_config.address, m_config.port, address, length)) {
+        return false;
+    }
+
+    SOCKET listener = socket(address.ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        return false;
+    }
+#ifndef _WIN32
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+#endif
+    if (bind(listener, (struct sockaddr*)&address, length) != 0 || listen(listener, SOMAXCONN) != 0 ||
+        !SetSocketNonBlocking(listener)) {
+        closesocket(listener);
+        return false;
+    }
+
+    // Wake socket: loopback UDP connected to its own address
+    struct sockaddr_storage wakeAddress;
+    socklen_t wakeLength;
+    ParseSocketAddress("127.0.0.1", 0, wakeAddress, wakeLength);
+    SOCKET wake = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (wake == INVALID_SOCKET || bind(wake, (struct sockaddr*)&wakeAddress, wakeLength) != 0 ||
+        getsockname(wake, (struct sockaddr*)&wakeAddress, &wakeLength) != 0 ||
+        connect(wake, (struct sockaddr*)&wakeAddress, wakeLength) != 0 || !SetSocketNonBlocking(wake)) {
+        if (wake != INVALID_SOCKET) closesocket(wake);
+        closesocket(listener);
+        return false;
+    }
+
+    m_state->listener = listener;
+    m_state->wake = wake;
+    m_thread = std::thread(RunServerLoop, m_state);
+    m_pageThread = std::thread(RunPageLoop, m_state);
+    return true;
+}
+
+void MetricsServer::Publish(const std::string& line) {
+    if (m_state->streamClients == 0) return;
+
+    {
+        std::lock_guard<std::mutex> guard(m_state->lock);
+        // The server thread drains this on every wake; if it cannot keep up, drop lines
+        if (m_state->pending.size() + line.size() + 1 > m_config.maxStreamBacklog) return;
+        bool wasEmpty = m_state->pending.empty();
+        m_state->pending += line;
+        m_state->pending += '\n';
+        if (!wasEmpty) return;
+    }
+    Wake(*m_state);
+}
+
+int MetricsServer::StreamClients() const {
+    return m_state->streamClients;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Server tuning. Everything is bounded: clients, request size, how long a
+// client may take, and the bytes queued for each streaming client.
+struct MetricsServerConfig {
+    std::string address = "127.0.0.1";     // Loopback only unless told otherwise
+    uint16_t port = 9153;
+    std::string streamPath = "/events";     // Long-lived JSON lines stream
+    int maxClients = 16;
+    size_t maxRequestBytes = 4096;
+    int requestTimeoutMs = 5000;            // To send a whole request, and again to read the answer
+    size_t maxStreamBacklog = 256 * 1024;   // A stream client further behind than this is dropped
+};
+
+// Answer a GET for path: fill contentType and body and return true, or
+// return false for 404. Called on the server's page thread, one page at a
+// time, so it may block without stalling streams or other clients.
+using MetricsPageFn = std::function<bool(const std::string& path, std::string& contentType, std::string& body)>;
+
+struct MetricsServerState;
+
+// Minimal HTTP/1.0 server for scraping. Plain GETs are answered through
+// the page callback and closed; GETs of streamPath stay open and receive
+// every line passed to Publish(). The server thread sleeps in poll() until
+// a socket is ready, a page is built, a client's deadline passes or
+// Publish() wakes it, so it costs nothing when idle.
+class MetricsServer {
+public:
+    MetricsServer(const MetricsServerConfig& config, MetricsPageFn pages);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // Bind, listen and start the server thread; false if the port is unavailable
+    bool Start();
+
+    // Queue one line (without the newline) for every stream client
+    void Publish(const std::string& line);
+
+    // Connected stream clients; lets callers skip formatting lines nobody reads
+    int StreamClients() const;
+
+    const MetricsServerConfig& Config() const { return m_config; }
+
+private:
+    MetricsServerConfig m_config;
+    std::shared_ptr<MetricsServerState> m_state;
+    std::thread m_thread;
+    std::thread m_pageThread;
+};
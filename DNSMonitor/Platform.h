@@ -0,0 +1,148 @@
+#pragma once
+
+// Portable socket and resolver includes shared by the probe modules.
+// DNSMonitor.cpp stays Windows-only; everything that includes this header
+// also builds with g++ on Linux so it can be exercised against local stubs.
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+typedef WSAPOLLFD SocketPollFd;
+
+inline int PollSockets(SocketPollFd* fds, size_t count, int timeoutMs) {
+    return WSAPoll(fds, (ULONG)count, timeoutMs);
+}
+
+inline bool SetSocketNonBlocking(SOCKET sock) {
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+}
+
+inline int LastSocketError() {
+    return WSAGetLastError();
+}
+
+// Non-blocking send/recv/connect that has not finished yet
+inline bool SocketWouldBlock(int error) {
+    return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+}
+
+// Windows reports ICMP port unreachable on the next UDP receive; not fatal
+inline bool SocketTransientError(int error) {
+    return error == WSAECONNRESET || error == WSAEMSGSIZE;
+}
+
+// Connect answered with a reset: the host is up but nothing listens
+inline bool SocketRefused(int error) {
+    return error == WSAECONNREFUSED;
+}
+
+// Flags for send() on stream sockets whose peer may have gone away
+static const int SOCKET_SEND_FLAGS = 0;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+typedef int SOCKET;
+typedef struct pollfd SocketPollFd;
+
+#ifndef INVALID_SOCKET
+#define INVALID_SOCKET (-1)
+#endif
+#ifndef SOCKET_ERROR
+#define SOCKET_ERROR (-1)
+#endif
+
+inline int closesocket(SOCKET sock) {
+    return close(sock);
+}
+
+inline int PollSockets(SocketPollFd* fds, size_t count, int timeoutMs) {
+    return poll(fds, (nfds_t)count, timeoutMs);
+}
+
+inline bool SetSocketNonBlocking(SOCKET sock) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+inline int LastSocketError() {
+    return errno;
+}
+
+inline bool SocketWouldBlock(int error) {
+    return error == EWOULDBLOCK || error == EAGAIN || error == EINPROGRESS;
+}
+
+inline bool SocketTransientError(int error) {
+    return error == ECONNREFUSED || error == EINTR;
+}
+
+inline bool SocketRefused(int error) {
+    return error == ECONNREFUSED;
+}
+
+// Report a vanished peer as EPIPE instead of raising SIGPIPE
+static const int SOCKET_SEND_FLAGS = MSG_NOSIGNAL;
+#endif
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// Parse "1.2.3.4", "1.2.3.4:53", "::1" or "[::1]:53" into a socket address
+inline bool ParseSocketAddress(const std::string& text, uint16_t defaultPort,
+    struct sockaddr_storage& address, socklen_t& length) {
+    std::string host = text;
+    uint16_t port = defaultPort;
+
+    if (!host.empty() && host[0] == '[') {
+        size_t close = host.find(']');
+        if (close == std::string::npos) return false;
+        if (close + 1 < host.size()) {
+            if (host[close + 1] != ':') return false;
+            port = (uint16_t)atoi(host.c_str() + close + 2);
+        }
+        host = host.substr(1, close - 1);
+    }
+    else if (host.find(':') != std::string::npos && host.find(':') == host.rfind(':')) {
+        // A single colon is a port separator; more than one is a bare IPv6 address
+        size_t colon = host.find(':');
+        port = (uint16_t)atoi(host.c_str() + colon + 1);
+        host = host.substr(0, colon);
+    }
+
+    address = {};
+    struct sockaddr_in* v4 = (struct sockaddr_in*)&address;
+    struct sockaddr_in6* v6 = (struct sockaddr_in6*)&address;
+    if (inet_pton(AF_INET, host.c_str(), &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons(port);
+        length = sizeof(struct sockaddr_in);
+        return true;
+    }
+    if (inet_pton(AF_INET6, host.c_str(), &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons(port);
+        length = sizeof(struct sockaddr_in6);
+        return true;
+    }
+    return false;
+}
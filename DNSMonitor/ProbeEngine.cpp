@@ -0,0 +1,305 @@
+#include "ProbeEngine.h"
+#include "Platform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t SAMPLE_CAPACITY = 4096;     // Latencies kept for percentiles
+static const int RATE_WINDOW_SECONDS = 10;      // Window for probes/sec
+
+// A probe handed to a worker
+struct ProbeJob {
+    size_t id;
+    std::string hostname;
+    ProbeFamily family;
+    Clock::time_point started;
+    Clock::time_point deadline;
+    bool expired;
+};
+
+// Shared between the owner and the worker threads. Workers hold their own
+// reference so an abandoned lookup can return after the engine is gone.
+struct ProbeEngineState {
+    std::mutex lock;
+    std::condition_variable workReady;
+    std::condition_variable resultReady;
+
+    ProbeEngineConfig config;
+    ResolveFn resolve;
+    bool stopping = false;
+
+    std::deque<std::shared_ptr<ProbeJob>> queue;
+    std::vector<std::shared_ptr<ProbeJob>> inFlight;
+    std::vector<ProbeResult> results;
+
+    int activeWorkers = 0;      // Threads counted against maxConcurrency
+    int abandoned = 0;          // Threads stuck in a lookup past its deadline
+
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+    uint64_t timedOut = 0;
+    uint64_t lateReturns = 0;
+
+    ProbeSampleWindow samples;
+};
+
+void ProbeSampleWindow::Record(Clock::time_point at, uint32_t latency) {
+    if (m_samples.empty()) {
+        m_first = at;
+    }
+    if (m_samples.size() < SAMPLE_CAPACITY) {
+        m_samples.push_back({ at, latency });
+    }
+    else {
+        m_samples[m_next] = { at, latency };
+    }
+    m_next = (m_next + 1) % SAMPLE_CAPACITY;
+}
+
+void ProbeSampleWindow::Fill(ProbeEngineStats& stats, Clock::time_point now) const {
+    if (m_samples.empty()) {
+        return;
+    }
+
+    auto windowStart = now - std::chrono::seconds(RATE_WINDOW_SECONDS);
+    int inWindow = 0;
+    std::vector<uint32_t> latencies;
+    latencies.reserve(m_samples.size());
+    for (const auto& sample : m_samples) {
+        latencies.push_back(sample.latency);
+        if (sample.at >= windowStart) {
+            inWindow++;
+        }
+    }
+
+    // Rate over the window, or over the window's lifetime while it is younger
+    auto span = (std::max)(windowStart, m_first);
+    double seconds = std::chrono::duration<double>(now - span).count();
+    stats.probesPerSec = seconds > 0.001 ? inWindow / seconds : 0.0;
+
+    auto percentile = [&](double p) {
+        size_t rank = (size_t)(p * (latencies.size() - 1));
+        std::nth_element(latencies.begin(), latencies.begin() + rank, latencies.end());
+        return latencies[rank];
+    };
+    stats.p50 = percentile(0.50);
+    stats.p95 = percentile(0.95);
+    stats.p99 = percentile(0.99);
+    stats.maxLatency = *std::max_element(latencies.begin(), latencies.end());
+}
+
+static void RunWorker(std::shared_ptr<ProbeEngineState> state);
+
+// Start workers for queued probes, up to the concurrency limit. While too
+// many abandoned lookups are still stuck, stop admitting new threads.
+static void SpawnWorkersLocked(const std::shared_ptr<ProbeEngineState>& state) {
+    const ProbeEngineConfig& config = state->config;
+    while (!state->stopping &&
+        state->activeWorkers < config.maxConcurrency &&
+        state->abandoned < config.maxAbandoned &&
+        state->activeWorkers - (int)state->inFlight.size() < (int)state->queue.size()) {
+        std::thread(RunWorker, state).detach();
+        state->activeWorkers++;
+    }
+}
+
+// Report every in-flight probe past its deadline as Timeout and replace its worker
+static void ExpireLocked(const std::shared_ptr<ProbeEngineState>& state, Clock::time_point now) {
+    bool expiredAny = false;
+
+    for (auto it = state->inFlight.begin(); it != state->inFlight.end();) {
+        ProbeJob& job = **it;
+        if (now < job.deadline) {
+            ++it;
+            continue;
+        }
+
+        job.expired = true;
+        state->results.push_back({ job.id, job.hostname, ProbeOutcome::Timeout, PROBE_TIMEOUT, PROBE_TIMEOUT });
+        state->samples.Record(now, state->config.deadlineMs);
+        state->timedOut++;
+        state->activeWorkers--;
+        state->abandoned++;
+        it = state->inFlight.erase(it);
+        expiredAny = true;
+    }
+
+    if (expiredAny) {
+        SpawnWorkersLocked(state);
+    }
+}
+
+static void RunWorker(std::shared_ptr<ProbeEngineState> state) {
+    std::unique_lock<std::mutex> guard(state->lock);
+
+    for (;;) {
+        state->workReady.wait(guard, [&] { return state->stopping || !state->queue.empty(); });
+        if (state->stopping) {
+            state->activeWorkers--;
+            return;
+        }
+
+        std::shared_ptr<ProbeJob> job = state->queue.front();
+        state->queue.pop_front();
+        job->started = Clock::now();
+        job->deadline = job->started + std::chrono::milliseconds(state->config.deadlineMs);
+        state->inFlight.push_back(job);
+        state->resultReady.notify_all();   // Waiters recompute their earliest deadline
+
+        guard.unlock();
+        bool resolved = state->resolve(job->hostname, job->family);
+        auto finished = Clock::now();
+        guard.lock();
+
+        if (job->expired) {
+            // Already reported as Timeout and replaced; rejoin only if there is room
+            state->abandoned--;
+            state->lateReturns++;
+            if (state->stopping || state->activeWorkers >= state->config.maxConcurrency) {
+                return;
+            }
+            state->activeWorkers++;
+            continue;
+        }
+
+        state->inFlight.erase(std::find(state->inFlight.begin(), state->inFlight.end(), job));
+
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(finished - job->started);
+        uint32_t latency = static_cast<uint32_t>(duration.count());
+
+        ProbeResult result = { job->id, job->hostname, ProbeOutcome::Ok, latency, latency };
+        if (latency > state->config.deadlineMs) {
+            // Finished between the deadline and the owner's next poll
+            result.outcome = ProbeOutcome::Timeout;
+            result.responseTime = PROBE_TIMEOUT;
+            result.elapsedMs = PROBE_TIMEOUT;
+            state->timedOut++;
+            latency = state->config.deadlineMs;
+        }
+        else if (!resolved) {
+            result.outcome = ProbeOutcome::Failed;
+            result.responseTime = PROBE_TIMEOUT;
+            state->completed++;
+            state->failed++;
+        }
+        else {
+            state->completed++;
+        }
+
+        state->samples.Record(finished, latency);
+        state->results.push_back(std::move(result));
+        state->resultReady.notify_all();
+        if (state->config.onResult) state->config.onResult();
+    }
+}
+
+bool SystemResolve(const std::string& hostname, ProbeFamily family) {
+    struct addrinfo hints = {};
+    struct addrinfo* result = nullptr;
+    hints.ai_family = family == ProbeFamily::IPv4 ? AF_INET : family == ProbeFamily::IPv6 ? AF_INET6 : AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    int status = getaddrinfo(hostname.c_str(), nullptr, &hints, &result);
+
+    if (result) {
+        freeaddrinfo(result);
+    }
+    return status == 0;
+}
+
+ProbeEngine::ProbeEngine(const ProbeEngineConfig& config, ResolveFn resolve)
+    : m_config(config), m_state(std::make_shared<ProbeEngineState>()) {
+    if (m_config.maxConcurrency < 1) m_config.maxConcurrency = 1;
+    if (m_config.maxAbandoned < 1) m_config.maxAbandoned = 1;
+    m_state->config = m_config;
+    m_state->resolve = std::move(resolve);
+}
+
+ProbeEngine::~ProbeEngine() {
+    // Idle workers exit now; stuck ones exit when their lookup returns
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    m_state->stopping = true;
+    m_state->queue.clear();
+    m_state->workReady.notify_all();
+}
+
+void ProbeEngine::Submit(size_t id, const std::string& hostname, ProbeFamily family) {
+    auto job = std::make_shared<ProbeJob>();
+    job->id = id;
+    job->hostname = hostname;
+    job->family = family;
+    job->expired = false;
+
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    m_state->queue.push_back(std::move(job));
+    m_state->submitted++;
+    SpawnWorkersLocked(m_state);
+    m_state->workReady.notify_one();
+}
+
+size_t ProbeEngine::Poll(std::vector<ProbeResult>& results) {
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    ExpireLocked(m_state, Clock::now());
+
+    size_t count = m_state->results.size();
+    for (auto& result : m_state->results) {
+        results.push_back(std::move(result));
+    }
+    m_state->results.clear();
+    return count;
+}
+
+size_t ProbeEngine::Wait(std::vector<ProbeResult>& results, uint32_t timeoutMs) {
+    auto waitUntil = Clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    std::unique_lock<std::mutex> guard(m_state->lock);
+    for (;;) {
+        auto now = Clock::now();
+        ExpireLocked(m_state, now);
+        if (!m_state->results.empty() || now >= waitUntil) {
+            break;
+        }
+
+        // Wake for the earliest deadline so timeouts are reported on time
+        auto wakeAt = waitUntil;
+        for (const auto& job : m_state->inFlight) {
+            wakeAt = (std::min)(wakeAt, job->deadline);
+        }
+        m_state->resultReady.wait_until(guard, wakeAt);
+    }
+
+    size_t count = m_state->results.size();
+    for (auto& result : m_state->results) {
+        results.push_back(std::move(result));
+    }
+    m_state->results.clear();
+    return count;
+}
+
+size_t ProbeEngine::Pending() const {
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    return m_state->queue.size() + m_state->inFlight.size() + m_state->results.size();
+}
+
+ProbeEngineStats ProbeEngine::GetStats() const {
+    ProbeEngineStats stats = {};
+
+    std::lock_guard<std::mutex> guard(m_state->lock);
+    stats.submitted = m_state->submitted;
+    stats.completed = m_state->completed;
+    stats.failed = m_state->failed;
+    stats.timedOut = m_state->timedOut;
+    stats.lateReturns = m_state->lateReturns;
+    stats.queued = (int)m_state->queue.size();
+    stats.inFlight = (int)m_state->inFlight.size();
+    stats.abandoned = m_state->abandoned;
+    m_state->samples.Fill(stats, Clock::now());
+    return stats;
+}
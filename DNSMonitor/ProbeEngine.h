@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Response time reported for probes that failed or hit their deadline
+// (same value as MAXDWORD, which the console UI already treats as TIMEOUT)
+static const uint32_t PROBE_TIMEOUT = 0xFFFFFFFF;
+
+// How a probe ended
+enum class ProbeOutcome {
+    Ok,         // Name resolved before the deadline
+    Failed,     // Resolver answered with an error
+    Timeout     // Deadline expired; the lookup was abandoned
+};
+
+// Address family a probe asks the resolver for
+enum class ProbeFamily {
+    Any,        // Resolves if either family does
+    IPv4,
+    IPv6
+};
+
+// Result handed back to the owner of the engine
+struct ProbeResult {
+    size_t id;                  // Caller supplied id (index into the cache list)
+    std::string hostname;
+    ProbeOutcome outcome;
+    uint32_t responseTime;      // Milliseconds, PROBE_TIMEOUT unless outcome is Ok
+    uint32_t elapsedMs;         // Until the lookup returned, Failed included; PROBE_TIMEOUT on Timeout
+};
+
+// Engine tuning
+struct ProbeEngineConfig {
+    int maxConcurrency = 16;    // Lookups in flight at once
+    uint32_t deadlineMs = 3000; // Hard per-probe deadline
+    int maxAbandoned = 32;      // Abandoned lookups allowed to linger before admission stalls
+    // Called on a worker after each result is queued, with the engine's lock
+    // held: it may signal the owner but must not call back into the engine.
+    // Timeouts are found by Poll() and Wait(), so they do not call it.
+    std::function<void()> onResult;
+};
+
+// Throughput and tail latency over the recent sample window
+struct ProbeEngineStats {
+    uint64_t submitted;
+    uint64_t completed;         // Ok + Failed
+    uint64_t failed;
+    uint64_t timedOut;
+    uint64_t lateReturns;       // Abandoned lookups that eventually returned
+    int queued;
+    int inFlight;
+    int abandoned;              // Abandoned lookups still blocking a thread
+    double probesPerSec;
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t maxLatency;
+};
+
+// Recent completions kept for throughput and tail percentiles.
+// Not synchronized; owners guard it with their own lock.
+class ProbeSampleWindow {
+public:
+    void Record(std::chrono::steady_clock::time_point at, uint32_t latency);
+
+    // Fill probesPerSec and the percentile fields of stats
+    void Fill(ProbeEngineStats& stats, std::chrono::steady_clock::time_point now) const;
+
+private:
+    struct Sample {
+        std::chrono::steady_clock::time_point at;
+        uint32_t latency;
+    };
+
+    std::vector<Sample> m_samples;
+    size_t m_next = 0;
+    std::chrono::steady_clock::time_point m_first;
+};
+
+struct ProbeEngineState;
+
+// Blocking name lookup; returns true when the name resolved to an address
+// of the family. Injectable so the engine can be driven by a stub resolver.
+using ResolveFn = std::function<bool(const std::string& hostname, ProbeFamily family)>;
+
+// Default resolver: getaddrinfo through the operating system
+bool SystemResolve(const std::string& hostname, ProbeFamily family);
+
+// Runs blocking lookups on a pool of worker threads under a concurrency limit.
+// A lookup that outlives its deadline is reported as Timeout straight away
+// and its worker is replaced, so one dead host never holds up the others.
+class ProbeEngine {
+public:
+    explicit ProbeEngine(const ProbeEngineConfig& config = ProbeEngineConfig(),
+        ResolveFn resolve = SystemResolve);
+    ~ProbeEngine();
+
+    ProbeEngine(const ProbeEngine&) = delete;
+    ProbeEngine& operator=(const ProbeEngine&) = delete;
+
+    // Queue a probe; never blocks
+    void Submit(size_t id, const std::string& hostname, ProbeFamily family = ProbeFamily::Any);
+
+    // Append finished and deadline-expired probes to results without blocking
+    size_t Poll(std::vector<ProbeResult>& results);
+
+    // Like Poll, but waits up to timeoutMs for at least one result
+    size_t Wait(std::vector<ProbeResult>& results, uint32_t timeoutMs);
+
+    // Queued, in flight, and finished but not yet collected
+    size_t Pending() const;
+
+    const ProbeEngineConfig& Config() const { return m_config; }
+    ProbeEngineStats GetStats() const;
+
+private:
+    ProbeEngineConfig m_config;
+    std::shared_ptr<ProbeEngineState> m_state;
+};
@@ -0,0 +1,123 @@
+#include "ProbeScheduler.h"
+
+#include <algorithm>
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t NOT_QUEUED = (size_t)-1;
+static const int MAX_FAILURE_STEPS = 4;
+
+Clock::time_point ProbeDueTime(const ProbeUrgency& urgency, const ProbeSchedulePolicy& policy) {
+    double interval = policy.retestMs;
+    for (int i = 0; i < (std::min)(urgency.failures, MAX_FAILURE_STEPS); i++) {
+        interval *= policy.failureFactor;
+    }
+    if (urgency.visible) {
+        interval *= policy.visibleFactor;
+    }
+    interval = (std::max)(interval, (double)policy.minRetestMs);
+
+    Clock::time_point due = urgency.lastTested + std::chrono::milliseconds((int64_t)interval);
+
+    // Catch the record just before it expires, unless it already had by the last probe
+    if (urgency.expiresAt > urgency.lastTested) {
+        Clock::time_point beforeExpiry = urgency.expiresAt - std::chrono::milliseconds(policy.expiryLeadMs);
+        Clock::time_point earliest = urgency.lastTested + std::chrono::milliseconds(policy.minRetestMs);
+        if (beforeExpiry < due) {
+            due = (std::max)(beforeExpiry, earliest);
+        }
+    }
+    return due;
+}
+
+void ProbeScheduler::Schedule(size_t id, Clock::time_point due) {
+    if (id >= m_position.size()) {
+        m_position.resize(id + 1, NOT_QUEUED);
+    }
+
+    size_t slot = m_position[id];
+    if (slot == NOT_QUEUED) {
+        m_heap.push_back({ due, id });
+        m_position[id] = m_heap.size() - 1;
+        SiftUp(m_heap.size() - 1);
+        return;
+    }
+
+    Clock::time_point previous = m_heap[slot].due;
+    m_heap[slot].due = due;
+    if (due < previous) {
+        SiftUp(slot);
+    }
+    else {
+        SiftDown(slot);
+    }
+}
+
+void ProbeScheduler::Remove(size_t id) {
+    if (Contains(id)) {
+        RemoveAt(m_position[id]);
+    }
+}
+
+void ProbeScheduler::Clear() {
+    m_heap.clear();
+    m_position.clear();
+}
+
+bool ProbeScheduler::Contains(size_t id) const {
+    return id < m_position.size() && m_position[id] != NOT_QUEUED;
+}
+
+size_t ProbeScheduler::Pop() {
+    size_t id = m_heap.front().id;
+    RemoveAt(0);
+    return id;
+}
+
+void ProbeScheduler::Place(size_t slot, const Slot& value) {
+    m_heap[slot] = value;
+    m_position[value.id] = slot;
+}
+
+void ProbeScheduler::SiftUp(size_t slot) {
+    Slot value = m_heap[slot];
+    while (slot > 0) {
+        size_t parent = (slot - 1) / 2;
+        if (!(value.due < m_heap[parent].due)) break;
+        Place(slot, m_heap[parent]);
+        slot = parent;
+    }
+    Place(slot, value);
+}
+
+void ProbeScheduler::SiftDown(size_t slot) {
+    Slot value = m_heap[slot];
+    size_t count = m_heap.size();
+    for (;;) {
+        size_t child = slot * 2 + 1;
+        if (child >= count) break;
+        if (child + 1 < count && m_heap[child + 1].due < m_heap[child].due) {
+            child++;
+        }
+        if (!(m_heap[child].due < value.due)) break;
+        Place(slot, m_heap[child]);
+        slot = child;
+    }
+    Place(slot, value);
+}
+
+void ProbeScheduler::RemoveAt(size_t slot) {
+    m_position[m_heap[slot].id] = NOT_QUEUED;
+
+    Slot last = m_heap.back();
+    m_heap.pop_back();
+    if (slot == m_heap.size()) return;
+
+    Place(slot, last);
+    if (slot > 0 && last.due < m_heap[(slot - 1) / 2].due) {
+        SiftUp(slot);
+    }
+    else {
+        SiftDown(slot);
+    }
+}
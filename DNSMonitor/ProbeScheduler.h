@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What the scheduler weighs when deciding how soon an entry needs a probe
+struct ProbeUrgency {
+    std::chrono::steady_clock::time_point lastTested;
+    std::chrono::steady_clock::time_point expiresAt;   // When the cached record's TTL runs out
+    int failures;               // Consecutive failed probes
+    bool visible;               // Currently shown on screen
+};
+
+// Scheduling tuning
+struct ProbeSchedulePolicy {
+    uint32_t retestMs = 15000;      // Retest interval for a healthy, off-screen entry
+    uint32_t minRetestMs = 2000;    // Floor after failure and visibility boosts
+    uint32_t expiryLeadMs = 2000;   // Probe this long before the TTL runs out
+    double failureFactor = 0.5;     // Interval multiplier per consecutive failure (up to 4)
+    double visibleFactor = 0.5;     // Interval multiplier for on-screen entries
+};
+
+// When an entry should next be probed. Recent failures and being on screen
+// shorten the retest interval; a TTL about to run out pulls the probe forward.
+std::chrono::steady_clock::time_point ProbeDueTime(const ProbeUrgency& urgency, const ProbeSchedulePolicy& policy);
+
+// Indexed min-heap of entry ids ordered by due time. Schedule, Remove and
+// Pop are O(log n); ids are dense (cache list positions), so the id to
+// heap slot map is a plain vector.
+class ProbeScheduler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Insert id, or move it if it is already queued
+    void Schedule(size_t id, Clock::time_point due);
+    void Remove(size_t id);
+    void Clear();
+
+    bool Contains(size_t id) const;
+    bool Empty() const { return m_heap.empty(); }
+    size_t Size() const { return m_heap.size(); }
+
+    // Earliest due time; only valid when not Empty()
+    Clock::time_point NextDue() const { return m_heap.front().due; }
+
+    // Remove and return the most urgent id; only valid when not Empty()
+    size_t Pop();
+
+private:
+    struct Slot {
+        Clock::time_point due;
+        size_t id;
+    };
+
+    void Place(size_t slot, const Slot& value);
+    void SiftUp(size_t slot);
+    void SiftDown(size_t slot);
+    void RemoveAt(size_t slot);
+
+    std::vector<Slot> m_heap;
+    std::vector<size_t> m_position;     // id -> heap slot, NOT_QUEUED when absent
+};
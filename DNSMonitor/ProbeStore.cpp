@@ -0,0 +1,359 @@
+#include "ProbeStore.h"
+#include "Platform.h"
+
+#include <atomic>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <share.h>
+#else
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char PROBE_STORE_MAGIC[8] = { 'D', 'N', 'S', 'P', 'R', 'O', 'B', 'E' };
+static const uint32_t PROBE_STORE_VERSION = 1;
+
+// Start of <base>.probes; records follow immediately
+struct ProbeStoreHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t capacity;
+    std::atomic<uint64_t> appended;     // Released after the record it counts; shared with other processes
+    uint8_t reserved[32];
+};
+static_assert(sizeof(ProbeStoreHeader) == 64, "ProbeStoreHeader is an on-disk format");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "appended must be usable across processes");
+
+struct MappedFile {
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+    uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+static void UnmapFile(MappedFile& mapped) {
+#ifdef _WIN32
+    if (mapped.data) UnmapViewOfFile(mapped.data);
+    if (mapped.mapping) CloseHandle(mapped.mapping);
+    if (mapped.file != INVALID_HANDLE_VALUE) CloseHandle(mapped.file);
+    mapped.file = INVALID_HANDLE_VALUE;
+    mapped.mapping = NULL;
+#else
+    if (mapped.data) munmap(mapped.data, mapped.size);
+    if (mapped.fd >= 0) close(mapped.fd);
+    mapped.fd = -1;
+#endif
+    mapped.data = nullptr;
+    mapped.size = 0;
+}
+
+// Map path whole. A missing or empty file is created at createSize unless
+// readOnly; created is set when that happened. A writable map is exclusive:
+// it fails while another process has the file open for writing.
+static bool MapFile(MappedFile& mapped, const std::string& path, size_t createSize, bool readOnly, bool& created) {
+    created = false;
+#ifdef _WIN32
+    // Readers share writing, the writer does not, so a second writer's open fails
+    mapped.file = CreateFileA(path.c_str(), GENERIC_READ | (readOnly ? 0 : GENERIC_WRITE),
+        FILE_SHARE_READ | (readOnly ? FILE_SHARE_WRITE : 0), NULL, readOnly ? OPEN_EXISTING : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mapped.file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mapped.file, &size)) {
+        UnmapFile(mapped);
+        return false;
+    }
+    mapped.size = (size_t)size.QuadPart;
+    if (mapped.size == 0) {
+        if (readOnly) {
+            UnmapFile(mapped);
+            return false;
+        }
+        mapped.size = createSize;
+        created = true;
+    }
+
+    // Mapping past the end of a writable file extends it
+    unsigned long long mapSize = mapped.size;
+    mapped.mapping = CreateFileMappingA(mapped.file, NULL, readOnly ? PAGE_READONLY : PAGE_READWRITE,
+        (DWORD)(mapSize >> 32), (DWORD)mapSize, NULL);
+    if (mapped.mapping) {
+        mapped.data = (uint8_t*)MapViewOfFile(mapped.mapping, readOnly ? FILE_MAP_READ : FILE_MAP_WRITE, 0, 0, mapped.size);
+    }
+#else
+    mapped.fd = open(path.c_str(), readOnly ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+    if (mapped.fd < 0) return false;
+    // Held until the descriptor closes; readers do not take it
+    if (!readOnly && flock(mapped.fd, LOCK_EX | LOCK_NB) != 0) {
+        UnmapFile(mapped);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(mapped.fd, &info) != 0) {
+        UnmapFile(mapped);
+        return false;
+    }
+    mapped.size = (size_t)info.st_size;
+    if (mapped.size == 0) {
+        if (readOnly || ftruncate(mapped.fd, (off_t)createSize) != 0) {
+            UnmapFile(mapped);
+            return false;
+        }
+        mapped.size = createSize;
+        created = true;
+    }
+
+    void* data = mmap(nullptr, mapped.size, PROT_READ | (readOnly ? 0 : PROT_WRITE), MAP_SHARED, mapped.fd, 0);
+    mapped.data = data == MAP_FAILED ? nullptr : (uint8_t*)data;
+#endif
+    if (!mapped.data) {
+        UnmapFile(mapped);
+        return false;
+    }
+    return true;
+}
+
+bool SetRecordAddress(ProbeRecord& record, const std::string& address) {
+    memset(record.address, 0, sizeof(record.address));
+    record.family = 0;
+    if (inet_pton(AF_INET, address.c_str(), record.address) == 1) {
+        record.family = 4;
+        return true;
+    }
+    if (inet_pton(AF_INET6, address.c_str(), record.address) == 1) {
+        record.family = 6;
+        return true;
+    }
+    return false;
+}
+
+std::string RecordAddress(const ProbeRecord& record) {
+    char text[INET6_ADDRSTRLEN] = "";
+    if (record.family == 4) {
+        inet_ntop(AF_INET, (void*)record.address, text, sizeof(text));
+    }
+    else if (record.family == 6) {
+        inet_ntop(AF_INET6, (void*)record.address, text, sizeof(text));
+    }
+    return text;
+}
+
+ProbeStore::ProbeStore()
+    : m_file(nullptr), m_readOnly(true), m_hostsFile(nullptr) {
+}
+
+ProbeStore::~ProbeStore() {
+    Close();
+}
+
+bool ProbeStore::Open(const std::string& basePath, uint64_t capacity, bool readOnly) {
+    Close();
+    if (capacity == 0) return false;
+
+    m_file = new MappedFile();
+    m_readOnly = readOnly;
+    bool created = false;
+    size_t createSize = sizeof(ProbeStoreHeader) + (size_t)capacity * sizeof(ProbeRecord);
+    if (!MapFile(*m_file, basePath + ".probes", createSize, readOnly, created) || m_file->size < sizeof(ProbeStoreHeader)) {
+        Close();
+        return false;
+    }
+
+    ProbeStoreHeader* header = (ProbeStoreHeader*)m_file->data;
+    if (created) {
+        memset((void*)header, 0, sizeof(*header));  // Fresh mapping, nothing reads it yet
+        memcpy(header->magic, PROBE_STORE_MAGIC, sizeof(header->magic));
+        header->version = PROBE_STORE_VERSION;
+        header->recordSize = sizeof(ProbeRecord);
+        header->capacity = capacity;
+    }
+    if (memcmp(header->magic, PROBE_STORE_MAGIC, sizeof(header->magic)) != 0 || header->version != PROBE_STORE_VERSION ||
+        header->recordSize != sizeof(ProbeRecord) || header->capacity == 0 ||
+        m_file->size < sizeof(ProbeStoreHeader) + header->capacity * sizeof(ProbeRecord)) {
+        Close();
+        return false;
+    }
+
+    // Dictionary: line n is host id n
+    std::string hostsPath = basePath + ".hosts";
+    FILE* hosts = nullptr;
+#ifdef _WIN32
+    fopen_s(&hosts, hostsPath.c_str(), "rb");
+#else
+    hosts = fopen(hostsPath.c_str(), "rb");
+#endif
+    if (hosts) {
+        char line[512];
+        while (fgets(line, sizeof(line), hosts)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            m_hostIds.emplace(line, (uint32_t)m_hosts.size());
+            m_hosts.push_back(line);
+        }
+        fclose(hosts);
+    }
+
+    if (!readOnly) {
+#ifdef _WIN32
+        // fopen_s opens files unshared; readers must be able to load the dictionary
+        m_hostsFile = _fsopen(hostsPath.c_str(), "ab", _SH_DENYNO);
+#else
+        m_hostsFile = fopen(hostsPath.c_str(), "ab");
+#endif
+        if (!m_hostsFile) {
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void ProbeStore::Close() {
+    if (m_hostsFile) {
+        fclose(m_hostsFile);
+        m_hostsFile = nullptr;
+    }
+    if (m_file) {
+        UnmapFile(*m_file);
+        delete m_file;
+        m_file = nullptr;
+    }
+    m_hosts.clear();
+    m_hostIds.clear();
+}
+
+bool ProbeStore::IsOpen() const {
+    return m_file != nullptr;
+}
+
+uint32_t ProbeStore::HostId(const std::string& hostname) {
+    auto it = m_hostIds.find(hostname);
+    if (it != m_hostIds.end()) {
+        return it->second;
+    }
+
+    // On disk before any record refers to it
+    uint32_t id = (uint32_t)m_hosts.size();
+    if (m_hostsFile) {
+        fprintf(m_hostsFile, "%s\n", hostname.c_str());
+        fflush(m_hostsFile);
+    }
+    m_hostIds.emplace(hostname, id);
+    m_hosts.push_back(hostname);
+    return id;
+}
+
+bool ProbeStore::FindHost(const std::string& hostname, uint32_t& id) const {
+    auto it = m_hostIds.find(hostname);
+    if (it == m_hostIds.end()) return false;
+    id = it->second;
+    return true;
+}
+
+const std::string& ProbeStore::HostName(uint32_t id) const {
+    static const std::string unknown;
+    return id < m_hosts.size() ? m_hosts[id] : unknown;
+}
+
+const ProbeRecord& ProbeStore::At(uint64_t sequence) const {
+    const ProbeStoreHeader* header = (const ProbeStoreHeader*)m_file->data;
+    const ProbeRecord* records = (const ProbeRecord*)(m_file->data + sizeof(ProbeStoreHeader));
+    return records[sequence % header->capacity];
+}
+
+void ProbeStore::Append(const ProbeRecord& record) {
+    if (!m_file || m_readOnly) return;
+
+    ProbeStoreHeader* header = (ProbeStoreHeader*)m_file->data;
+    ProbeRecord* records = (ProbeRecord*)(m_file->data + sizeof(ProbeStoreHeader));
+    uint64_t appended = header->appended.load(std::memory_order_relaxed);
+    // A reader that sees this record half written also sees the count that retires the old one
+    std::atomic_thread_fence(std::memory_order_release);
+    records[appended % header->capacity] = record;
+    // Readers that see the new count see the record
+    header->appended.store(appended + 1, std::memory_order_release);
+}
+
+uint64_t ProbeStore::Capacity() const {
+    return m_file ? ((const ProbeStoreHeader*)m_file->data)->capacity : 0;
+}
+
+uint64_t ProbeStore::Appended() const {
+    return m_file ? ((const ProbeStoreHeader*)m_file->data)->appended.load(std::memory_order_acquire) : 0;
+}
+
+uint64_t ProbeStore::Count() const {
+    uint64_t appended = Appended();
+    uint64_t capacity = Capacity();
+    return appended < capacity ? appended : capacity;
+}
+
+size_t ProbeStore::Scan(uint32_t from, uint32_t to, uint32_t hostId,
+    const std::function<void(const ProbeRecord&)>& visit) const {
+    if (!m_file) return 0;
+
+    // Every record before the end is visible. Once the ring is full a running
+    // writer overwrites the oldest slots next, so after reading records check
+    // how far it got: the search is redone if it reached the searched range,
+    // and records it reached while being copied are skipped.
+    const std::atomic<uint64_t>& appended = ((const ProbeStoreHeader*)m_file->data)->appended;
+    uint64_t capacity = Capacity();
+    auto oldest = [capacity](uint64_t end) { return end >= capacity ? end + 1 - capacity : 0; };
+    uint64_t end = Appended();
+    uint64_t low;
+    for (;;) {
+        // First record at or after from
+        uint64_t first = oldest(end);
+        low = first;
+        uint64_t high = end;
+        while (low < high) {
+            uint64_t middle = low + (high - low) / 2;
+            if (At(middle).timestamp < from) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t now = appended.load(std::memory_order_relaxed);
+        if (oldest(now) <= first) break;
+        end = now;
+    }
+
+    size_t visited = 0;
+    for (uint64_t sequence = low; sequence < end; sequence++) {
+        ProbeRecord record = At(sequence);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t first = oldest(appended.load(std::memory_order_relaxed));
+        if (sequence < first) {
+            sequence = first - 1;
+            continue;
+        }
+
+        if (record.timestamp >= to) break;
+        if (hostId != PROBE_STORE_ANY_HOST && record.hostId != hostId) continue;
+        visit(record);
+        visited++;
+    }
+    return visited;
+}
+
+void ProbeStore::Flush() {
+    if (!m_file || m_readOnly) return;
+#ifdef _WIN32
+    FlushViewOfFile(m_file->data, 0);
+#else
+    msync(m_file->data, m_file->size, MS_ASYNC);
+#endif
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// How a stored probe ended; mirrors ProbeOutcome plus direct-probe results
+enum class StoredOutcome : uint8_t {
+    Ok,
+    Failed,         // Resolver answered with an error, or NXDOMAIN
+    Timeout,
+    Changed         // Answered, but without the cached address
+};
+
+// One probe result on disk. Fixed size so the file is a plain array and a
+// record's position follows from its sequence number.
+struct ProbeRecord {
+    uint32_t timestamp;         // Unix time, seconds
+    uint32_t hostId;            // Line number in the hostname dictionary
+    uint32_t latencyMs;         // PROBE_TIMEOUT unless the probe was answered
+    uint8_t outcome;            // StoredOutcome
+    uint8_t family;             // 4, 6, or 0 when no address was recorded (failures, getaddrinfo probes)
+    uint16_t reserved;
+    uint8_t address[16];        // Resolved address; IPv4 uses the first four bytes
+};
+static_assert(sizeof(ProbeRecord) == 32, "ProbeRecord is an on-disk format");
+
+static const uint32_t PROBE_STORE_ANY_HOST = 0xFFFFFFFF;
+
+// Store a textual address in a record; false if it does not parse
+bool SetRecordAddress(ProbeRecord& record, const std::string& address);
+std::string RecordAddress(const ProbeRecord& record);
+
+struct MappedFile;
+
+// Append-only probe history in a memory-mapped ring: <base>.probes holds a
+// small header and a fixed number of records, and the oldest are overwritten
+// once it is full. Hostnames are interned in <base>.hosts, one per line.
+//
+// Appends are a copy into the mapping and a header update, so the probe path
+// never blocks on disk. Scans walk the mapping in place; records are in time
+// order, so a time window is found by binary search. One process writes,
+// and a second writable Open() of the same files fails while it does;
+// readers may open them at the same time.
+class ProbeStore {
+public:
+    ProbeStore();
+    ~ProbeStore();
+
+    ProbeStore(const ProbeStore&) = delete;
+    ProbeStore& operator=(const ProbeStore&) = delete;
+
+    // Create the files with room for capacity records, or open existing ones
+    // (keeping their capacity). Read-only opens fail if the files are missing.
+    bool Open(const std::string& basePath, uint64_t capacity, bool readOnly);
+    void Close();
+    bool IsOpen() const;
+
+    // Id for hostname, adding it to the dictionary if needed (writer only)
+    uint32_t HostId(const std::string& hostname);
+    bool FindHost(const std::string& hostname, uint32_t& id) const;
+    const std::string& HostName(uint32_t id) const;
+    size_t HostCount() const { return m_hosts.size(); }
+
+    void Append(const ProbeRecord& record);
+
+    uint64_t Capacity() const;
+    uint64_t Count() const;             // Records currently held
+    uint64_t Appended() const;          // Records ever appended
+
+    // Visit records with from <= timestamp < to, oldest first, optionally
+    // only one host's. Returns the number visited. On a full ring the slot
+    // the writer fills next is left out, and records it overwrites during
+    // the scan are skipped rather than read torn.
+    size_t Scan(uint32_t from, uint32_t to, uint32_t hostId,
+        const std::function<void(const ProbeRecord&)>& visit) const;
+
+    // Ask the OS to write dirty pages back now instead of eventually
+    void Flush();
+
+private:
+    const ProbeRecord& At(uint64_t sequence) const;
+
+    MappedFile* m_file;
+    bool m_readOnly;
+    FILE* m_hostsFile;                  // Dictionary, open for appending (writer only)
+    std::vector<std::string> m_hosts;
+    std::unordered_map<std::string, uint32_t> m_hostIds;
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Token bucket: refills at rate tokens per second and holds at most burst.
+// Not synchronized; each owner keeps its own.
+class TokenBucket {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit TokenBucket(double rate = 10.0, double burst = 1.0)
+        : m_rate(rate), m_burst((std::max)(burst, 1.0)), m_tokens(m_burst), m_last(Clock::now()) {
+    }
+
+    double Rate() const { return m_rate; }
+    double Burst() const { return m_burst; }
+
+    void SetRate(double rate, Clock::time_point now = Clock::now()) {
+        Refill(now);
+        m_rate = rate;
+    }
+
+    // Take a token if one is available
+    bool TryTake(Clock::time_point now = Clock::now()) {
+        Refill(now);
+        if (m_tokens < 1.0) {
+            return false;
+        }
+        m_tokens -= 1.0;
+        return true;
+    }
+
+    // How long until TryTake would succeed
+    Clock::duration Delay(Clock::time_point now = Clock::now()) {
+        Refill(now);
+        if (m_tokens >= 1.0 || m_rate <= 0.0) {
+            return Clock::duration::zero();
+        }
+        return std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>((1.0 - m_tokens) / m_rate));
+    }
+
+private:
+    void Refill(Clock::time_point now) {
+        if (now > m_last) {
+            double elapsed = std::chrono::duration<double>(now - m_last).count();
+            m_tokens = (std::min)(m_burst, m_tokens + elapsed * m_rate);
+            m_last = now;
+        }
+    }
+
+    double m_rate;
+    double m_burst;
+    double m_tokens;
+    Clock::time_point m_last;
+};
+
+// Tuning for AdaptiveRate
+struct AdaptiveRateConfig {
+    double minRate = 1.0;           // Probes per second
+    double maxRate = 50.0;          // Hard ceiling; never exceeded
+    double initialRate = 10.0;
+    double rateStep = 2.0;          // Added after each healthy interval
+    int minWindow = 1;              // Probes queued or in flight
+    int maxWindow = 32;
+    int initialWindow = 4;
+    double decrease = 0.5;          // Rate and window multiplier when degraded
+    uint32_t latencyTarget = 250;   // Degraded when the interval's p95 is above this (ms)
+    double timeoutLimit = 0.05;     // or when more than this fraction timed out
+    int minSamples = 4;             // Results needed to judge an interval; it runs on until there are
+    std::chrono::milliseconds interval{ 1000 };
+    std::chrono::milliseconds cooldown{ 3000 };     // No second decrease until probes sent before the first are done
+};
+
+// Which way the last interval moved the rate
+enum class RateTrend {
+    Hold,
+    Increase,
+    Decrease
+};
+
+// Additive increase, multiplicative decrease for a probe rate and window.
+// Results are recorded as they finish; once per interval they are judged as
+// a whole. Too many timeouts or a slow p95 cuts rate and window by the
+// decrease factor, so a struggling resolver sheds load quickly; a healthy
+// interval adds one step, so recovery is probed gently. Owners pace their
+// TokenBucket with Rate(). Not synchronized; each owner keeps its own.
+class AdaptiveRate {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    explicit AdaptiveRate(const AdaptiveRateConfig& config = AdaptiveRateConfig(), Clock::time_point now = Clock::now())
+        : m_config(config), m_rate(config.initialRate), m_window(config.initialWindow), m_trend(RateTrend::Hold),
+          m_timeouts(0), m_errors(0), m_lastP95(0), m_lastTimeoutRate(0.0), m_lastErrors(0), m_intervalStart(now), m_lastDecrease(now - config.cooldown) {
+        Clamp();
+    }
+
+    const AdaptiveRateConfig& Config() const { return m_config; }
+    double Rate() const { return m_rate; }
+    int Window() const { return m_window; }
+    RateTrend Trend() const { return m_trend; }
+    uint32_t LastP95() const { return m_lastP95; }              // Of the last judged interval
+    double LastTimeoutRate() const { return m_lastTimeoutRate; }
+    int LastErrors() const { return m_lastErrors; }
+
+    void SetCeiling(double maxRate) {
+        m_config.maxRate = (std::max)(maxRate, m_config.minRate);
+        Clamp();
+    }
+
+    // One finished probe; latency is ignored for timeouts
+    void Record(uint32_t latencyMs, bool timedOut) {
+        if (timedOut) {
+            m_timeouts++;
+        }
+        else {
+            m_latencies.push_back(latencyMs);
+        }
+    }
+
+    // A probe the resolver failed without a usable latency, such as a
+    // getaddrinfo error or NXDOMAIN. Counted apart: it neither slows the
+    // rate nor counts toward judging an interval.
+    void RecordError() {
+        m_errors++;
+    }
+
+    // Judge the interval if it is over; true when rate or window changed
+    bool Update(Clock::time_point now = Clock::now()) {
+        if (now < m_intervalStart + m_config.interval) return false;
+
+        // Too few results to judge: let the interval run on, so a slow rate still gets decided
+        int samples = (int)m_latencies.size() + m_timeouts;
+        if (samples < m_config.minSamples) return false;
+        m_intervalStart = now;
+
+        double oldRate = m_rate;
+        int oldWindow = m_window;
+        m_lastTimeoutRate = (double)m_timeouts / samples;
+        // Timeouts rank as the slowest results
+        m_lastP95 = m_timeouts * 20 >= samples ? UINT32_MAX : Percentile95();
+        bool degraded = m_lastTimeoutRate > m_config.timeoutLimit || m_lastP95 > m_config.latencyTarget;
+        m_trend = RateTrend::Hold;
+        if (degraded && now >= m_lastDecrease + m_config.cooldown) {
+            m_rate *= m_config.decrease;
+            m_window = (int)(m_window * m_config.decrease);
+            m_lastDecrease = now;
+            m_trend = RateTrend::Decrease;
+        }
+        else if (!degraded) {
+            m_rate += m_config.rateStep;
+            m_window++;
+            m_trend = RateTrend::Increase;
+        }
+        Clamp();
+        m_latencies.clear();
+        m_timeouts = 0;
+        m_lastErrors = m_errors;
+        m_errors = 0;
+        return m_rate != oldRate || m_window != oldWindow;
+    }
+
+private:
+    uint32_t Percentile95() {
+        size_t rank = m_latencies.size() * 95 / 100;
+        std::nth_element(m_latencies.begin(), m_latencies.begin() + rank, m_latencies.end());
+        return m_latencies[rank];
+    }
+
+    void Clamp() {
+        m_rate = (std::min)((std::max)(m_rate, m_config.minRate), m_config.maxRate);
+        m_window = (std::min)((std::max)(m_window, m_config.minWindow), m_config.maxWindow);
+    }
+
+    AdaptiveRateConfig m_config;
+    double m_rate;
+    int m_window;
+    RateTrend m_trend;
+    std::vector<uint32_t> m_latencies;  // This interval's answered probes
+    int m_timeouts;
+    int m_errors;
+    uint32_t m_lastP95;
+    double m_lastTimeoutRate;
+    int m_lastErrors;
+    Clock::time_point m_intervalStart;
+    Clock::time_point m_lastDecrease;
+};
@@ -0,0 +1,129 @@
+#include "ResolverCompare.h"
+#include "DnsClient.h"
+#include "RateLimit.h"
+
+#include <algorithm>
+#include <memory>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int DRIVER_MAX_SLEEP_MS = 20;
+
+// Per-resolver progress through the target list
+struct ResolverRun {
+    std::unique_ptr<DnsClient> client;
+    TokenBucket bucket;
+    size_t nextTarget = 0;
+    int inFlight = 0;
+    std::vector<uint32_t> latencies;
+    uint64_t latencyTotal = 0;
+    ResolverReport report = {};
+};
+
+static uint32_t Percentile(const std::vector<uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    return sorted[(size_t)(p * (sorted.size() - 1))];
+}
+
+static void RecordAnswer(ResolverRun& run, const CompareTarget& target, const DnsQueryResult& answer) {
+    ResolverReport& report = run.report;
+
+    switch (answer.status) {
+    case DnsQueryStatus::Timeout:
+        report.timeouts++;
+        return;
+    case DnsQueryStatus::NetworkError:
+    case DnsQueryStatus::ServerError:
+        report.errors++;
+        return;
+    case DnsQueryStatus::Ok:
+    case DnsQueryStatus::NameError:
+        break;
+    }
+
+    report.answered++;
+    run.latencies.push_back(answer.responseTime);
+    run.latencyTotal += answer.responseTime;
+
+    // NXDOMAIN for a name the cache still resolves is a disagreement too
+    if (!target.cachedAddress.empty()) {
+        report.compared++;
+        if (!DnsAnswerHasAddress(answer, target.cachedAddress)) {
+            report.disagreements++;
+        }
+    }
+}
+
+std::vector<ResolverReport> CompareResolvers(const std::vector<CompareTarget>& targets,
+    const ResolverCompareConfig& config, CompareProgressFn progress) {
+    std::vector<ResolverRun> runs(config.resolvers.size());
+    int total = 0;
+
+    for (size_t i = 0; i < config.resolvers.size(); i++) {
+        ResolverRun& run = runs[i];
+        run.report.server = config.resolvers[i];
+        run.bucket = TokenBucket(config.queriesPerSecond, config.burst);
+
+        DnsClientConfig clientConfig;
+        clientConfig.server = config.resolvers[i];
+        clientConfig.deadlineMs = config.deadlineMs;
+        clientConfig.maxInFlight = config.maxInFlight;
+        run.client.reset(new DnsClient(clientConfig));
+        run.report.usable = run.client->Start();
+        if (run.report.usable) {
+            total += (int)targets.size();
+        }
+        else {
+            run.nextTarget = targets.size();
+        }
+    }
+
+    int done = 0;
+    std::vector<DnsQueryResult> answers;
+    while (done < total) {
+        auto now = Clock::now();
+        auto sleepFor = std::chrono::duration_cast<Clock::duration>(std::chrono::milliseconds(DRIVER_MAX_SLEEP_MS));
+
+        for (auto& run : runs) {
+            // Submit whatever the bucket and the in-flight cap allow
+            while (run.nextTarget < targets.size() && run.inFlight < config.maxInFlight && run.bucket.TryTake(now)) {
+                run.client->Submit(run.nextTarget, targets[run.nextTarget].hostname, DNS_TYPE_A);
+                run.nextTarget++;
+                run.inFlight++;
+                run.report.queries++;
+            }
+            if (run.nextTarget < targets.size() && run.inFlight < config.maxInFlight) {
+                sleepFor = (std::min)(sleepFor, run.bucket.Delay(now));
+            }
+
+            answers.clear();
+            run.client->Poll(answers);
+            for (const auto& answer : answers) {
+                RecordAnswer(run, targets[answer.id], answer);
+                run.inFlight--;
+                done++;
+                if (progress) progress(done, total);
+            }
+        }
+
+        if (done < total) {
+            std::this_thread::sleep_for(sleepFor);
+        }
+    }
+
+    std::vector<ResolverReport> reports;
+    for (auto& run : runs) {
+        ResolverReport& report = run.report;
+        std::sort(run.latencies.begin(), run.latencies.end());
+        report.p50 = Percentile(run.latencies, 0.50);
+        report.p95 = Percentile(run.latencies, 0.95);
+        report.p99 = Percentile(run.latencies, 0.99);
+        report.maxLatency = run.latencies.empty() ? 0 : run.latencies.back();
+        report.meanLatency = run.latencies.empty() ? 0.0 : (double)run.latencyTotal / run.latencies.size();
+        report.timeoutRate = report.queries > 0 ? 100.0 * report.timeouts / report.queries : 0.0;
+        report.disagreementRate = report.compared > 0 ? 100.0 * report.disagreements / report.compared : 0.0;
+        reports.push_back(report);
+    }
+    return reports;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A cached name to look up, and what the local cache says it resolves to
+struct CompareTarget {
+    std::string hostname;
+    std::string cachedAddress;
+};
+
+struct ResolverCompareConfig {
+    std::vector<std::string> resolvers;     // "ip", "ip:port" or "[ipv6]:port"
+    uint32_t deadlineMs = 2000;
+    double queriesPerSecond = 20.0;         // Ceiling per resolver
+    int burst = 5;
+    int maxInFlight = 16;                   // Per resolver
+};
+
+// Outcome for one resolver over the whole target set
+struct ResolverReport {
+    std::string server;
+    bool usable;                // False if the address could not be opened
+    int queries;
+    int answered;               // Any response, including NXDOMAIN
+    int timeouts;
+    int errors;                 // SERVFAIL, REFUSED, network errors
+    int compared;               // Answers checked against the cached address
+    int disagreements;          // Cached address missing from the answer
+    uint32_t p50;
+    uint32_t p95;
+    uint32_t p99;
+    uint32_t maxLatency;
+    double meanLatency;
+    double timeoutRate;         // Percent of queries
+    double disagreementRate;    // Percent of compared answers
+};
+
+// Called after each completed query with the number done so far
+using CompareProgressFn = std::function<void(int done, int total)>;
+
+// Send every target to every resolver in parallel, rate limited per resolver,
+// and summarize latency, timeouts and disagreement with the local cache.
+std::vector<ResolverReport> CompareResolvers(const std::vector<CompareTarget>& targets,
+    const ResolverCompareConfig& config, CompareProgressFn progress = nullptr);
@@ -0,0 +1,325 @@
+#include "TraceFile.h"
+#include "ProbeEngine.h"
+
+#include <algorithm>
+#include <cstring>
+
+static const char TRACE_MAGIC[8] = { 'D', 'N', 'S', 'T', 'R', 'A', 'C', 'E' };
+static const uint32_t TRACE_VERSION = 1;
+static const size_t TRACE_HEADER_SIZE = 24;    // Magic, version, reserved, start time
+static const size_t TRACE_BUFFER_SIZE = 1 << 16;
+static const size_t MAX_TRACE_NAME = 1024;
+static const uint8_t ADDRESS_V4 = 4;
+static const uint8_t ADDRESS_V6 = 6;
+
+static FILE* OpenTraceFile(const std::string& path, const char* mode) {
+    FILE* file = nullptr;
+#ifdef _WIN32
+    fopen_s(&file, path.c_str(), mode);
+#else
+    file = fopen(path.c_str(), mode);
+#endif
+    return file;
+}
+
+TraceWriter::TraceWriter()
+    : m_file(nullptr), m_lastMs(0), m_events(0), m_bytes(0) {
+}
+
+TraceWriter::~TraceWriter() {
+    Close();
+}
+
+bool TraceWriter::Open(const std::string& path, time_t started) {
+    Close();
+    m_file = OpenTraceFile(path, "wb");
+    if (!m_file) return false;
+
+    uint8_t header[TRACE_HEADER_SIZE] = {};
+    memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    for (int i = 0; i < 4; i++) {
+        header[8 + i] = (uint8_t)(TRACE_VERSION >> (8 * i));
+    }
+    for (int i = 0; i < 8; i++) {
+        header[16 + i] = (uint8_t)((uint64_t)started >> (8 * i));
+    }
+    m_buffer.assign(header, header + sizeof(header));
+    m_names.clear();
+    m_lastMs = 0;
+    m_events = 0;
+    m_bytes = 0;
+    return Drain(true);
+}
+
+void TraceWriter::Close() {
+    if (!m_file) return;
+    Drain(true);
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+void TraceWriter::PutVarint(uint64_t value) {
+    while (value >= 0x80) {
+        m_buffer.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    m_buffer.push_back((uint8_t)value);
+}
+
+// Number + 1 of a name written before, or 0 and the name itself
+void TraceWriter::PutName(std::string_view name) {
+    name = name.substr(0, MAX_TRACE_NAME);
+    auto it = m_names.find(std::string(name));
+    if (it != m_names.end()) {
+        PutVarint((uint64_t)it->second + 1);
+        return;
+    }
+    PutVarint(0);
+    PutVarint(name.size());
+    m_buffer.insert(m_buffer.end(), name.begin(), name.end());
+    m_names.emplace(std::string(name), (uint32_t)m_names.size());
+}
+
+void TraceWriter::PutTime(uint64_t timeMs) {
+    if (timeMs < m_lastMs) {
+        timeMs = m_lastMs;
+    }
+    PutVarint(timeMs - m_lastMs);
+    m_lastMs = timeMs;
+}
+
+// Write the buffer out once it is big enough, or always when all is set
+bool TraceWriter::Drain(bool all) {
+    if (!m_file) return false;
+    if (m_buffer.empty() || (!all && m_buffer.size() < TRACE_BUFFER_SIZE)) return true;
+
+    size_t written = fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+    m_bytes += written;
+    bool ok = written == m_buffer.size();
+    m_buffer.clear();
+    if (all) {
+        ok = fflush(m_file) == 0 && ok;
+    }
+    return ok;
+}
+
+bool TraceWriter::WriteSnapshot(uint64_t timeMs, const EntryTable& entries) {
+    if (!m_file) return false;
+
+    PutByte((uint8_t)TraceEventType::Snapshot);
+    PutTime(timeMs);
+    PutVarint(entries.Size());
+    std::vector<PackedAddress> addresses;
+    for (size_t row = 0; row < entries.Size(); row++) {
+        PutName(entries.Hostname(row));
+        PutByte((uint8_t)entries.Kind(row));
+        PutVarint(entries.Ttl(row));
+        entries.Addresses(row, addresses);
+        PutVarint(addresses.size());
+        for (const auto& address : addresses) {
+            if (address.IsV4()) {
+                PutByte(ADDRESS_V4);
+                m_buffer.insert(m_buffer.end(), address.bytes + 12, address.bytes + 16);
+            }
+            else {
+                PutByte(ADDRESS_V6);
+                m_buffer.insert(m_buffer.end(), address.bytes, address.bytes + 16);
+            }
+        }
+        if (entries.Kind(row) == RecordKind::CNAME) {
+            PutName(entries.Target(row));
+        }
+    }
+    m_events++;
+    return Drain(false);
+}
+
+bool TraceWriter::WriteProbe(uint64_t timeMs, std::string_view hostname, RecordKind kind, StoredOutcome outcome,
+    uint32_t latencyMs, bool direct) {
+    if (!m_file) return false;
+
+    PutByte((uint8_t)TraceEventType::Probe);
+    PutTime(timeMs);
+    PutName(hostname);
+    PutByte((uint8_t)kind);
+    PutByte((uint8_t)((uint8_t)outcome | (direct ? 0x80 : 0)));
+    // Timeouts are the common large value; store them as 0 and shift the rest up
+    PutVarint(latencyMs == PROBE_TIMEOUT ? 0 : (uint64_t)latencyMs + 1);
+    m_events++;
+    return Drain(false);
+}
+
+TraceReader::TraceReader()
+    : m_file(nullptr), m_position(0), m_lastMs(0), m_started(0), m_damaged(false) {
+}
+
+TraceReader::~TraceReader() {
+    Close();
+}
+
+bool TraceReader::Open(const std::string& path) {
+    Close();
+    m_file = OpenTraceFile(path, "rb");
+    if (!m_file) return false;
+
+    uint8_t header[TRACE_HEADER_SIZE];
+    uint32_t version = 0;
+    uint64_t started = 0;
+    if (fread(header, 1, sizeof(header), m_file) == sizeof(header)) {
+        for (int i = 0; i < 4; i++) {
+            version |= (uint32_t)header[8 + i] << (8 * i);
+        }
+        for (int i = 0; i < 8; i++) {
+            started |= (uint64_t)header[16 + i] << (8 * i);
+        }
+    }
+    if (memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || version != TRACE_VERSION) {
+        Close();
+        return false;
+    }
+    m_started = (time_t)started;
+    m_buffer.clear();
+    m_position = 0;
+    m_names.clear();
+    m_lastMs = 0;
+    m_damaged = false;
+    return true;
+}
+
+void TraceReader::Close() {
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+// Make sure bytes unread bytes are buffered; false at the end of the file
+bool TraceReader::Fill(size_t bytes) {
+    if (m_buffer.size() - m_position >= bytes) return true;
+    if (!m_file) return false;
+
+    m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_position);
+    m_position = 0;
+    size_t have = m_buffer.size();
+    m_buffer.resize(have + (std::max)(bytes, TRACE_BUFFER_SIZE));
+    size_t got = fread(m_buffer.data() + have, 1, m_buffer.size() - have, m_file);
+    m_buffer.resize(have + got);
+    return m_buffer.size() >= bytes;
+}
+
+bool TraceReader::GetByte(uint8_t& value) {
+    if (!Fill(1)) return false;
+    value = m_buffer[m_position++];
+    return true;
+}
+
+bool TraceReader::GetVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte;
+        if (!GetByte(byte)) return false;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool TraceReader::GetName(std::string& name) {
+    uint64_t reference;
+    if (!GetVarint(reference)) return false;
+    if (reference > 0) {
+        if (reference > m_names.size()) return false;
+        name = m_names[reference - 1];
+        return true;
+    }
+
+    uint64_t length;
+    if (!GetVarint(length) || length > MAX_TRACE_NAME || !Fill((size_t)length)) return false;
+    name.assign((const char*)m_buffer.data() + m_position, (size_t)length);
+    m_position += (size_t)length;
+    m_names.push_back(name);
+    return true;
+}
+
+bool TraceReader::ReadSnapshot(TraceEvent& event) {
+    uint64_t rows;
+    if (!GetVarint(rows)) return false;
+
+    event.entries.Clear();
+    std::string hostname;
+    std::string target;
+    for (uint64_t i = 0; i < rows; i++) {
+        uint8_t kind;
+        uint64_t ttl;
+        uint64_t count;
+        if (!GetName(hostname) || !GetByte(kind) || kind > (uint8_t)RecordKind::Other ||
+            !GetVarint(ttl) || !GetVarint(count)) {
+            return false;
+        }
+
+        size_t row = 0;
+        bool added = false;
+        for (uint64_t a = 0; a < count; a++) {
+            uint8_t family;
+            if (!GetByte(family) || (family != ADDRESS_V4 && family != ADDRESS_V6)) return false;
+            size_t size = family == ADDRESS_V4 ? 4 : 16;
+            if (!Fill(size)) return false;
+            PackedAddress address;
+            if (family == ADDRESS_V4) {
+                address.bytes[10] = 0xFF;
+                address.bytes[11] = 0xFF;
+            }
+            memcpy(address.bytes + 16 - size, m_buffer.data() + m_position, size);
+            m_position += size;
+            if (!added) {
+                row = event.entries.Add(hostname, (RecordKind)kind, address, (uint32_t)ttl);
+                added = true;
+            }
+            else {
+                event.entries.AddAddress(row, address);
+            }
+        }
+        if (!added) {
+            row = event.entries.Add(hostname, (RecordKind)kind, PackedAddress(), (uint32_t)ttl);
+        }
+        if ((RecordKind)kind == RecordKind::CNAME) {
+            if (!GetName(target)) return false;
+            event.entries.SetTarget(row, target);
+        }
+    }
+    return true;
+}
+
+bool TraceReader::Next(TraceEvent& event) {
+    uint8_t type;
+    if (!GetByte(type)) return false;
+
+    uint64_t delta;
+    bool ok = GetVarint(delta);
+    if (ok) {
+        m_lastMs += delta;
+        event.timeMs = m_lastMs;
+        event.type = (TraceEventType)type;
+        if (type == (uint8_t)TraceEventType::Snapshot) {
+            ok = ReadSnapshot(event);
+        }
+        else if (type == (uint8_t)TraceEventType::Probe) {
+            uint8_t kind;
+            uint8_t outcome;
+            uint64_t latency;
+            ok = GetName(event.hostname) && GetByte(kind) && kind <= (uint8_t)RecordKind::Other &&
+                GetByte(outcome) && (outcome & 0x7F) <= (uint8_t)StoredOutcome::Changed && GetVarint(latency);
+            if (ok) {
+                event.kind = (RecordKind)kind;
+                event.outcome = (StoredOutcome)(outcome & 0x7F);
+                event.direct = (outcome & 0x80) != 0;
+                event.latencyMs = latency == 0 ? PROBE_TIMEOUT : (uint32_t)(latency - 1);
+            }
+        }
+        else {
+            ok = false;
+        }
+    }
+    m_damaged = !ok;
+    return ok;
+}
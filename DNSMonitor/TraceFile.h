@@ -0,0 +1,106 @@
+#pragma once
+
+#include "EntryTable.h"
+#include "ProbeStore.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Kinds of record in a trace
+enum class TraceEventType : uint8_t {
+    Snapshot = 1,   // The whole cache listing, as ParseDNSCache() returned it
+    Probe = 2       // One probe result
+};
+
+// One decoded trace record. Snapshots fill entries; probes fill the rest.
+struct TraceEvent {
+    TraceEventType type;
+    uint64_t timeMs;            // Since the trace started
+    EntryTable entries;
+    std::string hostname;
+    RecordKind kind;
+    StoredOutcome outcome;
+    uint32_t latencyMs;         // PROBE_TIMEOUT unless answered
+    bool direct;                // Sent straight to the DNS server rather than through the OS
+};
+
+// Compact binary trace of what the monitor saw: cache snapshots and probe
+// results, each stamped with milliseconds since the trace began. Hostnames
+// are written out the first time and referenced by number afterwards, and
+// numbers are varints, so a probe costs about five bytes and a snapshot row
+// a few more plus its addresses. Written and read strictly front to back.
+class TraceWriter {
+public:
+    TraceWriter();
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    // Create path, replacing any trace there; started is the Unix time of ms 0
+    bool Open(const std::string& path, time_t started);
+    void Close();
+    bool IsOpen() const { return m_file != nullptr; }
+
+    // Times must not go backwards; an earlier one is recorded as the latest
+    bool WriteSnapshot(uint64_t timeMs, const EntryTable& entries);
+    bool WriteProbe(uint64_t timeMs, std::string_view hostname, RecordKind kind, StoredOutcome outcome,
+        uint32_t latencyMs, bool direct);
+
+    uint64_t Events() const { return m_events; }
+    uint64_t Bytes() const { return m_bytes + m_buffer.size(); }
+
+private:
+    void PutByte(uint8_t value) { m_buffer.push_back(value); }
+    void PutVarint(uint64_t value);
+    void PutName(std::string_view name);
+    void PutTime(uint64_t timeMs);
+    bool Drain(bool all);
+
+    FILE* m_file;
+    std::vector<uint8_t> m_buffer;
+    std::unordered_map<std::string, uint32_t> m_names;
+    uint64_t m_lastMs;
+    uint64_t m_events;
+    uint64_t m_bytes;           // Written to the file so far
+};
+
+// Reads a trace written by TraceWriter
+class TraceReader {
+public:
+    TraceReader();
+    ~TraceReader();
+
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    time_t Started() const { return m_started; }
+
+    // The next record; false at the end, or at a truncated or damaged record (Damaged())
+    bool Next(TraceEvent& event);
+    bool Damaged() const { return m_damaged; }
+
+private:
+    bool Fill(size_t bytes);
+    bool GetByte(uint8_t& value);
+    bool GetVarint(uint64_t& value);
+    bool GetName(std::string& name);
+    bool ReadSnapshot(TraceEvent& event);
+
+    FILE* m_file;
+    std::vector<uint8_t> m_buffer;
+    size_t m_position;
+    std::vector<std::string> m_names;
+    uint64_t m_lastMs;
+    time_t m_started;
+    bool m_damaged;
+};
@@ -0,0 +1,297 @@
+#include "TraceReplay.h"
+#include "ProbeEngine.h"
+
+#include <algorithm>
+#include <queue>
+#include <string>
+#include <unordered_map>
+
+typedef std::chrono::steady_clock Clock;
+
+ReplayConfig::ReplayConfig() {
+    rate.maxRate = 50.0;
+    rate.maxWindow = 32;
+    rate.latencyTarget = slowMs;
+    rate.cooldown = std::chrono::milliseconds(deadlineMs);
+}
+
+// Per entry, row for row with the replayed table
+struct ReplayState {
+    int failures = 0;
+    Clock::time_point lastTested;
+    Clock::time_point expiresAt;
+    HostDetector detector;
+};
+
+// The last recorded result for a name, handed to every replayed probe of it
+struct RecordedBehavior {
+    StoredOutcome outcome;
+    uint32_t latencyMs;
+};
+
+// A replayed probe that has not come back yet
+struct ReplayProbe {
+    uint64_t doneMs;
+    std::string hostname;
+    RecordKind kind;
+    StoredOutcome outcome;
+    uint32_t latencyMs;
+
+    bool operator>(const ReplayProbe& other) const { return doneMs > other.doneMs; }
+};
+
+static std::string BehaviorKey(std::string_view hostname, RecordKind kind) {
+    std::string key(hostname);
+    key += '\0';
+    key += (char)kind;
+    return key;
+}
+
+// The monitor's alert board name: hostname, with the record type unless A
+static std::string ReplayAlertHost(const EntryTable& entries, size_t row) {
+    std::string host(entries.Hostname(row));
+    if (entries.Kind(row) != RecordKind::A) {
+        host += '/';
+        host += RecordKindName(entries.Kind(row));
+    }
+    return host;
+}
+
+class Replay {
+public:
+    Replay(const ReplayConfig& config, time_t started)
+        : m_config(config), m_started(started), m_origin(Clock::now()), m_anomalies(config.anomalies),
+          m_rate(config.rate, m_origin), m_bucket(m_rate.Rate(), config.rate.maxWindow), m_report() {
+        m_bucket.TryTake(m_origin);
+        m_anomalies.SetListener([this](const AnomalyAlert& alert) {
+            m_report.alerts.push_back(alert);
+            if (alert.cleared == 0) {
+                m_report.alertsRaised++;
+            }
+            else {
+                m_report.alertsCleared++;
+            }
+        });
+    }
+
+    ReplayReport Run(TraceReader& reader);
+
+private:
+    Clock::time_point At(uint64_t ms) const { return m_origin + std::chrono::milliseconds(ms); }
+    time_t WallTime(uint64_t ms) const { return m_started + (time_t)(ms / 1000); }
+
+    void Merge(EntryTable& snapshot, uint64_t nowMs);
+    void Schedule(size_t row);
+    void Complete(const ReplayProbe& probe, uint64_t nowMs);
+    void SubmitDue(uint64_t nowMs);
+    void Sample(uint64_t nowMs);
+
+    ReplayConfig m_config;
+    time_t m_started;
+    Clock::time_point m_origin;         // Virtual time 0
+    EntryTable m_entries;
+    std::vector<ReplayState> m_states;
+    ProbeScheduler m_scheduler;
+    AnomalyDetector m_anomalies;
+    AdaptiveRate m_rate;
+    TokenBucket m_bucket;
+    std::unordered_map<std::string, RecordedBehavior> m_behavior;
+    std::priority_queue<ReplayProbe, std::vector<ReplayProbe>, std::greater<ReplayProbe>> m_inFlight;
+    bool m_flushAdvised = false;
+    uint64_t m_lastSampleMs = 0;
+    ReplayReport m_report;
+};
+
+void Replay::Schedule(size_t row) {
+    const ReplayState& state = m_states[row];
+    ProbeUrgency urgency = { state.lastTested, state.expiresAt, state.failures, false };
+    m_scheduler.Schedule(row, ProbeDueTime(urgency, m_config.policy));
+}
+
+// As a cache refresh merges: entries with the same addresses keep their history
+void Replay::Merge(EntryTable& snapshot, uint64_t nowMs) {
+    Clock::time_point now = At(nowMs);
+    std::vector<ReplayState> states(snapshot.Size());
+    for (size_t row = 0; row < snapshot.Size(); row++) {
+        ReplayState& state = states[row];
+        size_t current;
+        if (m_entries.Find(snapshot.Hostname(row), snapshot.Kind(row), current) &&
+            snapshot.Target(row) == m_entries.Target(current) && snapshot.SameAddresses(row, m_entries, current)) {
+            state = m_states[current];
+            snapshot.ResponseMs(row) = m_entries.ResponseMs(current);
+            snapshot.Flags(row) = (m_entries.Flags(current) & ~ENTRY_STALE) | (snapshot.Flags(row) & ENTRY_STALE);
+        }
+        else {
+            state.lastTested = now - std::chrono::minutes(10);
+        }
+        state.expiresAt = now + std::chrono::seconds(snapshot.Ttl(row));
+    }
+    std::swap(m_entries, snapshot);
+    m_states.swap(states);
+
+    // Alerts of names that left or were reset can no longer clear themselves
+    m_anomalies.Prune([this](const AnomalyAlert& alert) {
+        size_t slash = alert.host.find('/');
+        RecordKind kind = RecordKind::A;
+        if (slash != std::string::npos) {
+            std::string type = alert.host.substr(slash + 1);
+            kind = type == "AAAA" ? RecordKind::AAAA : type == "CNAME" ? RecordKind::CNAME : RecordKind::Other;
+        }
+        size_t row;
+        if (!m_entries.Find(std::string_view(alert.host).substr(0, slash), kind, row)) return false;
+        const HostDetector& detector = m_states[row].detector;
+        return alert.kind == AlertKind::Latency ? detector.latency.alarm : detector.failures.alarm;
+    }, WallTime(nowMs));
+
+    m_scheduler.Clear();
+    for (size_t row = 0; row < m_entries.Size(); row++) {
+        if (!(m_entries.Flags(row) & ENTRY_PENDING)) {
+            Schedule(row);
+        }
+    }
+    m_report.snapshots++;
+}
+
+void Replay::Complete(const ReplayProbe& probe, uint64_t nowMs) {
+    bool reachable = probe.outcome == StoredOutcome::Ok || probe.outcome == StoredOutcome::Changed;
+    bool timedOut = probe.outcome == StoredOutcome::Timeout;
+    uint32_t latency = reachable ? probe.latencyMs : PROBE_TIMEOUT;
+    m_rate.Record(latency, timedOut);
+    if (reachable) {
+        m_report.probesAnswered++;
+    }
+    else {
+        m_report.probesFailed++;
+    }
+
+    size_t row;
+    if (!m_entries.Find(probe.hostname, probe.kind, row)) return;
+
+    ReplayState& state = m_states[row];
+    bool negative = (m_entries.Flags(row) & ENTRY_NEGATIVE) != 0;
+    bool changed = negative ? reachable : probe.outcome == StoredOutcome::Changed;
+    m_entries.ResponseMs(row) = latency;
+    m_entries.Flags(row) = (m_entries.Flags(row) & ~(ENTRY_REACHABLE | ENTRY_CHANGED | ENTRY_PENDING)) |
+        (reachable ? ENTRY_REACHABLE : 0) | (changed ? ENTRY_CHANGED : 0);
+    state.failures = reachable || negative ? 0 : state.failures + 1;
+    state.lastTested = At(nowMs);
+    if (!negative) {
+        m_anomalies.Observe(state.detector, ReplayAlertHost(m_entries, row), { latency, !reachable }, WallTime(nowMs));
+    }
+    Schedule(row);
+}
+
+// Top up the probes in flight, most urgent first, within the window and rate
+void Replay::SubmitDue(uint64_t nowMs) {
+    Clock::time_point now = At(nowMs);
+    int slots = m_rate.Window() - (int)m_inFlight.size();
+    while (slots > 0 && !m_scheduler.Empty() && m_scheduler.NextDue() <= now && m_bucket.TryTake(now)) {
+        size_t row = m_scheduler.Pop();
+        ReplayState& state = m_states[row];
+        auto it = m_behavior.find(BehaviorKey(m_entries.Hostname(row), m_entries.Kind(row)));
+        if (it == m_behavior.end()) {
+            // Nothing to answer with yet; try again after a normal retest interval
+            m_report.probesUnknown++;
+            state.lastTested = now;
+            Schedule(row);
+            continue;
+        }
+
+        const RecordedBehavior& behavior = it->second;
+        bool answered = behavior.outcome != StoredOutcome::Timeout && behavior.latencyMs < m_config.deadlineMs;
+        ReplayProbe probe;
+        probe.hostname = std::string(m_entries.Hostname(row));
+        probe.kind = m_entries.Kind(row);
+        probe.outcome = answered ? behavior.outcome : StoredOutcome::Timeout;
+        probe.latencyMs = answered ? behavior.latencyMs : PROBE_TIMEOUT;
+        probe.doneMs = nowMs + (answered ? behavior.latencyMs : m_config.deadlineMs);
+        m_inFlight.push(probe);
+        m_entries.Flags(row) |= ENTRY_PENDING;
+        m_report.probesSent++;
+        slots--;
+    }
+}
+
+void Replay::Sample(uint64_t nowMs) {
+    ReplaySample sample;
+    sample.timeMs = nowMs;
+    sample.counts = CountEntries(m_entries, m_config.slowMs);
+    sample.needsFlush = m_anomalies.GlobalAlert();
+    sample.activeAlerts = m_anomalies.ActiveAlerts();
+    sample.probeRate = m_rate.Rate();
+    m_report.samples.push_back(sample);
+}
+
+ReplayReport Replay::Run(TraceReader& reader) {
+    auto wallStart = Clock::now();
+    TraceEvent event;
+    bool more = reader.Next(event);
+    uint64_t nowMs = more ? event.timeMs : 0;
+    uint64_t startMs = nowMs;
+    uint64_t endMs = nowMs;
+    m_lastSampleMs = nowMs;
+
+    while (more) {
+        // Everything recorded up to now: refreshes and the results the live monitor saw
+        while (more && event.timeMs <= nowMs) {
+            if (event.type == TraceEventType::Snapshot) {
+                Merge(event.entries, nowMs);
+            }
+            else {
+                m_behavior[BehaviorKey(event.hostname, event.kind)] = { event.outcome, event.latencyMs };
+                m_report.recordedProbes++;
+            }
+            endMs = event.timeMs;
+            more = reader.Next(event);
+        }
+
+        while (!m_inFlight.empty() && m_inFlight.top().doneMs <= nowMs) {
+            Complete(m_inFlight.top(), nowMs);
+            m_inFlight.pop();
+        }
+        m_anomalies.Tick(WallTime(nowMs));
+        if (m_rate.Update(At(nowMs))) {
+            m_bucket.SetRate(m_rate.Rate(), At(nowMs));
+        }
+        SubmitDue(nowMs);
+
+        bool flush = m_anomalies.GlobalAlert();
+        if (flush && !m_flushAdvised) {
+            m_report.flushAdvisories++;
+        }
+        m_flushAdvised = flush;
+        if (nowMs >= m_lastSampleMs + m_config.sampleMs) {
+            Sample(nowMs);
+            m_lastSampleMs = nowMs;
+        }
+
+        // Next cycle; with nothing in flight, skip idle cycles up to the next thing to do
+        uint64_t nextMs = nowMs + m_config.tickMs;
+        if (m_inFlight.empty()) {
+            uint64_t wake = m_lastSampleMs + m_config.sampleMs;
+            if (more) {
+                wake = (std::min)(wake, event.timeMs);
+            }
+            if (!m_scheduler.Empty()) {
+                auto due = m_scheduler.NextDue();
+                uint64_t dueMs = due > At(nowMs) ?
+                    (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(due - m_origin).count() : nowMs;
+                wake = (std::min)(wake, dueMs);
+            }
+            nextMs = (std::max)(nextMs, wake);
+        }
+        if (flush) {
+            m_report.flushAdvisedMs += nextMs - nowMs;
+        }
+        nowMs = nextMs;
+    }
+
+    m_report.durationMs = endMs - startMs;
+    m_report.wallSeconds = std::chrono::duration<double>(Clock::now() - wallStart).count();
+    return m_report;
+}
+
+ReplayReport ReplayTrace(TraceReader& reader, const ReplayConfig& config) {
+    Replay replay(config, reader.Started());
+    return replay.Run(reader);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "AnomalyDetector.h"
+#include "EntryTable.h"
+#include "ProbeScheduler.h"
+#include "RateLimit.h"
+#include "TraceFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The monitor's tuning, as replay applies it. Defaults match the monitor's.
+struct ReplayConfig {
+    ProbeSchedulePolicy policy;
+    AdaptiveRateConfig rate;
+    AnomalyConfig anomalies;
+    uint32_t deadlineMs = 3000;
+    uint32_t slowMs = 200;
+    uint32_t tickMs = 50;               // Virtual monitor cycle
+    uint32_t sampleMs = 10000;          // Virtual time between ReplaySamples
+
+    ReplayConfig();
+};
+
+// The health panel's numbers at one point of virtual time
+struct ReplaySample {
+    uint64_t timeMs;
+    EntryCounts counts;
+    bool needsFlush;
+    size_t activeAlerts;
+    double probeRate;
+};
+
+struct ReplayReport {
+    uint64_t durationMs;                // Virtual time covered
+    uint64_t snapshots;
+    uint64_t recordedProbes;
+    uint64_t probesSent;
+    uint64_t probesAnswered;
+    uint64_t probesFailed;              // Failed or timed out
+    uint64_t probesUnknown;             // No recorded outcome for the name yet; not counted as a result
+    uint64_t alertsRaised;
+    uint64_t alertsCleared;
+    uint64_t flushAdvisedMs;            // Virtual time with the flush recommendation up
+    int flushAdvisories;                // Times it came up
+    std::vector<AnomalyAlert> alerts;   // Every raise and clear, in order
+    std::vector<ReplaySample> samples;
+    double wallSeconds;
+};
+
+// Replay a trace through the monitor's decision path on a virtual clock, as
+// fast as the CPU allows. Snapshots are merged the way a cache refresh is;
+// the scheduler and rate controller decide when to probe; each probe gets
+// the outcome and latency most recently recorded for its name, so changed
+// tuning can be judged on the same outage. Anomaly detection and the health
+// counts then run on those results. Needs no network and no Windows APIs.
+//
+// Simplified next to the monitor: every entry is probed itself (CNAME chains
+// are not followed), there are no connect probes and nothing is on screen.
+ReplayReport ReplayTrace(TraceReader& reader, const ReplayConfig& config = ReplayConfig());
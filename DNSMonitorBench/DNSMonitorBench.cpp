@@ -0,0 +1,2000 @@
+// Benchmarks for the DNS cache monitor's hot paths. Portable: builds with
+// Visual Studio (DNSMonitorBench.vcxproj) or with g++ on Linux, see README.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <new>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "CacheSnoop.h"
+#include "CacheSource.h"
+#include "ConsoleRenderer.h"
+#include "DnsClient.h"
+#include "EntryIndex.h"
+#include "EntryTable.h"
+#include "EventLoop.h"
+#include "FakeDnsServer.h"
+#include "FleetCollector.h"
+#include "FleetSender.h"
+#include "Platform.h"
+#include "ProbeEngine.h"
+#include "RateLimit.h"
+#include "TraceFile.h"
+#include "TraceReplay.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// Live heap bytes, so the storage benchmarks can report bytes per entry,
+// and the most there have been, for the cache source peaks. Every
+// allocation carries a 16-byte size header. Atomic because the probe and
+// fleet benchmarks allocate on other threads; only the storage and source
+// benchmarks, which run alone, read them.
+static std::atomic<size_t> g_liveBytes{ 0 };
+static std::atomic<size_t> g_peakBytes{ 0 };
+
+void* operator new(size_t size) {
+    size_t* block = (size_t*)malloc(size + 16);
+    if (!block) throw std::bad_alloc();
+    block[0] = size;
+    size_t live = g_liveBytes += size;
+    size_t peak = g_peakBytes;
+    while (live > peak && !g_peakBytes.compare_exchange_weak(peak, live)) {
+    }
+    return (char*)block + 16;
+}
+
+void operator delete(void* memory) noexcept {
+    if (!memory) return;
+    size_t* block = (size_t*)((char*)memory - 16);
+    g_liveBytes -= block[0];
+    free(block);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    operator delete(memory);
+}
+
+static const int DEFAULT_RECORDS = 100000;
+static const int DEFAULT_REPEATS = 5;
+static const char* DEFAULT_DUMP_PATH = "dnsmonitor_bench_dump.txt";
+static const char* DEFAULT_TRACE_PATH = "dnsmonitor_bench_trace.bin";
+static const int DEFAULT_PROBES = 20000;
+static const int DEFAULT_FRAMES = 2000;
+static const int DEFAULT_FLEET_MONITORS = 256;
+static const int DEFAULT_FLEET_ROUNDS = 20;
+static const double SNOOP_MISS_MS = 30.0;       // What a name the stand-in has to resolve costs on top
+static const size_t SOURCE_FIRST_ROWS = 4096;   // What the monitor's first partial snapshot holds
+
+// Options shared by all benchmarks
+struct BenchOptions {
+    int records = DEFAULT_RECORDS;
+    int repeats = DEFAULT_REPEATS;
+    std::string input;              // Captured dump to parse instead of a synthetic one
+    std::string dumpPath = DEFAULT_DUMP_PATH;
+    bool keepDump = false;
+    std::string replay;             // Recorded trace to replay instead of benchmarking
+    int probes = DEFAULT_PROBES;    // Queries sent to the stand-in resolver
+    int inFlight = 256;
+    FakeDnsConfig resolver;
+    int frames = DEFAULT_FRAMES;
+    int fleetMonitors = DEFAULT_FLEET_MONITORS;     // Simulated monitors streaming to the collector; 0 skips it
+    int fleetRounds = DEFAULT_FLEET_ROUNDS;
+    int fleetThreads = 4;                           // Collector workers
+    std::string jsonPath;           // Also write every result here, for regression tracking
+};
+
+// One benchmark's numbers, kept for the JSON report
+struct BenchResult {
+    std::string name;
+    std::vector<std::pair<const char*, double>> values;
+};
+
+static std::vector<BenchResult> g_results;
+
+static void AddResult(const char* name, std::vector<std::pair<const char*, double>> values) {
+    g_results.push_back({ name, std::move(values) });
+}
+
+// Print one result line: name, records, megabytes, best seconds, throughput
+static void Report(const char* name, uint64_t records, double megabytes, double seconds) {
+    printf("%-24s  %10llu  %9.1f  %9.4f  %9.1f MB/s  %11.0f rec/s\n", name, (unsigned long long)records,
+        megabytes, seconds, seconds > 0 ? megabytes / seconds : 0.0, seconds > 0 ? records / seconds : 0.0);
+    AddResult(name, { { "records", (double)records }, { "megabytes", megabytes }, { "seconds", seconds },
+        { "records_per_sec", seconds > 0 ? records / seconds : 0.0 } });
+}
+
+// Best wall time of several runs
+static double BestOf(int repeats, const std::function<void()>& run) {
+    double best = 1e30;
+    for (int i = 0; i < repeats; i++) {
+        auto start = Clock::now();
+        run();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds < best) best = seconds;
+    }
+    return best;
+}
+
+static unsigned Pick(std::mt19937& random, unsigned bound) {
+    return (unsigned)(random() % bound);
+}
+
+// Write a synthetic "ipconfig /displaydns" dump. Mix: 70% A, 15% AAAA,
+// 10% CNAME groups (alias plus target A), 5% negative entries.
+static std::string GenerateDisplayDns(int records, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::string out;
+    out.reserve((size_t)records * 330);
+    out += "\r\nWindows IP Configuration\r\n\r\n";
+
+    char line[512];
+    for (int i = 0; i < records; i++) {
+        char host[128];
+        snprintf(host, sizeof(host), "host%d.svc%u.region%u.example.com", i, Pick(random, 500), Pick(random, 20));
+        unsigned kind = Pick(random, 100);
+        unsigned ttl = Pick(random, 86400);
+
+        snprintf(line, sizeof(line), "    %s\r\n    ----------------------------------------\r\n", host);
+        out += line;
+
+        if (kind >= 95) {
+            out += "    Name does not exist.\r\n\r\n\r\n";
+            continue;
+        }
+
+        const char* recordName = host;
+        char alias[160];
+        if (kind >= 85) {
+            snprintf(alias, sizeof(alias), "edge%u.cdn.example.net", Pick(random, 5000));
+            snprintf(line, sizeof(line),
+                "    Record Name . . . . . : %s\r\n    Record Type . . . . . : 5\r\n"
+                "    Time To Live  . . . . : %u\r\n    Data Length . . . . . : 8\r\n"
+                "    Section . . . . . . . : Answer\r\n    CNAME Record  . . . . : %s\r\n\r\n",
+                host, ttl, alias);
+            out += line;
+            recordName = alias;
+        }
+
+        if (kind >= 70 && kind < 85) {
+            snprintf(line, sizeof(line),
+                "    Record Name . . . . . : %s\r\n    Record Type . . . . . : 28\r\n"
+                "    Time To Live  . . . . : %u\r\n    Data Length . . . . . : 16\r\n"
+                "    Section . . . . . . . : Answer\r\n    AAAA Record . . . . . : 2001:db8:%x:%x::%x\r\n\r\n",
+                recordName, ttl, Pick(random, 0xFFFF), Pick(random, 0xFFFF), Pick(random, 0xFFFF));
+        }
+        else {
+            snprintf(line, sizeof(line),
+                "    Record Name . . . . . : %s\r\n    Record Type . . . . . : 1\r\n"
+                "    Time To Live  . . . . : %u\r\n    Data Length . . . . . : 4\r\n"
+                "    Section . . . . . . . : Answer\r\n    A (Host) Record . . . : 10.%u.%u.%u\r\n\r\n",
+                recordName, ttl, Pick(random, 256), Pick(random, 256), Pick(random, 256));
+        }
+        out += line;
+        out += "\r\n";
+    }
+    return out;
+}
+
+static bool WriteFile(const std::string& path, const std::string& contents) {
+    FILE* file = nullptr;
+#ifdef _WIN32
+    fopen_s(&file, path.c_str(), "wb");
+#else
+    file = fopen(path.c_str(), "wb");
+#endif
+    if (!file) return false;
+    bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+    return ok;
+}
+
+static bool ReadFile(const std::string& path, std::string& contents) {
+    FILE* file = nullptr;
+#ifdef _WIN32
+    fopen_s(&file, path.c_str(), "rb");
+#else
+    file = fopen(path.c_str(), "rb");
+#endif
+    if (!file) return false;
+    char buffer[65536];
+    size_t length;
+    contents.clear();
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, length);
+    }
+    fclose(file);
+    return true;
+}
+
+// The parser ParseDNSCache() used before streaming: fgets into a 1 KB
+// buffer, a std::string per line, a find() chain, and two entry copies.
+// Kept here as the baseline the streaming parser is measured against.
+struct LegacyEntry {
+    std::string hostname;
+    std::string recordType;
+    std::string ipAddress;
+    int ttl;
+};
+
+static size_t LegacyParse(const std::string& path) {
+    FILE* file = nullptr;
+#ifdef _WIN32
+    fopen_s(&file, path.c_str(), "r");
+#else
+    file = fopen(path.c_str(), "r");
+#endif
+    if (!file) return 0;
+
+    std::vector<LegacyEntry> entries;
+    char line[1024];
+    LegacyEntry currentEntry;
+    bool inEntry = false;
+
+    auto trimmedValue = [](const std::string& lineStr) {
+        std::string value = lineStr.substr(lineStr.find(':') + 1);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t") + 1);
+        return value;
+    };
+
+    while (fgets(line, sizeof(line), file)) {
+        std::string lineStr(line);
+        if (!lineStr.empty() && lineStr.back() == '\n') lineStr.pop_back();
+        if (!lineStr.empty() && lineStr.back() == '\r') lineStr.pop_back();
+        if (lineStr.empty() || lineStr.find("Windows IP Configuration") != std::string::npos) continue;
+
+        if (lineStr.find("-------") != std::string::npos) {
+            if (inEntry && !currentEntry.hostname.empty()) entries.push_back(currentEntry);
+            currentEntry = LegacyEntry();
+            inEntry = true;
+            continue;
+        }
+        if (!inEntry) continue;
+
+        if (lineStr.find("Record Name") != std::string::npos) {
+            currentEntry.hostname = trimmedValue(lineStr);
+        }
+        else if (lineStr.find("Record Type") != std::string::npos) {
+            currentEntry.recordType = trimmedValue(lineStr);
+        }
+        else if (lineStr.find("Time To Live") != std::string::npos) {
+            currentEntry.ttl = atoi(trimmedValue(lineStr).c_str());
+        }
+        else if (lineStr.find("A (Host) Record") != std::string::npos) {
+            currentEntry.ipAddress = trimmedValue(lineStr);
+        }
+    }
+    if (inEntry && !currentEntry.hostname.empty()) entries.push_back(currentEntry);
+    fclose(file);
+
+    std::vector<LegacyEntry> filteredEntries;
+    std::map<std::string, bool> seenHosts;
+    for (const auto& entry : entries) {
+        if (entry.recordType == "1" || entry.recordType.find("A") != std::string::npos) {
+            if (!entry.hostname.empty() && !entry.ipAddress.empty() && seenHosts.find(entry.hostname) == seenHosts.end()) {
+                seenHosts[entry.hostname] = true;
+                LegacyEntry newEntry = entry;
+                filteredEntries.push_back(newEntry);
+            }
+        }
+    }
+    return filteredEntries.size();
+}
+
+// Parser throughput: legacy baseline, streaming from memory, streaming from a file
+static void BenchParse(const BenchOptions& options) {
+    std::string dump;
+    std::string path = options.input.empty() ? options.dumpPath : options.input;
+
+    if (options.input.empty()) {
+        dump = GenerateDisplayDns(options.records, 12345);
+        if (!WriteFile(path, dump)) {
+            printf("Cannot write %s\n", path.c_str());
+            return;
+        }
+    }
+    else if (!ReadFile(path, dump)) {
+        printf("Cannot read %s\n", path.c_str());
+        return;
+    }
+
+    double megabytes = dump.size() / (1024.0 * 1024.0);
+    uint64_t records = 0;
+    auto count = [&](const CacheRecord&) { records++; };
+
+    size_t legacyEntries = 0;
+    double legacy = BestOf(options.repeats, [&] { legacyEntries = LegacyParse(path); });
+    Report("parse.legacy", legacyEntries, megabytes, legacy);
+
+    double memory = BestOf(options.repeats, [&] {
+        records = 0;
+        DisplayDnsParser parser(count);
+        for (size_t offset = 0; offset < dump.size(); offset += 64 * 1024) {
+            size_t length = dump.size() - offset < 64 * 1024 ? dump.size() - offset : 64 * 1024;
+            parser.Feed(dump.data() + offset, length);
+        }
+        parser.Finish();
+    });
+    Report("parse.stream_memory", records, megabytes, memory);
+
+    double file = BestOf(options.repeats, [&] {
+        records = 0;
+        ParseDisplayDnsFile(path.c_str(), count);
+    });
+    Report("parse.stream_file", records, megabytes, file);
+
+    if (options.input.empty() && !options.keepDump) {
+        remove(path.c_str());
+    }
+}
+
+// Print one storage result: name, entries, live megabytes, bytes per entry
+static void ReportMemory(const char* name, uint64_t entries, size_t bytes) {
+    printf("%-24s  %10llu  %9.1f  %9s  %14s  %9.1f B/entry\n", name, (unsigned long long)entries,
+        bytes / (1024.0 * 1024.0), "", "", entries > 0 ? (double)bytes / entries : 0.0);
+    AddResult(name, { { "records", (double)entries }, { "megabytes", bytes / (1024.0 * 1024.0) },
+        { "bytes_per_entry", entries > 0 ? (double)bytes / entries : 0.0 } });
+}
+
+// The entry layout the monitor used before EntryTable: three heap strings
+// per entry plus a string-keyed index (hostname + '/' + record type).
+struct LegacyCacheEntry {
+    std::string hostname;
+    std::string recordType;
+    std::string ipAddress;
+    int ttl;
+    uint32_t lastResponseTime;
+    bool isReachable;
+    bool isStale;
+    bool probePending;
+    bool addressChanged;
+};
+
+struct LegacyCache {
+    std::vector<LegacyCacheEntry> entries;
+    std::unordered_map<std::string, size_t> index;
+};
+
+static void LegacyAdd(LegacyCache& cache, const CacheRecord& record) {
+    std::string key = std::string(record.name) + '/' + std::to_string(record.type);
+    if (cache.index.count(key)) return;
+    cache.index.emplace(key, cache.entries.size());
+
+    LegacyCacheEntry entry;
+    entry.hostname.assign(record.name.data(), record.name.size());
+    entry.recordType = std::to_string(record.type);
+    entry.ipAddress.assign(record.data.data(), record.data.size());
+    entry.ttl = (int)record.ttl;
+    entry.lastResponseTime = 0;
+    entry.isReachable = false;
+    entry.isStale = record.ttl == 0;
+    entry.probePending = false;
+    entry.addressChanged = false;
+    cache.entries.push_back(std::move(entry));
+}
+
+static void TableAdd(EntryTable& table, const CacheRecord& record) {
+    RecordKind kind = RecordKindFromType(record.type);
+    size_t row;
+    PackedAddress address;
+    if (table.Find(record.name, kind, row) || !PackAddress(record.data, address)) return;
+    table.Add(record.name, kind, address, record.ttl);
+}
+
+// Feed a dump held in memory to a parser, keeping A and AAAA records
+static void ParseAddresses(const std::string& dump, const std::function<void(const CacheRecord&)>& add) {
+    DisplayDnsParser parser([&](const CacheRecord& record) {
+        if ((record.type == 1 || record.type == 28) && !record.data.empty()) add(record);
+    });
+    parser.Feed(dump.data(), dump.size());
+    parser.Finish();
+}
+
+// Entry storage: memory per entry, building from a parse, the stats pass
+// (flags and response times of every entry) and lookups by hostname
+static void BenchEntries(const BenchOptions& options) {
+    std::string dump;
+    if (options.input.empty()) {
+        dump = GenerateDisplayDns(options.records, 12345);
+    }
+    else if (!ReadFile(options.input, dump)) {
+        printf("Cannot read %s\n", options.input.c_str());
+        return;
+    }
+
+    size_t before = g_liveBytes;
+    LegacyCache legacy;
+    ParseAddresses(dump, [&](const CacheRecord& record) { LegacyAdd(legacy, record); });
+    size_t legacyBytes = g_liveBytes - before;
+
+    before = g_liveBytes;
+    EntryTable table;
+    ParseAddresses(dump, [&](const CacheRecord& record) { TableAdd(table, record); });
+    size_t tableBytes = g_liveBytes - before;
+
+    ReportMemory("entries.memory_legacy", legacy.entries.size(), legacyBytes);
+    ReportMemory("entries.memory_table", table.Size(), tableBytes);
+
+    double megabytes = dump.size() / (1024.0 * 1024.0);
+    double build = BestOf(options.repeats, [&] {
+        LegacyCache cache;
+        ParseAddresses(dump, [&](const CacheRecord& record) { LegacyAdd(cache, record); });
+    });
+    Report("entries.build_legacy", legacy.entries.size(), megabytes, build);
+    build = BestOf(options.repeats, [&] {
+        EntryTable fresh;
+        ParseAddresses(dump, [&](const CacheRecord& record) { TableAdd(fresh, record); });
+    });
+    Report("entries.build_table", table.Size(), megabytes, build);
+
+    // Same probe results in both layouts
+    std::mt19937 random(777);
+    for (size_t i = 0; i < legacy.entries.size(); i++) {
+        uint32_t responseTime = Pick(random, 400);
+        bool reachable = Pick(random, 10) != 0;
+        legacy.entries[i].lastResponseTime = responseTime;
+        legacy.entries[i].isReachable = reachable;
+        table.ResponseMs(i) = responseTime;
+        table.Flags(i) |= reachable ? ENTRY_REACHABLE : 0;
+    }
+
+    // The CalculateStats() pass
+    uint64_t checksum = 0;
+    double scan = BestOf(options.repeats * 10, [&] {
+        uint64_t reachable = 0, stale = 0, slow = 0, total = 0;
+        for (const auto& entry : legacy.entries) {
+            if (entry.isStale) stale++;
+            if (entry.isReachable) {
+                reachable++;
+                total += entry.lastResponseTime;
+                if (entry.lastResponseTime > 200) slow++;
+            }
+        }
+        checksum += reachable + stale + slow + total;
+    });
+    Report("entries.scan_legacy", legacy.entries.size(), legacy.entries.size() * sizeof(LegacyCacheEntry) / (1024.0 * 1024.0), scan);
+    scan = BestOf(options.repeats * 10, [&] {
+        uint64_t reachable = 0, stale = 0, slow = 0, total = 0;
+        for (size_t row = 0; row < table.Size(); row++) {
+            uint8_t flags = table.Flags(row);
+            if (flags & ENTRY_STALE) stale++;
+            if (flags & ENTRY_REACHABLE) {
+                uint32_t responseTime = table.ResponseMs(row);
+                reachable++;
+                total += responseTime;
+                if (responseTime > 200) slow++;
+            }
+        }
+        checksum -= reachable + stale + slow + total;
+    });
+    Report("entries.scan_table", table.Size(), table.Size() * (sizeof(uint32_t) + sizeof(uint8_t)) / (1024.0 * 1024.0), scan);
+
+    // CalculateStats() itself, every monitor cycle
+    double health = 0.0;
+    double stats = BestOf(options.repeats * 10, [&] { health += CountEntries(table, 200).HealthPercentage(); });
+    Report("stats.calculate", table.Size(), table.Size() * (sizeof(uint32_t) + sizeof(uint8_t)) / (1024.0 * 1024.0), stats);
+
+    // The same counts kept current per probe result, whole table and one suffix, read after every update
+    EntryTally tally(200);
+    tally.AddSuffix(table, "region3.example.com");
+    std::vector<std::pair<uint8_t, uint32_t>> updates;
+    for (size_t i = 0; i < 100000; i++) {
+        updates.push_back({ (uint8_t)(Pick(random, 10) != 0 ? ENTRY_REACHABLE : 0), Pick(random, 400) });
+    }
+    double read = 0.0;
+    double incremental = BestOf(options.repeats, [&] {
+        for (size_t i = 0; i < updates.size(); i++) {
+            size_t row = (i * 7919) % table.Size();
+            uint8_t oldFlags = table.Flags(row);
+            uint32_t oldResponseMs = table.ResponseMs(row);
+            table.Flags(row) = (oldFlags & ~ENTRY_REACHABLE) | updates[i].first;
+            table.ResponseMs(row) = updates[i].second;
+            tally.Update(table, row, oldFlags, oldResponseMs);
+            read += tally.Counts().avgResponseMs;
+        }
+    });
+    Report("stats.incremental", updates.size(), 0.0, incremental);
+    EntryCounts kept = tally.Counts();
+    EntryCounts recounted = CountEntries(table, 200);
+    if (kept.reachable != recounted.reachable || kept.slow != recounted.slow || kept.avgResponseMs != recounted.avgResponseMs ||
+        tally.SuffixCounts(0).total == 0 || read < 0) {
+        printf("stats: incremental and full counts disagree\n");
+    }
+
+    // Probe results are matched back to their entry by hostname
+    std::vector<std::string> names;
+    for (size_t i = 0; i < legacy.entries.size(); i += 7) {
+        names.push_back(legacy.entries[i].hostname);
+    }
+    size_t found = 0;
+    double lookup = BestOf(options.repeats, [&] {
+        for (const auto& name : names) {
+            found += legacy.index.count(name + "/1") + legacy.index.count(name + "/28");
+        }
+    });
+    Report("entries.lookup_legacy", names.size(), 0.0, lookup);
+    lookup = BestOf(options.repeats, [&] {
+        size_t row;
+        for (const auto& name : names) {
+            found += table.Find(name, RecordKind::A, row) + table.Find(name, RecordKind::AAAA, row);
+        }
+    });
+    Report("entries.lookup_table", names.size(), 0.0, lookup);
+
+    if (checksum != 0 || found % names.size() != 0) {
+        printf("entries: legacy and table disagree\n");
+    }
+}
+
+// name is suffix or a name under it
+static bool NameUnder(std::string_view name, std::string_view suffix) {
+    if (suffix.empty() || name == suffix) return true;
+    return name.size() > suffix.size() && name[name.size() - suffix.size() - 1] == '.' &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Filtered and sorted entry views: building the indexes after a refresh,
+// keeping them current per probe result, and finding a page of each kind of
+// view, against filtering and sorting the whole table for it
+static void BenchViews(const BenchOptions& options) {
+    std::string dump = GenerateDisplayDns(options.records, 12345);
+    EntryTable table;
+    ParseAddresses(dump, [&](const CacheRecord& record) { TableAdd(table, record); });
+    if (table.Size() == 0) return;
+
+    std::mt19937 random(4242);
+    for (size_t row = 0; row < table.Size(); row++) {
+        table.ResponseMs(row) = Pick(random, 400);
+        table.Flags(row) |= Pick(random, 10) != 0 ? ENTRY_REACHABLE : 0;
+        table.Flags(row) |= Pick(random, 20) == 0 ? ENTRY_STALE : 0;
+    }
+
+    EntryIndex index(200);
+    size_t before = g_liveBytes;
+    index.Rebuild(table);
+    ReportMemory("view.memory", table.Size(), g_liveBytes - before);
+    double rebuild = BestOf(options.repeats, [&] { index.Rebuild(table); });
+    Report("view.rebuild", table.Size(), 0.0, rebuild);
+
+    std::vector<std::pair<uint8_t, uint32_t>> updates;
+    for (size_t i = 0; i < 100000; i++) {
+        updates.push_back({ (uint8_t)(Pick(random, 10) != 0 ? ENTRY_REACHABLE : 0), Pick(random, 400) });
+    }
+    double update = BestOf(options.repeats, [&] {
+        for (size_t i = 0; i < updates.size(); i++) {
+            size_t row = (i * 7919) % table.Size();
+            uint8_t oldFlags = table.Flags(row);
+            uint32_t oldResponseMs = table.ResponseMs(row);
+            table.Flags(row) = (oldFlags & ~ENTRY_REACHABLE) | updates[i].first;
+            table.ResponseMs(row) = updates[i].second;
+            index.Update(table, row, oldFlags, oldResponseMs);
+        }
+    });
+    Report("view.update", updates.size(), 0.0, update);
+
+    struct ViewCase {
+        const char* name;
+        EntryFilter filter;
+        EntrySort sort;
+        const char* suffix;
+    };
+    const ViewCase cases[] = {
+        { "view.failing", EntryFilter::Failing, EntrySort::Cache, "" },
+        { "view.domain", EntryFilter::All, EntrySort::Cache, "region3.example.com" },
+        { "view.slowest", EntryFilter::All, EntrySort::Slowest, "" },
+        { "view.recent_failures", EntryFilter::All, EntrySort::RecentFailure, "" },
+        { "view.slow_domain", EntryFilter::Slow, EntrySort::Slowest, "region3.example.com" },
+    };
+    const int queries = 1000;
+    size_t mismatches = 0;
+    for (const ViewCase& view : cases) {
+        EntryView entryView;
+        entryView.filter = view.filter;
+        entryView.sort = view.sort;
+        entryView.suffix = view.suffix;
+
+        // First page, then the last page the view has
+        std::vector<uint32_t> rows;
+        size_t total = index.Query(table, entryView, 0, 8, rows);
+        size_t last = total > 8 ? (total - 1) / 8 * 8 : 0;
+        double first = BestOf(options.repeats, [&] {
+            for (int i = 0; i < queries; i++) {
+                rows.clear();
+                index.Query(table, entryView, 0, 8, rows);
+            }
+        });
+        double deep = BestOf(options.repeats, [&] {
+            for (int i = 0; i < queries; i++) {
+                rows.clear();
+                index.Query(table, entryView, last, 8, rows);
+            }
+        });
+
+        // What the list would cost without the indexes: test every row, then sort
+        std::vector<uint32_t> scanned;
+        double scan = BestOf(options.repeats, [&] {
+            scanned.clear();
+            for (size_t row = 0; row < table.Size(); row++) {
+                if ((view.filter == EntryFilter::All || index.Matches(view.filter, row)) && NameUnder(table.Hostname(row), view.suffix)) {
+                    scanned.push_back((uint32_t)row);
+                }
+            }
+            if (view.sort == EntrySort::Slowest) {
+                scanned.erase(std::remove_if(scanned.begin(), scanned.end(),
+                    [&](uint32_t row) { return !(table.Flags(row) & ENTRY_REACHABLE); }), scanned.end());
+                size_t ranked = (std::min)(scanned.size(), EntryIndex::TOP_K);
+                std::partial_sort(scanned.begin(), scanned.begin() + ranked, scanned.end(), [&](uint32_t a, uint32_t b) {
+                    return table.ResponseMs(a) != table.ResponseMs(b) ? table.ResponseMs(a) > table.ResponseMs(b) : a < b;
+                });
+                scanned.resize(ranked);
+            }
+        });
+        // A domain view in cache order goes zone by zone, so only these come out in the scan's order
+        if (view.sort == EntrySort::Slowest || (view.sort == EntrySort::Cache && view.suffix[0] == 0)) {
+            rows.clear();
+            index.Query(table, entryView, 0, scanned.size(), rows);
+            if (rows != scanned) mismatches++;
+        }
+
+        printf("%-24s  %10zu  entries   page %.2fus  last page %.2fus   full scan %.2fms\n", view.name, total,
+            first / queries * 1e6, deep / queries * 1e6, scan * 1e3);
+        AddResult(view.name, { { "entries", (double)total }, { "page_us", first / queries * 1e6 },
+            { "last_page_us", deep / queries * 1e6 }, { "scan_ms", scan * 1e3 } });
+    }
+    if (mismatches != 0) {
+        printf("view: index and scan disagree\n");
+    }
+}
+
+// The same synthetic cache as GenerateDisplayDns, in another resolver's dump
+// format: unbound's dump_cache, dnsmasq's SIGUSR1 dump as journalctl shows it,
+// or resolvectl show-cache
+static std::string GenerateCacheDump(CacheFormat format, int records, uint32_t seed) {
+    if (format == CacheFormat::DisplayDns) return GenerateDisplayDns(records, seed);
+
+    std::mt19937 random(seed);
+    std::string out;
+    std::string messages;           // unbound lists negative answers after the RRsets
+    out.reserve((size_t)records * 120);
+    time_t now = time(nullptr);
+    if (format == CacheFormat::Unbound) {
+        out += "START_RRSET_CACHE\n";
+    }
+    else if (format == CacheFormat::Dnsmasq) {
+        out += "dnsmasq[812]: cache size 150000, 0/0 cache insertions re-used unexpired cache entries.\n";
+        out += "dnsmasq[812]: Host                           Address                                  Flags      Expires\n";
+    }
+    else {
+        out += "Scope protocol=dns interface=eth0\n";
+    }
+
+    char line[512];
+    auto add = [&](const char* name, const char* type, unsigned ttl, const char* data) {
+        if (format == CacheFormat::Unbound) {
+            snprintf(line, sizeof(line), ";rrset %u 1 0 1 0\n%s.\t%u\tIN\t%s\t%s%s\n", ttl, name, ttl, type, data,
+                strcmp(type, "CNAME") == 0 ? "." : "");
+            out += line;
+            snprintf(line, sizeof(line), "msg %s. IN %s 33152 1 %u 0 1 0 0\n%s. IN %s 0\n", name, type, ttl, name, type);
+            messages += line;
+        }
+        else if (format == CacheFormat::Dnsmasq) {
+            time_t expires = now + ttl;
+            struct tm local;
+#ifdef _WIN32
+            localtime_s(&local, &expires);
+#else
+            localtime_r(&expires, &local);
+#endif
+            char when[32];
+            strftime(when, sizeof(when), "%a %b %e %H:%M:%S %Y", &local);
+            snprintf(line, sizeof(line), "dnsmasq[812]: %-30s %-40s %-10s %s\n", name, data,
+                strcmp(type, "A") == 0 ? "4F" : strcmp(type, "AAAA") == 0 ? "6F" : "CF", when);
+            out += line;
+        }
+        else {
+            snprintf(line, sizeof(line), "%s IN %s %s\n", name, type, data);
+            out += line;
+        }
+    };
+
+    for (int i = 0; i < records; i++) {
+        char host[128];
+        snprintf(host, sizeof(host), "host%d.svc%u.region%u.example.com", i, Pick(random, 500), Pick(random, 20));
+        unsigned kind = Pick(random, 100);
+        unsigned ttl = Pick(random, 86400);
+
+        if (kind >= 95) {
+            if (format == CacheFormat::Unbound) {
+                snprintf(line, sizeof(line), "msg %s. IN A 33155 1 %u 0 0 1 0\nexample.com. IN SOA 0\n", host, ttl);
+                messages += line;
+            }
+            else if (format == CacheFormat::Dnsmasq) {
+                snprintf(line, sizeof(line), "dnsmasq[812]: %-30s %-40s %-10s\n", host, "", "4F   NX");
+                out += line;
+            }
+            else {
+                snprintf(line, sizeof(line), "%s IN A NXDOMAIN\n", host);
+                out += line;
+            }
+            continue;
+        }
+
+        const char* recordName = host;
+        char alias[160];
+        if (kind >= 85) {
+            snprintf(alias, sizeof(alias), "edge%u.cdn.example.net", Pick(random, 5000));
+            add(host, "CNAME", ttl, alias);
+            recordName = alias;
+        }
+
+        char address[64];
+        if (kind >= 70 && kind < 85) {
+            snprintf(address, sizeof(address), "2001:db8:%x:%x::%x", Pick(random, 0xFFFF), Pick(random, 0xFFFF),
+                Pick(random, 0xFFFF));
+            add(recordName, "AAAA", ttl, address);
+        }
+        else {
+            snprintf(address, sizeof(address), "10.%u.%u.%u", Pick(random, 256), Pick(random, 256), Pick(random, 256));
+            add(recordName, "A", ttl, address);
+        }
+    }
+
+    if (format == CacheFormat::Unbound) {
+        out += "END_RRSET_CACHE\nSTART_MSG_CACHE\n";
+        out += messages;
+        out += "END_MSG_CACHE\nEOF\n";
+    }
+    return out;
+}
+
+// Every cache source backend reading the same synthetic cache from a file
+// into an EntryTable, as the monitor's parser thread does: throughput, the
+// heap at its highest during the read against what the finished table
+// keeps, and how soon the first partial snapshot's worth of entries is there
+static void BenchSources(const BenchOptions& options) {
+    for (CacheFormat format : { CacheFormat::DisplayDns, CacheFormat::Unbound, CacheFormat::Dnsmasq, CacheFormat::Resolved }) {
+        std::string path = options.dumpPath + "." + CacheFormatName(format);
+        size_t dumpBytes;
+        {
+            std::string dump = GenerateCacheDump(format, options.records, 12345);
+            dumpBytes = dump.size();
+            if (!WriteFile(path, dump)) {
+                printf("Cannot write %s\n", path.c_str());
+                return;
+            }
+        }
+
+        FileCacheSource source(format, path);
+        size_t entries = 0;
+        size_t peakBytes = 0;
+        size_t tableBytes = 0;
+        double firstMs = 1e30;
+        double seconds = BestOf(options.repeats, [&] {
+            size_t before = g_liveBytes;
+            g_peakBytes = before;
+            auto start = Clock::now();
+            EntryTable table;
+            source.Read([&](const CacheRecord& record) {
+                size_t rows = table.Size();
+                AddCacheRecord(table, record);
+                if (rows < SOURCE_FIRST_ROWS && table.Size() == SOURCE_FIRST_ROWS) {
+                    firstMs = (std::min)(firstMs, std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+                }
+            }, nullptr);
+            entries = table.Size();
+            peakBytes = g_peakBytes - before;
+            tableBytes = g_liveBytes - before;
+        });
+
+        if (entries < SOURCE_FIRST_ROWS) firstMs = 0;
+        char name[64];
+        snprintf(name, sizeof(name), "source.%s", CacheFormatName(format));
+        double megabytes = dumpBytes / (1024.0 * 1024.0);
+        uint64_t records = source.LastRead().records;
+        printf("%-24s  %10llu  %9.1f  %9.4f  %9.1f MB/s  %11.0f rec/s   %zu entries, peak heap %.1f MB (table %.1f MB), "
+            "first %zu after %.1fms\n", name, (unsigned long long)records, megabytes, seconds, megabytes / seconds,
+            records / seconds, entries, peakBytes / (1024.0 * 1024.0), tableBytes / (1024.0 * 1024.0), SOURCE_FIRST_ROWS,
+            firstMs);
+        AddResult(name, { { "records", (double)records }, { "megabytes", megabytes }, { "seconds", seconds },
+            { "records_per_sec", records / seconds }, { "entries", (double)entries },
+            { "peak_heap_megabytes", peakBytes / (1024.0 * 1024.0) }, { "table_megabytes", tableBytes / (1024.0 * 1024.0) },
+            { "first_entries_ms", firstMs } });
+
+        if (!options.keepDump) {
+            remove(path.c_str());
+        }
+    }
+}
+
+// Stand-in resolver on a virtual clock. It answers one query at a time at a
+// fixed capacity, so latency is a base cost plus queueing delay; between
+// slowStart and slowEnd its capacity drops by slowdown, as an overloaded
+// upstream's would.
+struct SimulatedResolver {
+    double capacity = 200.0;        // Queries per second when healthy
+    double baseMs = 15.0;
+    double slowdown = 25.0;
+    double slowStart = 30.0;        // Seconds
+    double slowEnd = 60.0;
+    double busyUntil = 0.0;
+
+    // Milliseconds until a query sent at time t is answered
+    double Query(double t) {
+        double rate = t >= slowStart && t < slowEnd ? capacity / slowdown : capacity;
+        busyUntil = (std::max)(t, busyUntil) + 1.0 / rate;
+        return (busyUntil - t) * 1000.0 + baseMs;
+    }
+};
+
+struct RateRun {
+    int sent = 0;
+    int timeouts = 0;
+    int slowSent = 0;               // During the slowdown
+    int slowTimeouts = 0;
+    double backoffAfter = -1.0;     // Seconds from slowStart to the first decrease
+    double recoveredAfter = -1.0;   // Seconds from slowEnd until the rate is back where it was
+    int errors = 0;                 // Probes failed by the resolver
+    double lowestRate = 0.0;        // After the first 20 seconds' ramp up
+    double finalRate = 0.0;
+};
+
+// Drive a resolver with the monitor's pacing for 90 virtual seconds: the
+// adaptive controller, or a fixed rate and window as the monitor used before.
+// With failEvery, the resolver never slows down but fails every failEvery-th
+// probe at once, as getaddrinfo does for a cached NXDOMAIN; the results are
+// recorded the way CollectProbeResults() does.
+static RateRun SimulateRate(bool adaptive, int failEvery = 0) {
+    const double step = 0.01;
+    const double deadlineMs = 3000.0;
+    SimulatedResolver resolver;
+    if (failEvery > 0) {
+        resolver.slowdown = 1.0;
+    }
+    AdaptiveRateConfig config;
+    config.maxRate = 50.0;
+    config.maxWindow = 32;
+    config.latencyTarget = 200;
+    config.cooldown = std::chrono::milliseconds((int)deadlineMs);
+
+    Clock::time_point origin = Clock::now();
+    auto at = [&](double t) { return origin + std::chrono::microseconds((long long)(t * 1e6)); };
+    AdaptiveRate control(config, origin);
+    TokenBucket bucket(adaptive ? control.Rate() : config.maxRate, config.maxWindow);
+    bucket.TryTake(origin);
+
+    // Completion time and latency of every query in flight; a failure has PROBE_TIMEOUT as latency
+    typedef std::pair<double, double> Pending;
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>> inFlight;
+    RateRun run;
+    double healthyRate = 0.0;
+    for (double t = 0.0; t < 90.0; t += step) {
+        auto now = at(t);
+        while (!inFlight.empty() && inFlight.top().first <= t) {
+            if (inFlight.top().second == (double)PROBE_TIMEOUT) {
+                control.RecordError();
+            }
+            else {
+                control.Record((uint32_t)inFlight.top().second, inFlight.top().second >= deadlineMs);
+            }
+            inFlight.pop();
+        }
+        if (adaptive && control.Update(now)) {
+            bucket.SetRate(control.Rate(), now);
+            if (control.Trend() == RateTrend::Decrease && t >= resolver.slowStart && run.backoffAfter < 0) {
+                run.backoffAfter = t - resolver.slowStart;
+            }
+        }
+        if (t < resolver.slowStart) {
+            healthyRate = control.Rate();
+        }
+        else if (t >= resolver.slowEnd && run.recoveredAfter < 0 && control.Rate() >= healthyRate * 0.9) {
+            run.recoveredAfter = t - resolver.slowEnd;
+        }
+        if (t >= 20.0 && (run.lowestRate == 0.0 || control.Rate() < run.lowestRate)) {
+            run.lowestRate = control.Rate();
+        }
+
+        int window = adaptive ? control.Window() : config.maxWindow;
+        while ((int)inFlight.size() < window && bucket.TryTake(now)) {
+            double latency = (std::min)(resolver.Query(t), deadlineMs);
+            bool slow = t >= resolver.slowStart && t < resolver.slowEnd;
+            if (failEvery > 0 && (run.sent + 1) % failEvery == 0) {
+                inFlight.push({ t + resolver.baseMs / 1000.0, (double)PROBE_TIMEOUT });
+                run.sent++;
+                run.errors++;
+                continue;
+            }
+            run.sent++;
+            run.slowSent += slow;
+            run.timeouts += latency >= deadlineMs;
+            run.slowTimeouts += slow && latency >= deadlineMs;
+            inFlight.push({ t + latency / 1000.0, latency });
+        }
+    }
+    run.finalRate = control.Rate();
+    return run;
+}
+
+// Probe pacing against a resolver that slows down 25-fold for 30 seconds:
+// how much load and how many timeouts each policy causes, and how quickly
+// the adaptive one backs off and recovers; then that failed probes alone do
+// not back it off
+static void BenchRateControl() {
+    for (bool adaptive : { false, true }) {
+        RateRun run = SimulateRate(adaptive);
+        printf("%-24s  %10d  sent, %d during slowdown   %d timeouts (%.1f%% of slowdown probes)",
+            adaptive ? "rate.adaptive" : "rate.fixed", run.sent, run.slowSent, run.timeouts,
+            run.slowSent > 0 ? 100.0 * run.slowTimeouts / run.slowSent : 0.0);
+        if (adaptive) {
+            printf("   backed off after %.1fs, recovered %.1fs after", run.backoffAfter, run.recoveredAfter);
+        }
+        printf("\n");
+        AddResult(adaptive ? "rate.adaptive" : "rate.fixed", { { "sent", (double)run.sent },
+            { "slowdown_sent", (double)run.slowSent }, { "timeouts", (double)run.timeouts },
+            { "slowdown_timeouts", (double)run.slowTimeouts }, { "backoff_seconds", run.backoffAfter },
+            { "recovery_seconds", run.recoveredAfter } });
+    }
+
+    // A healthy resolver, one probe in 20 failing: the rate should climb to the ceiling and stay
+    RateRun run = SimulateRate(true, 20);
+    printf("%-24s  %10d  sent, %d failed   rate %.1f/s at the end, lowest %.1f/s after ramp up\n", "rate.failing",
+        run.sent, run.errors, run.finalRate, run.lowestRate);
+    AddResult("rate.failing", { { "sent", (double)run.sent }, { "errors", (double)run.errors },
+        { "final_rate", run.finalRate }, { "lowest_rate", run.lowestRate } });
+}
+
+// Value at fraction (0..1) of an ascending list, nearest rank
+static double Percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) return 0.0;
+    return sorted[(size_t)(fraction * (sorted.size() - 1) + 0.5)];
+}
+
+// Direct probes through DnsClient against a local stand-in resolver with
+// the configured latency and loss: how many probes a second the client
+// sustains and the latency it measures
+static void BenchProbes(const BenchOptions& options) {
+    FakeDnsServer server(options.resolver);
+    if (!server.Start()) {
+        printf("Cannot start the stand-in resolver\n");
+        return;
+    }
+    DnsClientConfig config;
+    config.server = server.Address();
+    config.deadlineMs = 1000;
+    config.maxInFlight = options.inFlight;
+    DnsClient client(config);
+    if (!client.Start()) {
+        printf("Cannot reach the stand-in resolver at %s\n", config.server.c_str());
+        return;
+    }
+
+    std::vector<std::string> names;
+    names.reserve(options.probes);
+    for (int i = 0; i < options.probes; i++) {
+        names.push_back("host" + std::to_string(i) + ".bench.example.com");
+    }
+
+    std::vector<DnsQueryResult> results;
+    results.reserve(options.probes);
+    auto start = Clock::now();
+    for (int i = 0; i < options.probes; i++) {
+        client.Submit((size_t)i, names[i], DNS_TYPE_A);
+    }
+    while (results.size() < (size_t)options.probes) {
+        if (client.Wait(results, config.deadlineMs * 2) == 0 && client.Pending() == 0) break;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> latencies;
+    uint64_t timeouts = 0;
+    uint64_t errors = 0;
+    for (const auto& result : results) {
+        if (result.status == DnsQueryStatus::Ok) {
+            latencies.push_back(result.responseTime);
+        }
+        else if (result.status == DnsQueryStatus::Timeout) {
+            timeouts++;
+        }
+        else {
+            errors++;
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double rate = seconds > 0 ? results.size() / seconds : 0.0;
+    double p50 = Percentile(latencies, 0.50);
+    double p99 = Percentile(latencies, 0.99);
+    printf("%-24s  %10zu  probes in %.2fs, %.0f/s   p50 %.0fms  p99 %.0fms   %llu timeouts, %llu errors\n",
+        "probe.direct", results.size(), seconds, rate, p50, p99, (unsigned long long)timeouts, (unsigned long long)errors);
+    AddResult("probe.direct", { { "probes", (double)results.size() }, { "seconds", seconds }, { "probes_per_sec", rate },
+        { "p50_ms", p50 }, { "p99_ms", p99 }, { "timeouts", (double)timeouts }, { "errors", (double)errors } });
+}
+
+// The getaddrinfo engine driven through its ResolveFn by a stub resolver.
+// First a stub that answers after a fixed delay: probes a second should
+// come out at concurrency over that delay, and p99 at the delay. Then a
+// stub that blocks for good on some names: each must be reported as
+// Timeout within the deadline, and while they stay stuck, threads must
+// stop at maxConcurrency plus maxAbandoned with the rest left queued.
+static const int ENGINE_PROBES = 1000;
+static const int ENGINE_STUB_MS = 20;
+static const int ENGINE_CONCURRENCY = 16;
+static const int ENGINE_STUCK = 48;
+static const uint32_t ENGINE_DEADLINE_MS = 200;
+static const int ENGINE_MAX_ABANDONED = 8;
+
+static void BenchEngine() {
+    {
+        ProbeEngineConfig config;
+        config.maxConcurrency = ENGINE_CONCURRENCY;
+        config.deadlineMs = 1000;
+        ProbeEngine engine(config, [](const std::string&, ProbeFamily) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ENGINE_STUB_MS));
+            return true;
+        });
+
+        std::vector<ProbeResult> results;
+        results.reserve(ENGINE_PROBES);
+        auto start = Clock::now();
+        for (int i = 0; i < ENGINE_PROBES; i++) {
+            engine.Submit((size_t)i, "host" + std::to_string(i) + ".bench.example.com");
+        }
+        while (results.size() < (size_t)ENGINE_PROBES) {
+            if (engine.Wait(results, config.deadlineMs * 2) == 0 && engine.Pending() == 0) break;
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<double> latencies;
+        uint64_t timeouts = 0;
+        for (const auto& result : results) {
+            if (result.outcome == ProbeOutcome::Ok) {
+                latencies.push_back(result.responseTime);
+            }
+            else {
+                timeouts++;
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        double rate = seconds > 0 ? results.size() / seconds : 0.0;
+        double expected = ENGINE_CONCURRENCY * 1000.0 / ENGINE_STUB_MS;
+        double p50 = Percentile(latencies, 0.50);
+        double p99 = Percentile(latencies, 0.99);
+        printf("%-24s  %10zu  probes in %.2fs, %.0f/s of %.0f/s   p50 %.0fms  p99 %.0fms of %dms   %llu timeouts\n",
+            "engine.resolve", results.size(), seconds, rate, expected, p50, p99, ENGINE_STUB_MS, (unsigned long long)timeouts);
+        AddResult("engine.resolve", { { "probes", (double)results.size() }, { "seconds", seconds }, { "probes_per_sec", rate },
+            { "expected_per_sec", expected }, { "p50_ms", p50 }, { "p99_ms", p99 }, { "stub_ms", (double)ENGINE_STUB_MS },
+            { "timeouts", (double)timeouts } });
+    }
+
+    // Stuck lookups block until released; the stub counts the threads inside it
+    std::mutex stubLock;
+    std::condition_variable stubWake;
+    bool released = false;
+    int inside = 0;
+    int peakInside = 0;
+    std::vector<Clock::time_point> startedAt(ENGINE_STUCK);
+    ResolveFn stuck = [&](const std::string& hostname, ProbeFamily) {
+        std::unique_lock<std::mutex> lock(stubLock);
+        startedAt[(size_t)atoi(hostname.c_str() + 5)] = Clock::now();   // "stuckN.bench.example.com"
+        peakInside = (std::max)(peakInside, ++inside);
+        stubWake.wait(lock, [&] { return released; });
+        inside--;
+        stubWake.notify_all();
+        return true;
+    };
+
+    std::vector<ProbeResult> results;
+    double lateMs = 0.0;
+    int stalled = 0;
+    uint64_t lateReturns = 0;
+    {
+        ProbeEngineConfig config;
+        config.maxConcurrency = ENGINE_CONCURRENCY;
+        config.deadlineMs = ENGINE_DEADLINE_MS;
+        config.maxAbandoned = ENGINE_MAX_ABANDONED;
+        ProbeEngine engine(config, stuck);
+        for (int i = 0; i < ENGINE_STUCK; i++) {
+            engine.Submit((size_t)i, "stuck" + std::to_string(i) + ".bench.example.com");
+        }
+
+        // Several deadlines with nothing returning: every admitted probe times out
+        auto until = Clock::now() + std::chrono::milliseconds(ENGINE_DEADLINE_MS * 5);
+        std::vector<ProbeResult> batch;
+        while (Clock::now() < until) {
+            batch.clear();
+            engine.Wait(batch, ENGINE_DEADLINE_MS / 4);
+            auto now = Clock::now();
+            std::lock_guard<std::mutex> lock(stubLock);
+            for (const auto& result : batch) {
+                double ms = std::chrono::duration<double, std::milli>(now - startedAt[result.id]).count();
+                lateMs = (std::max)(lateMs, ms - ENGINE_DEADLINE_MS);
+                results.push_back(result);
+            }
+        }
+        stalled = engine.GetStats().queued;
+
+        // Let the stuck threads go; they pick up what was left queued
+        {
+            std::lock_guard<std::mutex> lock(stubLock);
+            released = true;
+        }
+        stubWake.notify_all();
+        while (results.size() < (size_t)ENGINE_STUCK) {
+            if (engine.Wait(results, ENGINE_DEADLINE_MS * 2) == 0 && engine.Pending() == 0) break;
+        }
+        lateReturns = engine.GetStats().lateReturns;
+    }
+
+    // Workers outlive the engine; wait for them to leave the stub before its state goes
+    {
+        std::unique_lock<std::mutex> lock(stubLock);
+        stubWake.wait(lock, [&] { return inside == 0; });
+    }
+
+    uint64_t timeouts = 0;
+    for (const auto& result : results) {
+        timeouts += result.outcome == ProbeOutcome::Timeout;
+    }
+    int threadCap = ENGINE_CONCURRENCY + ENGINE_MAX_ABANDONED;
+    printf("%-24s  %10llu  timeouts, at most %.0fms past the %lums deadline   %d threads stuck at most (cap %d), %d left queued"
+        "   %llu returned late\n", "engine.stuck", (unsigned long long)timeouts, lateMs, (unsigned long)ENGINE_DEADLINE_MS,
+        peakInside, threadCap, stalled, (unsigned long long)lateReturns);
+    AddResult("engine.stuck", { { "timeouts", (double)timeouts }, { "late_ms", lateMs }, { "deadline_ms", (double)ENGINE_DEADLINE_MS },
+        { "peak_threads", (double)peakInside }, { "thread_cap", (double)threadCap }, { "queued", (double)stalled },
+        { "late_returns", (double)lateReturns } });
+}
+
+// Cache snooping against a caching stand-in that holds most of the names,
+// some with a newer copy or another address than the local cache: the RD=0
+// queries of SnoopResolverCache(), checked against what was planted, then
+// the same names as recursive direct probes, which make the stand-in
+// resolve every name it did not hold
+static void BenchSnoop(const BenchOptions& options) {
+    FakeDnsConfig resolverConfig = options.resolver;
+    resolverConfig.caching = true;
+    resolverConfig.lossRate = 0.0;
+    resolverConfig.failRate = 0.0;
+    resolverConfig.missMs = SNOOP_MISS_MS;
+    FakeDnsServer server(resolverConfig);
+
+    std::mt19937 random(9090);
+    std::vector<SnoopTarget> targets;
+    int expectCached = 0, expectNewer = 0, expectMoved = 0;
+    for (int i = 0; i < options.probes; i++) {
+        SnoopTarget target;
+        target.hostname = "host" + std::to_string(i) + ".snoop.example.com";
+        target.type = DNS_TYPE_A;
+        target.cachedTtl = 30 + Pick(random, 200);
+        unsigned kind = Pick(random, 20);
+        // 6 in 20 expired upstream, 1 fetched again upstream since, 1 moved, the rest the same copy
+        if (kind >= 6) {
+            bool newer = kind == 6;
+            bool moved = kind == 7;
+            server.Prime(target.hostname, newer ? resolverConfig.ttl : target.cachedTtl, moved);
+            expectCached++;
+            expectNewer += newer;
+            expectMoved += moved;
+        }
+        // The address the stand-in gives the name, as FakeDnsServer derives it
+        uint32_t hash = 2166136261u;
+        for (char c : target.hostname) {
+            hash = (hash ^ (uint8_t)c) * 16777619u;
+        }
+        target.cachedAddress = "10." + std::to_string((hash >> 16) & 255) + "." + std::to_string((hash >> 8) & 255) + "." +
+            std::to_string(hash & 255);
+        targets.push_back(target);
+    }
+    if (!server.Start()) {
+        printf("Cannot start the stand-in resolver\n");
+        return;
+    }
+
+    CacheSnoopConfig config;
+    config.server = server.Address();
+    config.deadlineMs = 1000;
+    config.batchSize = options.inFlight;
+    config.queriesPerSecond = 0.0;
+    CacheSnoopReport report = SnoopResolverCache(targets, config);
+    uint64_t resolvedBySnoop = server.Stats().resolved;
+    double rate = report.seconds > 0 ? report.queries / report.seconds : 0.0;
+    printf("%-24s  %10d  queries in %.2fs, %.0f/s   %d cached, %d not cached, %d newer upstream, %d moved   %llu resolves\n",
+        "snoop.rd0", report.queries, report.seconds, rate, report.cached, report.notCached, report.upstreamNewer,
+        report.addressMismatches, (unsigned long long)resolvedBySnoop);
+    AddResult("snoop.rd0", { { "queries", (double)report.queries }, { "seconds", report.seconds }, { "queries_per_sec", rate },
+        { "cached", (double)report.cached }, { "not_cached", (double)report.notCached }, { "resolves", (double)resolvedBySnoop } });
+    if (!report.usable || report.cached != expectCached || report.upstreamNewer != expectNewer ||
+        report.addressMismatches != expectMoved || report.timeouts + report.errors + report.refused + report.negative != 0) {
+        printf("snoop: classification disagrees with the stand-in's cache (expected %d cached, %d newer, %d moved)\n",
+            expectCached, expectNewer, expectMoved);
+    }
+
+    // The same check made with recursive probes
+    DnsClientConfig clientConfig;
+    clientConfig.server = server.Address();
+    clientConfig.deadlineMs = 1000;
+    clientConfig.maxInFlight = options.inFlight;
+    DnsClient client(clientConfig);
+    if (!client.Start()) return;
+    std::vector<DnsQueryResult> results;
+    auto start = Clock::now();
+    for (size_t i = 0; i < targets.size(); i++) {
+        client.Submit(i, targets[i].hostname, DNS_TYPE_A);
+    }
+    while (results.size() < targets.size()) {
+        if (client.Wait(results, clientConfig.deadlineMs * 2) == 0 && client.Pending() == 0) break;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t resolved = server.Stats().resolved - resolvedBySnoop;
+    rate = seconds > 0 ? results.size() / seconds : 0.0;
+    printf("%-24s  %10zu  queries in %.2fs, %.0f/s   %llu resolves\n", "snoop.recursive", results.size(), seconds, rate,
+        (unsigned long long)resolved);
+    AddResult("snoop.recursive", { { "queries", (double)results.size() }, { "seconds", seconds }, { "queries_per_sec", rate },
+        { "resolves", (double)resolved } });
+}
+
+// Where frames go in the render benchmark, so its cost is building,
+// diffing and encoding them rather than a terminal drawing them
+#ifdef _WIN32
+static const char* NULL_DEVICE = "NUL";
+#else
+static const char* NULL_DEVICE = "/dev/null";
+#endif
+
+// One probed row of the dashboard
+struct BenchRow {
+    std::string hostname;
+    std::string address;
+    uint32_t ttl;
+    uint32_t responseMs;
+};
+
+static uint8_t BenchColor(uint32_t responseMs) {
+    return responseMs <= 50 ? 10 : responseMs <= 200 ? 14 : 12;
+}
+
+// The monitor's dashboard layout: title, health panel, one page of
+// entries and the controls, with the numbers that change every cycle
+static void DrawBenchFrame(FrameBuffer& frame, int frameNumber, const std::vector<BenchRow>& rows, const EntryCounts& counts) {
+    frame.SetColor(11);
+    frame.Print("========================================================================================\n");
+    frame.Print("                     DNS CACHE HEALTH MONITOR - %02d:%02d:%02d                     \n",
+        frameNumber / 3600 % 24, frameNumber / 60 % 60, frameNumber % 60);
+    frame.Print("========================================================================================\n\n");
+
+    frame.SetColor(13);
+    frame.Print("CACHE HEALTH ANALYSIS:\n");
+    frame.SetColor(8);
+    frame.Print("----------------------------------------------------------------------------------------\n");
+    frame.SetColor(15);
+    frame.Print("Entries: %d  Reachable: %d  Stale: %d  Timeouts: %d  Slow: %d  Changed: %d  NXDOMAIN: %d\n",
+        counts.total, counts.reachable, counts.stale, counts.timeouts, counts.slow, counts.changed, counts.negative);
+    frame.Print("Health: ");
+    frame.SetColor(10);
+    frame.Print("%.1f%% EXCELLENT", counts.HealthPercentage());
+    frame.SetColor(15);
+    frame.Print("   Avg Response: ");
+    frame.SetColor(BenchColor((uint32_t)counts.avgResponseMs));
+    frame.Print("%.1fms\n", counts.avgResponseMs);
+    frame.SetColor(15);
+    frame.Print("Probes: %.1f/s   In Flight: %d   Queued: %d   p50: %lums   p95: %lums   p99: %lums\n\n",
+        48.0 + frameNumber % 5, frameNumber % 32, frameNumber % 7, 12ul, 40ul, 180ul + frameNumber % 20);
+
+    frame.SetColor(13);
+    frame.Print("DNS CACHE ENTRIES (Page 1 of %d):\n", (counts.total + 7) / 8);
+    frame.SetColor(8);
+    frame.Print("----------------------------------------------------------------------------------------\n");
+    frame.SetColor(15);
+    frame.Print("%-8s  %-28s  %-24s  TTL    Response   p99\n", "Status", "Hostname", "Address");
+    for (const auto& row : rows) {
+        frame.SetColor(BenchColor(row.responseMs));
+        frame.Print("%-8s  ", row.responseMs <= 50 ? "Fast" : row.responseMs <= 200 ? "Ok" : "Slow");
+        frame.SetColor(15);
+        frame.Print("%-28.28s  ", row.hostname.c_str());
+        frame.SetColor(11);
+        frame.Print("%-24s  ", row.address.c_str());
+        frame.SetColor(15);
+        frame.Print("%4lu   ", (unsigned long)row.ttl);
+        frame.SetColor(BenchColor(row.responseMs));
+        frame.Print("%4lums%6lums\n", (unsigned long)row.responseMs, (unsigned long)row.responseMs * 2);
+    }
+
+    frame.SetColor(13);
+    frame.Print("\nCONTROLS:\n");
+    frame.SetColor(8);
+    frame.Print("----------------------------------------------------------------------------------------\n");
+    frame.SetColor(15);
+    frame.Print("[F] Evict Bad Entries   [R] Refresh Cache List   [P] Pause/Resume   [Q] Quit\n");
+    frame.Print("[N] Next Page   [B] Previous Page   [V] View Full Cache   [C] Network Config\n");
+}
+
+// Frame cost at the monitor's screen size: a few rows change every frame,
+// TTLs tick down, and every 50th frame turns the page
+static void BenchRender(const BenchOptions& options) {
+    FILE* out = nullptr;
+#ifdef _WIN32
+    fopen_s(&out, NULL_DEVICE, "wb");
+#else
+    out = fopen(NULL_DEVICE, "wb");
+#endif
+    if (!out) {
+        printf("Cannot open %s\n", NULL_DEVICE);
+        return;
+    }
+
+    std::mt19937 random(99);
+    std::vector<BenchRow> rows(8);
+    auto newPage = [&] {
+        for (auto& row : rows) {
+            row.hostname = "host" + std::to_string(Pick(random, 100000)) + ".svc.example.com";
+            row.address = "10." + std::to_string(Pick(random, 256)) + "." + std::to_string(Pick(random, 256)) + ".1";
+            row.ttl = Pick(random, 86400);
+            row.responseMs = Pick(random, 300);
+        }
+    };
+    newPage();
+
+    EntryCounts counts = {};
+    counts.total = options.records;
+    ConsoleRenderer renderer(std::unique_ptr<ConsoleBackend>(new AnsiConsoleBackend(out)), 90, 40);
+    std::vector<double> frameMs;
+    uint64_t bytes = 0;
+    uint64_t cells = 0;
+    for (int i = 0; i < options.frames; i++) {
+        if (i % 50 == 0) {
+            newPage();
+        }
+        for (auto& row : rows) {
+            row.ttl = row.ttl > 0 ? row.ttl - 1 : 0;
+        }
+        rows[Pick(random, (unsigned)rows.size())].responseMs = Pick(random, 300);
+        counts.reachable = options.records - (int)Pick(random, 100);
+        counts.avgResponseMs = 40.0 + Pick(random, 100) / 10.0;
+
+        DrawBenchFrame(renderer.BeginFrame(), i, rows, counts);
+        renderer.Present();
+        frameMs.push_back(renderer.Stats().frameMs);
+        bytes += renderer.Stats().bytesWritten;
+        cells += renderer.Stats().cellsChanged;
+    }
+    fclose(out);
+
+    double total = 0.0;
+    for (double ms : frameMs) {
+        total += ms;
+    }
+    std::sort(frameMs.begin(), frameMs.end());
+    double mean = total / frameMs.size();
+    double p99 = Percentile(frameMs, 0.99);
+    printf("%-24s  %10d  frames, %.3fms mean, %.3fms p99   %.0f bytes, %.0f cells changed per frame\n", "render.frame",
+        options.frames, mean, p99, (double)bytes / options.frames, (double)cells / options.frames);
+    AddResult("render.frame", { { "frames", (double)options.frames }, { "mean_ms", mean }, { "p99_ms", p99 },
+        { "bytes_per_frame", (double)bytes / options.frames }, { "cells_per_frame", (double)cells / options.frames } });
+}
+
+// A synthetic recording: hosts probed round robin at the monitor's default
+// ceiling for hours, a cache snapshot every minute, one host regressing
+// after an hour and every host slowing down with timeouts for ten minutes
+// halfway through
+struct SyntheticTrace {
+    int hosts = 1000;
+    int hours = 6;
+    int probesPerSec = 50;
+    uint64_t regressionMs = 3600 * 1000;
+    uint64_t outageStartMs = 3 * 3600 * 1000;
+    uint64_t outageEndMs = outageStartMs + 600 * 1000;
+};
+
+static bool WriteSyntheticTrace(const std::string& path, const SyntheticTrace& shape, uint64_t& events, uint64_t& bytes) {
+    TraceWriter writer;
+    if (!writer.Open(path, 1700000000)) return false;
+
+    std::mt19937 random(777);
+    std::lognormal_distribution<double> jitter(0.0, 0.3);
+    std::vector<std::string> names;
+    std::vector<double> baseMs;
+    for (int i = 0; i < shape.hosts; i++) {
+        char host[64];
+        snprintf(host, sizeof(host), "host%05d.example.com", i);
+        names.push_back(host);
+        baseMs.push_back(5.0 + Pick(random, 60));
+    }
+
+    uint64_t endMs = (uint64_t)shape.hours * 3600 * 1000;
+    uint64_t stepMs = 1000 / shape.probesPerSec;
+    EntryTable snapshot;
+    int next = 0;
+    for (uint64_t t = 0; t < endMs; t += stepMs) {
+        if (t % 60000 == 0) {
+            snapshot.Clear();
+            for (int i = 0; i < shape.hosts; i++) {
+                PackedAddress address;
+                std::string text = "10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256);
+                PackAddress(text, address);
+                snapshot.Add(names[i], RecordKind::A, address, 300 - (uint32_t)((t / 1000 + i) % 300));
+            }
+            writer.WriteSnapshot(t, snapshot);
+        }
+
+        int host = next;
+        next = (next + 1) % shape.hosts;
+        double latency = baseMs[host] * jitter(random);
+        bool outage = t >= shape.outageStartMs && t < shape.outageEndMs;
+        if (host == 7 && t >= shape.regressionMs) {
+            latency *= 8.0;
+        }
+        if (outage) {
+            latency *= 10.0;
+        }
+        if (outage && Pick(random, 100) < 20) {
+            writer.WriteProbe(t, names[host], RecordKind::A, StoredOutcome::Timeout, PROBE_TIMEOUT, false);
+        }
+        else {
+            writer.WriteProbe(t, names[host], RecordKind::A, StoredOutcome::Ok, (uint32_t)latency, false);
+        }
+    }
+    events = writer.Events();
+    bytes = writer.Bytes();
+    writer.Close();
+    return true;
+}
+
+// Trace size and speed, and how fast hours of monitoring replay: the
+// synthetic outage should raise the flush advice and the regressing host
+// should alert, with no network and on a virtual clock
+static void BenchReplay(const BenchOptions& options) {
+    SyntheticTrace shape;
+    uint64_t events = 0;
+    uint64_t bytes = 0;
+    auto start = Clock::now();
+    if (!WriteSyntheticTrace(DEFAULT_TRACE_PATH, shape, events, bytes)) {
+        printf("Cannot write %s\n", DEFAULT_TRACE_PATH);
+        return;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double megabytes = bytes / (1024.0 * 1024.0);
+    Report("trace.write", events, megabytes, seconds);
+
+    uint64_t read = 0;
+    double readSeconds = BestOf(options.repeats, [&] {
+        TraceReader reader;
+        TraceEvent event;
+        read = 0;
+        if (!reader.Open(DEFAULT_TRACE_PATH)) return;
+        while (reader.Next(event)) {
+            read++;
+        }
+    });
+    Report("trace.read", read, megabytes, readSeconds);
+
+    TraceReader reader;
+    if (!reader.Open(DEFAULT_TRACE_PATH)) {
+        printf("Cannot read %s\n", DEFAULT_TRACE_PATH);
+        return;
+    }
+    ReplayReport report = ReplayTrace(reader);
+    double hours = report.durationMs / 3600000.0;
+    printf("%-24s  %10llu  sent, %.1f virtual hours in %.2fs (%.0fx)   %.1f B/event\n", "replay.run",
+        (unsigned long long)report.probesSent, hours, report.wallSeconds,
+        report.wallSeconds > 0 ? hours * 3600.0 / report.wallSeconds : 0.0, events > 0 ? (double)bytes / events : 0.0);
+
+    double firstFlush = -1.0;
+    for (const auto& sample : report.samples) {
+        if (sample.needsFlush) {
+            firstFlush = sample.timeMs / 1000.0 - shape.outageStartMs / 1000.0;
+            break;
+        }
+    }
+    printf("%-24s  %10llu  alerts raised, %llu cleared   flush advised %d times for %.0fs, %.0fs into the outage\n",
+        "replay.decisions", (unsigned long long)report.alertsRaised, (unsigned long long)report.alertsCleared,
+        report.flushAdvisories, report.flushAdvisedMs / 1000.0, firstFlush);
+    AddResult("replay.run", { { "sent", (double)report.probesSent }, { "virtual_seconds", hours * 3600.0 },
+        { "seconds", report.wallSeconds }, { "bytes_per_event", events > 0 ? (double)bytes / events : 0.0 } });
+    AddResult("replay.decisions", { { "alerts_raised", (double)report.alertsRaised },
+        { "alerts_cleared", (double)report.alertsCleared }, { "flush_advisories", (double)report.flushAdvisories },
+        { "flush_seconds", report.flushAdvisedMs / 1000.0 }, { "flush_after_seconds", firstFlush } });
+    reader.Close();
+    if (!options.keepDump) {
+        remove(DEFAULT_TRACE_PATH);
+    }
+}
+
+static const int LOOP_IDLE_SECONDS = 2;
+static const int LOOP_POLL_MS = 100;        // The UI thread's old frame timer
+static const int LOOP_HEARTBEAT_MS = 1000;  // How often an idle monitor publishes now
+static const int LOOP_WAKES = 2000;
+
+// CPU seconds this process has used, all threads
+static double ProcessCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0.0;
+    auto seconds = [](const FILETIME& time) {
+        return (((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime) / 1e7;
+    };
+    return seconds(kernel) + seconds(user);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+// An idle UI thread: the old loop woke on a frame timer whether or not
+// anything changed; the event loop wakes only when the monitor publishes,
+// which an idle monitor does once a heartbeat. Then how long a wake from
+// another thread takes to arrive.
+static void BenchEventLoop() {
+    for (bool evented : { false, true }) {
+        EventLoop loop;
+        if (!loop.Open()) {
+            printf("Cannot open an event loop\n");
+            return;
+        }
+        std::atomic<bool> stop{ false };
+        std::thread monitor;
+        if (evented) {
+            monitor = std::thread([&] {
+                auto next = Clock::now();
+                while (!stop) {
+                    next += std::chrono::milliseconds(LOOP_HEARTBEAT_MS);
+                    std::this_thread::sleep_until(next);
+                    loop.Wake();
+                }
+            });
+        }
+
+        double cpuStart = ProcessCpuSeconds();
+        auto start = Clock::now();
+        auto end = start + std::chrono::seconds(LOOP_IDLE_SECONDS);
+        while (Clock::now() < end) {
+            loop.Wait(evented ? end : Clock::now() + std::chrono::milliseconds(LOOP_POLL_MS));
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        double cpuMs = (ProcessCpuSeconds() - cpuStart) * 1000.0;
+        double wakeups = loop.Stats().waits / seconds;
+        stop = true;
+        if (monitor.joinable()) monitor.join();
+
+        const char* name = evented ? "loop.event" : "loop.poll";
+        printf("%-24s  %10.1f  wakeups/s idle   %.1f ms CPU in %.1fs\n", name, wakeups, cpuMs, seconds);
+        AddResult(name, { { "wakeups_per_sec", wakeups }, { "cpu_ms", cpuMs }, { "seconds", seconds } });
+    }
+
+    EventLoop loop;
+    if (!loop.Open()) return;
+    std::atomic<int64_t> sentAt{ 0 };
+    std::atomic<int> received{ 0 };
+    std::thread waker([&] {
+        for (int i = 0; i < LOOP_WAKES; i++) {
+            while (received.load() < i) {
+                std::this_thread::yield();
+            }
+            sentAt = Clock::now().time_since_epoch().count();
+            loop.Wake();
+        }
+    });
+
+    std::vector<double> latencies;
+    latencies.reserve(LOOP_WAKES);
+    while ((int)latencies.size() < LOOP_WAKES) {
+        if (!(loop.Wait(Clock::now() + std::chrono::seconds(1)) & EVENT_WAKE)) continue;
+        Clock::duration elapsed = Clock::now().time_since_epoch() - Clock::duration(sentAt.load());
+        latencies.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        received++;
+    }
+    waker.join();
+
+    std::sort(latencies.begin(), latencies.end());
+    double p50 = Percentile(latencies, 0.50);
+    double p99 = Percentile(latencies, 0.99);
+    printf("%-24s  %10d  wakes from another thread   p50 %.0fus  p99 %.0fus\n", "loop.wake", LOOP_WAKES, p50, p99);
+    AddResult("loop.wake", { { "wakes", (double)LOOP_WAKES }, { "p50_us", p50 }, { "p99_us", p99 } });
+}
+
+// Simulated monitors for the fleet benchmark: each caches a random share
+// of a common name pool and reports a tenth of it as changed every round.
+// A few migrated names are cached everywhere and fail on some monitors.
+static const int FLEET_POOL = 5000;
+static const int FLEET_HOSTS_PER_MONITOR = 200;
+static const int FLEET_MIGRATED = 5;
+static const unsigned FLEET_FAILING_PERCENT = 40;
+
+struct SimulatedMonitor {
+    SOCKET sock = INVALID_SOCKET;
+    FleetEncoder encoder;
+    std::vector<int> hosts;         // Pool numbers; the migrated names are -1 - k
+};
+
+static std::string FleetHostName(int id) {
+    if (id < 0) return "app" + std::to_string(-1 - id) + ".migrated.example.com";
+    return "web" + std::to_string(id) + ".corp.example.com";
+}
+
+static void FleetHostState(std::mt19937& random, std::lognormal_distribution<double>& latency, int id, bool failing,
+    FleetHostUpdate& update) {
+    update.host = FleetHostName(id);
+    update.removed = false;
+    update.probes = 1;
+    update.failures = 0;
+    if (id < 0 && failing) {
+        update.flags = ENTRY_CHANGED;
+        update.responseMs = PROBE_TIMEOUT;
+        update.failures = 1;
+    }
+    else if (Pick(random, 50) == 0) {
+        update.flags = 0;
+        update.responseMs = PROBE_TIMEOUT;
+        update.failures = 1;
+    }
+    else {
+        update.flags = ENTRY_REACHABLE;
+        update.responseMs = (uint32_t)latency(random);
+    }
+}
+
+static bool SendAll(SOCKET sock, const std::vector<uint8_t>& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int written = send(sock, (const char*)data.data() + sent, (int)(data.size() - sent), SOCKET_SEND_FLAGS);
+        if (written <= 0) return false;
+        sent += written;
+    }
+    return true;
+}
+
+// A collector on loopback fed by simulated monitors over real TCP streams,
+// plus one FleetSender: reports and host updates a second it absorbs, the
+// bytes a delta-encoded report costs, and whether the ranking puts the
+// migrated names on top. Disconnecting everything must leave nothing ranked.
+static void BenchFleet(const BenchOptions& options) {
+    FleetCollectorConfig config;
+    config.address = "127.0.0.1";
+    config.port = 0;
+    config.threads = options.fleetThreads;
+    FleetCollector collector(config);
+    if (!collector.Start()) {
+        printf("Cannot start the fleet collector\n");
+        return;
+    }
+    std::string address = "127.0.0.1:" + std::to_string(collector.Port());
+    struct sockaddr_storage collectorAddress = {};
+    socklen_t collectorLength = 0;
+    if (!ParseSocketAddress(address, 0, collectorAddress, collectorLength)) {
+        printf("Cannot parse the fleet collector address %s\n", address.c_str());
+        return;
+    }
+
+    std::mt19937 random(99);
+    std::vector<SimulatedMonitor> monitors(options.fleetMonitors);
+    for (auto& monitor : monitors) {
+        for (int k = 0; k < FLEET_MIGRATED; k++) {
+            monitor.hosts.push_back(-1 - k);
+        }
+        for (int i = 0; i < FLEET_HOSTS_PER_MONITOR; i++) {
+            monitor.hosts.push_back((int)Pick(random, FLEET_POOL));
+        }
+        monitor.sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (monitor.sock == INVALID_SOCKET ||
+            connect(monitor.sock, (struct sockaddr*)&collectorAddress, collectorLength) != 0) {
+            printf("Cannot connect simulated monitor %zu to %s\n", &monitor - monitors.data(), address.c_str());
+            return;
+        }
+    }
+
+    // The real sender, as DNSMonitor --report runs it
+    FleetSenderConfig senderConfig;
+    senderConfig.collector = address;
+    senderConfig.monitor = "bench-sender";
+    FleetSender sender(senderConfig);
+    sender.Start();
+    FleetReport senderReport = {};
+    for (int k = 0; k < FLEET_MIGRATED; k++) {
+        senderReport.hosts.push_back({ FleetHostName(-1 - k), ENTRY_CHANGED, PROBE_TIMEOUT, 1, 1, false, 0 });
+    }
+    sender.Submit(senderReport);
+
+    // Encode every report up front so the timing is the collector's
+    std::vector<std::vector<uint8_t>> streams(monitors.size());
+    std::lognormal_distribution<double> latency(std::log(20.0), 1.0);
+    uint64_t reports = 0;
+    uint64_t hostUpdates = 0;
+    for (size_t m = 0; m < monitors.size(); m++) {
+        SimulatedMonitor& monitor = monitors[m];
+        bool failing = Pick(random, 100) < FLEET_FAILING_PERCENT;
+        monitor.encoder.Hello("monitor" + std::to_string(m), streams[m]);
+        for (int round = 0; round < options.fleetRounds; round++) {
+            FleetReport report;
+            report.timestamp = 1700000000 + round * 10;
+            report.full = round == 0;
+            report.summary.entries = (uint32_t)monitor.hosts.size();
+            report.summary.reachable = report.summary.entries - (failing ? FLEET_MIGRATED : 0);
+            report.summary.changed = failing ? FLEET_MIGRATED : 0;
+            report.summary.avgResponseMs = 20 + Pick(random, 10);
+            for (size_t h = 0; h < monitor.hosts.size(); h++) {
+                if (!report.full && Pick(random, 10) != 0) continue;
+                report.hosts.emplace_back();
+                FleetHostState(random, latency, monitor.hosts[h], failing, report.hosts.back());
+            }
+            monitor.encoder.Encode(report, streams[m]);
+            reports++;
+            hostUpdates += report.hosts.size();
+        }
+    }
+    uint64_t bytes = 0;
+    for (const auto& stream : streams) {
+        bytes += stream.size();
+    }
+
+    // A few sender threads, as many monitors each
+    uint64_t before = collector.Stats().reports;
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    std::atomic<int> sendFailures{ 0 };
+    int senderThreads = 4;
+    for (int t = 0; t < senderThreads; t++) {
+        threads.emplace_back([&, t] {
+            for (size_t m = t; m < monitors.size(); m += senderThreads) {
+                if (!SendAll(monitors[m].sock, streams[m])) sendFailures++;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    while (collector.Stats().reports - before < reports && Clock::now() - start < std::chrono::seconds(30)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    FleetCollectorStats stats = collector.Stats();
+    uint64_t applied = stats.reports - before;
+
+    printf("%-24s  %10llu  reports from %u monitors in %.3fs, %.0f reports/s, %.0f host updates/s, %.1f B/report%s\n",
+        "fleet.ingest", (unsigned long long)applied, stats.monitors, seconds, seconds > 0 ? applied / seconds : 0.0,
+        seconds > 0 ? hostUpdates / seconds : 0.0, reports > 0 ? (double)bytes / reports : 0.0,
+        applied < reports || sendFailures > 0 ? "   INCOMPLETE" : "");
+    AddResult("fleet.ingest", { { "monitors", (double)monitors.size() }, { "reports", (double)applied },
+        { "seconds", seconds }, { "reports_per_sec", seconds > 0 ? applied / seconds : 0.0 },
+        { "host_updates_per_sec", seconds > 0 ? hostUpdates / seconds : 0.0 },
+        { "bytes_per_report", reports > 0 ? (double)bytes / reports : 0.0 } });
+
+    std::vector<FleetHostRank> ranked;
+    double rankSeconds = BestOf(options.repeats, [&] { collector.Ranked(ranked, 20); });
+    int migratedOnTop = 0;
+    for (size_t i = 0; i < ranked.size() && i < (size_t)FLEET_MIGRATED; i++) {
+        if (ranked[i].host.find(".migrated.") != std::string::npos) migratedOnTop++;
+    }
+    FleetSenderStats senderStats = sender.Stats();
+    printf("%-24s  %10zu  ranked in %.2fms   top %d: %d migrated, first %s failing on %u of %u monitors   sender %s\n",
+        "fleet.rank", ranked.size(), rankSeconds * 1000.0, FLEET_MIGRATED, migratedOnTop,
+        ranked.empty() ? "-" : ranked[0].host.c_str(), ranked.empty() ? 0 : ranked[0].failing,
+        ranked.empty() ? 0 : ranked[0].monitors, senderStats.reports > 0 && senderStats.connected ? "reported" : "NOT CONNECTED");
+    AddResult("fleet.rank", { { "ms", rankSeconds * 1000.0 }, { "migrated_on_top", (double)migratedOnTop } });
+
+    // Everything a monitor reported goes with its connection
+    sender.Stop();
+    for (auto& monitor : monitors) {
+        closesocket(monitor.sock);
+    }
+    start = Clock::now();
+    while (collector.Stats().monitors > 0 && Clock::now() - start < std::chrono::seconds(10)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    collector.Ranked(ranked, 20);
+    if (!ranked.empty() || collector.Stats().monitors > 0) {
+        printf("%-24s  %zu hosts still ranked after every monitor disconnected\n", "fleet.withdraw", ranked.size());
+    }
+}
+
+// Replay a trace recorded with DNSMonitor --record and print what the monitor would have decided
+static int RunReplay(const std::string& path) {
+    TraceReader reader;
+    if (!reader.Open(path)) {
+        printf("Cannot read trace %s\n", path.c_str());
+        return 1;
+    }
+    ReplayReport report = ReplayTrace(reader);
+    if (reader.Damaged()) {
+        printf("Trace is damaged or truncated; replayed up to the bad record\n");
+    }
+
+    printf("Replayed %.1f virtual minutes in %.2fs: %llu snapshots, %llu recorded probes\n",
+        report.durationMs / 60000.0, report.wallSeconds, (unsigned long long)report.snapshots,
+        (unsigned long long)report.recordedProbes);
+    printf("Probes: %llu sent, %llu answered, %llu failed, %llu with no recorded outcome\n",
+        (unsigned long long)report.probesSent, (unsigned long long)report.probesAnswered,
+        (unsigned long long)report.probesFailed, (unsigned long long)report.probesUnknown);
+    printf("Flush advised %d times for %.0fs\n\n", report.flushAdvisories, report.flushAdvisedMs / 1000.0);
+
+    printf("%-10s  %7s  %9s  %7s  %8s  %6s  %6s  %s\n", "time", "entries", "reachable", "health", "avg ms", "rate", "alerts", "flush");
+    for (const auto& sample : report.samples) {
+        uint64_t seconds = sample.timeMs / 1000;
+        printf("%3llu:%02llu:%02llu   %7d  %9d  %6.1f%%  %8.1f  %6.1f  %6zu  %s\n",
+            (unsigned long long)(seconds / 3600), (unsigned long long)(seconds / 60 % 60), (unsigned long long)(seconds % 60),
+            sample.counts.total, sample.counts.reachable, sample.counts.HealthPercentage(), sample.counts.avgResponseMs,
+            sample.probeRate, sample.activeAlerts, sample.needsFlush ? "yes" : "");
+    }
+
+    printf("\nAlerts:\n");
+    for (const auto& alert : report.alerts) {
+        time_t when = alert.cleared != 0 ? alert.cleared : alert.raised;
+        printf("+%6llds  %-7s  %-40s  %-8s  score %.1f  baseline %.3f  current %.3f\n",
+            (long long)(when - reader.Started()), alert.cleared != 0 ? "cleared" : "raised", alert.host.c_str(),
+            AlertKindName(alert.kind), alert.score, alert.baseline, alert.current);
+    }
+    return 0;
+}
+
+// {"options": {...}, "results": [{"name": ..., "records": ..., ...}, ...]}
+static bool WriteJsonReport(const BenchOptions& options) {
+    std::string out;
+    char number[64];
+    auto append = [&](const char* format, double value) {
+        snprintf(number, sizeof(number), format, value);
+        out += number;
+    };
+
+    out += "{\n  \"options\": {\"records\": ";
+    append("%.0f", options.records);
+    out += ", \"repeats\": ";
+    append("%.0f", options.repeats);
+    out += ", \"probes\": ";
+    append("%.0f", options.probes);
+    out += ", \"latency_ms\": ";
+    append("%g", options.resolver.medianMs);
+    out += ", \"sigma\": ";
+    append("%g", options.resolver.sigma);
+    out += ", \"loss\": ";
+    append("%g", options.resolver.lossRate);
+    out += ", \"servfail\": ";
+    append("%g", options.resolver.failRate);
+    out += ", \"fleet_monitors\": ";
+    append("%.0f", options.fleetMonitors);
+    out += ", \"fleet_rounds\": ";
+    append("%.0f", options.fleetRounds);
+    out += ", \"input\": \"";
+    for (char c : options.input) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    out += "\"},\n  \"results\": [";
+    for (size_t i = 0; i < g_results.size(); i++) {
+        out += i > 0 ? ",\n    {\"name\": \"" : "\n    {\"name\": \"";
+        out += g_results[i].name;
+        out += '"';
+        for (const auto& value : g_results[i].values) {
+            out += ", \"";
+            out += value.first;
+            out += "\": ";
+            append("%.10g", value.second);
+        }
+        out += '}';
+    }
+    out += "\n  ]\n}\n";
+    return WriteFile(options.jsonPath, out);
+}
+
+static void PrintUsage() {
+    printf("Usage: DNSMonitorBench [--records N] [--repeats N] [--input dump.txt] [--keep-dump] [--json results.json]\n");
+    printf("                       [--probes N] [--in-flight N] [--latency MS] [--sigma S] [--loss PCT] [--servfail PCT]\n");
+    printf("                       [--frames N] [--fleet N] [--fleet-rounds N] [--fleet-threads N]\n");
+    printf("       DNSMonitorBench --replay trace.bin\n");
+    printf("\nThe stand-in resolver answers after a log-normal delay around --latency\n");
+    printf("(default 2ms; --sigma 0 makes it fixed) and drops --loss percent of queries.\n");
+    printf("--fleet sets how many simulated monitors stream to the fleet collector (default %d,\n", DEFAULT_FLEET_MONITORS);
+    printf("0 skips it); each uses a socket on both ends, so raise the descriptor limit for thousands.\n");
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--records") == 0 && i + 1 < argc) {
+            options.records = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--repeats") == 0 && i + 1 < argc) {
+            options.repeats = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            options.input = argv[++i];
+        }
+        else if (strcmp(argv[i], "--keep-dump") == 0) {
+            options.keepDump = true;
+        }
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            options.replay = argv[++i];
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            options.jsonPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--probes") == 0 && i + 1 < argc) {
+            options.probes = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--in-flight") == 0 && i + 1 < argc) {
+            options.inFlight = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+            options.resolver.medianMs = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--sigma") == 0 && i + 1 < argc) {
+            options.resolver.sigma = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            options.resolver.lossRate = atof(argv[++i]) / 100.0;
+        }
+        else if (strcmp(argv[i], "--servfail") == 0 && i + 1 < argc) {
+            options.resolver.failRate = atof(argv[++i]) / 100.0;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            options.frames = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fleet") == 0 && i + 1 < argc) {
+            options.fleetMonitors = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fleet-rounds") == 0 && i + 1 < argc) {
+            options.fleetRounds = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--fleet-threads") == 0 && i + 1 < argc) {
+            options.fleetThreads = atoi(argv[++i]);
+        }
+        else {
+            PrintUsage();
+            return 1;
+        }
+    }
+    if (options.records < 1 || options.repeats < 1 || options.probes < 1 || options.inFlight < 1 || options.frames < 1 ||
+        options.fleetMonitors < 0 || options.fleetRounds < 1 || options.fleetThreads < 1 ||
+        options.resolver.medianMs < 0 || options.resolver.sigma < 0) {
+        PrintUsage();
+        return 1;
+    }
+    if (!options.replay.empty()) {
+        return RunReplay(options.replay);
+    }
+
+#ifdef _WIN32
+    // The probe and fleet benchmarks' sockets use Winsock
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        printf("Cannot initialize Winsock\n");
+        return 1;
+    }
+#endif
+
+    printf("%-24s  %10s  %9s  %9s  %14s  %15s\n", "benchmark", "records", "MB", "seconds", "throughput", "rate");
+    BenchParse(options);
+    BenchEntries(options);
+    BenchViews(options);
+    BenchSources(options);
+    BenchRateControl();
+    BenchProbes(options);
+    BenchEngine();
+    BenchSnoop(options);
+    BenchRender(options);
+    BenchReplay(options);
+    BenchEventLoop();
+    if (options.fleetMonitors > 0) {
+        BenchFleet(options);
+    }
+
+    if (!options.jsonPath.empty() && !WriteJsonReport(options)) {
+        printf("Cannot write %s\n", options.jsonPath.c_str());
+        return 1;
+    }
+    return 0;
+}
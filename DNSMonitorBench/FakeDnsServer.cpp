@@ -0,0 +1,201 @@
+#include "FakeDnsServer.h"
+#include "DnsWire.h"
+#include "Platform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static const int MAX_IDLE_WAIT_MS = 50;         // Bounds shutdown latency
+
+// A reply held back until its drawn latency has passed
+struct FakeDnsReply {
+    Clock::time_point due;
+    std::vector<uint8_t> message;
+    struct sockaddr_storage peer;
+    socklen_t peerLength;
+
+    bool operator>(const FakeDnsReply& other) const { return due > other.due; }
+};
+
+// A name the caching server holds
+struct FakeDnsCached {
+    Clock::time_point expires;
+    bool moved;
+};
+
+struct FakeDnsState {
+    std::unordered_map<std::string, FakeDnsCached> cache;   // Serve thread only once started
+    SOCKET udp = INVALID_SOCKET;
+    uint16_t port = 0;
+    std::atomic<bool> stopping{ false };
+    std::atomic<uint64_t> received{ 0 };
+    std::atomic<uint64_t> answered{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+    std::atomic<uint64_t> failed{ 0 };
+    std::atomic<uint64_t> resolved{ 0 };
+};
+
+FakeDnsServer::FakeDnsServer(const FakeDnsConfig& config)
+    : m_config(config), m_state(std::make_shared<FakeDnsState>()) {
+}
+
+FakeDnsServer::~FakeDnsServer() {
+    Stop();
+}
+
+// Same name, same address: 10.x.y.z from an FNV-1a hash of the name
+static void AddressFor(const std::string& name, std::vector<uint8_t>& rdata) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    rdata = { 10, (uint8_t)(hash >> 16), (uint8_t)(hash >> 8), (uint8_t)hash };
+}
+
+static void ServeLoop(std::shared_ptr<FakeDnsState> state, FakeDnsConfig config) {
+    std::mt19937 random(config.seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::lognormal_distribution<double> latency(std::log((std::max)(config.medianMs, 0.001)), config.sigma);
+    std::priority_queue<FakeDnsReply, std::vector<FakeDnsReply>, std::greater<FakeDnsReply>> pending;
+    uint8_t buffer[DNS_UDP_MAX];
+
+    while (!state->stopping) {
+        int waitMs = MAX_IDLE_WAIT_MS;
+        if (!pending.empty()) {
+            auto until = std::chrono::duration_cast<std::chrono::milliseconds>(pending.top().due - Clock::now()).count();
+            waitMs = (int)(std::max)((long long)0, (std::min)((long long)waitMs, (long long)until));
+        }
+        SocketPollFd fd = {};
+        fd.fd = state->udp;
+        fd.events = POLLIN;
+        PollSockets(&fd, 1, waitMs);
+
+        // Every query that has arrived
+        for (;;) {
+            FakeDnsReply reply;
+            reply.peerLength = sizeof(reply.peer);
+            int length = recvfrom(state->udp, (char*)buffer, sizeof(buffer), 0, (struct sockaddr*)&reply.peer, &reply.peerLength);
+            if (length <= 0) break;
+
+            DnsMessage query;
+            if (!DecodeDnsMessage(buffer, (size_t)length, query) || query.IsResponse() || query.questions.size() != 1) continue;
+            state->received++;
+            if (chance(random) < config.lossRate) {
+                state->dropped++;
+                continue;
+            }
+
+            double missMs = 0.0;
+            DnsMessage response;
+            response.id = query.id;
+            response.flags = DNS_FLAG_QR | DNS_FLAG_RA | (query.flags & DNS_FLAG_RD);
+            response.questions = query.questions;
+            if (chance(random) < config.failRate) {
+                response.flags |= DNS_RCODE_SERVFAIL;
+                state->failed++;
+            }
+            else if (query.questions[0].type == DNS_TYPE_A) {
+                const std::string& name = query.questions[0].name;
+                DnsRecord answer;
+                answer.name = name;
+                answer.type = DNS_TYPE_A;
+                answer.rclass = DNS_CLASS_IN;
+                answer.ttl = config.ttl;
+                bool moved = false;
+                bool answered = true;
+                if (config.caching) {
+                    auto now = Clock::now();
+                    auto cached = state->cache.find(name);
+                    if (cached != state->cache.end() && cached->second.expires > now) {
+                        answer.ttl = (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(cached->second.expires - now).count();
+                        moved = cached->second.moved;
+                    }
+                    else if (query.flags & DNS_FLAG_RD) {
+                        state->cache[name] = { now + std::chrono::seconds(config.ttl), false };
+                        state->resolved++;
+                        missMs = config.missMs;
+                    }
+                    else {
+                        // Not held and not asked to resolve it: an empty answer
+                        answered = false;
+                    }
+                }
+                if (answered) {
+                    AddressFor(name, answer.rdata);
+                    if (moved) answer.rdata[3] ^= 0x80;
+                    response.answers.push_back(answer);
+                }
+            }
+            if (!EncodeDnsMessage(response, reply.message)) continue;
+
+            double delayMs = (config.sigma > 0 ? latency(random) : config.medianMs) + missMs;
+            reply.due = Clock::now() + std::chrono::microseconds((long long)(delayMs * 1000.0));
+            pending.push(std::move(reply));
+        }
+
+        auto now = Clock::now();
+        while (!pending.empty() && pending.top().due <= now) {
+            const FakeDnsReply& reply = pending.top();
+            sendto(state->udp, (const char*)reply.message.data(), (int)reply.message.size(), 0,
+                (const struct sockaddr*)&reply.peer, reply.peerLength);
+            if ((reply.message[3] & 0x0F) == DNS_RCODE_NOERROR) {
+                state->answered++;
+            }
+            pending.pop();
+        }
+    }
+}
+
+void FakeDnsServer::Prime(const std::string& name, uint32_t ttlLeft, bool moved) {
+    m_state->cache[name] = { Clock::now() + std::chrono::seconds(ttlLeft), moved };
+}
+
+bool FakeDnsServer::Start() {
+    SOCKET udp = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (udp == INVALID_SOCKET) return false;
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(udp, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        getsockname(udp, (struct sockaddr*)&address, &length) != 0 || !SetSocketNonBlocking(udp)) {
+        closesocket(udp);
+        return false;
+    }
+
+    m_state->udp = udp;
+    m_state->port = ntohs(address.sin_port);
+    m_thread = std::thread(ServeLoop, m_state, m_config);
+    return true;
+}
+
+void FakeDnsServer::Stop() {
+    if (!m_thread.joinable()) return;
+    m_state->stopping = true;
+    m_thread.join();
+    closesocket(m_state->udp);
+    m_state->udp = INVALID_SOCKET;
+}
+
+std::string FakeDnsServer::Address() const {
+    return "127.0.0.1:" + std::to_string(m_state->port);
+}
+
+FakeDnsStats FakeDnsServer::Stats() const {
+    FakeDnsStats stats;
+    stats.received = m_state->received;
+    stats.answered = m_state->answered;
+    stats.dropped = m_state->dropped;
+    stats.failed = m_state->failed;
+    stats.resolved = m_state->resolved;
+    return stats;
+}
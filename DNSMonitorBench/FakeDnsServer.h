@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+// How the stand-in resolver answers. Latency is log-normal around the
+// median (sigma 0 makes it fixed); lost queries are never answered and
+// failed ones get SERVFAIL. A caching server behaves like a recursive
+// resolver's cache: RD=0 queries are answered only for names it holds,
+// with the TTL they have left, and a name it has to resolve costs missMs
+// more and is then held for ttl seconds.
+struct FakeDnsConfig {
+    double medianMs = 2.0;
+    double sigma = 0.5;
+    double lossRate = 0.0;          // Fraction of queries dropped
+    double failRate = 0.0;          // Fraction answered with SERVFAIL
+    uint32_t seed = 4242;
+    bool caching = false;
+    uint32_t ttl = 300;             // Caching: seconds a resolved name is held
+    double missMs = 0.0;            // Caching: added to the latency of a resolve
+};
+
+// Counts since Start()
+struct FakeDnsStats {
+    uint64_t received;
+    uint64_t answered;
+    uint64_t dropped;
+    uint64_t failed;
+    uint64_t resolved;              // Caching: queries that had to be resolved
+};
+
+struct FakeDnsState;
+
+// Local UDP DNS server for benchmarks: answers every A query on 127.0.0.1
+// with an address derived from the name, after a delay drawn from the
+// configured distribution. Delays overlap, as a real resolver's would.
+class FakeDnsServer {
+public:
+    explicit FakeDnsServer(const FakeDnsConfig& config);
+    ~FakeDnsServer();
+
+    FakeDnsServer(const FakeDnsServer&) = delete;
+    FakeDnsServer& operator=(const FakeDnsServer&) = delete;
+
+    // Caching: hold name before Start() with ttlLeft seconds to go; a moved
+    // name has another address than a fresh resolve would give
+    void Prime(const std::string& name, uint32_t ttlLeft, bool moved = false);
+
+    // Bind to an ephemeral loopback port and start answering
+    bool Start();
+    void Stop();
+
+    // "127.0.0.1:port", for DnsClientConfig::server
+    std::string Address() const;
+
+    FakeDnsStats Stats() const;
+
+private:
+    FakeDnsConfig m_config;
+    std::shared_ptr<FakeDnsState> m_state;
+    std::thread m_thread;
+};